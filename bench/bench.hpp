@@ -0,0 +1,466 @@
+#pragma once
+
+/** A small self-contained micro-benchmark harness.
+ *
+ *  bench::measure runs a kernel for a few warmup passes, calibrates how many
+ *  passes make up one repetition, then times the repetitions and reports
+ *  percentiles of the per-pass time. Per-element figures divide by the
+ *  number of scalar elements one pass touches.
+ *
+ *  Hardware counters (cycles, instructions) come from perf_event_open on
+ *  Linux when enabled and permitted; otherwise they are reported as null.
+ *  The time-stamp counter is read on x86 as a frequency-independent
+ *  reference.
+ *
+ *  bench::session is the rest of a benchmark binary: it reads the common
+ *  options, times the implementations of each kernel over a fixture and
+ *  writes the results, so a benchmark file holds only its fixtures, its
+ *  kernels and the list of what to run.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC 1
+#endif
+
+namespace bench {
+
+//! Keep the compiler from discarding p or the memory it points to
+inline void
+escape(const void* p) {
+  asm volatile("" : : "g"(p) : "memory");
+}
+
+//! Keep the compiler from caching memory across this point
+inline void
+clobber() {
+  asm volatile("" : : : "memory");
+}
+
+inline std::uint64_t
+tsc() {
+#if defined(BENCH_TSC)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+/** Cycle and instruction counters of the calling thread.
+ *
+ *  ok() is false when the counters could not be opened, e.g. because
+ *  /proc/sys/kernel/perf_event_paranoid forbids it.
+ */
+class counters {
+ public:
+  counters() = default;
+  counters(const counters&) = delete;
+  counters& operator=(const counters&) = delete;
+
+  ~counters() {
+#if defined(__linux__)
+    if (_ins >= 0) close(_ins);
+    if (_cyc >= 0) close(_cyc);
+#endif
+  }
+
+  bool
+  open() {
+#if defined(__linux__)
+    _cyc = open_event(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (_cyc >= 0)
+      _ins = open_event(PERF_COUNT_HW_INSTRUCTIONS, _cyc);
+    if (_ins < 0 && _cyc >= 0) {
+      close(_cyc);
+      _cyc = -1;
+    }
+#endif
+    return ok();
+  }
+
+  bool
+  ok() const
+  { return _cyc >= 0 && _ins >= 0; }
+
+  void
+  start() {
+#if defined(__linux__)
+    if (!ok()) return;
+    ioctl(_cyc, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(_cyc, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+  }
+
+  //! Stop counting and read cycles and instructions since start()
+  void
+  stop(std::uint64_t& cycles, std::uint64_t& instructions) {
+    cycles = instructions = 0;
+#if defined(__linux__)
+    if (!ok()) return;
+    ioctl(_cyc, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    std::uint64_t v[3] = {0, 0, 0};  // nr, cycles, instructions
+    if (read(_cyc, v, sizeof(v)) == sizeof(v)) {
+      cycles = v[1];
+      instructions = v[2];
+    }
+#endif
+  }
+
+ private:
+#if defined(__linux__)
+  static int
+  open_event(std::uint64_t config, int group) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+  }
+#endif
+
+  int _cyc = -1;
+  int _ins = -1;
+};
+
+
+struct options {
+  int warmup = 3;                   //!< Untimed passes before calibration
+  int reps = 15;                    //!< Timed repetitions
+  double rep_ns = 200000;           //!< Target duration of one repetition
+  counters* hw = nullptr;           //!< Hardware counters, if opened
+};
+
+struct result {
+  std::string family;
+  std::string op;
+  std::string type;
+  std::size_t n;
+  std::string impl;
+
+  std::size_t elements;             //!< Scalar elements per pass
+  std::size_t passes;               //!< Passes per repetition
+  int reps;
+  double median_ns;                 //!< Per pass
+  double p10_ns;
+  double p90_ns;
+  double tsc_per_element;           //!< Negative if unavailable
+  double cycles_per_element;        //!< Negative if unavailable
+  double instructions_per_element;  //!< Negative if unavailable
+};
+
+//! The p-th percentile of sorted samples, interpolated
+inline double
+percentile(const std::vector<double>& sorted, double p) {
+  double x = p * (sorted.size() - 1);
+  std::size_t i = (std::size_t) x;
+  if (i + 1 >= sorted.size())
+    return sorted.back();
+  return sorted[i] + (x - i) * (sorted[i + 1] - sorted[i]);
+}
+
+/** Time pass(), which touches elements scalar elements per call
+ *
+ *  The result is labeled with everything but the timings left empty.
+ */
+template <typename Pass>
+result
+measure(const options& opt, std::size_t elements, Pass pass) {
+  typedef std::chrono::steady_clock clock;
+
+  for (int w = 0; w < opt.warmup; ++w)
+    pass();
+
+  // Calibrate the passes per repetition to roughly opt.rep_ns
+  std::size_t passes = 1;
+  for (;;) {
+    auto t0 = clock::now();
+    for (std::size_t p = 0; p < passes; ++p)
+      pass();
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - t0)
+                    .count();
+    if (ns >= opt.rep_ns / 4 || passes >= (std::size_t(1) << 30)) {
+      passes = std::max<std::size_t>(1, passes * opt.rep_ns / std::max(ns, 1.));
+      break;
+    }
+    passes *= 4;
+  }
+
+  std::vector<double> ns(opt.reps);
+  std::uint64_t tsc_total = 0, cyc_total = 0, ins_total = 0;
+  for (int r = 0; r < opt.reps; ++r) {
+    std::uint64_t cyc = 0, ins = 0;
+    if (opt.hw) opt.hw->start();
+    std::uint64_t c0 = tsc();
+    auto t0 = clock::now();
+    for (std::size_t p = 0; p < passes; ++p)
+      pass();
+    auto t1 = clock::now();
+    std::uint64_t c1 = tsc();
+    if (opt.hw) opt.hw->stop(cyc, ins);
+    ns[r] = std::chrono::duration<double, std::nano>(t1 - t0).count() / passes;
+    tsc_total += c1 - c0;
+    cyc_total += cyc;
+    ins_total += ins;
+  }
+  std::sort(ns.begin(), ns.end());
+
+  const double total = double(elements) * passes * opt.reps;
+  result res;
+  res.n = 0;
+  res.elements = elements;
+  res.passes = passes;
+  res.reps = opt.reps;
+  res.median_ns = percentile(ns, 0.5);
+  res.p10_ns = percentile(ns, 0.1);
+  res.p90_ns = percentile(ns, 0.9);
+  res.tsc_per_element = tsc_total ? tsc_total / total : -1;
+  bool hw = opt.hw && opt.hw->ok();
+  res.cycles_per_element = hw ? cyc_total / total : -1;
+  res.instructions_per_element = hw ? ins_total / total : -1;
+  return res;
+}
+
+
+//! Write a number, or null for the negative "unavailable" marker
+inline void
+write_number(std::ostream& s, double x) {
+  if (x < 0)
+    s << "null";
+  else
+    s << x;
+}
+
+//! Write results as a JSON array of objects, one per line
+inline void
+write_json(std::ostream& s, const std::vector<result>& rs) {
+  s << "[\n";
+  for (std::size_t i = 0; i < rs.size(); ++i) {
+    const result& r = rs[i];
+    s << "  {\"family\": \"" << r.family << "\""
+      << ", \"op\": \"" << r.op << "\""
+      << ", \"type\": \"" << r.type << "\""
+      << ", \"N\": " << r.n
+      << ", \"impl\": \"" << r.impl << "\""
+      << ", \"elements\": " << r.elements
+      << ", \"passes\": " << r.passes
+      << ", \"reps\": " << r.reps
+      << ", \"median_ns\": " << r.median_ns
+      << ", \"p10_ns\": " << r.p10_ns
+      << ", \"p90_ns\": " << r.p90_ns
+      << ", \"ns_per_element\": " << r.median_ns / r.elements
+      << ", \"tsc_per_element\": ";
+    write_number(s, r.tsc_per_element);
+    s << ", \"cycles_per_element\": ";
+    write_number(s, r.cycles_per_element);
+    s << ", \"instructions_per_element\": ";
+    write_number(s, r.instructions_per_element);
+    s << "}" << (i + 1 < rs.size() ? "," : "") << "\n";
+  }
+  s << "]\n";
+}
+
+
+//! Name of element type T in the results
+template <typename T>
+struct type_name;
+template <>
+struct type_name<bool> { static const char* get() { return "bool"; } };
+template <>
+struct type_name<float> { static const char* get() { return "float"; } };
+template <>
+struct type_name<double> { static const char* get() { return "double"; } };
+template <>
+struct type_name<std::int32_t> { static const char* get() { return "int32"; } };
+template <>
+struct type_name<std::int64_t> { static const char* get() { return "int64"; } };
+template <>
+struct type_name<std::uint16_t> { static const char* get() { return "uint16"; } };
+template <>
+struct type_name<std::uint32_t> { static const char* get() { return "uint32"; } };
+
+
+/** Base of the data a kernel runs over, labeled as aggregates of N
+ *  elements of T.
+ *
+ *  Derived fixtures provide elements(), the number of elements of the
+ *  results that one pass touches.
+ */
+template <typename T, std::size_t N>
+struct fixture {
+  typedef T value_type;
+  static constexpr std::size_t size = N;
+};
+
+
+/** A benchmark run: the common options, the results so far and where they
+ *  go.
+ *
+ *  A kernel K has two implementations of one operation on a fixture d,
+ *  K::agg(d) through the library and K::base(d) the code it replaces,
+ *  named impl[0] and impl[1] in the results unless K::baseline() names the
+ *  second.
+ */
+struct session {
+  options opt;
+  std::string filter;
+  std::vector<result> results;
+  const char* out = nullptr;
+  counters hw;
+
+  //! Names of the implementations of a kernel
+  const char* impl[2] = {"agg", "loop"};
+  //! The summary on stderr is in ns per unit, or in MB/s for "byte"
+  std::string unit = "element";
+
+  /** Read -o, -f, -r and --perf, and other options with a value through
+   *  extra(option, value), which returns whether it took them.
+   *
+   *  @return  false, after printing the usage, on an unknown option.
+   */
+  template <typename Extra>
+  bool
+  parse(int argc, char** argv, const char* extra_usage, Extra extra) {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+      if (arg == "-o" && value) {
+        out = argv[++i];
+      } else if (arg == "-f" && value) {
+        filter = argv[++i];
+      } else if (arg == "-r" && value) {
+        opt.reps = std::max(1, std::atoi(argv[++i]));
+      } else if (arg == "--perf") {
+        if (hw.open())
+          opt.hw = &hw;
+        else
+          std::cerr << "perf_event_open unavailable, counters disabled"
+                    << std::endl;
+      } else if (value && extra(arg, value)) {
+        ++i;
+      } else {
+        std::cerr << "usage: " << argv[0]
+                  << " [-o results.json] [-f filter] [-r reps]"
+                  << extra_usage << " [--perf]" << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool
+  parse(int argc, char** argv) {
+    return parse(argc, argv, "",
+                 [](const std::string&, const char*) { return false; });
+  }
+
+  //! Whether family/op/type/N contains the filter
+  bool
+  wanted(const char* family, const char* op, const char* type,
+         std::size_t n) const {
+    return label(family, op, type, n).find(filter) != std::string::npos;
+  }
+
+  //! Benchmark both implementations of kernel K on the fixture d
+  template <typename K, typename D>
+  void
+  run(D& d, const char* family, const char* op) {
+    const char* type = type_name<typename D::value_type>::get();
+    if (!wanted(family, op, type, D::size))
+      return;
+    time(family, op, type, D::size, d.elements(), impl[0], [&] {
+      K::agg(d);
+      escape(&d);
+    });
+    time(family, op, type, D::size, d.elements(), baseline<K>(0), [&] {
+      K::base(d);
+      escape(&d);
+    });
+  }
+
+  //! run<K> if the condition holds, e.g. for operators of integers only
+  template <typename K, typename D>
+  void
+  run_if(std::true_type, D& d, const char* family, const char* op)
+  { run<K>(d, family, op); }
+  template <typename K, typename D>
+  void
+  run_if(std::false_type, D&, const char*, const char*)
+  {}
+
+  //! Time pass(), which touches elements elements, as implementation name
+  template <typename Pass>
+  void
+  time(const char* family, const char* op, const char* type, std::size_t n,
+       std::size_t elements, const char* name, Pass pass) {
+    result r = measure(opt, elements, [&] {
+      pass();
+      clobber();
+    });
+    r.family = family;
+    r.op = op;
+    r.type = type;
+    r.n = n;
+    r.impl = name;
+    results.push_back(r);
+    std::cerr << label(family, op, type, n) << " " << name << ": ";
+    if (unit == "byte")
+      std::cerr << 1e3 * elements / r.median_ns << " MB/s" << std::endl;
+    else
+      std::cerr << r.median_ns / elements << " ns/" << unit << std::endl;
+  }
+
+  //! Write the results to the -o file or stdout, and return the exit code
+  int
+  finish() const {
+    if (out) {
+      std::ofstream file(out);
+      write_json(file, results);
+    } else {
+      write_json(std::cout, results);
+    }
+    return 0;
+  }
+
+ private:
+  static std::string
+  label(const char* family, const char* op, const char* type,
+        std::size_t n) {
+    return std::string(family) + "/" + op + "/" + type + "/" +
+           std::to_string(n);
+  }
+
+  template <typename K>
+  static auto
+  baseline(int) -> decltype(K::baseline())
+  { return K::baseline(); }
+  template <typename K>
+  const char*
+  baseline(long) const
+  { return impl[1]; }
+};
+
+} // end namespace bench
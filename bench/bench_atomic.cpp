@@ -0,0 +1,175 @@
+/** Contention micro-benchmarks of concurrent scatter-add into a shared array
+ *  of aggregates: agg::atomic_ref fetch_add against a mutex per bucket and
+ *  against a private copy of the array per thread, summed at the end.
+ *
+ *  Every pass adds AGG_BENCH_UPDATES random aggregates into random buckets,
+ *  split across the threads of an agg::thread_pool. "hot" scatters into
+ *  AGG_BENCH_HOT buckets, so threads collide on the same cache lines all
+ *  the time; "cold" scatters into AGG_BENCH_COLD buckets. double/3 updates
+ *  element by element, float/2 as one 8-byte word and float/4 as one
+ *  16-byte word where the target has cmpxchg16b. The "elements" of the
+ *  results are updates; the summary on stderr is in ns per update.
+ *
+ *  Usage: bench_atomic [-o results.json] [-f filter] [-r reps] [-t threads]
+ *                      [--perf]
+ *
+ *    -o FILE     write the JSON results to FILE instead of stdout
+ *    -f TEXT     only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS     timed repetitions per benchmark
+ *    -t THREADS  threads taking part, by default the hardware threads
+ *    --perf      read cycles and instructions through perf_event_open
+ */
+
+#include <mutex>
+#include <random>
+
+#include "aggregate.hpp"
+#include "agg_atomic.hpp"
+#include "agg_parallel.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_UPDATES)
+#define AGG_BENCH_UPDATES (1 << 18)
+#endif
+#if !defined(AGG_BENCH_HOT)
+#define AGG_BENCH_HOT 16
+#endif
+#if !defined(AGG_BENCH_COLD)
+#define AGG_BENCH_COLD (1 << 16)
+#endif
+
+using agg::aggregate;
+
+
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  typedef aggregate<T,N> V;
+
+  std::size_t threads;
+  std::vector<std::uint32_t> bucket;
+  std::vector<V> value, shared;
+  std::vector<std::mutex> lock;
+  std::vector<std::vector<V> > own;
+
+  buffers(std::size_t n, std::size_t buckets, std::size_t t)
+      : threads(t), bucket(n), value(n), shared(buckets), lock(buckets),
+        own(t, std::vector<V>(buckets)) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<T> noise(-1, 1);
+    for (std::size_t k = 0; k < n; ++k) {
+      bucket[k] = std::uint32_t(rng() % buckets);
+      for (auto& x : value[k])
+        x = noise(rng);
+    }
+  }
+
+  std::size_t
+  elements() const
+  { return bucket.size(); }
+
+  //! Call fn(k) for the updates k of every thread on pool
+  template <typename Fn>
+  void each(agg::thread_pool& pool, Fn fn) {
+    const std::size_t n = bucket.size();
+    pool.parallel_for(threads, [&](std::size_t t) {
+      for (std::size_t k = n * t / threads; k < n * (t + 1) / threads; ++k)
+        fn(t, k);
+    });
+  }
+};
+
+
+// Kernels: scatter-add every value into shared[bucket]
+
+struct atomic {
+  template <typename D>
+  static void run(D& d, agg::thread_pool& pool) {
+    d.each(pool, [&](std::size_t, std::size_t k) {
+      agg::atomic_ref<typename D::V>(d.shared[d.bucket[k]])
+          .fetch_add(d.value[k], std::memory_order_relaxed);
+    });
+  }
+};
+
+struct mutex {
+  template <typename D>
+  static void run(D& d, agg::thread_pool& pool) {
+    d.each(pool, [&](std::size_t, std::size_t k) {
+      std::lock_guard<std::mutex> hold(d.lock[d.bucket[k]]);
+      d.shared[d.bucket[k]] += d.value[k];
+    });
+  }
+};
+
+//! Clear a copy per thread, add into it, then sum the copies into shared
+struct private_copy {
+  template <typename D>
+  static void run(D& d, agg::thread_pool& pool) {
+    pool.parallel_for(d.threads, [&](std::size_t t) {
+      std::fill(d.own[t].begin(), d.own[t].end(), typename D::V{});
+    });
+    d.each(pool, [&](std::size_t t, std::size_t k) {
+      d.own[t][d.bucket[k]] += d.value[k];
+    });
+    const std::size_t b = d.shared.size();
+    pool.parallel_for(d.threads, [&](std::size_t t) {
+      for (std::size_t i = b * t / d.threads; i < b * (t + 1) / d.threads; ++i)
+        for (auto& o : d.own)
+          d.shared[i] += o[i];
+    });
+  }
+};
+
+
+//! Benchmark scatter-add into buckets aggregate<T,N> under atomic/op
+template <typename T, std::size_t N>
+void run(bench::session& s, std::size_t threads, std::size_t buckets,
+         const char* op) {
+  const char* type = bench::type_name<T>::get();
+  if (!s.wanted("atomic", op, type, N))
+    return;
+
+  agg::thread_pool pool(threads - 1);
+  buffers<T,N> d(AGG_BENCH_UPDATES, buckets, threads);
+  s.time("atomic", op, type, N, d.elements(), "atomic", [&] {
+    atomic::run(d, pool);
+    bench::escape(&d);
+  });
+  s.time("atomic", op, type, N, d.elements(), "mutex", [&] {
+    mutex::run(d, pool);
+    bench::escape(&d);
+  });
+  s.time("atomic", op, type, N, d.elements(), "private", [&] {
+    private_copy::run(d, pool);
+    bench::escape(&d);
+  });
+}
+
+template <typename T, std::size_t N>
+void all(bench::session& s, std::size_t threads) {
+  run<T,N>(s, threads, AGG_BENCH_HOT, "hot");
+  run<T,N>(s, threads, AGG_BENCH_COLD, "cold");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.unit = "update";
+  std::size_t threads = std::thread::hardware_concurrency();
+  auto extra = [&](const std::string& arg, const char* value) {
+    if (arg != "-t")
+      return false;
+    threads = std::size_t(std::max(1, std::atoi(value)));
+    return true;
+  };
+  if (!s.parse(argc, argv, " [-t threads]", extra))
+    return 1;
+  if (threads == 0)
+    threads = 1;
+
+  all<double,3>(s, threads);
+  all<float,2>(s, threads);
+  all<float,4>(s, threads);
+
+  return s.finish();
+}
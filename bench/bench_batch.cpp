@@ -0,0 +1,130 @@
+/** Batched matrix micro-benchmarks: agg::batch_matmul, batch_matvec and
+ *  batch_inverse against a loop applying matmul, matvec and inverse to
+ *  one matrix at a time.
+ *
+ *  Every benchmark runs over a buffer of AGG_BENCH_MATRICES N x N matrices;
+ *  the "elements" of the results are matrices.
+ *
+ *  Usage: bench_batch [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+
+#include "aggregate.hpp"
+#include "agg_batch.hpp"
+#include "agg_matrix.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_MATRICES)
+#define AGG_BENCH_MATRICES 4096
+#endif
+
+using agg::aggregate;
+using agg::matrix;
+
+
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  std::vector<matrix<T,N,N> >   a, b, c;
+  std::vector<aggregate<T,N> >  x, y;
+
+  explicit buffers(std::size_t count)
+      : a(count), b(count), c(count), x(count), y(count) {
+    // Diagonally dominant, so every matrix is well conditioned
+    for (std::size_t i = 0; i < count; ++i) {
+      for (std::size_t j = 0; j < N; ++j) {
+        for (std::size_t k = 0; k < N; ++k) {
+          a[i][j][k] = T((i * 7 + j * 3 + k) % 5) + (j == k ? T(8) : T(0));
+          b[i][j][k] = T((i * 5 + j + k * 3) % 7);
+        }
+        x[i][j] = T(1 + (i + j) % 3);
+      }
+    }
+  }
+
+  std::size_t
+  count() const
+  { return a.size(); }
+
+  std::size_t
+  elements() const
+  { return count(); }
+};
+
+
+// Kernels: agg() runs one pass through the batched call, base() the loop
+// over one matrix at a time.
+
+//! c = matmul(a, b)
+struct matmul {
+  template <typename D>
+  static void agg(D& d) {
+    agg::batch_matmul(d.a.begin(), d.a.end(), d.b.begin(), d.c.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.c[i] = agg::matmul(d.a[i], d.b[i]);
+  }
+};
+
+//! y = matvec(a, x)
+struct matvec {
+  template <typename D>
+  static void agg(D& d) {
+    agg::batch_matvec(d.a.begin(), d.a.end(), d.x.begin(), d.y.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.y[i] = agg::matvec(d.a[i], d.x[i]);
+  }
+};
+
+//! c = inverse(a)
+struct inverse {
+  template <typename D>
+  static void agg(D& d) {
+    agg::batch_inverse(d.a.begin(), d.a.end(), d.c.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.c[i] = agg::inverse(d.a[i]);
+  }
+};
+
+
+template <typename T, std::size_t N>
+void all(bench::session& s) {
+  buffers<T,N> d(AGG_BENCH_MATRICES);
+  s.run<matmul>(d, "matrix", "matmul");
+  s.run<matvec>(d, "matrix", "matvec");
+  s.run<inverse>(d, "matrix", "inverse");
+}
+
+template <typename T>
+void all_sizes(bench::session& s) {
+  all<T,2>(s);
+  all<T,3>(s);
+  all<T,4>(s);
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.impl[0] = "batch";
+  s.impl[1] = "each";
+  s.unit = "matrix";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all_sizes<float>(s);
+  all_sizes<double>(s);
+
+  return s.finish();
+}
@@ -0,0 +1,142 @@
+/** Flag micro-benchmarks: agg::bitset_aggregate<N> against
+ *  aggregate<bool,N> for the word-wide operators and the popcount
+ *  reductions.
+ *
+ *  Every benchmark runs over AGG_BENCH_CELLS cells of N random flags each,
+ *  as per-cell flag sets. The "elements" of the results are flags, and so
+ *  is the unit of the summary on stderr.
+ *
+ *  Usage: bench_bitset [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <random>
+
+#include "aggregate.hpp"
+#include "agg_bitset.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_CELLS)
+#define AGG_BENCH_CELLS 4096
+#endif
+
+using agg::aggregate;
+using agg::bitset_aggregate;
+
+
+template <std::size_t N>
+struct buffers : bench::fixture<bool,N> {
+  std::vector<aggregate<bool,N> > a, b, c;
+  std::vector<bitset_aggregate<N> > x, y, z;
+  std::size_t n = 0;
+
+  explicit buffers(std::size_t cells)
+      : a(cells), b(cells), c(cells), x(cells), y(cells), z(cells) {
+    std::mt19937 rng(1);
+    for (std::size_t k = 0; k < cells; ++k) {
+      for (std::size_t i = 0; i < N; ++i) {
+        a[k][i] = rng() % 2;
+        b[k][i] = rng() % 8 != 0;
+      }
+      x[k] = agg::pack(a[k]);
+      y[k] = agg::pack(b[k]);
+    }
+  }
+
+  std::size_t
+  elements() const
+  { return a.size() * N; }
+};
+
+
+// Kernels: agg() on bitset_aggregate, base() on aggregate<bool,N>
+
+//! c = a && !b
+struct and_not {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t k = 0; k < d.x.size(); ++k)
+      d.z[k] = d.x[k] && !d.y[k];
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t k = 0; k < d.a.size(); ++k)
+      d.c[k] = d.a[k] && !d.b[k];
+  }
+};
+
+//! c = a || b
+struct logical_or {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t k = 0; k < d.x.size(); ++k)
+      d.z[k] = d.x[k] || d.y[k];
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t k = 0; k < d.a.size(); ++k)
+      d.c[k] = d.a[k] || d.b[k];
+  }
+};
+
+//! The flags set over all cells
+struct count {
+  template <typename D>
+  static void agg(D& d) {
+    d.n = 0;
+    for (auto& x : d.x)
+      d.n += agg::count(x);
+  }
+  template <typename D>
+  static void base(D& d) {
+    d.n = 0;
+    for (auto& a : d.a)
+      d.n += agg::count(a);
+  }
+};
+
+//! The cells with every flag set
+struct all {
+  template <typename D>
+  static void agg(D& d) {
+    d.n = 0;
+    for (auto& y : d.y)
+      d.n += agg::all(y);
+  }
+  template <typename D>
+  static void base(D& d) {
+    d.n = 0;
+    for (auto& b : d.b)
+      d.n += agg::all(b);
+  }
+};
+
+
+template <std::size_t N>
+void all_ops(bench::session& s) {
+  buffers<N> d(AGG_BENCH_CELLS);
+  s.run<and_not>(d, "bitset", "and_not");
+  s.run<logical_or>(d, "bitset", "logical_or");
+  s.run<count>(d, "bitset", "count");
+  s.run<all>(d, "bitset", "all");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.impl[0] = "bitset";
+  s.impl[1] = "bool";
+  s.unit = "flag";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all_ops<64>(s);
+  all_ops<300>(s);
+  all_ops<1024>(s);
+
+  return s.finish();
+}
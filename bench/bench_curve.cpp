@@ -0,0 +1,251 @@
+/** Space-filling curve micro-benchmarks: agg::morton_encode, morton_decode,
+ *  hilbert_encode and hilbert_decode over ranges against the bit-at-a-time
+ *  loops they replace, and agg::morton_sort against std::sort by the same
+ *  index.
+ *
+ *  Every benchmark runs over AGG_BENCH_POINTS random points with the
+ *  curve_bits of their type. The "elements" of the results are points; the
+ *  summary on stderr is in ns per point.
+ *
+ *  Usage: bench_curve [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <random>
+
+#include "aggregate.hpp"
+#include "agg_curve.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_POINTS)
+#define AGG_BENCH_POINTS (1 << 16)
+#endif
+
+using agg::aggregate;
+
+
+// The loops every team writes: one bit of one element at a time
+
+template <typename U, std::size_t N>
+typename agg::curve_index<U,N>::type
+loop_morton_encode(const aggregate<U,N>& a) {
+  typedef typename agg::curve_index<U,N>::type W;
+  W r = 0;
+  for (std::size_t j = 0; j < agg::curve_bits<U,N>::value; ++j)
+    for (std::size_t i = 0; i < N; ++i)
+      r |= W((a[i] >> j) & 1) << (j * N + i);
+  return r;
+}
+
+template <typename U, std::size_t N>
+aggregate<U,N>
+loop_morton_decode(typename agg::curve_index<U,N>::type z) {
+  aggregate<U,N> a = {};
+  for (std::size_t j = 0; j < agg::curve_bits<U,N>::value; ++j)
+    for (std::size_t i = 0; i < N; ++i)
+      a[i] |= U(((z >> (j * N + i)) & 1) << j);
+  return a;
+}
+
+//! Skilling's AxesToTranspose, as published
+template <std::size_t N, std::size_t B, typename W>
+void
+loop_transpose(W* x) {
+  for (W q = W(1) << (B - 1); q > 1; q >>= 1) {
+    const W p = q - 1;
+    for (std::size_t i = 0; i < N; ++i) {
+      if (x[i] & q) {
+        x[0] ^= p;
+      } else {
+        W t = (x[0] ^ x[i]) & p;
+        x[0] ^= t;
+        x[i] ^= t;
+      }
+    }
+  }
+  for (std::size_t i = 1; i < N; ++i)
+    x[i] ^= x[i - 1];
+  W t = 0;
+  for (W q = W(1) << (B - 1); q > 1; q >>= 1)
+    if (x[N - 1] & q)
+      t ^= q - 1;
+  for (std::size_t i = 0; i < N; ++i)
+    x[i] ^= t;
+}
+
+//! Skilling's TransposeToAxes, as published
+template <std::size_t N, std::size_t B, typename W>
+void
+loop_untranspose(W* x) {
+  W t = x[N - 1] >> 1;
+  for (std::size_t i = N - 1; i > 0; --i)
+    x[i] ^= x[i - 1];
+  x[0] ^= t;
+  for (W q = 2; q != W(W(2) << (B - 1)); q <<= 1) {
+    const W p = q - 1;
+    for (std::size_t i = N; i-- > 0; ) {
+      if (x[i] & q) {
+        x[0] ^= p;
+      } else {
+        t = (x[0] ^ x[i]) & p;
+        x[0] ^= t;
+        x[i] ^= t;
+      }
+    }
+  }
+}
+
+//! Skilling's transform with the index interleaved bit by bit
+template <typename U, std::size_t N>
+typename agg::curve_index<U,N>::type
+loop_hilbert_encode(const aggregate<U,N>& a) {
+  typedef typename agg::curve_index<U,N>::type W;
+  const std::size_t B = agg::curve_bits<U,N>::value;
+  W x[N];
+  for (std::size_t i = 0; i < N; ++i)
+    x[i] = W(a[i]);
+  loop_transpose<N,B>(x);
+  W r = 0;
+  for (std::size_t j = 0; j < B; ++j)
+    for (std::size_t i = 0; i < N; ++i)
+      r |= W((x[i] >> j) & 1) << (j * N + N - 1 - i);
+  return r;
+}
+
+template <typename U, std::size_t N>
+aggregate<U,N>
+loop_hilbert_decode(typename agg::curve_index<U,N>::type h) {
+  typedef typename agg::curve_index<U,N>::type W;
+  const std::size_t B = agg::curve_bits<U,N>::value;
+  W x[N] = {};
+  for (std::size_t j = 0; j < B; ++j)
+    for (std::size_t i = 0; i < N; ++i)
+      x[i] |= W((h >> (j * N + N - 1 - i)) & 1) << j;
+  loop_untranspose<N,B>(x);
+  aggregate<U,N> a;
+  for (std::size_t i = 0; i < N; ++i)
+    a[i] = U(x[i]);
+  return a;
+}
+
+
+template <typename U, std::size_t N>
+struct buffers : bench::fixture<U,N> {
+  typedef typename agg::curve_index<U,N>::type index;
+
+  std::vector<aggregate<U,N> > p, q;
+  std::vector<index> z, h;
+
+  explicit buffers(std::size_t n) : p(n), q(n), z(n), h(n) {
+    std::mt19937_64 rng(1);
+    const std::size_t B = agg::curve_bits<U,N>::value;
+    for (auto& a : p)
+      for (std::size_t i = 0; i < N; ++i)
+        a[i] = U(rng() & ((std::uint64_t(1) << B) - 1));
+    agg::morton_encode(p.begin(), p.end(), z.begin());
+    agg::hilbert_encode(p.begin(), p.end(), h.begin());
+  }
+
+  std::size_t
+  elements() const
+  { return p.size(); }
+};
+
+
+// Kernels: agg() through agg_curve.hpp, base() bit at a time
+
+struct morton_encode {
+  template <typename D>
+  static void agg(D& d) {
+    agg::morton_encode(d.p.begin(), d.p.end(), d.z.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.p.size(); ++i)
+      d.z[i] = loop_morton_encode(d.p[i]);
+  }
+};
+
+struct morton_decode {
+  template <typename D>
+  static void agg(D& d) {
+    agg::morton_decode<typename D::value_type, D::size>(
+        d.z.begin(), d.z.end(), d.q.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.z.size(); ++i)
+      d.q[i] = loop_morton_decode<typename D::value_type, D::size>(d.z[i]);
+  }
+};
+
+struct hilbert_encode {
+  template <typename D>
+  static void agg(D& d) {
+    agg::hilbert_encode(d.p.begin(), d.p.end(), d.h.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.p.size(); ++i)
+      d.h[i] = loop_hilbert_encode(d.p[i]);
+  }
+};
+
+struct hilbert_decode {
+  template <typename D>
+  static void agg(D& d) {
+    agg::hilbert_decode<typename D::value_type, D::size>(
+        d.h.begin(), d.h.end(), d.q.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.h.size(); ++i)
+      d.q[i] = loop_hilbert_decode<typename D::value_type, D::size>(d.h[i]);
+  }
+};
+
+//! q = p in Z-order
+struct morton_sort {
+  template <typename D>
+  static void agg(D& d) {
+    d.q = d.p;
+    agg::morton_sort(d.q.begin(), d.q.end());
+  }
+  template <typename D>
+  static void base(D& d) {
+    typedef aggregate<typename D::value_type, D::size> V;
+    d.q = d.p;
+    std::sort(d.q.begin(), d.q.end(), [](const V& a, const V& b) {
+      return agg::morton_encode(a) < agg::morton_encode(b);
+    });
+  }
+};
+
+
+template <typename U, std::size_t N>
+void all(bench::session& s) {
+  buffers<U,N> d(AGG_BENCH_POINTS);
+  s.run<morton_encode>(d, "curve", "morton_encode");
+  s.run<morton_decode>(d, "curve", "morton_decode");
+  s.run<hilbert_encode>(d, "curve", "hilbert_encode");
+  s.run<hilbert_decode>(d, "curve", "hilbert_decode");
+  s.run<morton_sort>(d, "curve", "morton_sort");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.unit = "point";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all<std::uint32_t,2>(s);
+  all<std::uint32_t,3>(s);
+  all<std::uint16_t,4>(s);
+
+  return s.finish();
+}
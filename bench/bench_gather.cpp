@@ -0,0 +1,107 @@
+/** Indexed access micro-benchmarks: agg::gather and agg::scatter_add
+ *  against the loops over out[k] = base[idx[k]] and base[idx[k]] += v[k]
+ *  they replace.
+ *
+ *  Every benchmark goes through AGG_BENCH_INDICES random signed 32-bit indices
+ *  into an array of AGG_BENCH_RECORDS aggregates, so indices repeat. The
+ *  "elements" of the results are indices; the summary on stderr is in ns
+ *  per index.
+ *
+ *  Usage: bench_gather [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <random>
+
+#include "aggregate.hpp"
+#include "agg_gather.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_RECORDS)
+#define AGG_BENCH_RECORDS (1 << 16)
+#endif
+#if !defined(AGG_BENCH_INDICES)
+#define AGG_BENCH_INDICES (1 << 18)
+#endif
+
+using agg::aggregate;
+
+
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  std::vector<aggregate<T,N> > base, out, values;
+  std::vector<std::int32_t> idx;
+
+  buffers(std::size_t m, std::size_t n)
+      : base(m), out(n), values(n), idx(n) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<T> noise(-1, 1);
+    for (auto& a : base)
+      for (auto& x : a)
+        x = noise(rng);
+    for (auto& a : values)
+      for (auto& x : a)
+        x = noise(rng);
+    for (auto& i : idx)
+      i = std::int32_t(rng() % m);
+  }
+
+  std::size_t
+  elements() const
+  { return idx.size(); }
+};
+
+
+// Kernels: agg() through agg_gather.hpp, base() one index at a time
+
+struct gather {
+  template <typename D>
+  static void agg(D& d) {
+    agg::gather(d.base.data(), d.idx.begin(), d.idx.end(), d.out.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t k = 0; k < d.idx.size(); ++k)
+      d.out[k] = d.base[d.idx[k]];
+  }
+};
+
+struct scatter_add {
+  template <typename D>
+  static void agg(D& d) {
+    agg::scatter_add(d.base.data(), d.idx.begin(), d.idx.end(),
+                     d.values.begin());
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t k = 0; k < d.idx.size(); ++k)
+      d.base[d.idx[k]] += d.values[k];
+  }
+};
+
+
+template <typename T, std::size_t N>
+void all(bench::session& s) {
+  buffers<T,N> d(AGG_BENCH_RECORDS, AGG_BENCH_INDICES);
+  s.run<gather>(d, "gather", "gather");
+  s.run<scatter_add>(d, "gather", "scatter_add");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.unit = "index";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all<float,1>(s);
+  all<float,3>(s);
+  all<double,3>(s);
+  all<float,4>(s);
+
+  return s.finish();
+}
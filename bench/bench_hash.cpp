@@ -0,0 +1,168 @@
+/** Hash micro-benchmarks: std::hash of aggregates against the usual
+ *  hand-rolled combiner of element hashes (boost's hash_combine), hashing
+ *  grid-cell keys, building an unordered_map of them and looking them up.
+ *
+ *  The keys are the cells of a cube of AGG_BENCH_GRID cells a side around
+ *  the origin; the "elements" of the results are keys. Before timing, the
+ *  summary on stderr reports the distinct hashes and the longest bucket
+ *  chain of each hasher over the keys.
+ *
+ *  Usage: bench_hash [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "aggregate.hpp"
+#include "agg_hash.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_GRID)
+#define AGG_BENCH_GRID 48
+#endif
+
+using agg::aggregate;
+
+
+//! h = h ^ (hash(x) + 0x9e3779b9 + (h << 6) + (h >> 2)), element by element
+struct combine_hash {
+  template <typename T, std::size_t N>
+  std::size_t operator()(const aggregate<T,N>& a) const {
+    std::size_t h = 0;
+    for (std::size_t i = 0; i < N; ++i)
+      h ^= std::hash<T>()(a[i]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+  }
+};
+
+
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  typedef aggregate<T,N> key;
+
+  std::vector<key> keys;
+  std::vector<std::size_t> hashes;
+  std::unordered_map<key,int,std::hash<key> > a;   //!< Keyed by agg
+  std::unordered_map<key,int,combine_hash> c;      //!< Keyed by combine
+
+  explicit buffers(int side) {
+    // Unit cells for integers, half-unit lattice points for floats
+    const T step = std::is_integral<T>::value ? T(1) : T(0.5);
+    std::size_t count = 1;
+    for (std::size_t j = 0; j < N; ++j)
+      count *= std::size_t(side);
+    key k;
+    for (std::size_t i = 0; i < count; ++i) {
+      std::size_t r = i;
+      for (std::size_t j = 0; j < N; ++j, r /= std::size_t(side))
+        k[j] = T(int(r % std::size_t(side)) - side / 2) * step;
+      keys.push_back(k);
+    }
+    hashes.resize(keys.size());
+    for (std::size_t i = 0; i < count; ++i) {
+      a.emplace(keys[i], int(i));
+      c.emplace(keys[i], int(i));
+    }
+  }
+
+  std::size_t
+  count() const
+  { return keys.size(); }
+
+  std::size_t
+  elements() const
+  { return count(); }
+};
+
+
+// Kernels, each over the map m of one hasher: hashes of every key, the map
+// built, and every key looked up in it. agg() runs them on the map of
+// std::hash, base() on that of combine_hash.
+
+struct hash {
+  template <typename D, typename M>
+  static void run(D& d, M& m) {
+    typename M::hasher h = m.hash_function();
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.hashes[i] = h(d.keys[i]);
+  }
+};
+
+struct insert {
+  template <typename D, typename M>
+  static void run(D& d, M& m) {
+    m.clear();
+    m.reserve(d.count());
+    for (std::size_t i = 0; i < d.count(); ++i)
+      m.emplace(d.keys[i], int(i));
+  }
+};
+
+struct find {
+  template <typename D, typename M>
+  static void run(D& d, M& m) {
+    std::size_t found = 0;
+    for (std::size_t i = 0; i < d.count(); ++i)
+      found += m.find(d.keys[i]) != m.end();
+    d.hashes[0] = found;
+  }
+};
+
+//! Kernel Op on both maps
+template <typename Op>
+struct hashers {
+  template <typename D>
+  static void agg(D& d) { Op::run(d, d.a); }
+  template <typename D>
+  static void base(D& d) { Op::run(d, d.c); }
+};
+
+
+//! Distinct hashes and longest bucket chain of the keys of d under H
+template <typename H, typename D>
+void collisions(const D& d, const char* name) {
+  std::unordered_set<std::size_t> distinct;
+  std::unordered_map<typename D::key,int,H> m(d.count());
+  for (std::size_t i = 0; i < d.count(); ++i) {
+    distinct.insert(H()(d.keys[i]));
+    m.emplace(d.keys[i], 0);
+  }
+  std::size_t longest = 0;
+  for (std::size_t b = 0; b < m.bucket_count(); ++b)
+    longest = std::max(longest, m.bucket_size(b));
+  std::cerr << "  " << name << ": " << distinct.size() << " distinct of "
+            << d.count() << ", longest chain " << longest << std::endl;
+}
+
+
+template <typename T, std::size_t N>
+void all(bench::session& s, int side) {
+  buffers<T,N> d(side);
+  std::cerr << "hash/" << bench::type_name<T>::get() << "/" << N << ":"
+            << std::endl;
+  collisions<std::hash<typename buffers<T,N>::key> >(d, "agg");
+  collisions<combine_hash>(d, "combine");
+  s.run<hashers<hash> >(d, "hash", "hash");
+  s.run<hashers<insert> >(d, "hash", "insert");
+  s.run<hashers<find> >(d, "hash", "find");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.impl[1] = "combine";
+  s.unit = "key";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all<std::int32_t,2>(s, AGG_BENCH_GRID * AGG_BENCH_GRID / 4);
+  all<std::int32_t,3>(s, AGG_BENCH_GRID);
+  all<float,3>(s, AGG_BENCH_GRID);
+
+  return s.finish();
+}
@@ -0,0 +1,386 @@
+/** Operator micro-benchmarks: aggregate<T,N> against hand-written loops.
+ *
+ *  Every benchmark applies one operator to each of a buffer of aggregates
+ *  (about AGG_BENCH_ELEMENTS scalars in total) and is timed twice: through
+ *  the aggregate operator ("aggregate") and through the equivalent loop
+ *  over std::array<T,N> elements ("loop"), or std::array's own operator
+ *  for comparisons ("std::array").
+ *
+ *  Usage: bench_operators [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <array>
+#include <type_traits>
+
+#include "aggregate.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_ELEMENTS)
+#define AGG_BENCH_ELEMENTS 16384
+#endif
+
+using agg::aggregate;
+namespace fn = agg::fn;
+
+
+//! The same operands as aggregates and as std::arrays
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  std::vector<aggregate<T,N> >         a, b, c;
+  std::vector<aggregate<bool,N> >      m;
+  std::vector<std::array<T,N> >        x, y, z;
+  std::vector<std::array<bool,N> >     w;
+  std::vector<T>                       s;
+  std::vector<char>                    f;
+  T                                    k = T(3);
+
+  explicit buffers(std::size_t count)
+      : a(count), b(count), c(count), m(count),
+        x(count), y(count), z(count), w(count), s(count), f(count) {
+    // Operands in [1,8) keep division, modulus and shifts well defined
+    for (std::size_t i = 0; i < count; ++i) {
+      for (std::size_t j = 0; j < N; ++j) {
+        x[i][j] = a[i][j] = T(1 + (i * 7 + j * 3) % 7);
+        y[i][j] = b[i][j] = T(1 + (i * 5 + j) % 7);
+        z[i][j] = c[i][j] = T(0);
+      }
+    }
+  }
+
+  std::size_t
+  count() const
+  { return a.size(); }
+
+  std::size_t
+  elements() const
+  { return count() * N; }
+};
+
+
+// Kernels: agg() runs one pass with the aggregate operators, base() the
+// hand-written equivalent.
+
+//! c = a op b
+template <typename Fn>
+struct binary {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.c[i] = Fn()(d.a[i], d.b[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.z[i][j] = Fn()(d.x[i][j], d.y[i][j]);
+  }
+};
+
+//! c = a op k for a scalar k
+template <typename Fn>
+struct broadcast {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.c[i] = Fn()(d.a[i], d.k);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.z[i][j] = Fn()(d.x[i][j], d.k);
+  }
+};
+
+//! c = op a
+template <typename Fn>
+struct unary {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.c[i] = Fn()(d.a[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.z[i][j] = Fn()(d.x[i][j]);
+  }
+};
+
+//! c op= b
+template <typename Fn>
+struct compound {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      Fn()(d.c[i], d.b[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        Fn()(d.z[i][j], d.y[i][j]);
+  }
+};
+
+//! op c, for the increment operators
+template <typename Fn>
+struct mutate {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      Fn()(d.c[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        Fn()(d.z[i][j]);
+  }
+};
+
+//! m = a op b with a bool result
+template <typename Fn>
+struct logical {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.m[i] = Fn()(d.a[i], d.b[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.w[i][j] = Fn()(d.x[i][j], d.y[i][j]);
+  }
+};
+
+//! m = !a
+struct logical_not {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.m[i] = !d.a[i];
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.w[i][j] = !d.x[i][j];
+  }
+};
+
+//! f = a cmp b on whole aggregates, against std::array's operator
+template <typename Fn>
+struct comparison {
+  static const char* baseline() { return "std::array"; }
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.f[i] = Fn()(d.a[i], d.b[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.f[i] = Fn()(d.x[i], d.y[i]);
+  }
+};
+
+/** f = a cmp a' for a and a' at either end of the buffer. Every a holds
+ *  the same values, so the comparison reaches the last element.
+ */
+template <typename Fn>
+struct comparison_same {
+  static const char* baseline() { return "std::array"; }
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0, n = d.count(); i < n; ++i)
+      d.f[i] = Fn()(d.a[i], d.a[n - 1 - i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0, n = d.count(); i < n; ++i)
+      d.f[i] = Fn()(d.x[i], d.x[n - 1 - i]);
+  }
+};
+
+//! m = cmp_lt(a, b) element-wise
+struct mask_lt {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.m[i] = agg::cmp_lt(d.a[i], d.b[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.w[i][j] = d.x[i][j] < d.y[i][j];
+  }
+};
+
+//! c = select(m, a, b)
+struct mask_select {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.c[i] = agg::select(d.m[i], d.a[i], d.b[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.z[i][j] = d.w[i][j] ? d.x[i][j] : d.y[i][j];
+  }
+};
+
+//! c = a*b + c in one pass
+struct madd {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.c[i] = agg::fma(d.a[i], d.b[i], d.c[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.z[i][j] = d.x[i][j] * d.y[i][j] + d.z[i][j];
+  }
+};
+
+//! c += k*a in place
+struct axpy {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      agg::axpy(d.k, d.a[i], d.c[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        d.z[i][j] += d.k * d.x[i][j];
+  }
+};
+
+//! s = sum(a)
+struct sum {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.s[i] = agg::sum(d.a[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i) {
+      typename D::value_type t = 0;
+      for (std::size_t j = 0; j < D::size; ++j)
+        t += d.x[i][j];
+      d.s[i] = t;
+    }
+  }
+};
+
+//! s = dot(a, b)
+struct dot {
+  template <typename D>
+  static void agg(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i)
+      d.s[i] = agg::dot(d.a[i], d.b[i]);
+  }
+  template <typename D>
+  static void base(D& d) {
+    for (std::size_t i = 0; i < d.count(); ++i) {
+      typename D::value_type t = 0;
+      for (std::size_t j = 0; j < D::size; ++j)
+        t += d.x[i][j] * d.y[i][j];
+      d.s[i] = t;
+    }
+  }
+};
+
+
+template <typename T, std::size_t N>
+void all(bench::session& s) {
+  buffers<T,N> d(std::max<std::size_t>(1, AGG_BENCH_ELEMENTS / N));
+  std::is_integral<T> integral;
+  std::is_floating_point<T> floating;
+
+  s.run<binary<fn::plus> >(d, "arithmetic", "plus");
+  s.run<binary<fn::minus> >(d, "arithmetic", "minus");
+  s.run<binary<fn::multiplies> >(d, "arithmetic", "multiplies");
+  s.run<binary<fn::divides> >(d, "arithmetic", "divides");
+  s.run_if<binary<fn::modulus> >(integral, d, "arithmetic", "modulus");
+
+  s.run<broadcast<fn::multiplies> >(d, "scalar", "multiplies");
+  s.run<broadcast<fn::plus> >(d, "scalar", "plus");
+
+  s.run_if<binary<fn::bit_and> >(integral, d, "bitwise", "bit_and");
+  s.run_if<binary<fn::bit_or> >(integral, d, "bitwise", "bit_or");
+  s.run_if<binary<fn::bit_xor> >(integral, d, "bitwise", "bit_xor");
+  s.run_if<binary<fn::left_shift> >(integral, d, "bitwise", "left_shift");
+  s.run_if<binary<fn::right_shift> >(integral, d, "bitwise", "right_shift");
+
+  s.run<unary<fn::unary_minus> >(d, "unary", "unary_minus");
+  s.run_if<unary<fn::bit_not> >(integral, d, "unary", "bit_not");
+  s.run<mutate<fn::pre_increment> >(d, "unary", "pre_increment");
+
+  s.run<compound<fn::plus_assign> >(d, "compound", "plus_assign");
+  s.run<compound<fn::minus_assign> >(d, "compound", "minus_assign");
+  s.run_if<compound<fn::multiplies_assign> >(floating, d,
+                                              "compound", "multiplies_assign");
+  s.run_if<compound<fn::bit_xor_assign> >(integral, d,
+                                           "compound", "bit_xor_assign");
+
+  s.run<madd>(d, "fused", "fma");
+  s.run<axpy>(d, "fused", "axpy");
+
+  s.run<logical<fn::logical_and> >(d, "logical", "logical_and");
+  s.run<logical<fn::logical_or> >(d, "logical", "logical_or");
+  s.run<logical_not>(d, "logical", "logical_not");
+
+  s.run<comparison<fn::equal_to> >(d, "comparison", "equal_to");
+  s.run<comparison<fn::less> >(d, "comparison", "less");
+  s.run<comparison_same<fn::equal_to> >(d, "comparison", "equal_to_same");
+  s.run<comparison_same<fn::less> >(d, "comparison", "less_same");
+
+  s.run<mask_lt>(d, "mask", "cmp_lt");
+  s.run<mask_select>(d, "mask", "select");
+
+  s.run<sum>(d, "reduction", "sum");
+  s.run<dot>(d, "reduction", "dot");
+}
+
+template <typename T>
+void all_sizes(bench::session& s) {
+  all<T,1>(s);
+  all<T,2>(s);
+  all<T,3>(s);
+  all<T,4>(s);
+  all<T,8>(s);
+  all<T,16>(s);
+  all<T,64>(s);
+  all<T,256>(s);
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.impl[0] = "aggregate";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all_sizes<float>(s);
+  all_sizes<double>(s);
+  all_sizes<std::int32_t>(s);
+  all_sizes<std::int64_t>(s);
+
+  return s.finish();
+}
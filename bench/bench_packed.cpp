@@ -0,0 +1,142 @@
+/** Packed codec micro-benchmarks: agg::packed_encode and packed_decode of
+ *  whole blocks against copying the same aggregates raw, as reading or
+ *  writing an uncompressed binary file from the page cache does.
+ *
+ *  Every benchmark runs over AGG_BENCH_BLOCKS blocks of correlated records:
+ *  a random-walk integer trajectory, a noisy float sensor and a smooth
+ *  double orbit. The "elements" of the results are bytes of raw
+ *  aggregates; the summary on stderr is in MB/s of raw aggregates and the
+ *  packed size.
+ *
+ *  Usage: bench_packed [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <cmath>
+#include <random>
+
+#include "aggregate.hpp"
+#include "agg_packed.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_BLOCKS)
+#define AGG_BENCH_BLOCKS 64
+#endif
+
+using agg::aggregate;
+
+
+//! Records i of the benchmark streams
+inline void
+record(aggregate<std::int32_t,3>& a, std::size_t i, std::mt19937& rng) {
+  if (i == 0)
+    a = {{1000000, -5000, 0}};
+  a += aggregate<std::int32_t,3>{{std::int32_t(rng() % 41) - 20,
+                                  std::int32_t(rng() % 41) - 20, 3}};
+}
+inline void
+record(aggregate<float,4>& a, std::size_t i, std::mt19937& rng) {
+  a = {{20.f + float(rng() % 1000) * 1e-5f, 1013.25f, float(i),
+        float(i % 7 == 0)}};
+}
+inline void
+record(aggregate<double,3>& a, std::size_t i, std::mt19937&) {
+  a = {{std::cos(i * 1e-3), std::sin(i * 1e-3), 1e-3 * i}};
+}
+
+
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  std::vector<aggregate<T,N> > a, b;
+  std::vector<unsigned char> packed, raw;
+  std::size_t packed_bytes;
+
+  explicit buffers(std::size_t blocks)
+      : a(blocks * agg::packed_block), b(a.size()),
+        packed(blocks * agg::packed_bound<T,N>()),
+        raw(a.size() * sizeof(aggregate<T,N>)) {
+    std::mt19937 rng(1);
+    for (std::size_t i = 0; i < a.size(); ++i) {
+      if (i)
+        a[i] = a[i-1];
+      record(a[i], i, rng);
+    }
+    packed_bytes = encode();
+  }
+
+  std::size_t
+  encode() {
+    unsigned char* p = packed.data();
+    for (std::size_t i = 0; i < a.size(); i += agg::packed_block)
+      p += agg::packed_encode(a.data() + i, agg::packed_block, p);
+    return std::size_t(p - packed.data());
+  }
+
+  void
+  decode() {
+    const unsigned char* p = packed.data();
+    const unsigned char* end = p + packed_bytes;
+    std::size_t n;
+    for (std::size_t i = 0; i < b.size(); i += agg::packed_block)
+      p = agg::packed_decode(p, end, b.data() + i, n);
+  }
+
+  std::size_t
+  elements() const
+  { return a.size() * N * sizeof(T); }
+};
+
+
+// Kernels: agg() runs one pass through the codec, base() the copy of the
+// same aggregates unpacked.
+
+//! packed = a
+struct encode {
+  template <typename D>
+  static void agg(D& d) { d.encode(); }
+  template <typename D>
+  static void base(D& d) {
+    std::memcpy(d.raw.data(), d.a.data(), d.raw.size());
+  }
+};
+
+//! b = packed
+struct decode {
+  template <typename D>
+  static void agg(D& d) { d.decode(); }
+  template <typename D>
+  static void base(D& d) {
+    std::memcpy(d.b.data(), d.raw.data(), d.raw.size());
+  }
+};
+
+
+template <typename T, std::size_t N>
+void all(bench::session& s) {
+  buffers<T,N> d(AGG_BENCH_BLOCKS);
+  std::cerr << "packed/" << bench::type_name<T>::get() << "/" << N << ": "
+            << 100. * d.packed_bytes / d.elements() << "% of "
+            << d.elements() << " bytes" << std::endl;
+  s.run<encode>(d, "packed", "encode");
+  s.run<decode>(d, "packed", "decode");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.impl[0] = "packed";
+  s.impl[1] = "raw";
+  s.unit = "byte";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all<std::int32_t,3>(s);
+  all<float,4>(s);
+  all<double,3>(s);
+
+  return s.finish();
+}
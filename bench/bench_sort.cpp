@@ -0,0 +1,116 @@
+/** Sort micro-benchmarks: agg::sort and agg::stable_sort against std::sort
+ *  and std::stable_sort with the lexicographic operator< of aggregates.
+ *
+ *  Every benchmark sorts AGG_BENCH_SORT aggregates: grid cells with
+ *  coordinates below 1024 as in spatial dedup, random 32-bit integers, and
+ *  normally distributed floats and doubles. Each pass copies the unsorted
+ *  input before sorting it, for both implementations. The "elements" of the
+ *  results are aggregates; the summary on stderr is in ns per aggregate.
+ *
+ *  Usage: bench_sort [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <random>
+
+#include "aggregate.hpp"
+#include "agg_sort.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_SORT)
+#define AGG_BENCH_SORT (1 << 20)
+#endif
+
+using agg::aggregate;
+
+
+//! Aggregates i of the benchmark inputs
+inline void
+record(aggregate<std::uint32_t,3>& a, std::mt19937& rng) {
+  a = {{std::uint32_t(rng() % 1024), std::uint32_t(rng() % 1024),
+        std::uint32_t(rng() % 1024)}};
+}
+inline void
+record(aggregate<std::int32_t,2>& a, std::mt19937& rng) {
+  a = {{std::int32_t(rng()), std::int32_t(rng())}};
+}
+template <typename T, std::size_t N>
+inline void
+record(aggregate<T,N>& a, std::mt19937& rng) {
+  std::normal_distribution<T> noise(0, 100);
+  for (std::size_t i = 0; i < N; ++i)
+    a[i] = noise(rng);
+}
+
+
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  std::vector<aggregate<T,N> > input, work;
+
+  explicit buffers(std::size_t n) : input(n), work(n) {
+    std::mt19937 rng(1);
+    for (auto& a : input)
+      record(a, rng);
+  }
+
+  std::size_t
+  elements() const
+  { return input.size(); }
+};
+
+
+// Kernels: agg() sorts a copy of the input with agg::, base() with std::.
+
+struct sort {
+  template <typename D>
+  static void agg(D& d) {
+    d.work = d.input;
+    agg::sort(d.work.begin(), d.work.end());
+  }
+  template <typename D>
+  static void base(D& d) {
+    d.work = d.input;
+    std::sort(d.work.begin(), d.work.end());
+  }
+};
+
+struct stable_sort {
+  template <typename D>
+  static void agg(D& d) {
+    d.work = d.input;
+    agg::stable_sort(d.work.begin(), d.work.end());
+  }
+  template <typename D>
+  static void base(D& d) {
+    d.work = d.input;
+    std::stable_sort(d.work.begin(), d.work.end());
+  }
+};
+
+
+template <typename T, std::size_t N>
+void all(bench::session& s) {
+  buffers<T,N> d(AGG_BENCH_SORT);
+  s.run<sort>(d, "sort", "sort");
+  s.run<stable_sort>(d, "sort", "stable_sort");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.impl[1] = "std";
+  s.unit = "aggregate";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all<std::uint32_t,3>(s);
+  all<std::int32_t,2>(s);
+  all<float,3>(s);
+  all<double,2>(s);
+
+  return s.finish();
+}
@@ -0,0 +1,111 @@
+/** Text micro-benchmarks: agg::format and agg::parse against writing and
+ *  reading the same aggregates through std::ostringstream and
+ *  std::istringstream with operator<< and element-wise operator>>.
+ *
+ *  Every benchmark runs over AGG_BENCH_RECORDS aggregates written at
+ *  round-trip precision; the "elements" of the results are bytes of text,
+ *  and the summary on stderr is in MB/s.
+ *
+ *  Usage: bench_text [-o results.json] [-f filter] [-r reps] [--perf]
+ *
+ *    -o FILE    write the JSON results to FILE instead of stdout
+ *    -f TEXT    only run benchmarks whose family/op/type/N contains TEXT
+ *    -r REPS    timed repetitions per benchmark
+ *    --perf     read cycles and instructions through perf_event_open
+ */
+
+#include <limits>
+#include <sstream>
+
+#include "aggregate.hpp"
+#include "agg_text.hpp"
+#include "bench.hpp"
+
+#if !defined(AGG_BENCH_RECORDS)
+#define AGG_BENCH_RECORDS 20000
+#endif
+
+using agg::aggregate;
+
+
+template <typename T, std::size_t N>
+struct buffers : bench::fixture<T,N> {
+  std::vector<aggregate<T,N> > a, b;
+  std::string text;     //!< The formatted a
+  std::string out;      //!< Room for formatting a
+
+  explicit buffers(std::size_t count) : a(count), b(count) {
+    for (std::size_t i = 0; i < count; ++i)
+      for (std::size_t j = 0; j < N; ++j)
+        a[i][j] = T((i * 7919 + j * 104729) % 200003) / T(7) - T(9000);
+    text = agg::format(a.data(), a.size());
+    out.resize(2 * text.size());
+  }
+
+  std::size_t
+  count() const
+  { return a.size(); }
+
+  std::size_t
+  elements() const
+  { return text.size(); }
+};
+
+
+// Kernels: agg() runs one pass through agg::format or agg::parse, base()
+// the same through the iostreams.
+
+//! text = a
+struct format {
+  template <typename D>
+  static void agg(D& d) {
+    agg::format(&d.out[0], &d.out[0] + d.out.size(), d.a.data(), d.count());
+  }
+  template <typename D>
+  static void base(D& d) {
+    std::ostringstream s;
+    s.precision(std::numeric_limits<typename D::value_type>::max_digits10);
+    for (std::size_t i = 0; i < d.count(); ++i)
+      s << d.a[i] << '\n';
+    d.out = s.str();
+  }
+};
+
+//! b = text
+struct parse {
+  template <typename D>
+  static void agg(D& d) {
+    agg::parse(d.text.data(), d.text.data() + d.text.size(),
+               d.b.data(), d.count());
+  }
+  template <typename D>
+  static void base(D& d) {
+    std::istringstream s(d.text);
+    for (std::size_t i = 0; i < d.count(); ++i)
+      for (std::size_t j = 0; j < D::size; ++j)
+        s >> d.b[i][j];
+  }
+};
+
+
+template <typename T, std::size_t N>
+void all(bench::session& s) {
+  buffers<T,N> d(AGG_BENCH_RECORDS);
+  s.run<format>(d, "text", "format");
+  s.run<parse>(d, "text", "parse");
+}
+
+
+int main(int argc, char** argv) {
+  bench::session s;
+  s.impl[1] = "iostream";
+  s.unit = "byte";
+  if (!s.parse(argc, argv))
+    return 1;
+
+  all<std::int32_t,4>(s);
+  all<float,3>(s);
+  all<double,3>(s);
+
+  return s.finish();
+}
@@ -0,0 +1,35 @@
+/** Translation unit for compile_time.sh: instantiates the generic operator
+ *  paths for large aggregates. Each function has external linkage so its
+ *  code is kept in the object file.
+ */
+
+#include <complex>
+
+#include "aggregate.hpp"
+#include "agg_expression.hpp"
+
+using agg::aggregate;
+
+#define AGG_LARGE_N(T, N)                                                     \
+  aggregate<T,N> add_##N(const aggregate<T,N>& a, const aggregate<T,N>& b)    \
+  { return a + b * b; }                                                       \
+  aggregate<T,N> scale_##N(const aggregate<T,N>& a, T s)                      \
+  { return a * s - a; }                                                       \
+  void update_##N(aggregate<T,N>& a, const aggregate<T,N>& b)                 \
+  { a += b; a -= b * b; }                                                     \
+  aggregate<T,N> fused_##N(const aggregate<T,N>& a, const aggregate<T,N>& b)  \
+  { return agg::lazy(a) * b + a; }
+
+namespace c {
+typedef std::complex<double> T;
+AGG_LARGE_N(T, 64)
+AGG_LARGE_N(T, 256)
+}
+
+namespace s {
+typedef short T;
+aggregate<int,64> shift_64(const aggregate<T,64>& a) { return (a << 2) % 7; }
+aggregate<int,256> shift_256(const aggregate<T,256>& a) { return (a << 2) % 7; }
+aggregate<int,1024> shift_1024(const aggregate<T,1024>& a)
+{ return (a << 2) % 7; }
+}
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Compile time and object size of compile/large_n.cpp with large aggregates
+# fully unrolled against the default loop fallback, as JSON on stdout.
+#
+#   CXX=clang++ ./compile_time.sh > compile_time.json
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=c++11 -O3 -ftemplate-depth=4096}
+DIR=$(dirname "$0")
+OBJ=$(mktemp)
+
+run() {
+  label=$1
+  shift
+  t0=$(date +%s.%N)
+  $CXX $CXXFLAGS -I"$DIR/../include" "$@" -c -o "$OBJ" \
+       "$DIR/compile/large_n.cpp" || exit 1
+  t1=$(date +%s.%N)
+  text=$(size "$OBJ" | awk 'NR == 2 { print $1 }')
+  printf '  {"config": "%s", "seconds": %s, "text_bytes": %s}' \
+         "$label" "$(awk "BEGIN { printf \"%.2f\", $t1 - $t0 }")" "$text"
+}
+
+echo "["
+run "unrolled, recursive sequence" \
+    -DAGG_UNROLL_LIMIT=100000 -DAGG_NO_BUILTIN_SEQUENCE;  echo ","
+run "unrolled, builtin sequence" -DAGG_UNROLL_LIMIT=100000; echo ","
+run "default"; echo
+echo "]"
+rm -f "$OBJ"
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#include "aggregate.hpp"
+
+/** Atomic read-modify-write of aggregates shared between threads.
+ *
+ *  agg::atomic_ref<aggregate<T,N> > refers to an aggregate of arithmetic
+ *  elements, in the manner of C++20 std::atomic_ref, and updates it without
+ *  locks, so threads can scatter into one array instead of guarding every
+ *  bucket with a mutex or keeping a private copy each:
+ *
+ *    std::vector<aggregate<double,3> > force(cells);
+ *    pool.parallel_for(pairs.size(), [&](std::size_t k) {
+ *      agg::atomic_ref<aggregate<double,3> >(force[pairs[k].cell])
+ *          .fetch_add(pairs[k].f, std::memory_order_relaxed);
+ *    });
+ *
+ *  An aggregate of 2, 4 or 8 bytes, or of 16 bytes where the target has a
+ *  double-width compare-and-swap (x86-64 with -mcx16), whose address is a
+ *  multiple of its size, is updated as one word: every operation sees and
+ *  replaces all elements at once. Any other aggregate is updated one
+ *  element at a time: each element changes atomically, but a concurrent
+ *  load may see some elements before an update and others after it.
+ *  whole() tells which applies to the referenced aggregate. Integers add and
+ *  subtract with fetch-and-add instructions, floating-point elements and
+ *  min and max with compare-and-swap loops. A fetch_min or fetch_max that
+ *  changes nothing does not write, except that a 16-byte word is confirmed
+ *  unchanged by a compare-and-swap.
+ *
+ *  Elements must be lock-free on their own, which rules out long double on
+ *  x86-64, where the builtins would call into libatomic and its locks.
+ *
+ *  Every access to the aggregate while atomic_refs to it exist must go
+ *  through an atomic_ref. The operations use the GCC __atomic and __sync
+ *  builtins.
+ */
+
+namespace agg {
+
+namespace detail {
+
+/** The unsigned word of Size bytes that an aggregate of that size updates
+ *  as, if any.
+ */
+template <std::size_t Size>
+struct atomic_word : std::false_type {};
+template <>
+struct atomic_word<2> : std::true_type {
+  typedef std::uint16_t __attribute__((__may_alias__)) type;
+};
+template <>
+struct atomic_word<4> : std::true_type {
+  typedef std::uint32_t __attribute__((__may_alias__)) type;
+};
+template <>
+struct atomic_word<8> : std::true_type {
+  typedef std::uint64_t __attribute__((__may_alias__)) type;
+};
+#if defined(__SIZEOF_INT128__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+template <>
+struct atomic_word<16> : std::true_type {
+  typedef unsigned __int128 __attribute__((__may_alias__)) type;
+};
+#endif
+
+//! The order of the load of a failed compare-and-swap under order
+constexpr int
+atomic_failure(int order) {
+  return order == __ATOMIC_ACQ_REL ? __ATOMIC_ACQUIRE
+       : order == __ATOMIC_RELEASE ? __ATOMIC_RELAXED
+       : order;
+}
+
+template <typename W>
+inline W
+atomic_word_load(W* p, int order) {
+  return __atomic_load_n(p, order);
+}
+
+//! The word at p, to start a compare-and-swap loop with, and whether it was
+//! read at once
+template <typename W>
+inline bool
+atomic_word_peek(W* p, W& w, int order) {
+  w = __atomic_load_n(p, order);
+  return true;
+}
+
+template <typename W>
+inline bool
+atomic_word_cas(W* p, W& expected, W desired, int order) {
+  return __atomic_compare_exchange_n(p, &expected, desired, true, order,
+                                     atomic_failure(order));
+}
+
+#if defined(__SIZEOF_INT128__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+// GCC sends 16-byte __atomic builtins to libatomic; the __sync ones emit
+// lock cmpxchg16b, which is a full barrier
+inline unsigned __int128
+atomic_word_load(unsigned __int128* p, int) {
+  return __sync_val_compare_and_swap(p, 0, 0);
+}
+
+// Reading halves saves a lock cmpxchg16b; a torn value fails the first
+// compare-and-swap
+inline bool
+atomic_word_peek(unsigned __int128* p, unsigned __int128& w, int) {
+  typedef atomic_word<8>::type H;
+  H h[2];
+  h[0] = __atomic_load_n(reinterpret_cast<H*>(p), __ATOMIC_RELAXED);
+  h[1] = __atomic_load_n(reinterpret_cast<H*>(p) + 1, __ATOMIC_RELAXED);
+  std::memcpy(&w, h, sizeof(w));
+  return false;
+}
+
+inline bool
+atomic_word_cas(unsigned __int128* p, unsigned __int128& expected,
+                unsigned __int128 desired, int) {
+  unsigned __int128 x = __sync_val_compare_and_swap(p, expected, desired);
+  bool done = x == expected;
+  expected = x;
+  return done;
+}
+#endif
+
+
+// Updates of atomic_ref: set r to the new value of x and v, and return
+// whether it differs from x
+
+struct atomic_plus {
+  template <typename T>
+  bool operator()(T x, T v, T& r) const { r = T(x + v); return true; }
+};
+struct atomic_minus {
+  template <typename T>
+  bool operator()(T x, T v, T& r) const { r = T(x - v); return true; }
+};
+struct atomic_min {
+  template <typename T>
+  bool operator()(T x, T v, T& r) const { r = v < x ? v : x; return v < x; }
+};
+struct atomic_max {
+  template <typename T>
+  bool operator()(T x, T v, T& r) const { r = x < v ? v : x; return x < v; }
+};
+struct atomic_set {
+  template <typename T>
+  bool operator()(T, T v, T& r) const { r = v; return true; }
+};
+
+//! Update the element at p with v by op, returning its previous value
+template <typename T, typename Op>
+inline T
+atomic_element(T* p, T v, Op op, int order) {
+  T x, r;
+  __atomic_load(p, &x, atomic_failure(order));
+  while (op(x, v, r) &&
+         !__atomic_compare_exchange(p, &x, &r, true, order,
+                                    atomic_failure(order))) {}
+  return x;
+}
+
+template <typename T>
+inline enable_if<std::is_integral<T>, T>
+atomic_element(T* p, T v, atomic_plus, int order) {
+  return __atomic_fetch_add(p, v, order);
+}
+
+template <typename T>
+inline enable_if<std::is_integral<T>, T>
+atomic_element(T* p, T v, atomic_minus, int order) {
+  return __atomic_fetch_sub(p, v, order);
+}
+
+template <typename T>
+inline T
+atomic_element(T* p, T v, atomic_set, int order) {
+  T x;
+  __atomic_exchange(p, &v, &x, order);
+  return x;
+}
+
+//! Update a element by element with v by op, returning its previous value
+template <typename T, std::size_t N, typename Op>
+inline aggregate<T,N>
+atomic_elements(aggregate<T,N>& a, const aggregate<T,N>& v, Op op,
+                int order) {
+  aggregate<T,N> x = {};
+  for (std::size_t i = 0; i < N; ++i)
+    x[i] = atomic_element(a.data() + i, v[i], op, order);
+  return x;
+}
+
+//! Update a as one word with v by op, returning its previous value
+template <typename T, std::size_t N, typename Op>
+inline aggregate<T,N>
+atomic_whole(aggregate<T,N>& a, const aggregate<T,N>& v, Op op, int order) {
+  typedef typename atomic_word<sizeof(aggregate<T,N>)>::type W;
+  W* p = reinterpret_cast<W*>(a.data());
+  W w;
+  const bool exact = atomic_word_peek(p, w, atomic_failure(order));
+  for (;;) {
+    aggregate<T,N> x, r;
+    std::memcpy(x.data(), &w, sizeof(W));
+    r = x;
+    bool change = false;
+    for (std::size_t i = 0; i < N; ++i)
+      change |= op(x[i], v[i], r[i]);
+    if (!change && exact)
+      return x;
+    W u;
+    std::memcpy(&u, r.data(), sizeof(W));
+    if (atomic_word_cas(p, w, u, order))
+      return x;
+  }
+}
+
+} // end namespace detail
+
+
+template <typename A>
+class atomic_ref;
+
+/** @brief Atomic operations on an aggregate<T,N> of arithmetic elements
+ *  that it refers to.
+ *
+ *  The fetch_ operations return the previous value; += and -= return the
+ *  new one.
+ */
+template <typename T, std::size_t N>
+class atomic_ref<aggregate<T,N> > {
+  static_assert(std::is_arithmetic<T>::value &&
+                !std::is_same<T, bool>::value &&
+                __atomic_always_lock_free(sizeof(T), 0),
+                "atomic_ref needs arithmetic elements that are lock-free");
+
+  typedef detail::atomic_word<sizeof(aggregate<T,N>)> _Word;
+
+ public:
+  typedef aggregate<T,N> value_type;
+
+  static constexpr bool is_always_lock_free = true;
+
+  //! The alignment at which aggregates update as one word, or 0 if they
+  //! never do
+  static constexpr std::size_t word_alignment
+      = _Word::value ? sizeof(value_type) : 0;
+
+  explicit atomic_ref(value_type& a) noexcept
+      : _ptr(std::addressof(a)),
+        _whole(word_alignment &&
+               reinterpret_cast<std::uintptr_t>(_ptr) % sizeof(value_type)
+               == 0) {}
+
+  atomic_ref(const atomic_ref&) noexcept = default;
+  atomic_ref& operator=(const atomic_ref&) = delete;
+
+  bool
+  is_lock_free() const noexcept
+  { return true; }
+
+  //! Whether every operation reads and writes all elements at once
+  bool
+  whole() const noexcept
+  { return _whole; }
+
+  value_type
+  load(std::memory_order order = std::memory_order_seq_cst) const noexcept {
+    return load(int(order), std::integral_constant<bool, _Word::value>());
+  }
+
+  operator value_type() const noexcept
+  { return load(); }
+
+  void
+  store(const value_type& v,
+        std::memory_order order = std::memory_order_seq_cst) const noexcept
+  { update(v, detail::atomic_set(), order); }
+
+  value_type
+  operator=(const value_type& v) const noexcept
+  { store(v); return v; }
+
+  value_type
+  exchange(const value_type& v,
+           std::memory_order order = std::memory_order_seq_cst) const noexcept
+  { return update(v, detail::atomic_set(), order); }
+
+  value_type
+  fetch_add(const value_type& v,
+            std::memory_order order = std::memory_order_seq_cst) const noexcept
+  { return update(v, detail::atomic_plus(), order); }
+
+  value_type
+  fetch_sub(const value_type& v,
+            std::memory_order order = std::memory_order_seq_cst) const noexcept
+  { return update(v, detail::atomic_minus(), order); }
+
+  //! Replace every element with the lesser of it and that of v
+  value_type
+  fetch_min(const value_type& v,
+            std::memory_order order = std::memory_order_seq_cst) const noexcept
+  { return update(v, detail::atomic_min(), order); }
+
+  //! Replace every element with the greater of it and that of v
+  value_type
+  fetch_max(const value_type& v,
+            std::memory_order order = std::memory_order_seq_cst) const noexcept
+  { return update(v, detail::atomic_max(), order); }
+
+  value_type
+  operator+=(const value_type& v) const noexcept
+  { return fetch_add(v) + v; }
+
+  value_type
+  operator-=(const value_type& v) const noexcept
+  { return fetch_sub(v) - v; }
+
+ private:
+  value_type
+  load(int order, std::true_type) const noexcept {
+    if (!_whole)
+      return load(order, std::false_type());
+    typedef typename _Word::type W;
+    W w = detail::atomic_word_load(reinterpret_cast<W*>(_ptr->data()), order);
+    value_type x;
+    std::memcpy(x.data(), &w, sizeof(W));
+    return x;
+  }
+
+  value_type
+  load(int order, std::false_type) const noexcept {
+    value_type x = {};
+    for (std::size_t i = 0; i < N; ++i)
+      __atomic_load(_ptr->data() + i, x.data() + i, order);
+    return x;
+  }
+
+  template <typename Op>
+  value_type
+  update(const value_type& v, Op op, std::memory_order order) const noexcept {
+    return update(v, op, int(order),
+                  std::integral_constant<bool, _Word::value>());
+  }
+
+  template <typename Op>
+  value_type
+  update(const value_type& v, Op op, int order,
+         std::true_type) const noexcept {
+    return _whole ? detail::atomic_whole(*_ptr, v, op, order)
+                  : detail::atomic_elements(*_ptr, v, op, order);
+  }
+
+  template <typename Op>
+  value_type
+  update(const value_type& v, Op op, int order,
+         std::false_type) const noexcept {
+    return detail::atomic_elements(*_ptr, v, op, order);
+  }
+
+  value_type* _ptr;
+  bool _whole;
+};
+
+} // end namespace agg
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <iterator>
+
+#include "aggregate.hpp"
+#include "agg_matrix.hpp"
+
+/** Batched small-matrix operations over ranges of nested aggregates.
+ *
+ *  agg::batch_matmul, agg::batch_matvec and agg::batch_inverse apply
+ *  matmul, matvec and inverse to every element of a range, like
+ *  std::transform:
+ *
+ *    std::vector<agg::matrix<float,4,4> > m(n);
+ *    std::vector<aggregate<float,4> > p(n), q(n);
+ *    agg::batch_matvec(m.begin(), m.end(), p.begin(), q.begin());
+ *
+ *  Elements are processed in blocks of W, detail::batch_width for the
+ *  operation and element type. A block is interleaved into a matrix of
+ *  aggregate<T,W> lanes, lane w holding element w of the block, so the
+ *  matrix kernel runs once per block and each of its operations is one
+ *  element-wise operation across the block. The result is scattered back
+ *  before the next block is read, so a block stays in cache throughout.
+ *  Elements past the last whole block go through the one-at-a-time kernels,
+ *  as do all elements when W is 1.
+ *
+ *  W defaults to AGG_BATCH_WIDTH. With AGG_SIMD (see agg_simd.hpp), float
+ *  and double rows of 3 or 4 elements are interleaved with register
+ *  transposes, a register of lanes at a time, and the operations that
+ *  measured no faster batched are left to the one-at-a-time kernels.
+ *
+ *  The iterators must be random-access. The output may be the first input
+ *  range; it may not otherwise overlap the inputs.
+ */
+
+#if !defined(AGG_BATCH_WIDTH)
+#define AGG_BATCH_WIDTH 8
+#endif
+
+namespace agg {
+
+namespace detail {
+
+//! Elements interleaved from blocks of W values of X
+template <typename X, std::size_t W>
+struct batch_lanes {
+  typedef aggregate<X,W> type;
+};
+template <typename T, std::size_t N, std::size_t W>
+struct batch_lanes<aggregate<T,N>,W> {
+  typedef aggregate<typename batch_lanes<T,W>::type,N> type;
+};
+
+//! The scalar elements of a nested aggregate
+template <typename X>
+struct batch_scalar {
+  typedef X type;
+};
+template <typename T, std::size_t N>
+struct batch_scalar<aggregate<T,N> > : batch_scalar<T> {};
+
+//! Lane w of r = x
+template <typename X, std::size_t W>
+inline void
+batch_put(aggregate<X,W>& r, const X& x, std::size_t w) {
+  r[w] = x;
+}
+template <typename L, typename T, std::size_t N>
+inline void
+batch_put(aggregate<L,N>& r, const aggregate<T,N>& x, std::size_t w) {
+  for (std::size_t i = 0; i < N; ++i)
+    batch_put(r[i], x[i], w);
+}
+
+//! x = lane w of r
+template <typename X, std::size_t W>
+inline void
+batch_get(const aggregate<X,W>& r, X& x, std::size_t w) {
+  x = r[w];
+}
+template <typename L, typename T, std::size_t N>
+inline void
+batch_get(const aggregate<L,N>& r, aggregate<T,N>& x, std::size_t w) {
+  for (std::size_t i = 0; i < N; ++i)
+    batch_get(r[i], x[i], w);
+}
+
+/** Interleave W consecutive values of X into batch_lanes<X,W>::type and
+ *  scatter them back. agg_simd.hpp specializes it for register rows.
+ */
+template <typename X, std::size_t W, typename Enable = void>
+struct batch_kernel {
+  typedef typename batch_lanes<X,W>::type lanes;
+
+  template <typename It>
+  static lanes load(It it) {
+    lanes r;
+    for (std::size_t w = 0; w < W; ++w)
+      batch_put(r, it[w], w);
+    return r;
+  }
+
+  template <typename It>
+  static void store(const lanes& r, It it) {
+    for (std::size_t w = 0; w < W; ++w)
+      batch_get(r, it[w], w);
+  }
+};
+
+//! The matrix operations, as function objects
+struct matmul_fn {
+  template <typename A, typename B>
+  auto operator()(const A& a, const B& b) const
+      -> decltype(matmul(a, b)) {
+    return matmul(a, b);
+  }
+};
+struct matvec_fn {
+  template <typename A, typename X>
+  auto operator()(const A& a, const X& x) const
+      -> decltype(matvec(a, x)) {
+    return matvec(a, x);
+  }
+};
+struct inverse_fn {
+  template <typename A>
+  auto operator()(const A& a) const
+      -> decltype(inverse(a)) {
+    return inverse(a);
+  }
+};
+
+/** Number of values of X interleaved at once for Fn.
+ *  A width of 1 applies Fn one value at a time.
+ */
+template <typename Fn, typename X, typename Enable = void>
+struct batch_width
+    : std::integral_constant<std::size_t, AGG_BATCH_WIDTH> {};
+
+#if defined(AGG_SIMD)
+
+/** Float and double matrices are interleaved a register at a time, for
+ *  inverse with rows of 3 or 4 elements only. matmul and matvec already
+ *  work on register rows one at a time, and the smaller inverses are a
+ *  handful of operations; interleaving measured slower for all of them.
+ */
+template <typename Fn, typename T, std::size_t M, std::size_t N>
+struct batch_width<Fn, matrix<T,M,N>, enable_if<simd_row<T,4>, void> >
+    : std::integral_constant<std::size_t,
+          std::is_same<Fn,inverse_fn>::value && simd_row<T,N>::value
+          ? simd_reg<typename simd_kind<T>::type, AGG_SIMD_BYTES>::lanes
+          : 1> {};
+
+/** Rows of N elements of W values: the row of value 4*g + w in quad g of
+ *  register w, then transpose4.
+ */
+template <typename T, std::size_t N>
+struct batch_rows {
+  typedef simd_row<T,N> V;
+  typedef simd_reg<typename simd_kind<T>::type, AGG_SIMD_BYTES> S;
+  typedef typename S::quad Q;
+  static constexpr std::size_t W = S::lanes;
+  static constexpr std::size_t G = S::quads;
+  typedef aggregate<aggregate<T,W>,N> lanes;
+
+  //! Row i of a value
+  static const aggregate<T,N>& row(const aggregate<T,N>& a, std::size_t) {
+    return a;
+  }
+  template <std::size_t M>
+  static const aggregate<T,N>& row(const matrix<T,M,N>& a, std::size_t i) {
+    return a[i];
+  }
+  static aggregate<T,N>& row(aggregate<T,N>& a, std::size_t) {
+    return a;
+  }
+  template <std::size_t M>
+  static aggregate<T,N>& row(matrix<T,M,N>& a, std::size_t i) {
+    return a[i];
+  }
+
+  //! r[j][w] = row i of it[w], element j
+  template <typename It>
+  static void load(lanes& r, It it, std::size_t i) {
+    typename S::type v[4];
+    for (std::size_t w = 0; w < 4; ++w) {
+      typename Q::type q[G];
+      for (std::size_t g = 0; g < G; ++g)
+        q[g] = V::load(row(it[4*g + w], i));
+      v[w] = S::join(q);
+    }
+    S::transpose4(v[0], v[1], v[2], v[3]);
+    for (std::size_t j = 0; j < N; ++j)
+      S::store(r[j].data(), v[j]);
+  }
+
+  //! Row i of it[w], element j = r[j][w]
+  template <typename It>
+  static void store(const lanes& r, It it, std::size_t i) {
+    typename S::type v[4];
+    for (std::size_t j = 0; j < N; ++j)
+      v[j] = S::load(r[j].data());
+    for (std::size_t j = N; j < 4; ++j)
+      v[j] = S::set1(T());
+    S::transpose4(v[0], v[1], v[2], v[3]);
+    for (std::size_t w = 0; w < 4; ++w) {
+      typename Q::type q[G];
+      S::split(v[w], q);
+      for (std::size_t g = 0; g < G; ++g)
+        V::store(row(it[4*g + w], i), q[g]);
+    }
+  }
+};
+
+//! Whether blocks of W values with rows of N elements of T go by batch_rows
+template <typename T, std::size_t N, std::size_t W, typename Enable = void>
+struct batch_by_rows : std::false_type {};
+template <typename T, std::size_t N, std::size_t W>
+struct batch_by_rows<T,N,W, enable_if<simd_row<T,N>, void> >
+    : std::integral_constant<bool, W == batch_rows<T,N>::W> {};
+
+template <typename T, std::size_t N, std::size_t W>
+struct batch_kernel<aggregate<T,N>, W,
+                    enable_if<batch_by_rows<T,N,W>, void> > {
+  typedef batch_rows<T,N> rows;
+  typedef typename rows::lanes lanes;
+
+  template <typename It>
+  static lanes load(It it) {
+    lanes r;
+    rows::load(r, it, 0);
+    return r;
+  }
+
+  template <typename It>
+  static void store(const lanes& r, It it) {
+    rows::store(r, it, 0);
+  }
+};
+
+template <typename T, std::size_t M, std::size_t N, std::size_t W>
+struct batch_kernel<matrix<T,M,N>, W,
+                    enable_if<batch_by_rows<T,N,W>, void> > {
+  typedef batch_rows<T,N> rows;
+  typedef aggregate<typename rows::lanes,M> lanes;
+
+  template <typename It>
+  static lanes load(It it) {
+    lanes r;
+    for (std::size_t i = 0; i < M; ++i)
+      rows::load(r[i], it, i);
+    return r;
+  }
+
+  template <typename It>
+  static void store(const lanes& r, It it) {
+    for (std::size_t i = 0; i < M; ++i)
+      rows::store(r[i], it, i);
+  }
+};
+
+#endif // AGG_SIMD
+
+template <typename It>
+using batch_value_t = typename std::iterator_traits<It>::value_type;
+
+//! d_first[i] = f(first1[i], first2[i]) in blocks of W
+template <std::size_t W, typename Fn, typename InputIt1, typename InputIt2,
+          typename OutputIt>
+inline OutputIt
+batch_transform(Fn f, InputIt1 first1, InputIt1 last1, InputIt2 first2,
+                OutputIt d_first) {
+  typedef batch_value_t<InputIt1> A;
+  typedef batch_value_t<InputIt2> B;
+  typedef decltype(f(std::declval<const A&>(), std::declval<const B&>())) R;
+  for (; W > 1 && last1 - first1 >= std::ptrdiff_t(W);
+       first1 += W, first2 += W, d_first += W)
+    batch_kernel<R,W>::store(f(batch_kernel<A,W>::load(first1),
+                               batch_kernel<B,W>::load(first2)), d_first);
+  for (; first1 != last1; ++first1, ++first2, ++d_first)
+    *d_first = f(*first1, *first2);
+  return d_first;
+}
+
+//! d_first[i] = f(first[i]) in blocks of W
+template <std::size_t W, typename Fn, typename InputIt, typename OutputIt>
+inline OutputIt
+batch_transform(Fn f, InputIt first, InputIt last, OutputIt d_first) {
+  typedef batch_value_t<InputIt> A;
+  typedef decltype(f(std::declval<const A&>())) R;
+  for (; W > 1 && last - first >= std::ptrdiff_t(W);
+       first += W, d_first += W)
+    batch_kernel<R,W>::store(f(batch_kernel<A,W>::load(first)), d_first);
+  for (; first != last; ++first, ++d_first)
+    *d_first = f(*first);
+  return d_first;
+}
+
+} // end namespace detail
+
+
+/** d_first[i] = matmul(first1[i], first2[i]) for i in [0, last1 - first1)
+ *  @return The end of the output range
+ */
+template <typename InputIt1, typename InputIt2, typename OutputIt>
+inline OutputIt
+batch_matmul(InputIt1 first1, InputIt1 last1, InputIt2 first2,
+             OutputIt d_first) {
+  typedef detail::batch_value_t<InputIt1> A;
+  return detail::batch_transform<
+      detail::batch_width<detail::matmul_fn, A>::value>(
+          detail::matmul_fn(), first1, last1, first2, d_first);
+}
+
+/** d_first[i] = matvec(first1[i], first2[i]) for i in [0, last1 - first1)
+ *  @return The end of the output range
+ */
+template <typename InputIt1, typename InputIt2, typename OutputIt>
+inline OutputIt
+batch_matvec(InputIt1 first1, InputIt1 last1, InputIt2 first2,
+             OutputIt d_first) {
+  typedef detail::batch_value_t<InputIt1> A;
+  return detail::batch_transform<
+      detail::batch_width<detail::matvec_fn, A>::value>(
+          detail::matvec_fn(), first1, last1, first2, d_first);
+}
+
+/** d_first[i] = inverse(first[i]) for i in [0, last - first)
+ *  @return The end of the output range
+ */
+template <typename InputIt, typename OutputIt>
+inline OutputIt
+batch_inverse(InputIt first, InputIt last, OutputIt d_first) {
+  typedef detail::batch_value_t<InputIt> A;
+  return detail::batch_transform<
+      detail::batch_width<detail::inverse_fn, A>::value>(
+          detail::inverse_fn(), first, last, d_first);
+}
+
+} // end namespace agg
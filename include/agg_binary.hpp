@@ -0,0 +1,568 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define AGG_HAVE_MMAP 1
+#endif
+
+#include "aggregate.hpp"
+
+/** Binary files of aggregates.
+ *
+ *  A file holds a contiguous range of aggregate<T,N> byte for byte as it
+ *  lies in memory, padding lanes included but written as zeros, after an
+ *  agg::binary_header recording the kind and size of T, N, the size and
+ *  alignment of one aggregate, the byte order and the count:
+ *
+ *    std::ofstream out("points.agg", std::ios::binary);
+ *    agg::binary_writer<float,3> w(out);
+ *    w.write(points.data(), points.size());
+ *    w.close();
+ *
+ *    std::ifstream in("points.agg", std::ios::binary);
+ *    agg::binary_reader<float,3> r(in);
+ *    std::vector<aggregate<float,3> > back(r.size());
+ *    r.read(back.data(), back.size());
+ *
+ *    agg::mapped_array<float,3> m("points.agg");  // no parsing, no copy
+ *    float x = m[i][0];
+ *
+ *  Writers and readers stream any number of aggregates per call. A writer
+ *  records the count when closed if its stream can seek and otherwise
+ *  leaves it unknown, for readers to read to the end of the stream.
+ *  Readers byte-swap the elements of files written with the other byte
+ *  order; a mapped_array cannot and rejects them. Files that do not hold
+ *  aggregate<T,N> raise agg::binary_error.
+ *
+ *  Files whose header names an encoding, such as the compressed files of
+ *  agg_packed.hpp, are read by their own readers.
+ *
+ *  T must be trivially copyable. mapped_array requires mmap.
+ */
+
+namespace agg {
+
+//! Raised on malformed, mismatched or truncated binary files and on I/O
+//! failures
+struct binary_error : std::runtime_error {
+  explicit binary_error(const std::string& what)
+      : std::runtime_error("agg binary: " + what) {}
+};
+
+
+namespace detail {
+
+//! The arithmetic type that aggregates of T are made of, void if none
+template <typename T>
+struct binary_scalar {
+  typedef typename std::conditional<std::is_arithmetic<T>::value,
+                                    T, void>::type type;
+};
+template <typename T, std::size_t N>
+struct binary_scalar<aggregate<T,N> > : binary_scalar<T> {};
+
+//! Size of the words a byte-order conversion reverses
+template <typename S>
+struct binary_word : std::integral_constant<std::size_t, sizeof(S)> {};
+template <>
+struct binary_word<void> : std::integral_constant<std::size_t, 1> {};
+
+//! 'b'ool, 'f'loating, 'i'nteger, 'u'nsigned or opaque 'x'
+template <typename S>
+struct binary_kind
+    : std::integral_constant<char,
+        std::is_same<S,bool>::value        ? 'b' :
+        std::is_floating_point<S>::value   ? 'f' :
+        std::is_signed<S>::value           ? 'i' :
+        std::is_unsigned<S>::value         ? 'u' : 'x'> {};
+
+//! Reverse the byte order of every size-byte word of [p, p+bytes)
+inline void
+binary_swap(void* p, std::size_t bytes, std::size_t size) {
+  unsigned char* c = static_cast<unsigned char*>(p);
+  for (std::size_t i = 0; i + size <= bytes; i += size)
+    std::reverse(c + i, c + i + size);
+}
+
+template <typename T>
+inline void
+binary_swap(T& t) {
+  binary_swap(&t, sizeof(T), sizeof(T));
+}
+
+//! Whether aggregates of T, at any depth, have padding lanes
+template <typename T>
+struct binary_padded : std::false_type {};
+template <typename T, std::size_t N>
+struct binary_padded<aggregate<T,N> >
+    : std::integral_constant<bool, binary_padded<T>::value ||
+                                   sizeof(aggregate<T,N>) != N * sizeof(T)> {};
+
+//! Copy the elements of t to p, skipping the padding lanes
+template <typename T>
+inline void
+binary_copy_elements(unsigned char* p, const T& t) {
+  std::memcpy(p, std::addressof(t), sizeof(T));
+}
+template <typename T, std::size_t N>
+inline void
+binary_copy_elements(unsigned char* p, const aggregate<T,N>& a) {
+  for (std::size_t i = 0; i < N; ++i)
+    binary_copy_elements(p + i * sizeof(T), a[i]);
+}
+
+} // end namespace detail
+
+
+/** The 64 bytes at the start of a binary file of aggregates, in the byte
+ *  order of the machine that wrote it.
+ */
+struct binary_header {
+  static constexpr std::uint32_t current_version = 2;
+  static constexpr std::uint32_t native_order = 0x01020304;
+  static constexpr std::uint64_t unknown_count = ~std::uint64_t(0);
+  static constexpr char raw_encoding = '\0';
+  static constexpr char packed_encoding = 'p';
+
+  char          magic[8];      //!< "AGGBIN\0\0"
+  std::uint32_t version;       //!< 1, or 2 for files with an encoding
+  std::uint32_t byte_order;    //!< native_order, as the writer stored it
+  char          kind;          //!< detail::binary_kind of the scalars of T
+  char          encoding;      //!< raw_encoding, or packed_encoding
+  char          reserved[2];
+  std::uint32_t element_size;  //!< sizeof(T)
+  std::uint64_t extent;        //!< N
+  std::uint64_t stride;        //!< sizeof(aggregate<T,N>), with any padding
+  std::uint64_t alignment;     //!< alignof(aggregate<T,N>)
+  std::uint64_t data_offset;   //!< Offset of the first aggregate in the file
+  std::uint64_t count;         //!< Number of aggregates, or unknown_count
+
+  //! The header of count aggregate<T,N>
+  template <typename T, std::size_t N>
+  static binary_header
+  make(std::uint64_t count = unknown_count) {
+    typedef aggregate<T,N> value_type;
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "binary files hold trivially copyable elements");
+    binary_header h = {};
+    std::memcpy(h.magic, "AGGBIN\0", 8);
+    h.version = 1;
+    h.byte_order = native_order;
+    h.kind = detail::binary_kind<
+        typename detail::binary_scalar<T>::type>::value;
+    h.element_size = sizeof(T);
+    h.extent = N;
+    h.stride = sizeof(value_type);
+    h.alignment = alignof(value_type);
+    h.data_offset = (sizeof(binary_header) + alignof(value_type) - 1)
+                    / alignof(value_type) * alignof(value_type);
+    h.count = count;
+    return h;
+  }
+
+  //! Whether the file was written with the other byte order
+  bool
+  swapped() const
+  { return byte_order != native_order; }
+
+  //! Convert the fields from the other byte order
+  void
+  swap_bytes() {
+    detail::binary_swap(version);
+    detail::binary_swap(byte_order);
+    detail::binary_swap(element_size);
+    detail::binary_swap(extent);
+    detail::binary_swap(stride);
+    detail::binary_swap(alignment);
+    detail::binary_swap(data_offset);
+    detail::binary_swap(count);
+  }
+
+  /** The header at bytes with its fields in native byte order. Its
+   *  byte_order is left as written, for swapped() to tell whether the
+   *  elements still need converting.
+   */
+  static binary_header
+  parse(const void* bytes) {
+    binary_header h;
+    std::memcpy(&h, bytes, sizeof(h));
+    if (std::memcmp(h.magic, "AGGBIN\0", 8) != 0)
+      throw binary_error("not a binary file of aggregates");
+    if (h.byte_order != native_order) {
+      h.swap_bytes();
+      if (h.byte_order != native_order)
+        throw binary_error("unknown byte order");
+      h.byte_order = 0x04030201;
+    }
+    if (h.version == 0 || h.version > current_version)
+      throw binary_error("unsupported version " + std::to_string(h.version));
+    return h;
+  }
+
+  //! Throw unless the file holds aggregates of N elements of type T
+  template <typename T, std::size_t N>
+  void
+  check_elements() const {
+    binary_header e = make<T,N>();
+    if (kind != e.kind || element_size != e.element_size)
+      throw binary_error(std::string("element type is '") + kind + "' of "
+                         + std::to_string(element_size) + " bytes, not '"
+                         + e.kind + "' of "
+                         + std::to_string(e.element_size) + " bytes");
+    if (extent != e.extent)
+      throw binary_error("aggregates of " + std::to_string(extent)
+                         + " elements, not " + std::to_string(e.extent));
+  }
+
+  //! Throw unless the file holds aggregate<T,N> as laid out in memory here
+  template <typename T, std::size_t N>
+  void
+  check() const {
+    check_elements<T,N>();
+    binary_header e = make<T,N>();
+    if (stride != e.stride)
+      throw binary_error("aggregates of " + std::to_string(stride)
+                         + " bytes, not " + std::to_string(e.stride));
+    if (data_offset < sizeof(binary_header) || data_offset % e.alignment)
+      throw binary_error("misaligned data offset "
+                         + std::to_string(data_offset));
+  }
+};
+
+static_assert(sizeof(binary_header) == 64, "the header is 64 bytes");
+
+
+/** @brief Writes aggregate<T,N> to a binary stream, which should be opened
+ *  with std::ios::binary.
+ *
+ *  The header goes out on construction, with the count unknown; close()
+ *  seeks back to record it when the stream allows.
+ */
+template <typename T, std::size_t N>
+class binary_writer {
+ public:
+  typedef aggregate<T,N> value_type;
+
+  explicit binary_writer(std::ostream& os)
+      : _os(os), _start(os.tellp()) {
+    binary_header h = binary_header::make<T,N>();
+    put(&h, sizeof(h));
+    static const char zeros[alignof(value_type)] = {};
+    put(zeros, h.data_offset - sizeof(h));
+  }
+
+  binary_writer(const binary_writer&) = delete;
+  binary_writer& operator=(const binary_writer&) = delete;
+
+  //! Closes, but cannot report errors; call close() to see them
+  ~binary_writer() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  //! Append the n aggregates at p
+  void
+  write(const value_type* p, std::size_t n) {
+    put(p, n, detail::binary_padded<value_type>());
+    _count += n;
+  }
+
+  void
+  write(const value_type& a)
+  { write(std::addressof(a), 1); }
+
+  //! Append [first, last)
+  template <typename InputIt>
+  void
+  write(InputIt first, InputIt last) {
+    for ( ; first != last; ++first)
+      write(*first);
+  }
+
+  //! Number of aggregates written
+  std::uint64_t
+  count() const noexcept
+  { return _count; }
+
+  //! Record the count if the stream can seek, and flush
+  void
+  close() {
+    if (_closed)
+      return;
+    _closed = true;
+    if (_start != std::streampos(-1)) {
+      std::streampos end = _os.tellp();
+      _os.seekp(_start + std::streamoff(offsetof(binary_header, count)));
+      put(&_count, sizeof(_count));
+      _os.seekp(end);
+    }
+    _os.flush();
+    if (!_os)
+      throw binary_error("write failed");
+  }
+
+ private:
+  void
+  put(const void* p, std::size_t bytes) {
+    if (!_os.write(static_cast<const char*>(p), std::streamsize(bytes)))
+      throw binary_error("write failed");
+  }
+
+  void
+  put(const value_type* p, std::size_t n, std::false_type) {
+    put(p, n * sizeof(value_type));
+  }
+
+  //! The padding lanes may be indeterminate; copy the elements into a
+  //! zeroed block at a time instead
+  void
+  put(const value_type* p, std::size_t n, std::true_type) {
+    static constexpr std::size_t block
+        = sizeof(value_type) < 4096 ? 4096 / sizeof(value_type) : 1;
+    unsigned char buf[block * sizeof(value_type)] = {};
+    while (n) {
+      const std::size_t k = std::min(n, block);
+      for (std::size_t i = 0; i < k; ++i)
+        detail::binary_copy_elements(buf + i * sizeof(value_type), p[i]);
+      put(buf, k * sizeof(value_type));
+      p += k;
+      n -= k;
+    }
+  }
+
+  std::ostream& _os;
+  std::streampos _start;
+  std::uint64_t _count = 0;
+  bool _closed = false;
+};
+
+
+/** @brief Reads aggregate<T,N> from a binary stream, which should be opened
+ *  with std::ios::binary.
+ *
+ *  The header is read and checked on construction.
+ */
+template <typename T, std::size_t N>
+class binary_reader {
+ public:
+  typedef aggregate<T,N> value_type;
+
+  explicit binary_reader(std::istream& is)
+      : _is(is) {
+    char bytes[sizeof(binary_header)];
+    get(bytes, sizeof(bytes), "header");
+    _header = binary_header::parse(bytes);
+    _header.template check<T,N>();
+    if (_header.encoding != binary_header::raw_encoding)
+      throw binary_error("packed file; read it with agg::packed_reader");
+    if (_header.swapped() && _header.kind == 'x')
+      throw binary_error("cannot byte-swap opaque elements");
+    _is.ignore(std::streamsize(_header.data_offset - sizeof(binary_header)));
+  }
+
+  binary_reader(const binary_reader&) = delete;
+  binary_reader& operator=(const binary_reader&) = delete;
+
+  const binary_header&
+  header() const noexcept
+  { return _header; }
+
+  //! Whether the header records the count
+  bool
+  size_known() const noexcept
+  { return _header.count != binary_header::unknown_count; }
+
+  //! Number of aggregates in the file, if size_known()
+  std::uint64_t
+  size() const noexcept
+  { return _header.count; }
+
+  /** Read up to n aggregates into p and return how many were read, fewer
+   *  than n only at the end of the file.
+   */
+  std::size_t
+  read(value_type* p, std::size_t n) {
+    if (size_known())
+      n = std::size_t(std::min<std::uint64_t>(n, _header.count - _read));
+    std::size_t bytes = n * sizeof(value_type);
+    _is.read(reinterpret_cast<char*>(p), std::streamsize(bytes));
+    if (std::size_t(_is.gcount()) != bytes) {
+      bytes = std::size_t(_is.gcount());
+      if (size_known() || bytes % sizeof(value_type))
+        throw binary_error("truncated file");
+      n = bytes / sizeof(value_type);
+    }
+    if (_header.swapped())
+      detail::binary_swap(p, bytes, detail::binary_word<scalar>::value);
+    _read += n;
+    return n;
+  }
+
+  //! Read the next aggregate into a, or return false at the end of the file
+  bool
+  read(value_type& a)
+  { return read(std::addressof(a), 1) == 1; }
+
+ private:
+  typedef typename detail::binary_scalar<T>::type scalar;
+
+  void
+  get(void* p, std::size_t bytes, const char* what) {
+    if (!_is.read(static_cast<char*>(p), std::streamsize(bytes)))
+      throw binary_error(std::string("truncated ") + what);
+  }
+
+  std::istream& _is;
+  binary_header _header;
+  std::uint64_t _read = 0;
+};
+
+
+#if defined(AGG_HAVE_MMAP)
+/** @brief A binary file of aggregate<T,N> mapped read-only into memory and
+ *  used in place as a contiguous array.
+ *
+ *  Opening checks the header and nothing else: pages are read from the
+ *  file as they are first touched.
+ */
+template <typename T, std::size_t N>
+class mapped_array {
+ public:
+  typedef aggregate<T,N>                          value_type;
+  typedef const value_type*                       pointer;
+  typedef const value_type*                       const_pointer;
+  typedef const value_type&                       reference;
+  typedef const value_type&                       const_reference;
+  typedef const value_type*                       iterator;
+  typedef const value_type*                       const_iterator;
+  typedef std::size_t                             size_type;
+  typedef std::ptrdiff_t                          difference_type;
+
+  mapped_array() = default;
+
+  explicit mapped_array(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw binary_error("cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0
+        || std::size_t(st.st_size) < sizeof(binary_header)) {
+      ::close(fd);
+      throw binary_error("truncated header in " + path);
+    }
+    _bytes = std::size_t(st.st_size);
+    _map = ::mmap(nullptr, _bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (_map == MAP_FAILED) {
+      _map = nullptr;
+      throw binary_error("cannot map " + path);
+    }
+
+    try {
+      binary_header h = binary_header::parse(_map);
+      h.template check<T,N>();
+      if (h.encoding != binary_header::raw_encoding)
+        throw binary_error("cannot map a packed file");
+      if (h.swapped())
+        throw binary_error("cannot map a file of the other byte order");
+      if (h.data_offset > _bytes)
+        throw binary_error("truncated file");
+      std::uint64_t fits = (_bytes - h.data_offset) / sizeof(value_type);
+      if (h.count != binary_header::unknown_count && h.count > fits)
+        throw binary_error("truncated file");
+      _size = std::size_t(h.count == binary_header::unknown_count
+                          ? fits : h.count);
+      _data = reinterpret_cast<const value_type*>(
+          static_cast<const char*>(_map) + h.data_offset);
+    } catch (...) {
+      unmap();
+      throw;
+    }
+  }
+
+  mapped_array(mapped_array&& other) noexcept
+  { swap(other); }
+
+  mapped_array&
+  operator=(mapped_array&& other) noexcept {
+    mapped_array(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  ~mapped_array()
+  { unmap(); }
+
+  void
+  swap(mapped_array& other) noexcept {
+    std::swap(_map, other._map);
+    std::swap(_bytes, other._bytes);
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+  }
+
+  // Iterators.
+  const_iterator
+  begin() const noexcept
+  { return _data; }
+
+  const_iterator
+  end() const noexcept
+  { return _data + _size; }
+
+  // Capacity.
+  size_type
+  size() const noexcept
+  { return _size; }
+
+  bool
+  empty() const noexcept
+  { return _size == 0; }
+
+  // Element access.
+  const_reference
+  operator[](size_type n) const noexcept
+  { return _data[n]; }
+
+  const_reference
+  front() const noexcept
+  { return _data[0]; }
+
+  const_reference
+  back() const noexcept
+  { return _data[_size - 1]; }
+
+  const_pointer
+  data() const noexcept
+  { return _data; }
+
+ private:
+  void
+  unmap() noexcept {
+    if (_map)
+      ::munmap(_map, _bytes);
+    _map = nullptr;
+  }
+
+  void* _map = nullptr;
+  std::size_t _bytes = 0;
+  const value_type* _data = nullptr;
+  std::size_t _size = 0;
+};
+#endif
+
+} // end namespace agg
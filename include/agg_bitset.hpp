@@ -0,0 +1,357 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
+
+#include "aggregate.hpp"
+
+#if defined(__BMI2__) && !defined(AGG_NO_SIMD)
+#include <immintrin.h>
+#endif
+
+/** Bit-packed aggregates of bool.
+ *
+ *  agg::bitset_aggregate<N> holds N flags in 64-bit words where
+ *  aggregate<bool,N> spends a byte on each, and runs the bitwise and logical
+ *  operators a word at a time:
+ *
+ *    agg::bitset_aggregate<300> open = {}, seen = {};
+ *    open[17] = true;
+ *    auto next = open & ~seen;               // 5 words, not 300 bytes
+ *    std::size_t n = agg::count(next);       // popcount
+ *
+ *  Like aggregate, it is an aggregate type: bitset_aggregate<N> b = {} is
+ *  all false, and a default-initialized one is indeterminate. Elements are
+ *  reached through operator[], a bit_reference proxy for a mutable
+ *  bitset_aggregate and bool for a const one, or test, set, reset and
+ *  flip. &, |, ^, && and || take two bitset_aggregates or one and a bool
+ *  that applies to every element; ~ and ! flip every element; &=, |= and
+ *  ^= assign. agg::count, any, all and none reduce with popcounts and word
+ *  compares.
+ *
+ *  agg::pack(m) makes a bitset_aggregate of a mask aggregate<bool,N> such
+ *  as agg::cmp_lt returns, 16 bools to a compare with SSE2, and
+ *  agg::unpack(b) makes the mask of it, 8 bools to a pdep with BMI2.
+ *
+ *  The bits of the last word past N are always zero.
+ */
+
+namespace agg {
+
+namespace detail {
+
+//! Number of set bits of w
+inline AGG_CONSTEXPR14 std::size_t
+bit_count(std::uint64_t w) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  w = w - ((w >> 1) & 0x5555555555555555ull);
+  w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+  w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return std::size_t((w * 0x0101010101010101ull) >> 56);
+#else
+  return std::size_t(__builtin_popcountll(w));
+#endif
+}
+
+} // end namespace detail
+
+
+/** @brief Reference to one bit of a bitset_aggregate.
+ */
+class bit_reference {
+ public:
+  AGG_CONSTEXPR14
+  bit_reference(std::uint64_t& w, std::uint64_t bit) noexcept
+      : _w(&w), _bit(bit) {}
+
+  bit_reference(const bit_reference&) = default;
+
+  AGG_CONSTEXPR14 bit_reference&
+  operator=(bool x) noexcept {
+    *_w = x ? *_w | _bit : *_w & ~_bit;
+    return *this;
+  }
+
+  AGG_CONSTEXPR14 bit_reference&
+  operator=(const bit_reference& x) noexcept
+  { return *this = bool(x); }
+
+  constexpr
+  operator bool() const noexcept
+  { return (*_w & _bit) != 0; }
+
+  constexpr bool
+  operator~() const noexcept
+  { return !bool(*this); }
+
+  AGG_CONSTEXPR14 bit_reference&
+  flip() noexcept {
+    *_w ^= _bit;
+    return *this;
+  }
+
+ private:
+  std::uint64_t* _w;
+  std::uint64_t _bit;
+};
+
+
+/**
+ *  @brief N flags packed 64 to a word.
+ *
+ *  @tparam  N  Number of elements.
+ */
+template <std::size_t N>
+struct bitset_aggregate {
+  typedef  bool                                   value_type;
+  typedef  bit_reference                          reference;
+  typedef  bool                                   const_reference;
+  typedef  std::size_t                            size_type;
+  typedef  std::uint64_t                          word_type;
+
+  //! Number of words, one even when N is 0
+  static constexpr size_type words = N ? (N + 63) / 64 : 1;
+  //! The bits of the last word that hold elements
+  static constexpr word_type tail
+      = N % 64 ? (word_type(1) << N % 64) - 1 : N ? ~word_type(0) : 0;
+
+  word_type                                       _words[words];
+
+  // No explicit construct/copy/destroy for aggregate type.
+
+  // Capacity.
+  constexpr size_type
+  size() const noexcept
+  { return N; }
+
+  constexpr bool
+  empty() const noexcept
+  { return N == 0; }
+
+  // Element access.
+  AGG_CONSTEXPR14 reference
+  operator[](size_type n) noexcept
+  { return reference(_words[n / 64], word_type(1) << n % 64); }
+
+  constexpr const_reference
+  operator[](size_type n) const noexcept
+  { return (_words[n / 64] >> n % 64) & 1; }
+
+  constexpr bool
+  test(size_type n) const noexcept
+  { return (*this)[n]; }
+
+  AGG_CONSTEXPR14 bitset_aggregate&
+  set(size_type n, bool x = true) noexcept {
+    (*this)[n] = x;
+    return *this;
+  }
+
+  AGG_CONSTEXPR14 bitset_aggregate&
+  reset(size_type n) noexcept
+  { return set(n, false); }
+
+  AGG_CONSTEXPR14 bitset_aggregate&
+  flip(size_type n) noexcept {
+    (*this)[n].flip();
+    return *this;
+  }
+
+  //! Set every element to x
+  AGG_CONSTEXPR14 void
+  fill(bool x) noexcept {
+    for (size_type i = 0; i < words; ++i)
+      _words[i] = x ? ~word_type(0) : 0;
+    _words[words - 1] &= tail;
+  }
+
+  //! The words, element i in bit i % 64 of word i / 64
+  word_type*
+  data() noexcept
+  { return _words; }
+
+  const word_type*
+  data() const noexcept
+  { return _words; }
+};
+
+
+// Word-wide operators, with either operand possibly a bool for all elements
+
+#define AGG_BITSET_OP(OP,WOP)                                                 \
+  template <std::size_t N>                                                    \
+  inline AGG_CONSTEXPR14 bitset_aggregate<N>                                  \
+  operator OP(const bitset_aggregate<N>& a, const bitset_aggregate<N>& b) {   \
+    bitset_aggregate<N> r = {};                                               \
+    for (std::size_t i = 0; i < r.words; ++i)                                 \
+      r._words[i] = a._words[i] WOP b._words[i];                              \
+    return r;                                                                 \
+  }                                                                           \
+  template <std::size_t N>                                                    \
+  inline AGG_CONSTEXPR14 bitset_aggregate<N>                                  \
+  operator OP(const bitset_aggregate<N>& a, bool b) {                         \
+    bitset_aggregate<N> r = {};                                               \
+    const std::uint64_t w = b ? ~std::uint64_t(0) : 0;                        \
+    for (std::size_t i = 0; i < r.words; ++i)                                 \
+      r._words[i] = a._words[i] WOP w;                                        \
+    r._words[r.words - 1] &= r.tail;                                          \
+    return r;                                                                 \
+  }                                                                           \
+  template <std::size_t N>                                                    \
+  inline AGG_CONSTEXPR14 bitset_aggregate<N>                                  \
+  operator OP(bool a, const bitset_aggregate<N>& b) {                         \
+    return b OP a;                                                            \
+  }
+
+AGG_BITSET_OP(&,  &)
+AGG_BITSET_OP(|,  |)
+AGG_BITSET_OP(^,  ^)
+AGG_BITSET_OP(&&, &)
+AGG_BITSET_OP(||, |)
+#undef AGG_BITSET_OP
+
+#define AGG_BITSET_OP_ASSIGN(OP)                                              \
+  template <std::size_t N>                                                    \
+  inline AGG_CONSTEXPR14 bitset_aggregate<N>&                                 \
+  operator OP##=(bitset_aggregate<N>& a, const bitset_aggregate<N>& b) {      \
+    for (std::size_t i = 0; i < a.words; ++i)                                 \
+      a._words[i] OP##= b._words[i];                                          \
+    return a;                                                                 \
+  }                                                                           \
+  template <std::size_t N>                                                    \
+  inline AGG_CONSTEXPR14 bitset_aggregate<N>&                                 \
+  operator OP##=(bitset_aggregate<N>& a, bool b) {                            \
+    return a = a OP b;                                                        \
+  }
+
+AGG_BITSET_OP_ASSIGN(&)
+AGG_BITSET_OP_ASSIGN(|)
+AGG_BITSET_OP_ASSIGN(^)
+#undef AGG_BITSET_OP_ASSIGN
+
+template <std::size_t N>
+inline AGG_CONSTEXPR14 bitset_aggregate<N>
+operator~(const bitset_aggregate<N>& a) {
+  bitset_aggregate<N> r = {};
+  for (std::size_t i = 0; i < r.words; ++i)
+    r._words[i] = ~a._words[i];
+  r._words[r.words - 1] &= r.tail;
+  return r;
+}
+
+template <std::size_t N>
+inline AGG_CONSTEXPR14 bitset_aggregate<N>
+operator!(const bitset_aggregate<N>& a) {
+  return ~a;
+}
+
+template <std::size_t N>
+inline AGG_CONSTEXPR14 bool
+operator==(const bitset_aggregate<N>& a, const bitset_aggregate<N>& b) {
+  bool same = true;
+  for (std::size_t i = 0; i < a.words; ++i)
+    same &= a._words[i] == b._words[i];
+  return same;
+}
+
+template <std::size_t N>
+inline AGG_CONSTEXPR14 bool
+operator!=(const bitset_aggregate<N>& a, const bitset_aggregate<N>& b) {
+  return !(a == b);
+}
+
+//! Write the elements as 0 and 1, like aggregate<bool,N>
+template <typename CharT, typename Traits, std::size_t N>
+inline std::basic_ostream<CharT,Traits>&
+operator<<(std::basic_ostream<CharT,Traits>& s, const bitset_aggregate<N>& a) {
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i) s << ' ';
+    s << a[i];
+  }
+  return s;
+}
+
+
+// Reductions
+
+//! Number of elements that are true
+template <std::size_t N>
+inline AGG_CONSTEXPR14 std::size_t
+count(const bitset_aggregate<N>& a) {
+  std::size_t n = 0;
+  for (std::size_t i = 0; i < a.words; ++i)
+    n += detail::bit_count(a._words[i]);
+  return n;
+}
+
+//! Whether any element is true
+template <std::size_t N>
+inline AGG_CONSTEXPR14 bool
+any(const bitset_aggregate<N>& a) {
+  std::uint64_t w = 0;
+  for (std::size_t i = 0; i < a.words; ++i)
+    w |= a._words[i];
+  return w != 0;
+}
+
+//! Whether every element is true
+template <std::size_t N>
+inline AGG_CONSTEXPR14 bool
+all(const bitset_aggregate<N>& a) {
+  std::uint64_t w = ~std::uint64_t(0);
+  for (std::size_t i = 0; i + 1 < a.words; ++i)
+    w &= a._words[i];
+  return w == ~std::uint64_t(0) && a._words[a.words - 1] == a.tail;
+}
+
+//! Whether no element is true
+template <std::size_t N>
+inline AGG_CONSTEXPR14 bool
+none(const bitset_aggregate<N>& a) {
+  return !any(a);
+}
+
+
+// Conversions from and to masks
+
+//! The bitset_aggregate of the elements of m
+template <std::size_t N>
+inline bitset_aggregate<N>
+pack(const aggregate<bool,N>& m) {
+  bitset_aggregate<N> r = {};
+  std::size_t i = 0;
+#if defined(AGG_SIMD)
+  unsigned char b[16];
+  for (; i + 16 <= N; i += 16) {
+    std::memcpy(b, m.data() + i, 16);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+    unsigned z = unsigned(_mm_movemask_epi8(
+        _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+    r._words[i / 64] |= std::uint64_t(~z & 0xffffu) << i % 64;
+  }
+#endif
+  for (; i < N; ++i)
+    r._words[i / 64] |= std::uint64_t(m[i]) << i % 64;
+  return r;
+}
+
+//! The mask aggregate<bool,N> of the elements of b
+template <std::size_t N>
+inline aggregate<bool,N>
+unpack(const bitset_aggregate<N>& b) {
+  aggregate<bool,N> r;
+  std::size_t i = 0;
+#if defined(__BMI2__) && !defined(AGG_NO_SIMD)
+  for (; i + 8 <= N; i += 8) {
+    std::uint64_t x = _pdep_u64(b._words[i / 64] >> i % 64,
+                                0x0101010101010101ull);
+    std::memcpy(r.data() + i, &x, 8);
+  }
+#endif
+  for (; i < N; ++i)
+    r[i] = b[i];
+  return r;
+}
+
+} // end namespace agg
@@ -0,0 +1,103 @@
+#pragma once
+
+/** Element-wise comparisons and selection.
+ *
+ *  The comparison operators of aggregates compare lexicographically into a
+ *  single bool. agg::cmp_eq, cmp_ne, cmp_lt, cmp_le, cmp_gt and cmp_ge
+ *  compare element by element instead, into a mask aggregate<bool,N>:
+ *
+ *    aggregate<float,4> v = ...;
+ *    aggregate<bool,4> m = agg::cmp_lt(v, 0.f);
+ *    v = agg::select(m, -v, v);
+ *    std::size_t negative = agg::count(m);
+ *
+ *  Either operand of a comparison may be a scalar that is broadcast to
+ *  every element. agg::select(m, a, b) takes a[i] where m[i] holds and
+ *  b[i] elsewhere, a and b each an aggregate or a scalar. Masks reduce with
+ *  agg::any, agg::all and agg::count.
+ *
+ *  agg_simd.hpp compiles comparisons of float, double and signed integer
+ *  aggregates to register compares and select to blends.
+ */
+
+namespace agg {
+
+namespace fn {
+
+//! a if m, and b otherwise
+struct select {
+  template <class M, class T, class U>
+  auto operator()(const M& m, const T& a, const U& b) const
+      -> decltype(m ? a : b) {
+    return m ? a : b;
+  }
+};
+
+} // end namespace fn
+
+
+namespace detail {
+
+/** r[i] = fn(a[i], b[i]) for a comparison Fn into an aggregate<bool,N>,
+ *  with either operand possibly a broadcast scalar. agg_simd.hpp
+ *  specializes it for arithmetic T.
+ */
+template <typename Fn, typename T, typename U, typename Enable = void>
+struct compare_kernel : map_kernel<Fn,T,U,generic_kernel> {};
+
+} // end namespace detail
+
+
+#define AGG_CMP_OP(NAME,FN)                                                   \
+  template <typename T, typename U, std::size_t N>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    has_##FN<T,U,bool>,                                                       \
+    aggregate<bool,N> >                                                       \
+  NAME(const aggregate<T,N>& a, const aggregate<U,N>& b) {                    \
+    using R = aggregate<bool,N>;                                              \
+    return detail::compare_kernel<fn::FN,T,U>::template map<R>(a, b);         \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##FN<T,U,bool>::value && is_scalar_operand<U>::value>,              \
+    aggregate<bool,N> >                                                       \
+  NAME(const aggregate<T,N>& a, const U& b) {                                 \
+    using R = aggregate<bool,N>;                                              \
+    return detail::compare_kernel<fn::FN,T,U>::template map_right<R>(a, b);   \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##FN<T,U,bool>::value && is_scalar_operand<T>::value>,              \
+    aggregate<bool,N> >                                                       \
+  NAME(const T& a, const aggregate<U,N>& b) {                                 \
+    using R = aggregate<bool,N>;                                              \
+    return detail::compare_kernel<fn::FN,T,U>::template map_left<R>(a, b);    \
+  }
+
+//! a[i] == b[i] element-wise
+AGG_CMP_OP(cmp_eq, equal_to)
+//! a[i] != b[i] element-wise
+AGG_CMP_OP(cmp_ne, not_equal_to)
+//! a[i] < b[i] element-wise
+AGG_CMP_OP(cmp_lt, less)
+//! a[i] <= b[i] element-wise
+AGG_CMP_OP(cmp_le, less_equal)
+//! a[i] > b[i] element-wise
+AGG_CMP_OP(cmp_gt, greater)
+//! a[i] >= b[i] element-wise
+AGG_CMP_OP(cmp_ge, greater_equal)
+#undef AGG_CMP_OP
+
+//! m[i] ? a[i] : b[i] element-wise; see fn::select
+template <typename M, typename A, typename B>
+inline detail::enable_if_fused<fn::select, M, A, B>
+select(const M& m, const A& a, const B& b) {
+  return detail::fused_map<fn::select>(m, a, b);
+}
+
+} // end namespace agg
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#if defined(__BMI2__) && !defined(AGG_NO_SIMD)
+#include <immintrin.h>
+#endif
+
+#include "aggregate.hpp"
+#include "agg_sort.hpp"
+
+/** Space-filling curves through aggregates of unsigned integers.
+ *
+ *  agg::morton_encode interleaves the bits of the elements of an
+ *  aggregate<U,N> into its index on the Z-order curve, and
+ *  agg::hilbert_encode gives its index on the Hilbert curve.
+ *  morton_decode and hilbert_decode map an index back to its point:
+ *
+ *    aggregate<std::uint32_t,3> cell = {{x, y, z}};
+ *    std::uint64_t z = agg::morton_encode(cell);
+ *    cell = agg::morton_decode<std::uint32_t,3>(z);
+ *
+ *  Points close on either curve are close in space, and on the Hilbert
+ *  curve successive indices are neighbouring points. An index is a
+ *  curve_index<U,N>::type, a std::uint32_t when the N elements fit in 32
+ *  bits and a std::uint64_t otherwise. It holds the low curve_bits<U,N>
+ *  bits of each element: 32 of aggregate<std::uint32_t,2>, 21 of
+ *  aggregate<std::uint32_t,3> and 16 of aggregate<std::uint16_t,4>. Higher
+ *  bits are ignored. Bit j of element i is bit j*N + i of the Morton
+ *  index.
+ *
+ *  The encoders and decoders map ranges as well. agg::morton_sort and
+ *  agg::hilbert_sort permute a range of aggregates into curve order by a
+ *  radix sort of their indices, so that neighbouring points are stored
+ *  close together.
+ *
+ *  With BMI2, Morton bits are interleaved by pdep and pext. Otherwise they
+ *  are spread and gathered by shifts and masks, in log2 of the bits steps.
+ */
+
+namespace agg {
+
+//! The type of the curve indices of aggregate<U,N>
+template <typename U, std::size_t N>
+struct curve_index {
+  static_assert(std::is_integral<U>::value && std::is_unsigned<U>::value,
+                "curves are through aggregates of unsigned integers");
+
+  typedef typename std::conditional<N * sizeof(U) <= 4,
+                                    std::uint32_t,
+                                    std::uint64_t>::type type;
+};
+
+//! The bits of each element of aggregate<U,N> in its curve index
+template <typename U, std::size_t N>
+struct curve_bits
+    : std::integral_constant<std::size_t,
+        (8 * sizeof(typename curve_index<U,N>::type) / N < 8 * sizeof(U)
+         ? 8 * sizeof(typename curve_index<U,N>::type) / N
+         : 8 * sizeof(U))> {
+  static_assert(N != 0 && N <= 64, "curves are in 1 to 64 dimensions");
+};
+
+
+namespace detail {
+
+//! Chunks of width bits every stride bits, from bit pos to bit end
+template <typename W>
+constexpr W
+curve_mask(std::size_t width, std::size_t stride, std::size_t pos,
+           std::size_t end) {
+  return pos >= end ? W(0)
+      : W(W(~W(0)) >> (8 * sizeof(W) - width) << pos)
+        | curve_mask<W>(width, stride, pos + stride, end);
+}
+
+//! The largest power of two below bits, or 0 when there is none
+constexpr std::size_t
+curve_step(std::size_t bits, std::size_t s = 1) {
+  return s >= bits ? s / 2 : curve_step(bits, 2 * s);
+}
+
+/** Moves of the bits of an element to every Nth bit and back, by chunks
+ *  of S bits and then of each smaller power of two.
+ */
+template <std::size_t N, typename W, std::size_t S>
+struct curve_spread {
+  //! Bit j of x, which has fewer than 2S bits, to bit j*N
+  static W
+  spread(W x) {
+    x = W(x | x << (S * (N - 1)))
+        & curve_mask<W>(S, S * N, 0, 8 * sizeof(W));
+    return curve_spread<N,W,S/2>::spread(x);
+  }
+
+  //! Bit j*N of x to bit j, for fewer than 2S bits j
+  static W
+  gather(W x) {
+    x = curve_spread<N,W,S/2>::gather(x);
+    return W(x | x >> (S * (N - 1)))
+        & curve_mask<W>(2 * S, 2 * S * N, 0, 8 * sizeof(W));
+  }
+};
+
+template <std::size_t N, typename W>
+struct curve_spread<N,W,0> {
+  static W spread(W x) { return x; }
+  static W gather(W x) { return x; }
+};
+
+#if defined(__BMI2__) && !defined(AGG_NO_SIMD)
+inline std::uint32_t
+curve_pdep(std::uint32_t x, std::uint32_t m) { return _pdep_u32(x, m); }
+inline std::uint32_t
+curve_pext(std::uint32_t x, std::uint32_t m) { return _pext_u32(x, m); }
+inline std::uint64_t
+curve_pdep(std::uint64_t x, std::uint64_t m) { return _pdep_u64(x, m); }
+inline std::uint64_t
+curve_pext(std::uint64_t x, std::uint64_t m) { return _pext_u64(x, m); }
+#endif
+
+//! The low B bits of x to every Nth bit from bit 0
+template <std::size_t N, std::size_t B, typename W>
+inline W
+curve_deposit(W x) {
+#if defined(__BMI2__) && !defined(AGG_NO_SIMD)
+  return curve_pdep(x, curve_mask<W>(1, N, 0, B * N));
+#else
+  x &= curve_mask<W>(B, 8 * sizeof(W), 0, B);
+  return curve_spread<N,W,N == 1 ? 0 : curve_step(B)>::spread(x);
+#endif
+}
+
+//! Every Nth bit of x from bit 0, for B bits
+template <std::size_t N, std::size_t B, typename W>
+inline W
+curve_extract(W x) {
+#if defined(__BMI2__) && !defined(AGG_NO_SIMD)
+  return curve_pext(x, curve_mask<W>(1, N, 0, B * N));
+#else
+  x &= curve_mask<W>(1, N, 0, B * N);
+  return curve_spread<N,W,N == 1 ? 0 : curve_step(B)>::gather(x)
+      & curve_mask<W>(B, 8 * sizeof(W), 0, B);
+#endif
+}
+
+/** Exchange the bits below bit k of x0 and xi if bit k of xi is clear, and
+ *  invert those of x0 otherwise, without branches on the bits.
+ *
+ *  X is a W, or an aggregate of W lanes that each step at once.
+ */
+template <typename W, typename X>
+inline void
+hilbert_step(X& x0, X& xi, std::size_t k) {
+  const W p = W(W(1) << k) - 1;
+  const X set = W(0) - ((xi >> k) & W(1));
+  const X t = (x0 ^ xi) & p & ~set;
+  x0 ^= (p & set) | t;
+  xi ^= t;
+}
+
+template <typename W, std::size_t L>
+inline void
+hilbert_step(aggregate<W,L>& x0, aggregate<W,L>& xi, std::size_t k) {
+  for (std::size_t w = 0; w < L; ++w)
+    hilbert_step<W>(x0[w], xi[w], k);
+}
+
+/** Undo the rotations and reflections of the Hilbert curve in the B bits
+ *  of each x[i] from the top down, as Skilling's AxesToTranspose does.
+ *
+ *  Programming the Hilbert curve, J. Skilling, AIP Conf. Proc. 707, 2004.
+ */
+template <std::size_t N, std::size_t B, typename W, typename X>
+inline void
+hilbert_transpose(X* x) {
+  for (std::size_t k = B - 1; k > 0; --k)
+    for (std::size_t i = 0; i < N; ++i)
+      hilbert_step<W>(x[0], x[i], k);
+  // Gray encode
+  for (std::size_t i = 1; i < N; ++i)
+    x[i] ^= x[i - 1];
+  X t = X();
+  for (std::size_t k = B - 1; k > 0; --k)
+    t ^= W(W(W(1) << k) - 1) & (W(0) - ((x[N - 1] >> k) & W(1)));
+  for (std::size_t i = 0; i < N; ++i)
+    x[i] ^= t;
+}
+
+//! The inverse of hilbert_transpose, Skilling's TransposeToAxes
+template <std::size_t N, std::size_t B, typename W, typename X>
+inline void
+hilbert_untranspose(X* x) {
+  // Gray decode
+  X t = x[N - 1] >> 1;
+  for (std::size_t i = N - 1; i > 0; --i)
+    x[i] ^= x[i - 1];
+  x[0] ^= t;
+  for (std::size_t k = 1; k < B; ++k)
+    for (std::size_t i = N; i-- > 0; )
+      hilbert_step<W>(x[0], x[i], k);
+}
+
+//! The number of points whose Hilbert transforms run at once in ranges
+constexpr std::size_t curve_lanes = 32;
+
+//! Hilbert indices of ranges of aggregate<U,N>, curve_lanes at a time
+template <typename U, std::size_t N>
+struct hilbert_block {
+  typedef typename curve_index<U,N>::type W;
+  static constexpr std::size_t B = curve_bits<U,N>::value;
+  typedef aggregate<W,curve_lanes> X;
+
+  template <typename InputIt, typename OutputIt>
+  static OutputIt
+  encode(InputIt first, InputIt last, OutputIt out) {
+    while (first != last) {
+      // Lanes past the end of the range transform zeros
+      X x[N] = {};
+      std::size_t m = 0;
+      for ( ; m < curve_lanes && first != last; ++m, ++first) {
+        const aggregate<U,N>& a = *first;
+        for (std::size_t i = 0; i < N; ++i)
+          x[i][m] = W(a[i]) & curve_mask<W>(B, 8 * sizeof(W), 0, B);
+      }
+      hilbert_transpose<N,B,W>(x);
+      for (std::size_t w = 0; w < m; ++w, ++out) {
+        W r = 0;
+        for (std::size_t i = 0; i < N; ++i)
+          r |= W(curve_deposit<N,B>(x[i][w]) << (N - 1 - i));
+        *out = r;
+      }
+    }
+    return out;
+  }
+
+  template <typename InputIt, typename OutputIt>
+  static OutputIt
+  decode(InputIt first, InputIt last, OutputIt out) {
+    while (first != last) {
+      X x[N] = {};
+      std::size_t m = 0;
+      for ( ; m < curve_lanes && first != last; ++m, ++first) {
+        const W h = *first;
+        for (std::size_t i = 0; i < N; ++i)
+          x[i][m] = curve_extract<N,B>(W(h >> (N - 1 - i)));
+      }
+      hilbert_untranspose<N,B,W>(x);
+      for (std::size_t w = 0; w < m; ++w, ++out) {
+        aggregate<U,N> a;
+        for (std::size_t i = 0; i < N; ++i)
+          a[i] = U(x[i][w]);
+        *out = a;
+      }
+    }
+    return out;
+  }
+};
+
+//! Permute [first, first+code.size()) by the curve index code[i] of each
+template <typename RandomIt>
+inline void
+curve_sort(RandomIt first, const std::vector<std::uint64_t>& code) {
+  typedef typename std::iterator_traits<RandomIt>::value_type V;
+  const std::size_t n = code.size();
+  // The positions break ties, so the permutation is stable
+  std::vector<aggregate<std::uint64_t,2> > keyed(n);
+  for (std::size_t i = 0; i < n; ++i)
+    keyed[i] = {{code[i], std::uint64_t(i)}};
+  agg::sort(keyed.begin(), keyed.end());
+  std::unique_ptr<V[]> buf(new V[n]);
+  for (std::size_t i = 0; i < n; ++i)
+    buf[i] = first[keyed[i][1]];
+  std::copy(buf.get(), buf.get() + n, first);
+}
+
+} // end namespace detail
+
+
+//! The index of a on the Z-order curve
+template <typename U, std::size_t N>
+inline typename curve_index<U,N>::type
+morton_encode(const aggregate<U,N>& a) {
+  typedef typename curve_index<U,N>::type W;
+  constexpr std::size_t B = curve_bits<U,N>::value;
+  W r = 0;
+  for (std::size_t i = 0; i < N; ++i)
+    r |= W(detail::curve_deposit<N,B>(W(a[i])) << i);
+  return r;
+}
+
+//! The point of aggregate<U,N> at index z on the Z-order curve
+template <typename U, std::size_t N>
+inline aggregate<U,N>
+morton_decode(typename curve_index<U,N>::type z) {
+  constexpr std::size_t B = curve_bits<U,N>::value;
+  aggregate<U,N> a;
+  for (std::size_t i = 0; i < N; ++i)
+    a[i] = U(detail::curve_extract<N,B>(decltype(z)(z >> i)));
+  return a;
+}
+
+//! The index of a on the Hilbert curve
+template <typename U, std::size_t N>
+inline typename curve_index<U,N>::type
+hilbert_encode(const aggregate<U,N>& a) {
+  typedef typename curve_index<U,N>::type W;
+  constexpr std::size_t B = curve_bits<U,N>::value;
+  W x[N];
+  for (std::size_t i = 0; i < N; ++i)
+    x[i] = W(a[i]) & detail::curve_mask<W>(B, 8 * sizeof(W), 0, B);
+  detail::hilbert_transpose<N,B,W>(x);
+  // The top bit of the index is the top bit of x[0]
+  W r = 0;
+  for (std::size_t i = 0; i < N; ++i)
+    r |= W(detail::curve_deposit<N,B>(x[i]) << (N - 1 - i));
+  return r;
+}
+
+//! The point of aggregate<U,N> at index h on the Hilbert curve
+template <typename U, std::size_t N>
+inline aggregate<U,N>
+hilbert_decode(typename curve_index<U,N>::type h) {
+  typedef typename curve_index<U,N>::type W;
+  constexpr std::size_t B = curve_bits<U,N>::value;
+  W x[N];
+  for (std::size_t i = 0; i < N; ++i)
+    x[i] = detail::curve_extract<N,B>(W(h >> (N - 1 - i)));
+  detail::hilbert_untranspose<N,B,W>(x);
+  aggregate<U,N> a;
+  for (std::size_t i = 0; i < N; ++i)
+    a[i] = U(x[i]);
+  return a;
+}
+
+
+/** Write the Z-order index of each aggregate of [first, last) to out and
+ *  return the end of the output.
+ */
+template <typename InputIt, typename OutputIt>
+inline OutputIt
+morton_encode(InputIt first, InputIt last, OutputIt out) {
+  for ( ; first != last; ++first, ++out)
+    *out = morton_encode(*first);
+  return out;
+}
+
+//! Write the point of aggregate<U,N> at each Z-order index of [first, last)
+template <typename U, std::size_t N, typename InputIt, typename OutputIt>
+inline OutputIt
+morton_decode(InputIt first, InputIt last, OutputIt out) {
+  for ( ; first != last; ++first, ++out)
+    *out = morton_decode<U,N>(*first);
+  return out;
+}
+
+/** Write the Hilbert index of each aggregate of [first, last) to out.
+ *
+ *  The transforms of blocks of points run together, lane by lane.
+ */
+template <typename InputIt, typename OutputIt>
+inline OutputIt
+hilbert_encode(InputIt first, InputIt last, OutputIt out) {
+  typedef typename std::iterator_traits<InputIt>::value_type V;
+  return detail::hilbert_block<typename V::value_type,
+                               std::tuple_size<V>::value>::encode(first, last,
+                                                                  out);
+}
+
+//! Write the point of aggregate<U,N> at each Hilbert index of [first, last)
+template <typename U, std::size_t N, typename InputIt, typename OutputIt>
+inline OutputIt
+hilbert_decode(InputIt first, InputIt last, OutputIt out) {
+  return detail::hilbert_block<U,N>::decode(first, last, out);
+}
+
+
+/** Permute [first, last) into Z-order, keeping aggregates of equal index
+ *  in order.
+ */
+template <typename RandomIt>
+inline void
+morton_sort(RandomIt first, RandomIt last) {
+  std::vector<std::uint64_t> code(std::distance(first, last));
+  morton_encode(first, last, code.begin());
+  detail::curve_sort(first, code);
+}
+
+//! Permute [first, last) into Hilbert order
+template <typename RandomIt>
+inline void
+hilbert_sort(RandomIt first, RandomIt last) {
+  std::vector<std::uint64_t> code(std::distance(first, last));
+  hilbert_encode(first, last, code.begin());
+  detail::curve_sort(first, code);
+}
+
+} // end namespace agg
@@ -0,0 +1,467 @@
+#pragma once
+
+#include <tuple>
+
+/** Expression templates for the aggregate operators.
+ *
+ *  Operators on agg::expression nodes build an expression tree instead of
+ *  materializing every intermediate aggregate. The tree is evaluated in a
+ *  single fused element-wise pass when it is converted to an aggregate or
+ *  used as the right-hand side of a compound assignment:
+ *
+ *    aggregate<float,3> r = agg::lazy(a)*b + agg::lazy(c)*d - e;
+ *    r += agg::lazy(a)*b;
+ *
+ *  Defining AGG_LAZY_EXPRESSIONS before including aggregate.hpp makes the
+ *  arithmetic, bitwise and logical operators on aggregates return expression
+ *  nodes themselves, so a*b + c*d - e is fused without agg::lazy. The macro
+ *  must be defined consistently across translation units.
+ *
+ *  Expressions hold aggregate operands by reference, and scalars and
+ *  sub-expressions by value. Evaluate an expression before its aggregate
+ *  operands go out of scope.
+ */
+
+namespace agg {
+
+template <typename Fn, typename... Args>
+struct expression;
+
+namespace detail {
+
+template <typename T>
+struct is_expression : std::false_type {};
+template <typename Fn, typename... Args>
+struct is_expression<expression<Fn,Args...> > : std::true_type {};
+
+//! Leaf referring to an aggregate operand
+template <typename T, std::size_t N>
+struct expr_ref {
+  const aggregate<T,N>& a;
+};
+
+//! Leaf broadcasting a scalar operand to every element
+template <typename S>
+struct expr_scalar {
+  S s;
+};
+
+//! Identity kernel for agg::lazy
+struct expr_identity {
+  template <class T>
+  constexpr T&& operator()(T&& t) const {
+    return std::forward<T>(t);
+  }
+};
+
+//! Number of elements of a node, zero for broadcast scalars
+template <typename X>
+struct expr_size
+    : std::integral_constant<std::size_t, 0> {};
+template <typename T, std::size_t N>
+struct expr_size<expr_ref<T,N> >
+    : std::integral_constant<std::size_t, N> {};
+template <typename Fn, typename... Args>
+struct expr_size<expression<Fn,Args...> >
+    : std::integral_constant<std::size_t,
+                             expression<Fn,Args...>::static_size> {};
+
+template <typename... X>
+struct expr_common_size
+    : std::integral_constant<std::size_t, 0> {};
+template <typename X, typename... Xs>
+struct expr_common_size<X,Xs...>
+    : std::integral_constant<std::size_t,
+                             (expr_size<X>::value > 0
+                              ? expr_size<X>::value
+                              : expr_common_size<Xs...>::value)> {};
+
+//! Type yielded by the elements of a node
+template <typename X>
+struct expr_element;
+template <typename T, std::size_t N>
+struct expr_element<expr_ref<T,N> > {
+  typedef const T& type;
+};
+template <typename S>
+struct expr_element<expr_scalar<S> > {
+  typedef const S& type;
+};
+template <typename Fn, typename... Args>
+struct expr_element<expression<Fn,Args...> > {
+  typedef typename expression<Fn,Args...>::value_type type;
+};
+
+//! Stored element type: nested expressions are materialized as aggregates
+template <typename X>
+struct expr_value {
+  typedef X type;
+};
+template <typename Fn, typename... Args>
+struct expr_value<expression<Fn,Args...> > {
+  typedef typename expression<Fn,Args...>::result_type type;
+};
+
+// Element access by compile-time index
+template <std::size_t I, typename T, std::size_t N>
+constexpr const T&
+expr_get(const expr_ref<T,N>& x) noexcept {
+  return std::get<I>(x.a);
+}
+template <std::size_t I, typename S>
+constexpr const S&
+expr_get(const expr_scalar<S>& x) noexcept {
+  return x.s;
+}
+template <std::size_t I, typename Fn, typename... Args>
+typename expression<Fn,Args...>::value_type
+expr_get(const expression<Fn,Args...>& x) {
+  return x.template get<I>();
+}
+
+// Element access by run-time index
+template <typename T, std::size_t N>
+const T&
+expr_at(const expr_ref<T,N>& x, std::size_t i) noexcept {
+  return x.a[i];
+}
+template <typename S>
+const S&
+expr_at(const expr_scalar<S>& x, std::size_t) noexcept {
+  return x.s;
+}
+template <typename Fn, typename... Args>
+typename expression<Fn,Args...>::value_type
+expr_at(const expression<Fn,Args...>& x, std::size_t i) {
+  return x[i];
+}
+
+template <typename Fn, typename... Args>
+expression<Fn,Args...>
+make_expr(const Args&... args) {
+  return {Fn(), std::tuple<Args...>(args...)};
+}
+
+//! Evaluate an expression into the elements of an aggregate, a[i] op= e[i]
+template <typename Fn, typename T, std::size_t N, typename E,
+          std::size_t... I>
+void expr_assign_impl(Fn f, aggregate<T,N>& a, const E& e,
+                      index_sequence<I...>) {
+  auto l = { (f(std::get<I>(a), e.template get<I>()), void(), 0)... };
+  (void) l;
+}
+template <typename Fn, typename T, std::size_t N, typename E>
+void expr_assign(Fn f, aggregate<T,N>& a, const E& e, std::true_type) {
+  expr_assign_impl(f, a, e, make_index_sequence<N>());
+}
+template <typename Fn, typename T, std::size_t N, typename E>
+void expr_assign(Fn f, aggregate<T,N>& a, const E& e, std::false_type) {
+  for (std::size_t i = 0; i < N; ++i)
+    f(a[i], e[i]);
+}
+
+} // end namespace detail
+
+
+/** @brief A lazily evaluated element-wise operation on aggregates.
+ *
+ *  @tparam Fn    The fn:: functor applied to each element.
+ *  @tparam Args  The operand nodes: detail::expr_ref, detail::expr_scalar
+ *                or nested expressions.
+ */
+template <typename Fn, typename... Args>
+struct expression {
+  typedef typename detail::expr_value<decay_t<
+      function_result_t<const Fn&,
+                        typename detail::expr_element<Args>::type...> > >::type
+                                                        value_type;
+  typedef std::size_t                                   size_type;
+
+  static constexpr size_type static_size =
+      detail::expr_common_size<Args...>::value;
+
+  typedef aggregate<value_type, static_size>            result_type;
+
+  Fn                                                    _fn;
+  std::tuple<Args...>                                   _args;
+
+  //! Compute element I of the expression
+  template <std::size_t I>
+  value_type
+  get() const {
+    static_assert(I < static_size, "index is out of bounds");
+    return _get<I>(detail::make_index_sequence<sizeof...(Args)>());
+  }
+
+  //! Compute element n of the expression
+  value_type
+  operator[](size_type n) const {
+    return _at(n, detail::make_index_sequence<sizeof...(Args)>());
+  }
+
+  constexpr size_type
+  size() const noexcept
+  { return static_size; }
+
+  //! Evaluate every element in a single pass
+  result_type
+  eval() const {
+    return _eval<value_type>(detail::unrolled<static_size>());
+  }
+
+  template <typename U,
+            typename = enable_if<std::is_convertible<value_type,U>, void> >
+  operator aggregate<U,static_size>() const {
+    return _eval<U>(detail::unrolled<static_size>());
+  }
+
+ private:
+  template <std::size_t I, std::size_t... J>
+  value_type
+  _get(detail::index_sequence<J...>) const {
+    return _fn(detail::expr_get<I>(std::get<J>(_args))...);
+  }
+
+  template <std::size_t... J>
+  value_type
+  _at(size_type n, detail::index_sequence<J...>) const {
+    return _fn(detail::expr_at(std::get<J>(_args), n)...);
+  }
+
+  template <typename U>
+  aggregate<U,static_size>
+  _eval(std::true_type) const {
+    return _eval<U>(detail::make_index_sequence<static_size>());
+  }
+
+  template <typename U>
+  aggregate<U,static_size>
+  _eval(std::false_type) const {
+    aggregate<U,static_size> r;
+    for (size_type i = 0; i < static_size; ++i)
+      r[i] = static_cast<U>((*this)[i]);
+    return r;
+  }
+
+  template <typename U, std::size_t... I>
+  aggregate<U,static_size>
+  _eval(detail::index_sequence<I...>) const {
+    return {static_cast<U>(get<I>())...};
+  }
+};
+
+
+/** Start an expression from an aggregate operand
+ *
+ *  All operators applied to the result produce expression nodes.
+ */
+template <typename T, std::size_t N>
+inline expression<detail::expr_identity, detail::expr_ref<T,N> >
+lazy(const aggregate<T,N>& a) {
+  return detail::make_expr<detail::expr_identity>(detail::expr_ref<T,N>{a});
+}
+
+//! Write to an output stream
+template <typename CharT, typename Traits, typename Fn, typename... Args>
+inline std::basic_ostream<CharT,Traits>&
+operator<<(std::basic_ostream<CharT,Traits>& s,
+           const expression<Fn,Args...>& e) {
+  return s << e.eval();
+}
+
+
+#define AGG_EXPR_TYPE(...) expression<__VA_ARGS__>
+#define AGG_EXPR_VALUE(...) typename expression<__VA_ARGS__>::value_type
+#define AGG_EXPR_SIZE(...) expression<__VA_ARGS__>::static_size
+
+#define AGG_EXPR_BIN_OP_ASSIGN(NAME,OP)                                       \
+  template <typename T, std::size_t N, typename F, typename... A>             \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T&,AGG_EXPR_VALUE(F,A...)>::value &&                         \
+      N == AGG_EXPR_SIZE(F,A...)>,                                            \
+    aggregate<T,N>&>                                                          \
+  operator OP(aggregate<T,N>& a, const AGG_EXPR_TYPE(F,A...)& b) {            \
+    detail::expr_assign(fn::NAME(), a, b, detail::unrolled<N>());             \
+    return a;                                                                 \
+  }
+
+AGG_EXPR_BIN_OP_ASSIGN(plus_assign,         +=)
+AGG_EXPR_BIN_OP_ASSIGN(minus_assign,        -=)
+AGG_EXPR_BIN_OP_ASSIGN(multiplies_assign,   *=)
+AGG_EXPR_BIN_OP_ASSIGN(divides_assign,      /=)
+AGG_EXPR_BIN_OP_ASSIGN(modulus_assign,      %=)
+AGG_EXPR_BIN_OP_ASSIGN(bit_and_assign,      &=)
+AGG_EXPR_BIN_OP_ASSIGN(bit_or_assign,       |=)
+AGG_EXPR_BIN_OP_ASSIGN(bit_xor_assign,      ^=)
+AGG_EXPR_BIN_OP_ASSIGN(left_shift_assign,  <<=)
+AGG_EXPR_BIN_OP_ASSIGN(right_shift_assign, >>=)
+#undef AGG_EXPR_BIN_OP_ASSIGN
+
+
+#define AGG_EXPR_UN_OP(NAME,OP)                                               \
+  template <typename F, typename... A>                                        \
+  inline                                                                      \
+  enable_if<                                                                  \
+    has_##NAME<AGG_EXPR_VALUE(F,A...)>,                                       \
+    expression<fn::NAME, AGG_EXPR_TYPE(F,A...)> >                             \
+  operator OP(const AGG_EXPR_TYPE(F,A...)& a) {                               \
+    return detail::make_expr<fn::NAME>(a);                                    \
+  }
+
+#if defined(AGG_LAZY_EXPRESSIONS)
+#define AGG_LAZY_UN_OP(NAME,OP)                                               \
+  AGG_EXPR_UN_OP(NAME,OP)                                                     \
+  template <typename T, std::size_t N>                                        \
+  inline                                                                      \
+  enable_if<                                                                  \
+    has_##NAME<const T&>,                                                     \
+    expression<fn::NAME, detail::expr_ref<T,N> > >                            \
+  operator OP(const aggregate<T,N>& a) {                                      \
+    return detail::make_expr<fn::NAME>(detail::expr_ref<T,N>{a});             \
+  }
+#else
+#define AGG_LAZY_UN_OP(NAME,OP) AGG_EXPR_UN_OP(NAME,OP)
+#endif
+
+AGG_LAZY_UN_OP(unary_plus,       +)
+AGG_LAZY_UN_OP(unary_minus,      -)
+AGG_LAZY_UN_OP(bit_not,          ~)
+AGG_LAZY_UN_OP(logical_not,      !)
+#undef AGG_LAZY_UN_OP
+#undef AGG_EXPR_UN_OP
+
+
+#define AGG_EXPR_BIN_OP(NAME,OP)                                              \
+  template <typename F1, typename... A1, typename F2, typename... A2>         \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<AGG_EXPR_VALUE(F1,A1...),AGG_EXPR_VALUE(F2,A2...)>::value && \
+      AGG_EXPR_SIZE(F1,A1...) == AGG_EXPR_SIZE(F2,A2...)>,                    \
+    expression<fn::NAME, AGG_EXPR_TYPE(F1,A1...), AGG_EXPR_TYPE(F2,A2...)> >  \
+  operator OP(const AGG_EXPR_TYPE(F1,A1...)& a,                               \
+              const AGG_EXPR_TYPE(F2,A2...)& b) {                             \
+    return detail::make_expr<fn::NAME>(a, b);                                 \
+  }                                                                           \
+  template <typename F, typename... A, typename U, std::size_t N>             \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<AGG_EXPR_VALUE(F,A...),const U&>::value &&                   \
+      AGG_EXPR_SIZE(F,A...) == N>,                                            \
+    expression<fn::NAME, AGG_EXPR_TYPE(F,A...), detail::expr_ref<U,N> > >     \
+  operator OP(const AGG_EXPR_TYPE(F,A...)& a, const aggregate<U,N>& b) {      \
+    return detail::make_expr<fn::NAME>(a, detail::expr_ref<U,N>{b});          \
+  }                                                                           \
+  template <typename T, std::size_t N, typename F, typename... A>             \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<const T&,AGG_EXPR_VALUE(F,A...)>::value &&                   \
+      N == AGG_EXPR_SIZE(F,A...)>,                                            \
+    expression<fn::NAME, detail::expr_ref<T,N>, AGG_EXPR_TYPE(F,A...)> >      \
+  operator OP(const aggregate<T,N>& a, const AGG_EXPR_TYPE(F,A...)& b) {      \
+    return detail::make_expr<fn::NAME>(detail::expr_ref<T,N>{a}, b);          \
+  }                                                                           \
+  template <typename F, typename... A, typename U>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<AGG_EXPR_VALUE(F,A...),const U&>::value &&                   \
+      !detail::is_expression<U>::value &&                                     \
+      is_scalar_operand<U>::value>,                                           \
+    expression<fn::NAME, AGG_EXPR_TYPE(F,A...), detail::expr_scalar<U> > >    \
+  operator OP(const AGG_EXPR_TYPE(F,A...)& a, const U& b) {                   \
+    return detail::make_expr<fn::NAME>(a, detail::expr_scalar<U>{b});         \
+  }                                                                           \
+  template <typename T, typename F, typename... A>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<const T&,AGG_EXPR_VALUE(F,A...)>::value &&                   \
+      !detail::is_expression<T>::value &&                                     \
+      is_scalar_operand<T>::value>,                                           \
+    expression<fn::NAME, detail::expr_scalar<T>, AGG_EXPR_TYPE(F,A...)> >     \
+  operator OP(const T& a, const AGG_EXPR_TYPE(F,A...)& b) {                   \
+    return detail::make_expr<fn::NAME>(detail::expr_scalar<T>{a}, b);         \
+  }
+
+
+#define COMMA ,
+
+AGG_EXPR_BIN_OP(plus,                 +)
+AGG_EXPR_BIN_OP(minus,                -)
+AGG_EXPR_BIN_OP(multiplies,           *)
+AGG_EXPR_BIN_OP(divides,              /)
+AGG_EXPR_BIN_OP(modulus,              %)
+AGG_EXPR_BIN_OP(bit_and,              &)
+AGG_EXPR_BIN_OP(bit_or,               |)
+AGG_EXPR_BIN_OP(bit_xor,              ^)
+AGG_EXPR_BIN_OP(comma,            COMMA)
+AGG_EXPR_BIN_OP(left_shift,          <<)
+AGG_EXPR_BIN_OP(right_shift,         >>)
+AGG_EXPR_BIN_OP(logical_and,         &&)
+AGG_EXPR_BIN_OP(logical_or,          ||)
+
+#if defined(AGG_LAZY_EXPRESSIONS)
+#define AGG_LAZY_BIN_OP(NAME,OP)                                              \
+  template <typename T, typename U, std::size_t N>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    has_##NAME<const T&,const U&>,                                            \
+    expression<fn::NAME, detail::expr_ref<T,N>, detail::expr_ref<U,N> > >     \
+  operator OP(const aggregate<T,N>& a, const aggregate<U,N>& b) {             \
+    return detail::make_expr<fn::NAME>(detail::expr_ref<T,N>{a},              \
+                                       detail::expr_ref<U,N>{b});             \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<const T&,const U&>::value &&                                 \
+      !detail::is_expression<U>::value &&                                     \
+      is_scalar_operand<U>::value>,                                           \
+    expression<fn::NAME, detail::expr_ref<T,N>, detail::expr_scalar<U> > >    \
+  operator OP(const aggregate<T,N>& a, const U& b) {                          \
+    return detail::make_expr<fn::NAME>(detail::expr_ref<T,N>{a},              \
+                                       detail::expr_scalar<U>{b});            \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<const T&,const U&>::value &&                                 \
+      !detail::is_expression<T>::value &&                                     \
+      is_scalar_operand<T>::value>,                                           \
+    expression<fn::NAME, detail::expr_scalar<T>, detail::expr_ref<U,N> > >    \
+  operator OP(const T& a, const aggregate<U,N>& b) {                          \
+    return detail::make_expr<fn::NAME>(detail::expr_scalar<T>{a},             \
+                                       detail::expr_ref<U,N>{b});             \
+  }
+
+AGG_LAZY_BIN_OP(plus,                 +)
+AGG_LAZY_BIN_OP(minus,                -)
+AGG_LAZY_BIN_OP(multiplies,           *)
+AGG_LAZY_BIN_OP(divides,              /)
+AGG_LAZY_BIN_OP(modulus,              %)
+AGG_LAZY_BIN_OP(bit_and,              &)
+AGG_LAZY_BIN_OP(bit_or,               |)
+AGG_LAZY_BIN_OP(bit_xor,              ^)
+AGG_LAZY_BIN_OP(comma,            COMMA)
+AGG_LAZY_BIN_OP(left_shift,          <<)
+AGG_LAZY_BIN_OP(right_shift,         >>)
+AGG_LAZY_BIN_OP(logical_and,         &&)
+AGG_LAZY_BIN_OP(logical_or,          ||)
+#undef AGG_LAZY_BIN_OP
+#endif
+
+#undef AGG_EXPR_BIN_OP
+#undef COMMA
+
+#undef AGG_EXPR_TYPE
+#undef AGG_EXPR_VALUE
+#undef AGG_EXPR_SIZE
+
+} // end namespace agg
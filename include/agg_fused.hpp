@@ -0,0 +1,260 @@
+#pragma once
+
+#include <cmath>
+
+/** Fused element-wise operations on aggregates.
+ *
+ *  agg::fma(a,b,c), agg::lerp(a,b,t) and agg::clamp(v,lo,hi) compute their
+ *  result in a single pass over the elements instead of through the
+ *  temporaries of the equivalent operator expression. Any operand may be a
+ *  scalar that is broadcast to every element, as long as one of them is an
+ *  aggregate; agg::axpy(alpha,x,y) updates y in place.
+ *
+ *  For float and double elements, x*y + z is rounded once with the target's
+ *  fused multiply-add when it has one (e.g. -mfma), and agg_simd.hpp maps
+ *  it onto FMA registers. Without hardware FMA, and for all other element
+ *  types, it is computed as fn::plus()(fn::multiplies()(x, y), z).
+ */
+
+#if defined(__FMA__) || defined(FP_FAST_FMA)
+#define AGG_FMA 1
+#endif
+
+namespace agg {
+
+namespace detail {
+
+//! x*y + z
+template <typename T, typename U, typename V>
+inline auto
+fused_madd(const T& x, const U& y, const V& z)
+    -> decltype(fn::plus()(fn::multiplies()(x, y), z)) {
+  return fn::plus()(fn::multiplies()(x, y), z);
+}
+
+#if defined(AGG_FMA)
+inline float
+fused_madd(float x, float y, float z) {
+  return std::fma(x, y, z);
+}
+
+inline double
+fused_madd(double x, double y, double z) {
+  return std::fma(x, y, z);
+}
+#endif
+
+} // end namespace detail
+
+
+namespace fn {
+
+//! x*y + z, rounded once where the target has a fused multiply-add
+struct fma {
+  template <class T, class U, class V>
+  auto operator()(const T& x, const U& y, const V& z) const
+      -> decltype(detail::fused_madd(x, y, z)) {
+    return detail::fused_madd(x, y, z);
+  }
+};
+
+/** a + t*(b - a), computed as t*b + (a - t*a) so that t == 0 gives a and
+ *  t == 1 gives b exactly
+ */
+struct lerp {
+  template <class T, class U, class V>
+  auto operator()(const T& a, const U& b, const V& t) const
+      -> decltype(detail::fused_madd(t, b, detail::fused_madd(-t, a, a))) {
+    return detail::fused_madd(t, b, detail::fused_madd(-t, a, a));
+  }
+};
+
+//! lo if v < lo, hi if hi < v, and v otherwise, as the type of v
+struct clamp {
+  template <class T, class U, class V>
+  auto operator()(const T& v, const U& lo, const V& hi) const
+      -> decltype(v < lo ? T(lo) : hi < v ? T(hi) : v) {
+    return v < lo ? T(lo) : hi < v ? T(hi) : v;
+  }
+};
+
+} // end namespace fn
+
+
+namespace detail {
+
+//! An operand of the fused operations: an aggregate or a broadcast scalar
+template <typename A>
+struct fused_operand {
+  static constexpr bool is_aggregate = false;
+  static constexpr bool valid = is_scalar_operand<A>::value;
+  static constexpr std::size_t size = 0;
+  typedef A element;
+};
+template <typename T, std::size_t N>
+struct fused_operand<aggregate<T,N> > {
+  static constexpr bool is_aggregate = true;
+  static constexpr bool valid = true;
+  static constexpr std::size_t size = N;
+  typedef T element;
+};
+
+//! Whether the operands are valid together, and the common size
+template <typename... A>
+struct fused_operands {
+  static constexpr bool any = false;
+  static constexpr bool valid = true;
+  static constexpr std::size_t size = 0;
+};
+template <typename A, typename... B>
+struct fused_operands<A, B...> {
+  typedef fused_operand<A> first;
+  typedef fused_operands<B...> rest;
+  static constexpr bool any = first::is_aggregate || rest::any;
+  static constexpr bool valid =
+      first::valid && rest::valid &&
+      (!first::is_aggregate || !rest::any || first::size == rest::size);
+  static constexpr std::size_t size =
+      first::is_aggregate ? first::size : rest::size;
+};
+
+//! Result of Fn over the elements of the operands A
+template <typename Fn, typename... A>
+using fused_result_t =
+    aggregate<decay_t<function_result_t<
+                const Fn&, const typename fused_operand<A>::element&...> >,
+              fused_operands<A...>::size>;
+
+template <typename Fn, typename... A>
+using enable_if_fused =
+    enable_if<std::integral_constant<bool, fused_operands<A...>::any &&
+                                           fused_operands<A...>::valid>,
+              fused_result_t<Fn, A...> >;
+
+//! Element I of an operand
+template <std::size_t I, typename T, std::size_t N>
+inline const T&
+fused_get(const aggregate<T,N>& a) {
+  return std::get<I>(a);
+}
+template <std::size_t I, typename S>
+inline const S&
+fused_get(const S& s) {
+  return s;
+}
+
+//! Element i of an operand
+template <typename T, std::size_t N>
+inline const T&
+fused_at(const aggregate<T,N>& a, std::size_t i) {
+  return a[i];
+}
+template <typename S>
+inline const S&
+fused_at(const S& s, std::size_t) {
+  return s;
+}
+
+/** r[i] = fn(a[i]...) for the fused operations, with scalar operands
+ *  broadcast. agg_simd.hpp specializes it for arithmetic T.
+ */
+template <typename Fn, typename T, typename Enable = void>
+struct fused_kernel {
+  template <typename R, typename... A>
+  static R map(const A&... a) {
+    return map_impl<R>(unrolled<fused_operands<A...>::size>(), a...);
+  }
+
+  template <std::size_t N, typename... A>
+  static void apply(aggregate<T,N>& r, const A&... a) {
+    apply_impl(unrolled<N>(), r, a...);
+  }
+
+ private:
+  template <std::size_t I, typename... A>
+  static auto element(const A&... a) -> decltype(Fn()(fused_get<I>(a)...)) {
+    return Fn()(fused_get<I>(a)...);
+  }
+
+  template <typename R, typename... A>
+  static R map_impl(std::true_type, const A&... a) {
+    typedef make_index_sequence<fused_operands<A...>::size> Seq;
+    return map_impl<R>(Seq(), a...);
+  }
+  template <typename R, std::size_t... I, typename... A>
+  static R map_impl(index_sequence<I...>, const A&... a) {
+    return {element<I>(a...)...};
+  }
+  template <typename R, typename... A>
+  static R map_impl(std::false_type, const A&... a) {
+    R r;
+    for (std::size_t i = 0; i < fused_operands<A...>::size; ++i)
+      r[i] = Fn()(fused_at(a, i)...);
+    return r;
+  }
+
+  template <std::size_t N, typename... A>
+  static void apply_impl(std::true_type, aggregate<T,N>& r, const A&... a) {
+    apply_impl(make_index_sequence<N>(), r, a...);
+  }
+  template <std::size_t N, std::size_t... I, typename... A>
+  static void apply_impl(index_sequence<I...>, aggregate<T,N>& r,
+                         const A&... a) {
+    auto l = {0, (std::get<I>(r) = element<I>(a...), void(), 0)...};
+    (void) l;
+  }
+  template <std::size_t N, typename... A>
+  static void apply_impl(std::false_type, aggregate<T,N>& r,
+                         const A&... a) {
+    for (std::size_t i = 0; i < N; ++i)
+      r[i] = Fn()(fused_at(a, i)...);
+  }
+};
+
+template <typename Fn, typename... A>
+inline fused_result_t<Fn, A...>
+fused_map(const A&... a) {
+  typedef fused_result_t<Fn, A...> R;
+  return fused_kernel<Fn, typename R::value_type>::template map<R>(a...);
+}
+
+} // end namespace detail
+
+
+//! a*b + c element-wise; see fn::fma
+template <typename A, typename B, typename C>
+inline detail::enable_if_fused<fn::fma, A, B, C>
+fma(const A& a, const B& b, const C& c) {
+  return detail::fused_map<fn::fma>(a, b, c);
+}
+
+/** y = alpha*x + y element-wise in a single pass
+ *
+ *  alpha and x may each be an aggregate or a scalar.
+ */
+template <typename A, typename X, typename T, std::size_t N>
+inline
+enable_if<
+  std::is_same<detail::enable_if_fused<fn::fma, A, X, aggregate<T,N> >,
+               aggregate<T,N> >,
+  aggregate<T,N>&>
+axpy(const A& alpha, const X& x, aggregate<T,N>& y) {
+  detail::fused_kernel<fn::fma,T>::apply(y, alpha, x, y);
+  return y;
+}
+
+//! a + t*(b - a) element-wise; see fn::lerp
+template <typename A, typename B, typename C>
+inline detail::enable_if_fused<fn::lerp, A, B, C>
+lerp(const A& a, const B& b, const C& t) {
+  return detail::fused_map<fn::lerp>(a, b, t);
+}
+
+//! v clamped to [lo, hi] element-wise; see fn::clamp
+template <typename A, typename B, typename C>
+inline detail::enable_if_fused<fn::clamp, A, B, C>
+clamp(const A& v, const B& lo, const C& hi) {
+  return detail::fused_map<fn::clamp>(v, lo, hi);
+}
+
+} // end namespace agg
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+#include "aggregate.hpp"
+
+/** Gather and scatter-add of aggregates through lists of indices.
+ *
+ *  agg::gather loads the records of an array that a range of indices names,
+ *  and agg::scatter_add adds a range of values into them, as in finite
+ *  element assembly and particle neighbour loops:
+ *
+ *    std::vector<aggregate<float,3> > x(nodes), f(nodes), xe(k), fe(k);
+ *    agg::gather(x.data(), conn.begin(), conn.end(), xe.begin());
+ *    ...                                   // element kernel, xe -> fe
+ *    agg::scatter_add(f.data(), conn.begin(), conn.end(), fe.begin());
+ *
+ *  are
+ *
+ *    for (std::size_t k = 0; k < conn.size(); ++k) xe[k] = x[conn[k]];
+ *    for (std::size_t k = 0; k < conn.size(); ++k) f[conn[k]] += fe[k];
+ *
+ *  Indices may repeat. scatter_add updates the records in the order of the
+ *  indices, so a repeated index receives every value added to it, as in the
+ *  loop.
+ *
+ *  With AVX, float and double records that partly fill a 16- or 32-byte
+ *  register, such as aggregate<float,3> and aggregate<double,3>, move and
+ *  add as one masked register load and store each instead of element by
+ *  element. With AVX2, records of one 4-byte element gathered from a
+ *  pointer by signed 32-bit indices are loaded eight at a time with
+ *  hardware gather instructions. All other records are copied and added
+ *  with their own = and +=.
+ *
+ *  base is a random-access iterator, out and values forward iterators to
+ *  records; the index range holds integers. The output may not overlap the
+ *  array.
+ */
+
+namespace agg {
+
+namespace detail {
+
+/** Copy and add whole records. Records that only partly fill a register
+ *  are loaded and stored under masks below.
+ */
+template <typename T, std::size_t N, typename Enable = void>
+struct gather_row {
+  static void copy(aggregate<T,N>& r, const aggregate<T,N>& a) { r = a; }
+  static void add(aggregate<T,N>& r, const aggregate<T,N>& a) { r += a; }
+};
+
+//! Records of one 4-byte element, gathered by signed 32-bit indices
+template <typename Base, typename Index, typename Enable = void>
+struct gather_words : std::false_type {};
+
+#if defined(AGG_SIMD) && defined(__AVX__)
+
+//! A register of Bytes bytes of T under a mask of its first L lanes
+template <typename T, std::size_t Bytes>
+struct gather_reg;
+
+template <>
+struct gather_reg<float,16> {
+  typedef __m128 type;
+  template <std::size_t L>
+  static __m128i mask() {
+    return _mm_setr_epi32(-(0 < L), -(1 < L), -(2 < L), -(3 < L));
+  }
+  static type load(const float* p, __m128i m) {
+    return _mm_maskload_ps(p, m);
+  }
+  static void store(float* p, __m128i m, type v) {
+    _mm_maskstore_ps(p, m, v);
+  }
+  static type add(type a, type b) { return _mm_add_ps(a, b); }
+};
+
+template <>
+struct gather_reg<float,32> {
+  typedef __m256 type;
+  template <std::size_t L>
+  static __m256i mask() {
+    return _mm256_setr_epi32(-(0 < L), -(1 < L), -(2 < L), -(3 < L),
+                             -(4 < L), -(5 < L), -(6 < L), -(7 < L));
+  }
+  static type load(const float* p, __m256i m) {
+    return _mm256_maskload_ps(p, m);
+  }
+  static void store(float* p, __m256i m, type v) {
+    _mm256_maskstore_ps(p, m, v);
+  }
+  static type add(type a, type b) { return _mm256_add_ps(a, b); }
+};
+
+template <>
+struct gather_reg<double,32> {
+  typedef __m256d type;
+  template <std::size_t L>
+  static __m256i mask() {
+    return _mm256_setr_epi32(-(0 < L), -(0 < L), -(1 < L), -(1 < L),
+                             -(2 < L), -(2 < L), -(3 < L), -(3 < L));
+  }
+  static type load(const double* p, __m256i m) {
+    return _mm256_maskload_pd(p, m);
+  }
+  static void store(double* p, __m256i m, type v) {
+    _mm256_maskstore_pd(p, m, v);
+  }
+  static type add(type a, type b) { return _mm256_add_pd(a, b); }
+};
+
+/** Whether float and double records, padding included, fill part of a
+ *  register. Smaller ones are one or two scalar moves; full registers are
+ *  loaded whole by agg_simd.hpp already.
+ */
+template <typename T, std::size_t N>
+struct gather_masked
+    : std::integral_constant<bool,
+          (std::is_same<T,float>::value || std::is_same<T,double>::value) &&
+          (sizeof(aggregate<T,N>) > 8) && sizeof(aggregate<T,N>) < 32 &&
+          sizeof(aggregate<T,N>) != 16 &&
+          !(std::is_same<T,double>::value && sizeof(aggregate<T,N>) < 16)> {};
+
+template <typename T, std::size_t N>
+struct gather_row<T,N, enable_if<gather_masked<T,N>, void> > {
+  static constexpr std::size_t L = sizeof(aggregate<T,N>) / sizeof(T);
+  typedef gather_reg<T, L * sizeof(T) < 16 ? 16 : 32> R;
+
+  static void copy(aggregate<T,N>& r, const aggregate<T,N>& a) {
+    const auto m = R::template mask<L>();
+    R::store(r.data(), m, R::load(a.data(), m));
+  }
+  static void add(aggregate<T,N>& r, const aggregate<T,N>& a) {
+    const auto m = R::template mask<L>();
+    R::store(r.data(), m, R::add(R::load(r.data(), m), R::load(a.data(), m)));
+  }
+};
+
+#endif
+
+#if defined(AGG_SIMD) && defined(__AVX2__)
+
+template <typename T, typename Index>
+struct gather_words<const aggregate<T,1>*, Index,
+    enable_if<std::integral_constant<bool,
+        sizeof(aggregate<T,1>) == 4 && std::is_arithmetic<T>::value &&
+        std::is_integral<
+            typename std::iterator_traits<Index>::value_type>::value &&
+        std::is_signed<
+            typename std::iterator_traits<Index>::value_type>::value &&
+        sizeof(typename std::iterator_traits<Index>::value_type) == 4>,
+        void> >
+    : std::true_type {};
+
+/** Gather the records of whole blocks of eight indices and return the
+ *  number of indices done.
+ *
+ *  Signed 32-bit indices only; unsigned ones, which the instructions would
+ *  sign-extend, take the scalar path.
+ */
+template <typename T, typename Index, typename Out>
+inline typename std::iterator_traits<Index>::difference_type
+gather_count(const aggregate<T,1>* base, Index first, Index last, Out& out,
+             std::true_type) {
+  const int* p = reinterpret_cast<const int*>(base->data());
+  const auto n = (last - first) / 8 * 8;
+  for (auto k = n; k; k -= 8, first += 8) {
+    __m256i ix = _mm256_setr_epi32(
+        int(first[0]), int(first[1]), int(first[2]), int(first[3]),
+        int(first[4]), int(first[5]), int(first[6]), int(first[7]));
+    aggregate<T,8> r;
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(r.data()),
+        _mm256_i32gather_epi32(p, ix, 4));
+    for (std::size_t w = 0; w < 8; ++w, ++out)
+      (*out)[0] = r[w];
+  }
+  return n;
+}
+
+#endif
+
+template <typename Base, typename Index, typename Out>
+inline typename std::iterator_traits<Index>::difference_type
+gather_count(Base, Index, Index, Out&, std::false_type) {
+  return 0;
+}
+
+} // end namespace detail
+
+
+/** @brief out[k] = base[first[k]] for the indices in [first,last).
+ *
+ *  @return  The end of the output.
+ */
+template <typename Base, typename Index, typename Out>
+inline Out
+gather(Base base, Index first, Index last, Out out) {
+  typedef typename std::iterator_traits<Base>::value_type V;
+  typedef detail::gather_row<typename V::value_type,
+                             std::tuple_size<V>::value> G;
+  typedef typename std::conditional<std::is_pointer<Base>::value,
+                                    const V*, Base>::type B;
+  std::advance(first, detail::gather_count(B(base), first, last, out,
+                                           detail::gather_words<B, Index>()));
+  for (; first != last; ++first, ++out)
+    G::copy(*out, base[*first]);
+  return out;
+}
+
+/** @brief base[first[k]] += values[k] for the indices in [first,last), in
+ *  order.
+ *
+ *  @return  The end of the values.
+ */
+template <typename Base, typename Index, typename In>
+inline In
+scatter_add(Base base, Index first, Index last, In values) {
+  typedef typename std::iterator_traits<Base>::value_type V;
+  typedef detail::gather_row<typename V::value_type,
+                             std::tuple_size<V>::value> G;
+  for (; first != last; ++first, ++values)
+    G::add(base[*first], *values);
+  return values;
+}
+
+} // end namespace agg
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+
+#include "aggregate.hpp"
+
+/** Hashing of aggregates.
+ *
+ *  std::hash<aggregate<T,N> > makes aggregates keys of the unordered
+ *  containers, and agg::hash_many hashes a range of them at once:
+ *
+ *    std::unordered_map<aggregate<int,3>, cell> grid;
+ *    std::vector<std::size_t> h(keys.size());
+ *    agg::hash_many(keys.begin(), keys.end(), h.begin());
+ *
+ *  Aggregates of elements whose equal values have equal bytes, the
+ *  integers, enums and pointers and any type agg::hash_as_bytes marks, are
+ *  hashed as one block of N * sizeof(T) bytes, eight at a time, with
+ *  128-bit multiply-and-fold mixing in the manner of wyhash. Every bit of
+ *  every element reaches every bit of the hash. float and double aggregates
+ *  are hashed the same way once -0 is made +0, so that equal aggregates
+ *  hash equal. Other elements are hashed with std::hash<T> and the element
+ *  hashes mixed together; for element types with neither, std::hash of the
+ *  aggregate is disabled like std::hash of any unhashable type: it cannot
+ *  be constructed or called.
+ *
+ *  Hashes depend on the byte order and may change between versions; do not
+ *  store them.
+ */
+
+namespace agg {
+
+/** Whether equal values of T have equal bytes and T has no padding, so
+ *  aggregates of T hash as blocks of bytes.
+ *
+ *  Specialize to std::true_type for such user types.
+ */
+template <typename T>
+struct hash_as_bytes
+    : std::integral_constant<bool, std::is_integral<T>::value ||
+                                   std::is_enum<T>::value ||
+                                   std::is_pointer<T>::value> {};
+template <typename T, std::size_t N>
+struct hash_as_bytes<aggregate<T,N> >
+    : std::integral_constant<bool, hash_as_bytes<T>::value &&
+                                   sizeof(aggregate<T,N>) ==
+                                   N * sizeof(T)> {};
+
+
+namespace detail {
+
+constexpr std::uint64_t hash_k0 = 0xa0761d6478bd642full;
+constexpr std::uint64_t hash_k1 = 0xe7037ed1a0b428dbull;
+constexpr std::uint64_t hash_k2 = 0x8ebc6af09c88c6e3ull;
+
+//! The 128-bit product of a and b, its halves folded with exclusive or
+inline std::uint64_t
+hash_mix(std::uint64_t a, std::uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128) a * b;
+  return std::uint64_t(r) ^ std::uint64_t(r >> 64);
+#else
+  std::uint64_t al = a & 0xffffffff, ah = a >> 32;
+  std::uint64_t bl = b & 0xffffffff, bh = b >> 32;
+  std::uint64_t ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+  std::uint64_t mid = (ll >> 32) + (lh & 0xffffffff) + (hl & 0xffffffff);
+  std::uint64_t lo = (mid << 32) | (ll & 0xffffffff);
+  std::uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  return lo ^ hi;
+#endif
+}
+
+inline std::uint64_t
+hash_read8(const unsigned char* p) {
+  std::uint64_t x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+inline std::uint64_t
+hash_read4(const unsigned char* p) {
+  std::uint32_t x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+//! Hash of the bytes [p, p+n); inlined with a constant n, the branches fold
+inline std::uint64_t
+hash_bytes(const void* data, std::size_t n, std::uint64_t seed = 0) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  seed ^= hash_k0;
+  std::uint64_t a, b;
+  if (n <= 16) {
+    if (n >= 4) {
+      // Two overlapping pairs of 4-byte words cover 4 to 16 bytes
+      std::size_t d = (n >> 3) << 2;
+      a = (hash_read4(p) << 32) | hash_read4(p + d);
+      b = (hash_read4(p + n - 4) << 32) | hash_read4(p + n - 4 - d);
+    } else if (n > 0) {
+      a = (std::uint64_t(p[0]) << 16) | (std::uint64_t(p[n >> 1]) << 8)
+          | p[n - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    std::size_t i = n;
+    if (i > 48) {
+      std::uint64_t s1 = seed, s2 = seed;
+      do {
+        seed = hash_mix(hash_read8(p) ^ hash_k1, hash_read8(p + 8) ^ seed);
+        s1 = hash_mix(hash_read8(p + 16) ^ hash_k2, hash_read8(p + 24) ^ s1);
+        s2 = hash_mix(hash_read8(p + 32) ^ hash_k0, hash_read8(p + 40) ^ s2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= s1 ^ s2;
+    }
+    for ( ; i > 16; i -= 16, p += 16)
+      seed = hash_mix(hash_read8(p) ^ hash_k1, hash_read8(p + 8) ^ seed);
+    a = hash_read8(p + i - 16);
+    b = hash_read8(p + i - 8);
+  }
+  return hash_mix(hash_k1 ^ n, hash_mix(a ^ hash_k1, b ^ seed));
+}
+
+
+//! Hash of aggregate<T,N>, by the kind of T
+template <typename T, typename Enable = void>
+struct hash_kernel {
+  template <std::size_t N>
+  static std::size_t hash(const aggregate<T,N>& a) {
+    std::hash<T> h;
+    std::uint64_t r = hash_k0 ^ N;
+    for (std::size_t i = 0; i < N; ++i)
+      r = hash_mix(r ^ std::uint64_t(h(a[i])), hash_k1);
+    return std::size_t(r);
+  }
+};
+
+template <typename T>
+struct hash_kernel<T, enable_if<hash_as_bytes<T>, void> > {
+  template <std::size_t N>
+  static std::size_t hash(const aggregate<T,N>& a) {
+    return std::size_t(hash_bytes(a.data(), N * sizeof(T)));
+  }
+};
+
+template <typename T>
+struct hash_kernel<T, enable_if<
+    std::integral_constant<bool, std::is_floating_point<T>::value &&
+                                 std::numeric_limits<T>::is_iec559 &&
+                                 (sizeof(T) == 4 || sizeof(T) == 8)>,
+    void> > {
+  template <std::size_t N>
+  static std::size_t hash(const aggregate<T,N>& a) {
+    aggregate<T,N> c = canonical_zero(a);
+    return std::size_t(hash_bytes(c.data(), N * sizeof(T)));
+  }
+};
+
+//! Whether std::hash<T> hashes T
+template <typename T, typename Enable = void>
+struct std_hashable : std::false_type {};
+template <typename T>
+struct std_hashable<T,
+    decltype(void(std::hash<T>()(std::declval<const T&>())))>
+    : std::true_type {};
+
+//! std::hash<aggregate<T,N> >, disabled unless some hash_kernel<T> applies
+template <typename T, std::size_t N, typename Enable = void>
+struct aggregate_hash {
+  aggregate_hash() = delete;
+  aggregate_hash(const aggregate_hash&) = delete;
+  aggregate_hash& operator=(const aggregate_hash&) = delete;
+};
+template <typename T, std::size_t N>
+struct aggregate_hash<T,N, enable_if<
+    std::integral_constant<bool, hash_as_bytes<T>::value ||
+                                 std_hashable<T>::value>, void> > {
+  typedef aggregate<T,N> argument_type;
+  typedef std::size_t    result_type;
+
+  std::size_t
+  operator()(const aggregate<T,N>& a) const {
+    return hash_kernel<T>::hash(a);
+  }
+};
+
+} // end namespace detail
+
+
+/** Write the hash of each aggregate of [first, last) to out, as
+ *  std::hash would, and return the end of the output.
+ */
+template <typename InputIt, typename OutputIt>
+inline OutputIt
+hash_many(InputIt first, InputIt last, OutputIt out) {
+  std::hash<typename std::iterator_traits<InputIt>::value_type> h;
+  for ( ; first != last; ++first, ++out)
+    *out = h(*first);
+  return out;
+}
+
+} // end namespace agg
+
+
+namespace std {
+
+//! Specialization of std::hash, for element types that can be hashed
+template <typename T, std::size_t N>
+struct hash<agg::aggregate<T,N> > : agg::detail::aggregate_hash<T,N> {};
+
+} // namespace std
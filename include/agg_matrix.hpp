@@ -0,0 +1,489 @@
+#pragma once
+
+#include "aggregate.hpp"
+
+/** Small fixed-size matrices as nested aggregates.
+ *
+ *  agg::matrix<T,M,N> is aggregate<aggregate<T,N>,M>: M rows of N elements,
+ *  stored row-major with the row stride of aggregate<T,N> (including any
+ *  padding from aggregate_storage). matmul, matvec, transpose and outer
+ *  unroll at compile time up to AGG_UNROLL_LIMIT and loop beyond;
+ *  determinant and inverse use closed forms for N <= 4.
+ *
+ *  With AGG_SIMD (see agg_simd.hpp), matmul is specialized for float and
+ *  double rows of 3 or 4 elements, and matvec for rows of 4, holding each
+ *  row in one register.
+ *  Sums of products are then accumulated in a different order than the
+ *  generic tree, and with fused multiply-adds where available, so results
+ *  can differ in the last bits.
+ */
+
+namespace agg {
+
+//! M rows of N elements
+template <typename T, std::size_t M, std::size_t N>
+using matrix = aggregate<aggregate<T,N>,M>;
+
+//! Type of the determinant of a matrix of T
+template <typename T>
+using determinant_result_t = decay_t<minus_result_t<dot_result_t<T,T>,
+                                                    dot_result_t<T,T> > >;
+
+//! Type of the elements of the inverse of a matrix of T
+template <typename T>
+using inverse_result_t = decay_t<divides_result_t<determinant_result_t<T>,
+                                                  determinant_result_t<T> > >;
+
+namespace detail {
+
+//! a[i] * b[i][J] as R
+template <typename R, typename T, typename U, std::size_t K, std::size_t N,
+          std::size_t J>
+struct matmul_leaf {
+  const aggregate<T,K>& a;
+  const matrix<U,K,N>& b;
+  R operator[](std::size_t i) const {
+    return static_cast<R>(a[i] * std::get<J>(b[i]));
+  }
+};
+
+//! Row a of A times B
+template <typename Row, typename U, std::size_t K, std::size_t N>
+struct matmul_row {
+  typedef typename Row::value_type E;
+  const matrix<U,K,N>& b;
+
+  template <typename T>
+  Row operator()(const aggregate<T,K>& a) const {
+    return apply(unrolled<K*N>(), a);
+  }
+
+ private:
+  template <typename T>
+  Row apply(std::true_type, const aggregate<T,K>& a) const {
+    return apply(make_index_sequence<N>(), a);
+  }
+  template <typename T, std::size_t... J>
+  Row apply(index_sequence<J...>, const aggregate<T,K>& a) const {
+    return {tree_reduce<0,K>::template apply<E>(
+        fn::plus(), matmul_leaf<E,T,U,K,N,J>{a, b})...};
+  }
+  template <typename T>
+  Row apply(std::false_type, const aggregate<T,K>& a) const {
+    Row r;
+    for (std::size_t j = 0; j < N; ++j)
+      r[j] = static_cast<E>(a[0] * b[0][j]);
+    for (std::size_t k = 1; k < K; ++k)
+      for (std::size_t j = 0; j < N; ++j)
+        r[j] = static_cast<E>(r[j] + a[k] * b[k][j]);
+    return r;
+  }
+};
+
+//! C = A * B
+template <typename T, typename U, typename Enable = void>
+struct matmul_kernel {
+  template <typename R, std::size_t M, std::size_t K, std::size_t N>
+  static R apply(const matrix<T,M,K>& a, const matrix<U,K,N>& b) {
+    return tuple_map<R>(matmul_row<typename R::value_type,U,K,N>{b}, a);
+  }
+};
+
+//! Row a of A dotted with x
+template <typename E, typename U, std::size_t K>
+struct matvec_row {
+  const aggregate<U,K>& x;
+  template <typename T>
+  E operator()(const aggregate<T,K>& a) const {
+    return dot_kernel<T,U>::template apply<E>(a, x);
+  }
+};
+
+//! y = A * x
+template <typename T, typename U, typename Enable = void>
+struct matvec_kernel {
+  template <typename R, std::size_t M, std::size_t K>
+  static R apply(const matrix<T,M,K>& a, const aggregate<U,K>& x) {
+    return tuple_map<R>(matvec_row<typename R::value_type,U,K>{x}, a);
+  }
+};
+
+#if defined(AGG_SIMD)
+
+/** Register holding one row of N elements of T, N of 3 or 4, for the matrix
+ *  kernels: four float or double lanes.
+ */
+template <typename T, std::size_t N, typename Enable = void>
+struct simd_row : std::false_type {};
+template <typename T, std::size_t N>
+struct simd_row<T,N,
+    enable_if<std::integral_constant<bool,
+        std::is_floating_point<T>::value && (N == 3 || N == 4) &&
+        simd_supports<simd_op<fn::multiplies>,
+                      simd_reg<typename simd_kind<T>::type, 4*sizeof(T)>,
+                      2>::value>, void> >
+    : std::true_type {
+  typedef simd_reg<typename simd_kind<T>::type, 4*sizeof(T)> S;
+  typedef typename S::type type;
+
+  //! Whether aggregate<T,N> storage spans a whole register
+  static constexpr bool full = __aggregate_traits<T,N>::_Lanes >= S::lanes;
+
+  //! The row in a register, with the padding lanes of the storage or zeros
+  static type load(const aggregate<T,N>& a) {
+    return load(a, std::integral_constant<bool, full>());
+  }
+  static type load(const aggregate<T,N>& a, std::true_type) {
+    return S::load(a.data());
+  }
+  static type load(const aggregate<T,N>& a, std::false_type) {
+    return S::load3(a.data());
+  }
+
+  //! Store the first N lanes, and padding lanes the storage has
+  static void store(aggregate<T,N>& a, type v) {
+    store(a, v, std::integral_constant<bool, full>());
+  }
+  static void store(aggregate<T,N>& a, type v, std::true_type) {
+    S::store(a.data(), v);
+  }
+  static void store(aggregate<T,N>& a, type v, std::false_type) {
+    S::store3(a.data(), v);
+  }
+};
+
+/** Rows of A times the rows of B held in registers: row i of C accumulates
+ *  a[i][k] * b[k] over k. Up to four rows of B, of 3 or 4 elements.
+ */
+template <typename T>
+struct matmul_kernel<T,T, enable_if<std::is_floating_point<T>, void> >
+    : matmul_kernel<T,T,generic_kernel> {
+  typedef matmul_kernel<T,T,generic_kernel> generic;
+
+  template <typename R, std::size_t M, std::size_t K, std::size_t N>
+  static R apply(const matrix<T,M,K>& a, const matrix<T,K,N>& b) {
+    return apply<R>(a, b, std::integral_constant<bool,
+                            simd_row<T,N>::value && K <= 4>());
+  }
+  template <typename R, std::size_t M, std::size_t K, std::size_t N>
+  static R apply(const matrix<T,M,K>& a, const matrix<T,K,N>& b,
+                 std::true_type) {
+    typedef simd_row<T,N> V;
+    typedef typename V::S S;
+    typename S::type rb[K];
+    for (std::size_t k = 0; k < K; ++k)
+      rb[k] = V::load(b[k]);
+    R r;
+    for (std::size_t i = 0; i < M; ++i) {
+      typename S::type c = S::mul(S::set1(a[i][0]), rb[0]);
+      for (std::size_t k = 1; k < K; ++k)
+        c = simd_madd<S>(S::set1(a[i][k]), rb[k], c, 0);
+      V::store(r[i], c);
+    }
+    return r;
+  }
+  template <typename R, std::size_t M, std::size_t K, std::size_t N>
+  static R apply(const matrix<T,M,K>& a, const matrix<T,K,N>& b,
+                 std::false_type) {
+    return generic::template apply<R>(a, b);
+  }
+};
+
+/** Products of the rows of A with x, up to four rows of 4 elements, summed
+ *  across lanes by one transposing hadd4. Rows of 3 elements are left to
+ *  the per-row dot products, which measured faster than widening them.
+ */
+template <typename T>
+struct matvec_kernel<T,T, enable_if<std::is_floating_point<T>, void> >
+    : matvec_kernel<T,T,generic_kernel> {
+  typedef matvec_kernel<T,T,generic_kernel> generic;
+
+  template <typename R, std::size_t M, std::size_t K>
+  static R apply(const matrix<T,M,K>& a, const aggregate<T,K>& x) {
+    return apply<R>(a, x, std::integral_constant<bool,
+                            K == 4 && simd_row<T,K>::value &&
+                            simd_row<T,M>::value>());
+  }
+  template <typename R, std::size_t M, std::size_t K>
+  static R apply(const matrix<T,M,K>& a, const aggregate<T,K>& x,
+                 std::true_type) {
+    typedef simd_row<T,K> V;
+    typedef typename V::S S;
+    const typename S::type rx = V::load(x);
+    typename S::type p[4];
+    for (std::size_t i = 0; i < M; ++i)
+      p[i] = S::mul(V::load(a[i]), rx);
+    for (std::size_t i = M; i < 4; ++i)
+      p[i] = S::set1(T());
+    R r;
+    simd_row<T,M>::store(r, S::hadd4(p[0], p[1], p[2], p[3]));
+    return r;
+  }
+  template <typename R, std::size_t M, std::size_t K>
+  static R apply(const matrix<T,M,K>& a, const aggregate<T,K>& x,
+                 std::false_type) {
+    return generic::template apply<R>(a, x);
+  }
+};
+
+#endif // AGG_SIMD
+
+//! Row a[i] * b
+template <typename Row, typename U, std::size_t N>
+struct outer_row {
+  const aggregate<U,N>& b;
+  template <typename T>
+  Row operator()(const T& a) const {
+    return map_kernel<fn::multiplies,T,U>::template map_left<Row>(a, b);
+  }
+};
+
+//! Column J of a matrix
+template <std::size_t J, typename Col, typename T, std::size_t M,
+          std::size_t N, std::size_t... I>
+inline Col
+transpose_col(const matrix<T,M,N>& a, index_sequence<I...>) {
+  return {std::get<J>(std::get<I>(a))...};
+}
+
+template <typename R, typename T, std::size_t M, std::size_t N,
+          std::size_t... J>
+inline R
+transpose_impl(index_sequence<J...>, const matrix<T,M,N>& a) {
+  typedef typename R::value_type Col;
+  return {transpose_col<J,Col>(a, make_index_sequence<M>())...};
+}
+
+template <typename R, typename T, std::size_t M, std::size_t N>
+inline R
+transpose_impl(std::true_type, const matrix<T,M,N>& a) {
+  return transpose_impl<R>(make_index_sequence<N>(), a);
+}
+
+template <typename R, typename T, std::size_t M, std::size_t N>
+inline R
+transpose_impl(std::false_type, const matrix<T,M,N>& a) {
+  R r;
+  for (std::size_t i = 0; i < M; ++i)
+    for (std::size_t j = 0; j < N; ++j)
+      r[j][i] = a[i][j];
+  return r;
+}
+
+
+//! x / d, through the reciprocal of d for floating-point d
+template <typename D, typename Enable = void>
+struct inverse_scale {
+  D d;
+  template <typename X>
+  auto operator()(const X& x) const -> decltype(x / d) { return x / d; }
+};
+template <typename D>
+struct inverse_scale<D,
+    enable_if<std::is_floating_point<D>, void> > {
+  D r;
+  explicit inverse_scale(const D& d) : r(D(1) / d) {}
+  D operator()(const D& x) const { return x * r; }
+};
+template <typename T, std::size_t N>
+struct inverse_scale<aggregate<T,N>,
+    enable_if<std::is_floating_point<T>, void> > {
+  aggregate<T,N> r;
+  explicit inverse_scale(const aggregate<T,N>& d) : r(T(1) / d) {}
+  aggregate<T,N> operator()(const aggregate<T,N>& x) const { return x * r; }
+};
+
+//! Determinant and inverse of an N x N matrix
+template <std::size_t N>
+struct square_kernel;
+
+template <>
+struct square_kernel<1> {
+  template <typename D, typename T>
+  static D det(const matrix<T,1,1>& a) {
+    return static_cast<D>(a[0][0]);
+  }
+  template <typename R, typename T>
+  static R inverse(const matrix<T,1,1>& a) {
+    typedef determinant_result_t<T> D;
+    typedef typename R::value_type Row;
+    inverse_scale<D> s{det<D>(a)};
+    return {Row{{s(D(1))}}};
+  }
+};
+
+template <>
+struct square_kernel<2> {
+  template <typename D, typename T>
+  static D det(const matrix<T,2,2>& a) {
+    return static_cast<D>(a[0][0] * a[1][1] - a[0][1] * a[1][0]);
+  }
+  template <typename R, typename T>
+  static R inverse(const matrix<T,2,2>& a) {
+    typedef determinant_result_t<T> D;
+    typedef typename R::value_type Row;
+    inverse_scale<D> s{det<D>(a)};
+    return {Row{{s(a[1][1]), s(D() - a[0][1])}},
+            Row{{s(D() - a[1][0]), s(a[0][0])}}};
+  }
+};
+
+template <>
+struct square_kernel<3> {
+  template <typename D, typename T>
+  static D det(const matrix<T,3,3>& a) {
+    return static_cast<D>(a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+                        + a[0][1] * (a[1][2] * a[2][0] - a[1][0] * a[2][2])
+                        + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]));
+  }
+  template <typename R, typename T>
+  static R inverse(const matrix<T,3,3>& a) {
+    typedef determinant_result_t<T> D;
+    typedef typename R::value_type Row;
+    // Cofactors of the first column, reused by the determinant
+    const D c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+    const D c10 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+    const D c20 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+    inverse_scale<D> s{static_cast<D>(a[0][0] * c00 + a[0][1] * c10
+                                      + a[0][2] * c20)};
+    return {Row{{s(c00),
+                 s(a[0][2] * a[2][1] - a[0][1] * a[2][2]),
+                 s(a[0][1] * a[1][2] - a[0][2] * a[1][1])}},
+            Row{{s(c10),
+                 s(a[0][0] * a[2][2] - a[0][2] * a[2][0]),
+                 s(a[0][2] * a[1][0] - a[0][0] * a[1][2])}},
+            Row{{s(c20),
+                 s(a[0][1] * a[2][0] - a[0][0] * a[2][1]),
+                 s(a[0][0] * a[1][1] - a[0][1] * a[1][0])}}};
+  }
+};
+
+/** Through the 2x2 minors of the top two rows (s) and the bottom two rows
+ *  (c), which the determinant and every cofactor share.
+ */
+template <>
+struct square_kernel<4> {
+  template <typename D, typename T>
+  struct minors {
+    D s0, s1, s2, s3, s4, s5;
+    D c0, c1, c2, c3, c4, c5;
+
+    explicit minors(const matrix<T,4,4>& a)
+        : s0(a[0][0] * a[1][1] - a[1][0] * a[0][1]),
+          s1(a[0][0] * a[1][2] - a[1][0] * a[0][2]),
+          s2(a[0][0] * a[1][3] - a[1][0] * a[0][3]),
+          s3(a[0][1] * a[1][2] - a[1][1] * a[0][2]),
+          s4(a[0][1] * a[1][3] - a[1][1] * a[0][3]),
+          s5(a[0][2] * a[1][3] - a[1][2] * a[0][3]),
+          c0(a[2][0] * a[3][1] - a[3][0] * a[2][1]),
+          c1(a[2][0] * a[3][2] - a[3][0] * a[2][2]),
+          c2(a[2][0] * a[3][3] - a[3][0] * a[2][3]),
+          c3(a[2][1] * a[3][2] - a[3][1] * a[2][2]),
+          c4(a[2][1] * a[3][3] - a[3][1] * a[2][3]),
+          c5(a[2][2] * a[3][3] - a[3][2] * a[2][3]) {}
+
+    D det() const {
+      return static_cast<D>(s0 * c5 - s1 * c4 + s2 * c3
+                          + s3 * c2 - s4 * c1 + s5 * c0);
+    }
+  };
+
+  template <typename D, typename T>
+  static D det(const matrix<T,4,4>& a) {
+    return minors<D,T>(a).det();
+  }
+
+  template <typename R, typename T>
+  static R inverse(const matrix<T,4,4>& a) {
+    typedef determinant_result_t<T> D;
+    typedef typename R::value_type Row;
+    const minors<D,T> m(a);
+    inverse_scale<D> s{m.det()};
+    return {Row{{s(a[1][1] * m.c5 - a[1][2] * m.c4 + a[1][3] * m.c3),
+                 s(a[0][2] * m.c4 - a[0][1] * m.c5 - a[0][3] * m.c3),
+                 s(a[3][1] * m.s5 - a[3][2] * m.s4 + a[3][3] * m.s3),
+                 s(a[2][2] * m.s4 - a[2][1] * m.s5 - a[2][3] * m.s3)}},
+            Row{{s(a[1][2] * m.c2 - a[1][0] * m.c5 - a[1][3] * m.c1),
+                 s(a[0][0] * m.c5 - a[0][2] * m.c2 + a[0][3] * m.c1),
+                 s(a[3][2] * m.s2 - a[3][0] * m.s5 - a[3][3] * m.s1),
+                 s(a[2][0] * m.s5 - a[2][2] * m.s2 + a[2][3] * m.s1)}},
+            Row{{s(a[1][0] * m.c4 - a[1][1] * m.c2 + a[1][3] * m.c0),
+                 s(a[0][1] * m.c2 - a[0][0] * m.c4 - a[0][3] * m.c0),
+                 s(a[3][0] * m.s4 - a[3][1] * m.s2 + a[3][3] * m.s0),
+                 s(a[2][1] * m.s2 - a[2][0] * m.s4 - a[2][3] * m.s0)}},
+            Row{{s(a[1][1] * m.c1 - a[1][0] * m.c3 - a[1][2] * m.c0),
+                 s(a[0][0] * m.c3 - a[0][1] * m.c1 + a[0][2] * m.c0),
+                 s(a[3][1] * m.s1 - a[3][0] * m.s3 - a[3][2] * m.s0),
+                 s(a[2][0] * m.s3 - a[2][1] * m.s1 + a[2][2] * m.s0)}}};
+  }
+};
+
+} // end namespace detail
+
+
+//! The M x N product of an M x K and a K x N matrix
+template <typename T, typename U, std::size_t M, std::size_t K, std::size_t N>
+inline
+enable_if<
+  has_multiplies<T,U>,
+  matrix<dot_result_t<T,U>,M,N> >
+matmul(const matrix<T,M,K>& a, const matrix<U,K,N>& b) {
+  static_assert(M > 0 && K > 0 && N > 0, "matmul of an empty matrix");
+  typedef matrix<dot_result_t<T,U>,M,N> R;
+  return detail::matmul_kernel<T,U>::template apply<R>(a, b);
+}
+
+//! The product of an M x K matrix and a vector of K elements
+template <typename T, typename U, std::size_t M, std::size_t K>
+inline
+enable_if<
+  has_multiplies<T,U>,
+  aggregate<dot_result_t<T,U>,M> >
+matvec(const matrix<T,M,K>& a, const aggregate<U,K>& x) {
+  static_assert(M > 0, "matvec of an empty matrix");
+  typedef aggregate<dot_result_t<T,U>,M> R;
+  return detail::matvec_kernel<T,U>::template apply<R>(a, x);
+}
+
+//! The N x M matrix of a[j][i]
+template <typename T, std::size_t M, std::size_t N>
+inline matrix<T,N,M>
+transpose(const matrix<T,M,N>& a) {
+  return detail::transpose_impl<matrix<T,N,M> >(
+      detail::unrolled<M*N>(), a);
+}
+
+//! The M x N matrix of a[i] * b[j]
+template <typename T, typename U, std::size_t M, std::size_t N>
+inline
+enable_if<
+  has_multiplies<T,U>,
+  matrix<decay_t<multiplies_result_t<T,U> >,M,N> >
+outer(const aggregate<T,M>& a, const aggregate<U,N>& b) {
+  typedef matrix<decay_t<multiplies_result_t<T,U> >,M,N> R;
+  return detail::tuple_map<R>(
+      detail::outer_row<typename R::value_type,U,N>{b}, a);
+}
+
+//! Determinant of an N x N matrix, N <= 4
+template <typename T, std::size_t N>
+inline determinant_result_t<T>
+determinant(const matrix<T,N,N>& a) {
+  static_assert(0 < N && N <= 4, "determinant is implemented for N <= 4");
+  return detail::square_kernel<N>::template det<determinant_result_t<T> >(a);
+}
+
+/** Inverse of an N x N matrix, N <= 4, as the adjugate over the determinant
+ *
+ *  The matrix must be invertible; for a floating-point T a singular matrix
+ *  gives infinite or NaN elements.
+ */
+template <typename T, std::size_t N>
+inline matrix<inverse_result_t<T>,N,N>
+inverse(const matrix<T,N,N>& a) {
+  static_assert(0 < N && N <= 4, "inverse is implemented for N <= 4");
+  typedef matrix<inverse_result_t<T>,N,N> R;
+  return detail::square_kernel<N>::template inverse<R>(a);
+}
+
+} // end namespace agg
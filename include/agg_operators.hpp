@@ -3,6 +3,13 @@
 #include <iostream>
 #include <cassert>
 
+/** Largest aggregate size whose element-wise operations are unrolled at
+ *  compile time; see detail::unrolled.
+ */
+#if !defined(AGG_UNROLL_LIMIT)
+#define AGG_UNROLL_LIMIT 32
+#endif
+
 namespace agg {
 
 //! Granulated sugar
@@ -12,6 +19,33 @@ using enable_if = typename std::enable_if<Bool::value, Type>::type;
 template <typename Type>
 using decay_t = typename std::decay<Type>::type;
 
+/** Whether U is broadcast to every element as a scalar operand of the
+ *  aggregate operators.
+ *
+ *  Specialize to std::false_type for types that define their own operators
+ *  with aggregates, so the broadcasting overloads do not compete with them.
+ */
+template <typename U, typename Enable = void>
+struct is_scalar_operand : std::true_type {};
+
+//! Streams take aggregates whole through << and >>
+template <typename U>
+struct is_scalar_operand<
+  U, enable_if<std::is_base_of<std::ios_base,U>, void> > : std::false_type {};
+
+/** Whether the binary operators reuse an expiring aggregate<T,N> operand,
+ *  e.g. std::move(a) + b, as their result when it has the result type,
+ *  computing a[i] = std::move(a[i]) op b[i] in its storage instead of
+ *  building a new aggregate.
+ *
+ *  True for element types with non-trivial copies, such as std::string or
+ *  big integers, which own storage worth keeping. Aggregates of trivially
+ *  copyable elements always take the element-wise kernels.
+ */
+template <typename T>
+struct reuse_operand
+    : std::integral_constant<bool, !std::is_trivially_copyable<T>::value> {};
+
 
 namespace detail {
 
@@ -21,23 +55,64 @@ struct integer_sequence {};
 template <std::size_t... Ints>
 using index_sequence = integer_sequence<std::size_t, Ints...>;
 
-template <class T, std::size_t N, T... Is>
-struct generate_integer_sequence {
-  using type = typename generate_integer_sequence<T, N-1, N-1, Is...>::type;
+#if defined(__has_builtin) && !defined(AGG_NO_BUILTIN_SEQUENCE)
+#  if __has_builtin(__make_integer_seq)
+#    define AGG_MAKE_INTEGER_SEQ 1
+#  elif __has_builtin(__integer_pack)
+#    define AGG_INTEGER_PACK 1
+#  endif
+#endif
+
+#if defined(AGG_MAKE_INTEGER_SEQ)
+template <class T, T N>
+using make_integer_sequence = __make_integer_seq<integer_sequence, T, N>;
+#elif defined(AGG_INTEGER_PACK)
+template <class T, T N>
+using make_integer_sequence = integer_sequence<T, __integer_pack(N)...>;
+#else
+//! [0,N) as the concatenation of [0,N/2) and [N/2,N), log(N) deep
+template <class S1, class S2>
+struct concat_integer_sequence;
+template <class T, T... I, T... J>
+struct concat_integer_sequence<integer_sequence<T, I...>,
+                               integer_sequence<T, J...> > {
+  using type = integer_sequence<T, I..., (T(sizeof...(I)) + J)...>;
 };
-template <class T, T... Is>
-struct generate_integer_sequence<T, 0, Is...> {
-  using type = integer_sequence<T, Is...>;
+
+template <class T, std::size_t N>
+struct generate_integer_sequence
+    : concat_integer_sequence<
+        typename generate_integer_sequence<T, N/2>::type,
+        typename generate_integer_sequence<T, N - N/2>::type> {};
+template <class T>
+struct generate_integer_sequence<T, 0> {
+  using type = integer_sequence<T>;
+};
+template <class T>
+struct generate_integer_sequence<T, 1> {
+  using type = integer_sequence<T, T(0)>;
 };
 
 template <class T, T N>
 using make_integer_sequence = typename generate_integer_sequence<T, N>::type;
+#endif
+#undef AGG_MAKE_INTEGER_SEQ
+#undef AGG_INTEGER_PACK
+
 template <std::size_t N>
 using make_index_sequence = make_integer_sequence<std::size_t, N>;
 
 
+/** Whether element-wise operations on N elements are unrolled at compile
+ *  time. Larger aggregates run a loop instead, which keeps the generated
+ *  code and the instantiation depth independent of N.
+ */
+template <std::size_t N>
+struct unrolled : std::integral_constant<bool, N <= AGG_UNROLL_LIMIT> {};
+
+
 template <std::size_t I, typename Fn, typename... Tuples>
-auto tuple_map_invoke(Fn f, Tuples&&... ts)
+constexpr auto tuple_map_invoke(Fn f, Tuples&&... ts)
     -> decltype(f(std::get<I>(std::forward<Tuples>(ts))...)) {
   return f(std::get<I>(std::forward<Tuples>(ts))...);
 }
@@ -45,7 +120,7 @@ auto tuple_map_invoke(Fn f, Tuples&&... ts)
 template <typename R>
 struct tuple_map_make_impl {
   template <std::size_t... I, typename Fn, typename... Tuples>
-  static R apply(index_sequence<I...>, Fn f, Tuples&&... ts) {
+  static constexpr R apply(index_sequence<I...>, Fn f, Tuples&&... ts) {
     return {tuple_map_invoke<I>(f, std::forward<Tuples>(ts)...)...};
   }
 };
@@ -53,21 +128,255 @@ struct tuple_map_make_impl {
 template <>
 struct tuple_map_make_impl<void> {
   template <std::size_t... I, typename Fn, typename... Tuples>
-  static void apply(index_sequence<I...>, Fn f, Tuples&&... ts) {
+  static AGG_CONSTEXPR14 void apply(index_sequence<I...>, Fn f,
+                                    Tuples&&... ts) {
     auto l =
         { (tuple_map_invoke<I>(f, std::forward<Tuples>(ts)...), void(), 0)... };
     (void) l;
   }
 };
 
+//! t[i], as an rvalue if Tuple is not an lvalue reference, like std::get
+template <typename Tuple,
+          typename Ref = decltype(std::declval<Tuple&>()[0]),
+          typename Out = typename std::conditional<
+              std::is_lvalue_reference<Tuple>::value,
+              Ref, typename std::remove_reference<Ref>::type&&>::type>
+constexpr Out tuple_at(typename std::remove_reference<Tuple>::type& t,
+                       std::size_t i) {
+  return static_cast<Out>(t[i]);
+}
+
+//! The loop counterpart of tuple_map_make_impl, through operator[]
+template <typename R>
+struct tuple_map_loop_impl {
+  template <typename Fn, typename... Tuples>
+  static R apply(std::size_t n, Fn f, Tuples&&... ts) {
+    R r;
+    for (std::size_t i = 0; i < n; ++i)
+      r[i] = f(tuple_at<Tuples>(ts, i)...);
+    return r;
+  }
+
+  //! apply() into a value-initialized R, as constant expressions require
+  template <typename Fn, typename... Tuples>
+  static AGG_CONSTEXPR14 R apply_constexpr(std::size_t n, Fn f,
+                                           Tuples&&... ts) {
+    R r{};
+    for (std::size_t i = 0; i < n; ++i)
+      r[i] = f(tuple_at<Tuples>(ts, i)...);
+    return r;
+  }
+};
+
+template <>
+struct tuple_map_loop_impl<void> {
+  template <typename Fn, typename... Tuples>
+  static AGG_CONSTEXPR14 void apply(std::size_t n, Fn f, Tuples&&... ts) {
+    for (std::size_t i = 0; i < n; ++i)
+      f(tuple_at<Tuples>(ts, i)...);
+  }
+
+  template <typename Fn, typename... Tuples>
+  static AGG_CONSTEXPR14 void apply_constexpr(std::size_t n, Fn f,
+                                              Tuples&&... ts) {
+    apply(n, f, std::forward<Tuples>(ts)...);
+  }
+};
+
+template <typename R, std::size_t N, typename Fn, typename... Tuples>
+constexpr R tuple_map_dispatch(std::true_type, Fn f, Tuples&&... ts) {
+  return tuple_map_make_impl<R>::apply(make_index_sequence<N>(),
+                                       f, std::forward<Tuples>(ts)...);
+}
+
+template <typename R, std::size_t N, typename Fn, typename... Tuples>
+constexpr R tuple_map_dispatch(std::false_type, Fn f, Tuples&&... ts) {
+  return AGG_IS_CONSTANT_EVALUATED()
+      ? tuple_map_loop_impl<R>::apply_constexpr(N, f,
+                                                std::forward<Tuples>(ts)...)
+      : tuple_map_loop_impl<R>::apply(N, f, std::forward<Tuples>(ts)...);
+}
+
 // TODO: Default or deduce the return type R?
+/** R{f(std::get<I>(t), std::get<I>(ts)...)...}, or a loop over operator[]
+ *  into a default-constructed R when the size is not unrolled<>.
+ *  The elements of rvalue tuples are passed to f as rvalues.
+ *
+ *  Usable in constant expressions when f is, since C++11 if unrolled and
+ *  since C++14 otherwise.
+ */
 template <typename R, typename Fn, typename Tuple, typename... Tuples>
-R tuple_map(Fn f, Tuple&& t, Tuples&&... ts) {
-  return tuple_map_make_impl<R>::apply(
-      make_index_sequence<std::tuple_size<decay_t<Tuple>>::value>(),
-      f,
-      t,
-      std::forward<Tuples>(ts)...);
+constexpr R tuple_map(Fn f, Tuple&& t, Tuples&&... ts) {
+  typedef std::tuple_size<decay_t<Tuple>> N;
+  return tuple_map_dispatch<R,N::value>(unrolled<N::value>(),
+                                        f,
+                                        std::forward<Tuple>(t),
+                                        std::forward<Tuples>(ts)...);
+}
+
+
+//! Fn with its right operand bound, broadcasts a scalar over an aggregate
+template <typename Fn, typename U>
+struct bind_right {
+  const U& u;
+  template <typename T>
+  constexpr auto operator()(T&& t) const
+      -> decltype(Fn()(std::forward<T>(t), std::declval<const U&>())) {
+    return Fn()(std::forward<T>(t), u);
+  }
+};
+
+//! Fn with its left operand bound, broadcasts a scalar over an aggregate
+template <typename Fn, typename T>
+struct bind_left {
+  const T& t;
+  template <typename U>
+  constexpr auto operator()(U&& u) const
+      -> decltype(Fn()(std::declval<const T&>(), std::forward<U>(u))) {
+    return Fn()(t, std::forward<U>(u));
+  }
+};
+
+
+//! Whether an expiring aggregate of T can hold a result of element type R
+template <typename R, typename T>
+struct reuses
+    : std::integral_constant<bool,
+        reuse_operand<T>::value && std::is_same<decay_t<R>,T>::value> {};
+
+//! a = fn(std::move(a), b), the result taking the place of the left operand
+template <typename Fn>
+struct reuse_left {
+  template <typename T, typename U>
+  AGG_CONSTEXPR14 void operator()(T& a, U&& b) const {
+    a = Fn()(std::move(a), std::forward<U>(b));
+  }
+};
+
+//! b = fn(a, std::move(b)), the result taking the place of the right operand
+template <typename Fn>
+struct reuse_right {
+  template <typename T, typename U>
+  AGG_CONSTEXPR14 void operator()(T&& a, U& b) const {
+    b = Fn()(std::forward<T>(a), std::move(b));
+  }
+};
+
+//! Broadcasts a scalar as the right operand of reuse_left
+template <typename Fn, typename U>
+struct reuse_left_scalar {
+  const U& u;
+  template <typename T>
+  AGG_CONSTEXPR14 void operator()(T& a) const {
+    a = Fn()(std::move(a), u);
+  }
+};
+
+//! Broadcasts a scalar as the left operand of reuse_right
+template <typename Fn, typename T>
+struct reuse_right_scalar {
+  const T& t;
+  template <typename U>
+  AGG_CONSTEXPR14 void operator()(U& b) const {
+    b = Fn()(t, std::move(b));
+  }
+};
+
+/** Element-wise kernels behind the operators.
+ *
+ *  The generic versions map through tuple_map, unrolled up to
+ *  AGG_UNROLL_LIMIT elements and looped beyond. agg_simd.hpp specializes
+ *  them for aggregates of arithmetic types; a specialization reaches the
+ *  generic version through the generic_kernel tag.
+ *
+ *  The generic versions are constexpr, and the operators call them directly
+ *  while AGG_IS_CONSTANT_EVALUATED().
+ */
+struct generic_kernel {};
+
+//! r = fn(a) for a possibly const aggregate<T,N> a
+template <typename Fn, typename T, typename Enable = void>
+struct unary_kernel {
+  template <typename R, typename A>
+  static constexpr R map(A& a) {
+    return tuple_map<R>(Fn(), a);
+  }
+};
+
+//! r = fn(a, b) with either operand possibly a broadcast scalar
+template <typename Fn, typename T, typename U, typename Enable = void>
+struct map_kernel {
+  template <typename R, std::size_t N>
+  static constexpr R map(const aggregate<T,N>& a, const aggregate<U,N>& b) {
+    return tuple_map<R>(Fn(), a, b);
+  }
+  template <typename R, std::size_t N>
+  static constexpr R map_right(const aggregate<T,N>& a, const U& b) {
+    return tuple_map<R>(bind_right<Fn,U>{b}, a);
+  }
+  template <typename R, std::size_t N>
+  static constexpr R map_left(const T& a, const aggregate<U,N>& b) {
+    return tuple_map<R>(bind_left<Fn,T>{a}, b);
+  }
+};
+
+//! fn(a, b) for a compound assignment Fn
+template <typename Fn, typename T, typename U, typename Enable = void>
+struct assign_kernel {
+  template <std::size_t N>
+  static AGG_CONSTEXPR14 void apply(aggregate<T,N>& a,
+                                    const aggregate<U,N>& b) {
+    tuple_map<void>(Fn(), a, b);
+  }
+  template <std::size_t N>
+  static AGG_CONSTEXPR14 void apply_right(aggregate<T,N>& a, const U& b) {
+    tuple_map<void>(bind_right<Fn,U>{b}, a);
+  }
+};
+
+//! a == b on whole aggregates, stopping at the first unequal element
+template <typename T, typename U, typename Enable = void>
+struct equal_kernel {
+  template <std::size_t N>
+  static AGG_CONSTEXPR14 bool apply(const aggregate<T,N>& a,
+                                    const aggregate<U,N>& b) {
+    for (std::size_t i = 0; i < N; ++i)
+      if (!(a[i] == b[i]))
+        return false;
+    return true;
+  }
+};
+
+//! a < b lexicographically, stopping at the first unequal element
+template <typename T, typename U, typename Enable = void>
+struct less_kernel {
+  template <std::size_t N>
+  static AGG_CONSTEXPR14 bool apply(const aggregate<T,N>& a,
+                                    const aggregate<U,N>& b) {
+    for (std::size_t i = 0; i < N; ++i) {
+      if (a[i] < b[i])
+        return true;
+      if (b[i] < a[i])
+        return false;
+    }
+    return false;
+  }
+};
+
+/** x, or a with every element, with -0 as +0: -0 + 0 is +0, and every
+ *  other value is unchanged. Used where the bytes of equal floating-point
+ *  values must match, as in hashing and radix sort keys.
+ */
+template <typename T>
+inline T
+canonical_zero(T x) {
+  return x + T(0);
+}
+template <typename T, std::size_t N>
+inline aggregate<T,N>
+canonical_zero(const aggregate<T,N>& a) {
+  return a + T(0);
 }
 
 } // end namespace detail
@@ -80,26 +389,30 @@ template <typename CharT, typename Traits, typename T, std::size_t N>
 inline
 enable_if<
   has_left_shift<std::basic_ostream<CharT,Traits>&,T>,
-  std::ostream&>
+  std::basic_ostream<CharT,Traits>&>
 operator<<(std::basic_ostream<CharT,Traits>& s, const aggregate<T,N>& a) {
-  std::copy(a.begin(), a.end()-1, std::ostream_iterator<T>(s, " "));
-  if (N >= 1) s << a[N-1];
+  for (std::size_t i = 0; i < N; ++i) {
+    if (i) s << ' ';
+    s << a[i];
+  }
   return s;
 }
 
 
 // Aggregate comparisons.
 template <typename T, typename U, std::size_t N>
-inline
+inline AGG_CONSTEXPR14
 enable_if<
   has_equal_to<T,U,bool>,
   bool>
 operator==(const aggregate<T,N>& a, const aggregate<U,N>& b) {
-  return std::equal(a.begin(), a.end(), b.begin());
+  return AGG_IS_CONSTANT_EVALUATED()
+      ? detail::equal_kernel<T,U,detail::generic_kernel>::apply(a, b)
+      : detail::equal_kernel<T,U>::apply(a, b);
 }
 
 template <typename T, typename U, std::size_t N>
-inline
+inline AGG_CONSTEXPR14
 enable_if<
   has_not_equal_to<T,U,bool>,
   bool>
@@ -108,16 +421,18 @@ operator!=(const aggregate<T,N>& a, const aggregate<U,N>& b) {
 }
 
 template <typename T, typename U, std::size_t N>
-inline
+inline AGG_CONSTEXPR14
 enable_if<
   has_less<T,U,bool>,
   bool>
 operator<(const aggregate<T,N>& a, const aggregate<U,N>& b) {
-  return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+  return AGG_IS_CONSTANT_EVALUATED()
+      ? detail::less_kernel<T,U,detail::generic_kernel>::apply(a, b)
+      : detail::less_kernel<T,U>::apply(a, b);
 }
 
 template <typename T, typename U, std::size_t N>
-inline
+inline AGG_CONSTEXPR14
 enable_if<
   has_greater<T,U,bool>,
   bool>
@@ -125,7 +440,7 @@ operator>(const aggregate<T,N>& a, const aggregate<U,N>& b)
 { return b < a; }
 
 template <typename T, typename U, std::size_t N>
-inline
+inline AGG_CONSTEXPR14
 enable_if<
   has_less_equal<T,U,bool>,
   bool>
@@ -133,7 +448,7 @@ operator<=(const aggregate<T,N>& a, const aggregate<U,N>& b)
 { return !(a > b); }
 
 template <typename T, typename U, std::size_t N>
-inline
+inline AGG_CONSTEXPR14
 enable_if<
   has_less_equal<T,U,bool>,
   bool>
@@ -164,7 +479,7 @@ operator>=(const aggregate<T,N>& a, const aggregate<U,N>& b)
 
 #define AGG_UN_OP_ASSIGN(NAME,OP)                                             \
   template <typename T, std::size_t N>                                        \
-  inline                                                                      \
+  inline AGG_CONSTEXPR14                                                      \
   enable_if<                                                                  \
     has_##NAME<T&>,                                                           \
     aggregate<T,N>&>                                                          \
@@ -179,30 +494,51 @@ AGG_UN_OP_ASSIGN(pre_decrement, --)
 
 #define AGG_UN_OP(NAME,OP)                                                    \
   template <typename T, std::size_t N>                                        \
-  inline                                                                      \
+  inline constexpr                                                            \
   enable_if<                                                                  \
-    has_##NAME<T&>,                                                           \
-    aggregate<NAME##_result_t<T&>,N> >                                        \
-  operator OP(aggregate<T,N>& a) {                                            \
-    return detail::tuple_map<aggregate<NAME##_result_t<T&>,N>>(fn::NAME(), a);\
+    has_##NAME<const T&>,                                                     \
+    aggregate<decay_t<NAME##_result_t<const T&>>,N> >                         \
+  operator OP(const aggregate<T,N>& a) {                                      \
+    using R = aggregate<decay_t<NAME##_result_t<const T&>>,N>;                \
+    return AGG_IS_CONSTANT_EVALUATED()                                        \
+        ? detail::unary_kernel<fn::NAME,T,detail::generic_kernel>::           \
+            template map<R>(a)                                                \
+        : detail::unary_kernel<fn::NAME,T>::template map<R>(a);               \
   }
 
+#if !defined(AGG_LAZY_EXPRESSIONS)
 AGG_UN_OP(unary_plus,       +)
 AGG_UN_OP(unary_minus,      -)
 AGG_UN_OP(bit_not,          ~)
 AGG_UN_OP(logical_not,      !)
+#endif
+#undef AGG_UN_OP
+
+// Operators into the elements, which only mutable aggregates give out
+#define AGG_UN_OP(NAME,OP)                                                    \
+  template <typename T, std::size_t N>                                        \
+  inline AGG_CONSTEXPR14                                                      \
+  enable_if<                                                                  \
+    has_##NAME<T&>,                                                           \
+    aggregate<decay_t<NAME##_result_t<T&>>,N> >                               \
+  operator OP(aggregate<T,N>& a) {                                            \
+    using R = aggregate<decay_t<NAME##_result_t<T&>>,N>;                      \
+    return detail::unary_kernel<fn::NAME,T>::template map<R>(a);              \
+  }
+
 AGG_UN_OP(dereference,      *)
 AGG_UN_OP(address_of,       &)
 #undef AGG_UN_OP
 
 #define AGG_UN_OP(NAME,OP)                                                    \
   template <typename T, std::size_t N>                                        \
-  inline                                                                      \
+  inline AGG_CONSTEXPR14                                                      \
   enable_if<                                                                  \
     has_##NAME<T&>,                                                           \
-    aggregate<NAME##_result_t<T&>,N> >                                        \
+    aggregate<decay_t<NAME##_result_t<T&>>,N> >                               \
   operator OP(aggregate<T,N>& a, int) {                                       \
-    return detail::tuple_map<aggregate<NAME##_result_t<T&>,N>>(fn::NAME(), a);\
+    using R = aggregate<decay_t<NAME##_result_t<T&>>,N>;                      \
+    return detail::unary_kernel<fn::NAME,T>::template map<R>(a);              \
   }
 
 AGG_UN_OP(post_increment,  ++)
@@ -212,21 +548,28 @@ AGG_UN_OP(post_decrement,  --)
 
 #define AGG_BIN_OP_ASSIGN(NAME,OP)                                            \
   template <typename T, typename U, std::size_t N>                            \
-  inline                                                                      \
+  inline AGG_CONSTEXPR14                                                      \
   enable_if<                                                                  \
     has_##NAME<T&,const U&>,                                                  \
     aggregate<T,N>&>                                                          \
   operator OP(aggregate<T,N>& a, const aggregate<U,N>& b) {                   \
-    detail::tuple_map<void>(fn::NAME(), a, b);                                \
+    AGG_IS_CONSTANT_EVALUATED()                                               \
+        ? detail::assign_kernel<fn::NAME,T,U,detail::generic_kernel>::        \
+            apply(a, b)                                                       \
+        : detail::assign_kernel<fn::NAME,T,U>::apply(a, b);                   \
     return a;                                                                 \
   }                                                                           \
   template <typename T, typename U, std::size_t N>                            \
-  inline                                                                      \
+  inline AGG_CONSTEXPR14                                                      \
   enable_if<                                                                  \
-    has_##NAME<T&,const U&>,                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T&,const U&>::value && is_scalar_operand<U>::value>,         \
     aggregate<T,N>&>                                                          \
   operator OP(aggregate<T,N>& a, const U& b) {                                \
-    detail::tuple_map<void>([&](T& t) { return fn::NAME()(t,b); }, a);        \
+    AGG_IS_CONSTANT_EVALUATED()                                               \
+        ? detail::assign_kernel<fn::NAME,T,U,detail::generic_kernel>::        \
+            apply_right(a, b)                                                 \
+        : detail::assign_kernel<fn::NAME,T,U>::apply_right(a, b);             \
     return a;                                                                 \
   }
 
@@ -243,33 +586,107 @@ AGG_BIN_OP_ASSIGN(right_shift_assign, >>=)
 #undef AGG_BIN_OP_ASSIGN
 
 
+// With AGG_LAZY_EXPRESSIONS the non-mutating operators come from
+// agg_expression.hpp and return expression nodes instead.
+#if !defined(AGG_LAZY_EXPRESSIONS)
+
 #define AGG_BIN_OP(NAME,OP)                                                   \
   template <typename T, typename U, std::size_t N>                            \
-  inline                                                                      \
+  inline constexpr                                                            \
   enable_if<                                                                  \
     has_##NAME<T,U>,                                                          \
-    aggregate<NAME##_result_t<T,U>,N> >                                       \
+    aggregate<decay_t<NAME##_result_t<T,U>>,N> >                              \
   operator OP(const aggregate<T,N>& a, const aggregate<U,N>& b) {             \
-    using R = aggregate<NAME##_result_t<T,U>,N>;                              \
-    return detail::tuple_map<R>(fn::NAME(), a, b);                            \
+    using R = aggregate<decay_t<NAME##_result_t<T,U>>,N>;                     \
+    return AGG_IS_CONSTANT_EVALUATED()                                        \
+        ? detail::map_kernel<fn::NAME,T,U,detail::generic_kernel>::           \
+            template map<R>(a, b)                                             \
+        : detail::map_kernel<fn::NAME,T,U>::template map<R>(a, b);            \
   }                                                                           \
   template <typename T, typename U, std::size_t N>                            \
-  inline                                                                      \
+  inline constexpr                                                            \
   enable_if<                                                                  \
-    has_##NAME<T,U>,                                                          \
-    aggregate<NAME##_result_t<T,U>,N> >                                       \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T,U>::value && is_scalar_operand<U>::value>,                 \
+    aggregate<decay_t<NAME##_result_t<T,U>>,N> >                              \
   operator OP(const aggregate<T,N>& a, const U& b) {                          \
-    using R = aggregate<NAME##_result_t<T,U>,N>;                              \
-    return detail::tuple_map<R>([&](const T& t){return fn::NAME()(t,b);}, a); \
+    using R = aggregate<decay_t<NAME##_result_t<T,U>>,N>;                     \
+    return AGG_IS_CONSTANT_EVALUATED()                                        \
+        ? detail::map_kernel<fn::NAME,T,U,detail::generic_kernel>::           \
+            template map_right<R>(a, b)                                       \
+        : detail::map_kernel<fn::NAME,T,U>::template map_right<R>(a, b);      \
   }                                                                           \
   template <typename T, typename U, std::size_t N>                            \
-  inline                                                                      \
+  inline constexpr                                                            \
   enable_if<                                                                  \
-    has_##NAME<T,U>,                                                          \
-    aggregate<NAME##_result_t<T,U>,N> >                                       \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T,U>::value && is_scalar_operand<T>::value>,                 \
+    aggregate<decay_t<NAME##_result_t<T,U>>,N> >                              \
   operator OP(const T& a, const aggregate<U,N>& b) {                          \
-    using R = aggregate<NAME##_result_t<T,U>,N>;                              \
-    return detail::tuple_map<R>([&](const U& u){return fn::NAME()(a,u);}, b); \
+    using R = aggregate<decay_t<NAME##_result_t<T,U>>,N>;                     \
+    return AGG_IS_CONSTANT_EVALUATED()                                        \
+        ? detail::map_kernel<fn::NAME,T,U,detail::generic_kernel>::           \
+            template map_left<R>(a, b)                                        \
+        : detail::map_kernel<fn::NAME,T,U>::template map_left<R>(a, b);       \
+  }
+
+// Overloads on expiring operands that reuse_operand<> and that have the
+// result type: the result is computed in their storage and moved out.
+#define AGG_BIN_OP_REUSE(NAME,OP)                                             \
+  template <typename T, typename U, std::size_t N>                            \
+  inline AGG_CONSTEXPR14                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T,const U&>::value &&                                        \
+      detail::reuses<NAME##_result_t<T,const U&>,T>::value>,                  \
+    aggregate<T,N> >                                                          \
+  operator OP(aggregate<T,N>&& a, const aggregate<U,N>& b) {                  \
+    detail::tuple_map<void>(detail::reuse_left<fn::NAME>(), a, b);            \
+    return std::move(a);                                                      \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline AGG_CONSTEXPR14                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<const T&,U>::value &&                                        \
+      detail::reuses<NAME##_result_t<const T&,U>,U>::value>,                  \
+    aggregate<U,N> >                                                          \
+  operator OP(const aggregate<T,N>& a, aggregate<U,N>&& b) {                  \
+    detail::tuple_map<void>(detail::reuse_right<fn::NAME>(), a, b);           \
+    return std::move(b);                                                      \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline AGG_CONSTEXPR14                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T,U>::value &&                                               \
+      detail::reuses<NAME##_result_t<T,U>,T>::value>,                         \
+    aggregate<T,N> >                                                          \
+  operator OP(aggregate<T,N>&& a, aggregate<U,N>&& b) {                       \
+    detail::tuple_map<void>(detail::reuse_left<fn::NAME>(), a, std::move(b)); \
+    return std::move(a);                                                      \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline AGG_CONSTEXPR14                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T,const U&>::value && is_scalar_operand<U>::value &&         \
+      detail::reuses<NAME##_result_t<T,const U&>,T>::value>,                  \
+    aggregate<T,N> >                                                          \
+  operator OP(aggregate<T,N>&& a, const U& b) {                               \
+    detail::tuple_map<void>(detail::reuse_left_scalar<fn::NAME,U>{b}, a);     \
+    return std::move(a);                                                      \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline AGG_CONSTEXPR14                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<const T&,U>::value && is_scalar_operand<T>::value &&         \
+      detail::reuses<NAME##_result_t<const T&,U>,U>::value>,                  \
+    aggregate<U,N> >                                                          \
+  operator OP(const T& a, aggregate<U,N>&& b) {                               \
+    detail::tuple_map<void>(detail::reuse_right_scalar<fn::NAME,T>{a}, b);    \
+    return std::move(b);                                                      \
   }
 
 #define COMMA ,
@@ -287,7 +704,34 @@ AGG_BIN_OP(left_shift,          <<)
 AGG_BIN_OP(right_shift,         >>)
 AGG_BIN_OP(logical_and,         &&)
 AGG_BIN_OP(logical_or,          ||)
+
+AGG_BIN_OP_REUSE(plus,                 +)
+AGG_BIN_OP_REUSE(minus,                -)
+AGG_BIN_OP_REUSE(multiplies,           *)
+AGG_BIN_OP_REUSE(divides,              /)
+AGG_BIN_OP_REUSE(modulus,              %)
+AGG_BIN_OP_REUSE(bit_and,              &)
+AGG_BIN_OP_REUSE(bit_or,               |)
+AGG_BIN_OP_REUSE(bit_xor,              ^)
+AGG_BIN_OP_REUSE(comma,            COMMA)
+AGG_BIN_OP_REUSE(left_shift,          <<)
+AGG_BIN_OP_REUSE(right_shift,         >>)
+AGG_BIN_OP_REUSE(logical_and,         &&)
+AGG_BIN_OP_REUSE(logical_or,          ||)
 #undef AGG_BIN_OP
+#undef AGG_BIN_OP_REUSE
 #undef COMMA
 
+#endif // AGG_LAZY_EXPRESSIONS
+
 } // end namespace agg
+
+#include "agg_reduce.hpp"
+#include "agg_fused.hpp"
+#include "agg_compare.hpp"
+#include "agg_swizzle.hpp"
+#include "agg_simd.hpp"
+
+#if defined(AGG_LAZY_EXPRESSIONS)
+#include "agg_expression.hpp"
+#endif
@@ -0,0 +1,576 @@
+#pragma once
+
+#include <vector>
+
+#include "agg_binary.hpp"
+
+/** Compressed binary files of aggregates.
+ *
+ *  Consecutive records of sensor or trajectory streams differ little, so
+ *  packed files store each component as the difference from the previous
+ *  record, in as few bits as the block needs:
+ *
+ *    std::ofstream out("track.aggp", std::ios::binary);
+ *    agg::packed_writer<std::int32_t,3> w(out);
+ *    w.write(track.data(), track.size());
+ *    w.close();
+ *
+ *    std::ifstream in("track.aggp", std::ios::binary);
+ *    agg::packed_reader<std::int32_t,3> r(in);
+ *    r.seek(100000);                       // through the block index
+ *    r.read(window.data(), window.size());
+ *
+ *  Records are coded in blocks of packed_block aggregates, a component at a
+ *  time. Integers take the difference from the previous record, zigzagged
+ *  so that small negative differences are small too; floating-point numbers
+ *  take the exclusive or of their bits with the previous record's, which
+ *  clears the sign, exponent and leading mantissa bits they share. The
+ *  block's codes are then packed at the width of the widest, with
+ *  detail::packed_lanes codes side by side in an aggregate of words, so
+ *  packing and unpacking are element-wise shifts and ors of whole
+ *  registers. Each block restarts from its first record, and an index of
+ *  block offsets at the end of the file gives random access.
+ *
+ *  The file starts with an agg::binary_header whose encoding is
+ *  packed_encoding, followed by the blocks, each a 32-bit record count and
+ *  byte size, an empty block, the index and a footer. Blocks are written in
+ *  native byte order; files of the other byte order are rejected.
+ *
+ *  T must be an arithmetic type of at most 8 bytes. packed_encode and
+ *  packed_decode code single blocks in memory, e.g. in a mapped file.
+ */
+
+namespace agg {
+
+//! Aggregates in a block of a packed file; all but the last are full
+constexpr std::size_t packed_block = 256;
+
+
+namespace detail {
+
+//! The unsigned words the codes of S are packed in
+template <typename S>
+struct packed_word {
+  static_assert(std::is_arithmetic<S>::value && sizeof(S) <= 8 &&
+                (!std::is_floating_point<S>::value ||
+                 sizeof(S) == 4 || sizeof(S) == 8),
+                "packs integers and 32- or 64-bit floating-point numbers");
+  typedef typename std::conditional<(sizeof(S) > 4),
+                                    std::uint64_t, std::uint32_t>::type type;
+};
+
+//! Codes packed side by side: a 256-bit register of words
+template <typename W>
+struct packed_lanes : std::integral_constant<std::size_t, 32 / sizeof(W)> {};
+
+//! The bits of s as a word
+template <typename S>
+inline enable_if<std::is_integral<S>, typename packed_word<S>::type>
+packed_bits(S s) {
+  typedef typename std::conditional<std::is_same<S,bool>::value,
+                                    unsigned char, S>::type I;
+  typedef typename std::make_unsigned<I>::type U;
+  return typename packed_word<S>::type(U(s));
+}
+
+template <typename S>
+inline enable_if<std::is_floating_point<S>, typename packed_word<S>::type>
+packed_bits(S s) {
+  typename packed_word<S>::type w;
+  std::memcpy(&w, &s, sizeof(w));
+  return w;
+}
+
+//! The S whose bits are w
+template <typename S, typename W>
+inline enable_if<std::is_integral<S>, S>
+packed_value(W w) {
+  return S(w);
+}
+
+template <typename S, typename W>
+inline enable_if<std::is_floating_point<S>, S>
+packed_value(W w) {
+  S s;
+  std::memcpy(&s, &w, sizeof(s));
+  return s;
+}
+
+//! The code of x after prev: zigzagged difference, or exclusive or
+template <typename S, typename W>
+inline W
+packed_code(W x, W prev, std::false_type) {
+  W d = W(x - prev);
+  return W(d << 1) ^ W(W(0) - (d >> (8 * sizeof(W) - 1)));
+}
+
+template <typename S, typename W>
+inline W
+packed_code(W x, W prev, std::true_type) {
+  return x ^ prev;
+}
+
+//! The value after prev whose code is z
+template <typename W>
+inline W
+packed_uncode(W z, W prev, std::false_type) {
+  return W(prev + (W(z >> 1) ^ W(W(0) - (z & 1))));
+}
+
+template <typename W>
+inline W
+packed_uncode(W z, W prev, std::true_type) {
+  return prev ^ z;
+}
+
+//! Bits of the widest of the codes whose union is m
+template <typename W>
+inline unsigned
+packed_width(W m) {
+  unsigned w = 0;
+  for ( ; m; m >>= 1)
+    ++w;
+  return w;
+}
+
+/** Pack the packed_block codes at z, of w bits each, into w registers of
+ *  words at out; lane l of word i holds the bits of codes l, l+L, l+2L...
+ *  that follow those of word i-1.
+ */
+template <typename W>
+inline unsigned char*
+packed_pack(const W* z, unsigned w, unsigned char* out) {
+  typedef aggregate<W, packed_lanes<W>::value> row;
+  static_assert(sizeof(row) == 32, "rows are one register");
+  const unsigned bits = 8 * sizeof(W);
+  row acc = {}, v;
+  unsigned shift = 0;
+  for (std::size_t k = 0; k < packed_block && w; k += v.size()) {
+    std::memcpy(v.data(), z + k, sizeof(v));
+    acc |= v << shift;
+    shift += w;
+    if (shift >= bits) {
+      std::memcpy(out, acc.data(), sizeof(acc));
+      out += sizeof(acc);
+      shift -= bits;
+      acc = shift ? row(v >> (w - shift)) : row{};
+    }
+  }
+  return out;
+}
+
+//! Unpack the packed_block codes of w bits from the w registers at in
+template <typename W>
+inline const unsigned char*
+packed_unpack(const unsigned char* in, unsigned w, W* z) {
+  typedef aggregate<W, packed_lanes<W>::value> row;
+  const unsigned bits = 8 * sizeof(W);
+  if (!w) {
+    std::fill(z, z + packed_block, W(0));
+    return in;
+  }
+  const W mask = w == bits ? W(~W(0)) : W((W(1) << w) - 1);
+  row cur, v;
+  std::memcpy(cur.data(), in, sizeof(cur));
+  in += sizeof(cur);
+  unsigned shift = 0;
+  for (std::size_t k = 0; k < packed_block; k += v.size()) {
+    v = cur >> shift;
+    shift += w;
+    if (shift >= bits) {
+      shift -= bits;
+      if (k + v.size() < packed_block) {
+        std::memcpy(cur.data(), in, sizeof(cur));
+        in += sizeof(cur);
+        if (shift)
+          v |= cur << (w - shift);
+      }
+    }
+    v &= mask;
+    std::memcpy(z + k, v.data(), sizeof(v));
+  }
+  return in;
+}
+
+inline void
+packed_put32(unsigned char* p, std::uint32_t x) {
+  std::memcpy(p, &x, sizeof(x));
+}
+
+inline std::uint32_t
+packed_get32(const unsigned char* p) {
+  std::uint32_t x;
+  std::memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+} // end namespace detail
+
+
+//! Most bytes a block of aggregate<T,N> packs into, its header included
+template <typename T, std::size_t N>
+constexpr std::size_t
+packed_bound() {
+  return 8 + N * (1 + sizeof(typename detail::packed_word<T>::type)
+                    * (1 + packed_block));
+}
+
+/** Pack the 1 to packed_block aggregates at a into one block at out, which
+ *  has room for packed_bound<T,N>() bytes, and return its size.
+ */
+template <typename T, std::size_t N>
+inline std::size_t
+packed_encode(const aggregate<T,N>* a, std::size_t n, unsigned char* out) {
+  typedef typename detail::packed_word<T>::type W;
+  typedef std::is_floating_point<T> xor_coded;
+  unsigned char* p = out + 8;
+  W z[packed_block];
+  for (std::size_t j = 0; j < N; ++j) {
+    const W base = detail::packed_bits(a[0][j]);
+    W prev = base, m = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      W x = detail::packed_bits(a[i][j]);
+      z[i] = detail::packed_code<T>(x, prev, xor_coded());
+      m |= z[i];
+      prev = x;
+    }
+    std::fill(z + n, z + packed_block, W(0));
+    unsigned w = detail::packed_width(m);
+    std::memcpy(p, &base, sizeof(base));
+    p[sizeof(base)] = (unsigned char) w;
+    p = detail::packed_pack(z, w, p + sizeof(base) + 1);
+  }
+  detail::packed_put32(out, std::uint32_t(n));
+  detail::packed_put32(out + 4, std::uint32_t(p - out - 8));
+  return std::size_t(p - out);
+}
+
+/** Unpack the block at [first, last) into a, which has room for
+ *  packed_block aggregates. Sets n to the number of aggregates and returns
+ *  the end of the block.
+ */
+template <typename T, std::size_t N>
+inline const unsigned char*
+packed_decode(const unsigned char* first, const unsigned char* last,
+              aggregate<T,N>* a, std::size_t& n) {
+  typedef typename detail::packed_word<T>::type W;
+  typedef std::is_floating_point<T> xor_coded;
+  typedef aggregate<W, detail::packed_lanes<W>::value> row;
+  if (last - first < 8)
+    throw binary_error("truncated block");
+  const std::size_t count = detail::packed_get32(first);
+  const unsigned char* end = first + 8 + detail::packed_get32(first + 4);
+  if (count > packed_block || end > last)
+    throw binary_error("corrupt block");
+  const unsigned char* p = first + 8;
+  W z[packed_block];
+  for (std::size_t j = 0; j < N && count; ++j) {
+    if (end - p < std::ptrdiff_t(sizeof(W) + 1))
+      throw binary_error("corrupt block");
+    W prev;
+    std::memcpy(&prev, p, sizeof(prev));
+    unsigned w = p[sizeof(W)];
+    p += sizeof(W) + 1;
+    if (w > 8 * sizeof(W) || end - p < std::ptrdiff_t(w * sizeof(row)))
+      throw binary_error("corrupt block");
+    p = detail::packed_unpack(p, w, z);
+    for (std::size_t i = 0; i < count; ++i)
+      z[i] = prev = detail::packed_uncode(z[i], prev, xor_coded());
+    for (std::size_t i = 0; i < count; ++i)
+      a[i][j] = detail::packed_value<T>(z[i]);
+  }
+  if (p != end)
+    throw binary_error("corrupt block");
+  n = count;
+  return end;
+}
+
+
+/** @brief Writes aggregate<T,N> to a packed binary stream, which should be
+ *  opened with std::ios::binary.
+ *
+ *  Aggregates are buffered until a block is full; close() writes the last
+ *  block and the index, and records the count in the header when the
+ *  stream can seek.
+ */
+template <typename T, std::size_t N>
+class packed_writer {
+ public:
+  typedef aggregate<T,N> value_type;
+
+  explicit packed_writer(std::ostream& os)
+      : _os(os), _start(os.tellp()), _block(packed_block),
+        _bytes(packed_bound<T,N>()) {
+    binary_header h = binary_header::make<T,N>();
+    h.version = 2;
+    h.encoding = binary_header::packed_encoding;
+    h.data_offset = sizeof(h);
+    put(&h, sizeof(h));
+  }
+
+  packed_writer(const packed_writer&) = delete;
+  packed_writer& operator=(const packed_writer&) = delete;
+
+  //! Closes, but cannot report errors; call close() to see them
+  ~packed_writer() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  //! Append the n aggregates at p
+  void
+  write(const value_type* p, std::size_t n) {
+    while (n) {
+      // Whole blocks straight from p, the rest through the buffer
+      if (_fill == 0 && n >= packed_block) {
+        flush(p, packed_block);
+        p += packed_block;
+        n -= packed_block;
+        continue;
+      }
+      std::size_t k = std::min(n, packed_block - _fill);
+      std::copy(p, p + k, _block.begin() + _fill);
+      _fill += k;
+      p += k;
+      n -= k;
+      if (_fill == packed_block) {
+        flush(_block.data(), packed_block);
+        _fill = 0;
+      }
+    }
+  }
+
+  void
+  write(const value_type& a)
+  { write(std::addressof(a), 1); }
+
+  //! Append [first, last)
+  template <typename InputIt>
+  void
+  write(InputIt first, InputIt last) {
+    for ( ; first != last; ++first)
+      write(*first);
+  }
+
+  //! Number of aggregates written
+  std::uint64_t
+  count() const noexcept
+  { return _count + _fill; }
+
+  //! Bytes written so far, headers and full blocks only
+  std::uint64_t
+  bytes() const noexcept
+  { return _offset; }
+
+  //! Write the last block, the index and the count, and flush
+  void
+  close() {
+    if (_closed)
+      return;
+    _closed = true;
+    if (_fill)
+      flush(_block.data(), _fill);
+    _fill = 0;
+
+    unsigned char empty[8] = {};
+    put(empty, sizeof(empty));
+    std::uint64_t index = _offset;
+    put(_index.data(), _index.size() * sizeof(std::uint64_t));
+    std::uint64_t footer[3] = {_count, index, 0};
+    std::memcpy(&footer[2], "AGGINDEX", 8);
+    put(footer, sizeof(footer));
+
+    if (_start != std::streampos(-1)) {
+      std::streampos end = _os.tellp();
+      _os.seekp(_start + std::streamoff(offsetof(binary_header, count)));
+      put(&_count, sizeof(_count));
+      _os.seekp(end);
+    }
+    _os.flush();
+    if (!_os)
+      throw binary_error("write failed");
+  }
+
+ private:
+  void
+  flush(const value_type* p, std::size_t n) {
+    _index.push_back(_offset);
+    put(_bytes.data(), packed_encode(p, n, _bytes.data()));
+    _count += n;
+  }
+
+  void
+  put(const void* p, std::size_t bytes) {
+    if (!_os.write(static_cast<const char*>(p), std::streamsize(bytes)))
+      throw binary_error("write failed");
+    _offset += bytes;
+  }
+
+  std::ostream& _os;
+  std::streampos _start;
+  std::vector<value_type> _block;
+  std::vector<unsigned char> _bytes;
+  std::vector<std::uint64_t> _index;
+  std::size_t _fill = 0;
+  std::uint64_t _count = 0;
+  std::uint64_t _offset = 0;
+  bool _closed = false;
+};
+
+
+/** @brief Reads aggregate<T,N> from a packed binary stream, which should be
+ *  opened with std::ios::binary.
+ *
+ *  The header is read and checked on construction and blocks are decoded
+ *  as reads reach them. seek() reads the index at the end of the file, so
+ *  needs a seekable stream.
+ */
+template <typename T, std::size_t N>
+class packed_reader {
+ public:
+  typedef aggregate<T,N> value_type;
+
+  explicit packed_reader(std::istream& is)
+      : _is(is), _start(is.tellg()), _block(packed_block) {
+    char bytes[sizeof(binary_header)];
+    get(bytes, sizeof(bytes), "header");
+    _header = binary_header::parse(bytes);
+    // Records hold the N elements only, so any stride and padding will do
+    _header.template check_elements<T,N>();
+    if (_header.encoding != binary_header::packed_encoding)
+      throw binary_error("not a packed file");
+    if (_header.data_offset < sizeof(binary_header))
+      throw binary_error("bad data offset "
+                         + std::to_string(_header.data_offset));
+    if (_header.swapped())
+      throw binary_error("cannot decode a packed file of the other byte "
+                         "order");
+    _is.ignore(std::streamsize(_header.data_offset - sizeof(binary_header)));
+  }
+
+  packed_reader(const packed_reader&) = delete;
+  packed_reader& operator=(const packed_reader&) = delete;
+
+  const binary_header&
+  header() const noexcept
+  { return _header; }
+
+  //! Whether the header records the count
+  bool
+  size_known() const noexcept
+  { return _header.count != binary_header::unknown_count; }
+
+  //! Number of aggregates in the file, if size_known()
+  std::uint64_t
+  size() const noexcept
+  { return _header.count; }
+
+  /** Read up to n aggregates into p and return how many were read, fewer
+   *  than n only at the end of the file.
+   */
+  std::size_t
+  read(value_type* p, std::size_t n) {
+    std::size_t done = 0;
+    while (done < n) {
+      if (_pos == _have && !next())
+        break;
+      std::size_t k = std::min(n - done, _have - _pos);
+      std::copy(_block.begin() + _pos, _block.begin() + _pos + k, p + done);
+      _pos += k;
+      done += k;
+    }
+    return done;
+  }
+
+  //! Read the next aggregate into a, or return false at the end of the file
+  bool
+  read(value_type& a)
+  { return read(std::addressof(a), 1) == 1; }
+
+  //! Make aggregate i the next one read; i may be the count, the end
+  void
+  seek(std::uint64_t i) {
+    if (_index.empty())
+      load_index();
+    if (i > _count)
+      throw binary_error("seek past the end");
+    std::uint64_t b = i / packed_block;
+    _is.clear();
+    _is.seekg(_start + std::streamoff(b < _index.size() ? _index[b]
+                                                        : _index_offset - 8));
+    _have = _pos = 0;
+    _done = false;
+    if (next())
+      _pos = std::size_t(i - b * packed_block);
+  }
+
+ private:
+  //! Decode the next block, or return false after the last
+  bool
+  next() {
+    if (_done)
+      return false;
+    unsigned char head[8];
+    get(head, sizeof(head), "block");
+    std::uint32_t bytes = detail::packed_get32(head + 4);
+    if (detail::packed_get32(head) == 0) {
+      _done = true;
+      _have = _pos = 0;
+      return false;
+    }
+    if (bytes > packed_bound<T,N>() - 8)
+      throw binary_error("corrupt block");
+    _bytes.resize(8 + bytes);
+    std::memcpy(_bytes.data(), head, sizeof(head));
+    get(_bytes.data() + 8, bytes, "block");
+    packed_decode(_bytes.data(), _bytes.data() + _bytes.size(),
+                  _block.data(), _have);
+    _pos = 0;
+    return true;
+  }
+
+  //! Read the block index and the count from the end of the stream
+  void
+  load_index() {
+    std::uint64_t footer[3];
+    _is.clear();
+    if (!_is.seekg(-std::streamoff(sizeof(footer)), std::ios::end))
+      throw binary_error("cannot seek");
+    std::streamoff end = _is.tellg() - _start;
+    get(footer, sizeof(footer), "index");
+    if (std::memcmp(&footer[2], "AGGINDEX", 8) != 0 ||
+        footer[1] > std::uint64_t(end) ||
+        (std::uint64_t(end) - footer[1]) % sizeof(std::uint64_t))
+      throw binary_error("corrupt index");
+    _count = footer[0];
+    _index_offset = footer[1];
+    _index.resize(std::size_t((std::uint64_t(end) - footer[1])
+                              / sizeof(std::uint64_t)));
+    _is.seekg(_start + std::streamoff(_index_offset));
+    get(_index.data(), _index.size() * sizeof(std::uint64_t), "index");
+    if (_index.size() != (_count + packed_block - 1) / packed_block)
+      throw binary_error("corrupt index");
+  }
+
+  void
+  get(void* p, std::size_t bytes, const char* what) {
+    if (!_is.read(static_cast<char*>(p), std::streamsize(bytes)))
+      throw binary_error(std::string("truncated ") + what);
+  }
+
+  std::istream& _is;
+  std::streampos _start;
+  binary_header _header;
+  std::vector<value_type> _block;
+  std::vector<unsigned char> _bytes;
+  std::size_t _have = 0;
+  std::size_t _pos = 0;
+  bool _done = false;
+  std::vector<std::uint64_t> _index;
+  std::uint64_t _index_offset = 0;
+  std::uint64_t _count = 0;
+};
+
+} // end namespace agg
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aggregate.hpp"
+
+/** Multithreaded bulk operations over ranges of aggregates.
+ *
+ *  agg::parallel_transform and agg::parallel_reduce split a random-access
+ *  range into fixed chunks of AGG_PARALLEL_GRAIN elements and run them on a
+ *  work-stealing agg::thread_pool. Any callable works as the kernel,
+ *  including the fn:: functors:
+ *
+ *    agg::parallel_transform(a, a+n, b, c, agg::fn::plus());        // c = a+b
+ *    agg::parallel_transform(a, a+n, b, a, agg::fn::plus_assign()); // a += b
+ *    auto s = agg::parallel_reduce(a, a+n, aggregate<float,3>{},
+ *                                  agg::fn::plus());
+ *
+ *  Chunk boundaries do not depend on the number of threads, and reductions
+ *  combine the per-chunk partials in chunk order, so results are the same
+ *  from run to run and from machine to machine. Kernels must not modify the
+ *  input ranges except through the output element they compute; an
+ *  exception thrown by a kernel is rethrown by the calling thread.
+ *
+ *  Link with -pthread.
+ */
+
+#if !defined(AGG_PARALLEL_GRAIN)
+#define AGG_PARALLEL_GRAIN 1024
+#endif
+
+namespace agg {
+
+/** @brief A fixed set of worker threads with one task deque each.
+ *
+ *  Workers take tasks from the front of their own deque and, when that is
+ *  empty, steal from the back of the others. A thread waiting in
+ *  parallel_for executes queued tasks too, so nested calls cannot
+ *  deadlock.
+ */
+class thread_pool {
+ public:
+  //! Start workers, by default one less than the hardware threads since the
+  //! calling thread takes part in every parallel_for.
+  explicit thread_pool(std::size_t workers = default_workers())
+      : _queues(workers ? workers : 1) {
+    for (auto& q : _queues)
+      q.reset(new queue);
+    for (std::size_t w = 0; w < workers; ++w)
+      _threads.emplace_back(&thread_pool::work, this, w);
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& t : _threads)
+      t.join();
+  }
+
+  //! Number of worker threads
+  std::size_t
+  size() const noexcept
+  { return _threads.size(); }
+
+  //! Call fn(c) for every c in [0,count) and wait for all of them
+  template <typename Fn>
+  void
+  parallel_for(std::size_t count, Fn fn) {
+    if (count == 0)
+      return;
+    if (count == 1 || _threads.empty()) {
+      for (std::size_t c = 0; c < count; ++c)
+        fn(c);
+      return;
+    }
+
+    std::atomic<std::size_t> left(count);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    for (std::size_t c = 0; c < count; ++c) {
+      push(c % _queues.size(), [&, c] {
+        try {
+          fn(c);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error)
+            error = std::current_exception();
+        }
+        left.fetch_sub(1, std::memory_order_release);
+      });
+    }
+
+    while (left.load(std::memory_order_acquire) != 0) {
+      task t;
+      if (take(_queues.size(), t))
+        t();
+      else
+        std::this_thread::yield();
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  static std::size_t
+  default_workers() {
+    std::size_t hw = std::thread::hardware_concurrency();
+    return hw > 1 ? hw - 1 : 0;
+  }
+
+ private:
+  typedef std::function<void()> task;
+
+  struct queue {
+    std::mutex mutex;
+    std::deque<task> tasks;
+  };
+
+  void
+  push(std::size_t q, task t) {
+    {
+      std::lock_guard<std::mutex> lock(_queues[q]->mutex);
+      _queues[q]->tasks.push_back(std::move(t));
+    }
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      ++_pending;
+    }
+    _wake.notify_one();
+  }
+
+  //! Take a task from the front of queue w if w is a worker's, otherwise
+  //! steal one from the back of the queue after it that has any
+  bool
+  take(std::size_t w, task& t) {
+    bool found = false;
+    for (std::size_t k = 0; k < _queues.size() && !found; ++k) {
+      std::size_t q = (w + k) % _queues.size();
+      std::lock_guard<std::mutex> lock(_queues[q]->mutex);
+      std::deque<task>& tasks = _queues[q]->tasks;
+      if (tasks.empty())
+        continue;
+      if (q == w) {
+        t = std::move(tasks.front());
+        tasks.pop_front();
+      } else {
+        t = std::move(tasks.back());
+        tasks.pop_back();
+      }
+      found = true;
+    }
+    if (found) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      --_pending;
+    }
+    return found;
+  }
+
+  void
+  work(std::size_t w) {
+    for (;;) {
+      task t;
+      if (take(w, t)) {
+        t();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this] { return _stop || _pending != 0; });
+      if (_stop)
+        return;
+    }
+  }
+
+  std::vector<std::unique_ptr<queue> >                  _queues;
+  std::vector<std::thread>                              _threads;
+  std::mutex                                            _mutex;
+  std::condition_variable                               _wake;
+  std::size_t                                           _pending = 0;
+  bool                                                  _stop = false;
+};
+
+//! The pool used when none is given
+inline thread_pool&
+default_pool() {
+  static thread_pool pool;
+  return pool;
+}
+
+
+namespace detail {
+
+//! Number of chunks of AGG_PARALLEL_GRAIN elements covering n elements
+inline std::size_t
+parallel_chunks(std::size_t n) {
+  return (n + AGG_PARALLEL_GRAIN - 1) / AGG_PARALLEL_GRAIN;
+}
+
+//! Element range [b,e) of chunk c of n elements
+inline void
+parallel_chunk(std::size_t c, std::size_t n, std::size_t& b, std::size_t& e) {
+  b = c * AGG_PARALLEL_GRAIN;
+  e = n - b < AGG_PARALLEL_GRAIN ? n : b + AGG_PARALLEL_GRAIN;
+}
+
+} // end namespace detail
+
+
+/** d_first[i] = fn(first[i]) for each i in [0, last-first)
+ *
+ *  @pre The ranges are random-access and d_first does not overlap
+ *       [first,last) except when d_first == first.
+ */
+template <typename InputIt, typename OutputIt, typename Fn>
+inline OutputIt
+parallel_transform(thread_pool& pool,
+                   InputIt first, InputIt last, OutputIt d_first, Fn fn) {
+  const std::size_t n = std::distance(first, last);
+  pool.parallel_for(detail::parallel_chunks(n), [&](std::size_t c) {
+    std::size_t b, e;
+    detail::parallel_chunk(c, n, b, e);
+    for (std::size_t i = b; i < e; ++i)
+      d_first[i] = fn(first[i]);
+  });
+  return d_first + n;
+}
+
+/** d_first[i] = fn(first1[i], first2[i]) for each i in [0, last1-first1)
+ *
+ *  A compound assignment functor such as fn::plus_assign with
+ *  d_first == first1 updates the first range in place.
+ */
+template <typename InputIt1, typename InputIt2, typename OutputIt,
+          typename Fn>
+inline OutputIt
+parallel_transform(thread_pool& pool,
+                   InputIt1 first1, InputIt1 last1, InputIt2 first2,
+                   OutputIt d_first, Fn fn) {
+  const std::size_t n = std::distance(first1, last1);
+  pool.parallel_for(detail::parallel_chunks(n), [&](std::size_t c) {
+    std::size_t b, e;
+    detail::parallel_chunk(c, n, b, e);
+    for (std::size_t i = b; i < e; ++i)
+      d_first[i] = fn(first1[i], first2[i]);
+  });
+  return d_first + n;
+}
+
+template <typename InputIt, typename OutputIt, typename Fn>
+inline OutputIt
+parallel_transform(InputIt first, InputIt last, OutputIt d_first, Fn fn) {
+  return parallel_transform(default_pool(), first, last, d_first, fn);
+}
+
+template <typename InputIt1, typename InputIt2, typename OutputIt,
+          typename Fn>
+inline OutputIt
+parallel_transform(InputIt1 first1, InputIt1 last1, InputIt2 first2,
+                   OutputIt d_first, Fn fn) {
+  return parallel_transform(default_pool(), first1, last1, first2, d_first,
+                            fn);
+}
+
+/** Fold [first,last) into init with acc = fn(acc, x)
+ *
+ *  Each chunk is folded starting from its first element and the chunk
+ *  partials are folded into init in order, so fn must be associative.
+ *  Compound assignment functors such as fn::plus_assign work as well.
+ *  T must be default-constructible.
+ */
+template <typename InputIt, typename T, typename Fn>
+inline T
+parallel_reduce(thread_pool& pool,
+                InputIt first, InputIt last, T init, Fn fn) {
+  const std::size_t n = std::distance(first, last);
+  std::vector<T> partial(detail::parallel_chunks(n));
+  pool.parallel_for(partial.size(), [&](std::size_t c) {
+    std::size_t b, e;
+    detail::parallel_chunk(c, n, b, e);
+    T acc = first[b];
+    for (std::size_t i = b + 1; i < e; ++i)
+      acc = fn(acc, first[i]);
+    partial[c] = acc;
+  });
+  for (const T& p : partial)
+    init = fn(init, p);
+  return init;
+}
+
+template <typename InputIt, typename T, typename Fn>
+inline T
+parallel_reduce(InputIt first, InputIt last, T init, Fn fn) {
+  return parallel_reduce(default_pool(), first, last, init, fn);
+}
+
+} // end namespace agg
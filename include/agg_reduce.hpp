@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cmath>
+
+/** Horizontal reductions of aggregates.
+ *
+ *  Each reduction is unrolled at compile time into a balanced binary tree,
+ *  ((a0 + a1) + (a2 + a3)) + ..., rather than the serial chain of
+ *  std::accumulate, which keeps the additions independent. Beyond
+ *  AGG_UNROLL_LIMIT elements, a loop instead folds reduce_partials
+ *  consecutive runs of the elements side by side, and the partial results
+ *  are combined as a tree. agg_simd.hpp
+ *  specializes sum and dot for arithmetic aggregates to add whole
+ *  registers pairwise before combining their lanes, and count for masks of
+ *  bool to add 16 bytes at a time.
+ *
+ *  Floating-point results therefore follow the tree order and can differ
+ *  from a left-to-right sum in the last bits. Ties of min_element and
+ *  max_element resolve to the first element either way.
+ */
+
+namespace agg {
+
+namespace detail {
+
+//! Element i of an aggregate as R
+template <typename R, typename T, std::size_t N>
+struct reduce_leaf {
+  const aggregate<T,N>& a;
+  R operator[](std::size_t i) const { return static_cast<R>(a[i]); }
+};
+
+//! Product of elements i of two aggregates as R
+template <typename R, typename T, typename U, std::size_t N>
+struct dot_leaf {
+  const aggregate<T,N>& a;
+  const aggregate<U,N>& b;
+  R operator[](std::size_t i) const { return static_cast<R>(a[i] * b[i]); }
+};
+
+//! Element i of an array as R
+template <typename R, typename T>
+struct array_leaf {
+  const T* p;
+  R operator[](std::size_t i) const { return static_cast<R>(p[i]); }
+};
+
+//! Number of partial results of the reductions that loop
+constexpr std::size_t reduce_partials = 8;
+
+/** f over the leaves [B,B+L) combined as a balanced binary tree, unrolled
+ *  when L is unrolled<> or at most reduce_partials. Larger ranges run a
+ *  loop over reduce_partials consecutive runs of leaves at once, each
+ *  folded left to right, and combine the runs as a tree.
+ */
+template <std::size_t B, std::size_t L, typename Enable = void>
+struct tree_reduce {
+  template <typename R, typename Fn, typename Leaf>
+  static R apply(const Fn& f, const Leaf& leaf) {
+    return static_cast<R>(
+        f(tree_reduce<B, L/2>::template apply<R>(f, leaf),
+          tree_reduce<B + L/2, L - L/2>::template apply<R>(f, leaf)));
+  }
+};
+template <std::size_t B>
+struct tree_reduce<B,1> {
+  template <typename R, typename Fn, typename Leaf>
+  static R apply(const Fn&, const Leaf& leaf) {
+    return leaf[B];
+  }
+};
+template <std::size_t B, std::size_t L>
+struct tree_reduce<B,L,
+    enable_if<std::integral_constant<bool,
+        (L > reduce_partials) && !unrolled<L>::value>, void> > {
+  static constexpr std::size_t K = reduce_partials;
+  //! Leaves in each run; the last run also takes the L % K left over
+  static constexpr std::size_t C = L / K;
+
+  template <typename R, typename Fn, typename Leaf>
+  static R apply(const Fn& f, const Leaf& leaf) {
+    return apply<R>(f, leaf, make_index_sequence<K>());
+  }
+
+ private:
+  template <typename R, typename Fn, typename Leaf, std::size_t... I>
+  static R apply(const Fn& f, const Leaf& leaf, index_sequence<I...>) {
+    R p[K] = {static_cast<R>(leaf[B + I * C])...};
+    for (std::size_t j = 1; j < C; ++j) {
+      auto l = {(p[I] = static_cast<R>(f(p[I], leaf[B + I * C + j])), 0)...};
+      (void) l;
+    }
+    for (std::size_t i = B + K * C; i < B + L; ++i)
+      p[K-1] = static_cast<R>(f(p[K-1], leaf[i]));
+    return tree_reduce<0,K>::template apply<R>(f, array_leaf<R,R>{p});
+  }
+};
+
+//! The lesser of two values, the first if neither is less
+struct min_of {
+  template <typename T>
+  const T& operator()(const T& a, const T& b) const { return b < a ? b : a; }
+};
+
+//! The greater of two values, the first if neither is greater
+struct max_of {
+  template <typename T>
+  const T& operator()(const T& a, const T& b) const { return a < b ? b : a; }
+};
+
+//! Element i of an aggregate as 1 if it converts to true, 0 otherwise
+template <typename T, std::size_t N>
+struct count_leaf {
+  const aggregate<T,N>& a;
+  std::size_t operator[](std::size_t i) const { return bool(a[i]) ? 1 : 0; }
+};
+
+//! Number of elements that convert to true
+template <typename T, typename Enable = void>
+struct count_kernel {
+  template <std::size_t N>
+  static std::size_t apply(const aggregate<T,N>& a) {
+    return tree_reduce<0,N>::template apply<std::size_t>(fn::plus(),
+                                                         count_leaf<T,N>{a});
+  }
+  static std::size_t apply(const aggregate<T,0>&) {
+    return 0;
+  }
+};
+
+//! Sum of the elements as R, zero for empty aggregates
+template <typename T, typename Enable = void>
+struct sum_kernel {
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a) {
+    return tree_reduce<0,N>::template apply<R>(fn::plus(),
+                                               reduce_leaf<R,T,N>{a});
+  }
+  template <typename R>
+  static R apply(const aggregate<T,0>&) {
+    return R();
+  }
+};
+
+//! Sum of the element products as R, zero for empty aggregates
+template <typename T, typename U, typename Enable = void>
+struct dot_kernel {
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a, const aggregate<U,N>& b) {
+    return tree_reduce<0,N>::template apply<R>(fn::plus(),
+                                               dot_leaf<R,T,U,N>{a, b});
+  }
+  template <typename R>
+  static R apply(const aggregate<T,0>&, const aggregate<U,0>&) {
+    return R();
+  }
+};
+
+} // end namespace detail
+
+
+//! Type of the sum of elements of type T
+template <typename T>
+using sum_result_t = decay_t<plus_result_t<T,T> >;
+
+//! Type of the sum of products of elements of types T and U
+template <typename T, typename U>
+using dot_result_t = sum_result_t<decay_t<multiplies_result_t<T,U> > >;
+
+
+//! a[0] + a[1] + ... + a[N-1]
+template <typename T, std::size_t N>
+inline
+enable_if<
+  has_plus<T,T>,
+  sum_result_t<T> >
+sum(const aggregate<T,N>& a) {
+  return detail::sum_kernel<T>::template apply<sum_result_t<T> >(a);
+}
+
+//! a[0]*b[0] + a[1]*b[1] + ... + a[N-1]*b[N-1]
+template <typename T, typename U, std::size_t N>
+inline
+enable_if<
+  has_multiplies<T,U>,
+  dot_result_t<T,U> >
+dot(const aggregate<T,N>& a, const aggregate<U,N>& b) {
+  return detail::dot_kernel<T,U>::template apply<dot_result_t<T,U> >(a, b);
+}
+
+//! dot(a, a)
+template <typename T, std::size_t N>
+inline
+enable_if<
+  has_multiplies<T,T>,
+  dot_result_t<T,T> >
+squared_norm(const aggregate<T,N>& a) {
+  return dot(a, a);
+}
+
+//! sqrt(dot(a, a))
+template <typename T, std::size_t N>
+inline auto
+norm(const aggregate<T,N>& a) -> decltype(std::sqrt(squared_norm(a))) {
+  return std::sqrt(squared_norm(a));
+}
+
+//! The smallest element, the first of equal ones
+template <typename T, std::size_t N>
+inline
+enable_if<
+  has_less<T,T,bool>,
+  T>
+min_element(const aggregate<T,N>& a) {
+  static_assert(N > 0, "min_element of an empty aggregate");
+  return detail::tree_reduce<0,N>::template apply<T>(
+      detail::min_of(), detail::reduce_leaf<const T&,T,N>{a});
+}
+
+//! The largest element, the first of equal ones
+template <typename T, std::size_t N>
+inline
+enable_if<
+  has_less<T,T,bool>,
+  T>
+max_element(const aggregate<T,N>& a) {
+  static_assert(N > 0, "max_element of an empty aggregate");
+  return detail::tree_reduce<0,N>::template apply<T>(
+      detail::max_of(), detail::reduce_leaf<const T&,T,N>{a});
+}
+
+//! Whether any element converts to true
+template <typename T, std::size_t N>
+inline bool
+any(const aggregate<T,N>& a) {
+  return detail::tree_reduce<0,N>::template apply<bool>(
+      fn::logical_or(), detail::reduce_leaf<bool,T,N>{a});
+}
+template <typename T>
+inline bool
+any(const aggregate<T,0>&) {
+  return false;
+}
+
+//! Whether every element converts to true
+template <typename T, std::size_t N>
+inline bool
+all(const aggregate<T,N>& a) {
+  return detail::tree_reduce<0,N>::template apply<bool>(
+      fn::logical_and(), detail::reduce_leaf<bool,T,N>{a});
+}
+template <typename T>
+inline bool
+all(const aggregate<T,0>&) {
+  return true;
+}
+
+//! Number of elements that convert to true, e.g. the set lanes of a mask
+template <typename T, std::size_t N>
+inline std::size_t
+count(const aggregate<T,N>& a) {
+  return detail::count_kernel<T>::apply(a);
+}
+
+/** f(f(a[0], a[1]), f(a[2], a[3])) ... over all elements as a balanced tree
+ *
+ *  f must be associative; its result type is the result type of the
+ *  reduction.
+ */
+template <typename Fn, typename T, std::size_t N>
+inline decay_t<function_result_t<const Fn&, const T&, const T&> >
+reduce(Fn f, const aggregate<T,N>& a) {
+  static_assert(N > 0, "reduce of an empty aggregate");
+  typedef decay_t<function_result_t<const Fn&, const T&, const T&> > R;
+  return detail::tree_reduce<0,N>::template apply<R>(
+      f, detail::reduce_leaf<R,T,N>{a});
+}
+
+} // end namespace agg
@@ -0,0 +1,1820 @@
+#pragma once
+
+/** SIMD kernels for aggregates of arithmetic types.
+ *
+ *  Specializes the detail:: kernels of agg_operators.hpp so that the
+ *  arithmetic (+ - * / unary -), bitwise (& | ^ ~) and compound assignment
+ *  operators on aggregate<T,N> with T float, double or a 32/64-bit integer
+ *  run on SSE2/AVX/AVX2/AVX-512 registers. Full registers are processed
+ *  widest first, then narrower ones, and the tail in scalar code. Operations
+ *  without a register equivalent (integer division, modulus, shifts) and all
+ *  other element types keep the generic tuple_map path. The reductions,
+ *  fused operations and == and < of whole aggregates are specialized here
+ *  as well; agg_matrix.hpp and agg_batch.hpp specialize their own kernels
+ *  when AGG_SIMD is defined.
+ *
+ *  Define AGG_NO_SIMD to disable.
+ */
+
+#if !defined(AGG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+
+#define AGG_SIMD 1
+
+#include <immintrin.h>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX512F__)
+#define AGG_SIMD_BYTES 64
+#elif defined(__AVX__)
+#define AGG_SIMD_BYTES 32
+#else
+#define AGG_SIMD_BYTES 16
+#endif
+
+namespace agg {
+namespace detail {
+
+//! Lane kinds
+struct simd_f32 {};
+struct simd_f64 {};
+struct simd_i32 {};
+struct simd_i64 {};
+
+//! Lane kind of an element type, void if it has none
+template <typename T, typename Enable = void>
+struct simd_kind {
+  typedef void type;
+};
+template <>
+struct simd_kind<float> {
+  typedef simd_f32 type;
+};
+template <>
+struct simd_kind<double> {
+  typedef simd_f64 type;
+};
+template <typename T>
+struct simd_kind<T, enable_if<
+    std::integral_constant<bool, std::is_integral<T>::value &&
+                                 !std::is_same<T,bool>::value &&
+                                 sizeof(T) == 4>, void> > {
+  typedef simd_i32 type;
+};
+template <typename T>
+struct simd_kind<T, enable_if<
+    std::integral_constant<bool, std::is_integral<T>::value &&
+                                 !std::is_same<T,bool>::value &&
+                                 sizeof(T) == 8>, void> > {
+  typedef simd_i64 type;
+};
+
+
+/** Masks of lanes from bits, for the selects of the registers below: lane
+ *  i of 32 or 64 bits is all ones where bit i is set.
+ */
+inline __m128i
+simd_bits_epi32(unsigned m) {
+  const __m128i k = _mm_setr_epi32(1, 2, 4, 8);
+  return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(int(m)), k), k);
+}
+inline __m128i
+simd_bits_epi64(unsigned m) {
+  const __m128i k = _mm_setr_epi32(1, 1, 2, 2);
+  return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(int(m)), k), k);
+}
+
+
+/** Register of Bytes bytes holding lanes of Kind.
+ *
+ *  Only the operations the target supports are declared; the kernels detect
+ *  the rest and fall back to narrower registers or scalar code.
+ */
+template <typename Kind, std::size_t Bytes>
+struct simd_reg {};
+
+template <>
+struct simd_reg<simd_f32,16> {
+  typedef __m128 type;
+  typedef float  lane;
+  static constexpr std::size_t lanes = 4;
+  static type load(const void* p) { return _mm_loadu_ps((const float*) p); }
+  static void store(void* p, type v) { _mm_storeu_ps((float*) p, v); }
+  static type set1(lane s) { return _mm_set1_ps(s); }
+  static type add(type a, type b) { return _mm_add_ps(a, b); }
+  static type sub(type a, type b) { return _mm_sub_ps(a, b); }
+  static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+  static type div(type a, type b) { return _mm_div_ps(a, b); }
+  static type neg(type a) { return _mm_xor_ps(a, _mm_set1_ps(-0.f)); }
+  static type min(type a, type b) { return _mm_min_ps(a, b); }
+  static type max(type a, type b) { return _mm_max_ps(a, b); }
+#if defined(__FMA__)
+  static type fmadd(type a, type b, type c) { return _mm_fmadd_ps(a, b, c); }
+#endif
+  //! The first three lanes; the fourth is zero on load
+  static type load3(const lane* p) {
+    return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*) p),
+                         _mm_load_ss(p + 2));
+  }
+  static void store3(lane* p, type v) {
+    _mm_storel_pi((__m64*) p, v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+  }
+  //! Lane i is the sum of the lanes of operand i
+  static type hadd4(type a, type b, type c, type d) {
+    type ab = _mm_add_ps(_mm_unpacklo_ps(a, b), _mm_unpackhi_ps(a, b));
+    type cd = _mm_add_ps(_mm_unpacklo_ps(c, d), _mm_unpackhi_ps(c, d));
+    return _mm_add_ps(_mm_movelh_ps(ab, cd), _mm_movehl_ps(cd, ab));
+  }
+  //! Lane j of operand i becomes lane i of operand j
+  static void transpose4(type& a, type& b, type& c, type& d) {
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+  }
+  //! The register as groups of four lanes, which transpose4 works within
+  typedef simd_reg quad;
+  static constexpr std::size_t quads = 1;
+  static type join(const type* q) { return q[0]; }
+  static void split(type v, type* q) { q[0] = v; }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return unsigned(_mm_movemask_ps(_mm_cmpeq_ps(a, b))); }
+  static unsigned lt_bits(type a, type b)
+  { return unsigned(_mm_movemask_ps(_mm_cmplt_ps(a, b))); }
+  static unsigned le_bits(type a, type b)
+  { return unsigned(_mm_movemask_ps(_mm_cmple_ps(a, b))); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m)
+  { return _mm_castsi128_ps(simd_bits_epi32(m)); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+};
+
+template <>
+struct simd_reg<simd_f64,16> {
+  typedef __m128d type;
+  typedef double  lane;
+  static constexpr std::size_t lanes = 2;
+  static type load(const void* p) { return _mm_loadu_pd((const double*) p); }
+  static void store(void* p, type v) { _mm_storeu_pd((double*) p, v); }
+  static type set1(lane s) { return _mm_set1_pd(s); }
+  static type add(type a, type b) { return _mm_add_pd(a, b); }
+  static type sub(type a, type b) { return _mm_sub_pd(a, b); }
+  static type mul(type a, type b) { return _mm_mul_pd(a, b); }
+  static type div(type a, type b) { return _mm_div_pd(a, b); }
+  static type neg(type a) { return _mm_xor_pd(a, _mm_set1_pd(-0.)); }
+  static type min(type a, type b) { return _mm_min_pd(a, b); }
+  static type max(type a, type b) { return _mm_max_pd(a, b); }
+#if defined(__FMA__)
+  static type fmadd(type a, type b, type c) { return _mm_fmadd_pd(a, b, c); }
+#endif
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return unsigned(_mm_movemask_pd(_mm_cmpeq_pd(a, b))); }
+  static unsigned lt_bits(type a, type b)
+  { return unsigned(_mm_movemask_pd(_mm_cmplt_pd(a, b))); }
+  static unsigned le_bits(type a, type b)
+  { return unsigned(_mm_movemask_pd(_mm_cmple_pd(a, b))); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m)
+  { return _mm_castsi128_pd(simd_bits_epi64(m)); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b)); }
+};
+
+template <>
+struct simd_reg<simd_i32,16> {
+  typedef __m128i      type;
+  typedef std::int32_t lane;
+  static constexpr std::size_t lanes = 4;
+  static type load(const void* p) { return _mm_loadu_si128((const __m128i*) p); }
+  static void store(void* p, type v) { _mm_storeu_si128((__m128i*) p, v); }
+  static type set1(lane s) { return _mm_set1_epi32(s); }
+  static type add(type a, type b) { return _mm_add_epi32(a, b); }
+  static type sub(type a, type b) { return _mm_sub_epi32(a, b); }
+#if defined(__SSE4_1__)
+  static type mul(type a, type b) { return _mm_mullo_epi32(a, b); }
+#endif
+  static type band(type a, type b) { return _mm_and_si128(a, b); }
+  static type bor(type a, type b) { return _mm_or_si128(a, b); }
+  static type bxor(type a, type b) { return _mm_xor_si128(a, b); }
+  static type neg(type a) { return _mm_sub_epi32(_mm_setzero_si128(), a); }
+  static type bnot(type a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+#if defined(__SSE4_1__)
+  static type min(type a, type b) { return _mm_min_epi32(a, b); }
+  static type max(type a, type b) { return _mm_max_epi32(a, b); }
+#endif
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return unsigned(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)))); }
+  static unsigned lt_bits(type a, type b)
+  { return unsigned(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(a, b)))); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m) { return simd_bits_epi32(m); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); }
+};
+
+template <>
+struct simd_reg<simd_i64,16> {
+  typedef __m128i      type;
+  typedef std::int64_t lane;
+  static constexpr std::size_t lanes = 2;
+  static type load(const void* p) { return _mm_loadu_si128((const __m128i*) p); }
+  static void store(void* p, type v) { _mm_storeu_si128((__m128i*) p, v); }
+  static type set1(lane s) { return _mm_set1_epi64x(s); }
+  static type add(type a, type b) { return _mm_add_epi64(a, b); }
+  static type sub(type a, type b) { return _mm_sub_epi64(a, b); }
+#if defined(__AVX512DQ__) && defined(__AVX512VL__)
+  static type mul(type a, type b) { return _mm_mullo_epi64(a, b); }
+#endif
+  static type band(type a, type b) { return _mm_and_si128(a, b); }
+  static type bor(type a, type b) { return _mm_or_si128(a, b); }
+  static type bxor(type a, type b) { return _mm_xor_si128(a, b); }
+  static type neg(type a) { return _mm_sub_epi64(_mm_setzero_si128(), a); }
+  static type bnot(type a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+#if defined(__AVX512VL__)
+  static type min(type a, type b) { return _mm_min_epi64(a, b); }
+  static type max(type a, type b) { return _mm_max_epi64(a, b); }
+#endif
+  //! Bit i set where lane i compares true
+#if defined(__SSE4_1__)
+  static unsigned eq_bits(type a, type b)
+  { return unsigned(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(a, b)))); }
+#endif
+#if defined(__SSE4_2__)
+  static unsigned lt_bits(type a, type b)
+  { return unsigned(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(b, a)))); }
+#endif
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m) { return simd_bits_epi64(m); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); }
+};
+
+#if defined(__AVX__)
+template <>
+struct simd_reg<simd_f32,32> {
+  typedef __m256 type;
+  typedef float  lane;
+  static constexpr std::size_t lanes = 8;
+  static type load(const void* p) { return _mm256_loadu_ps((const float*) p); }
+  static void store(void* p, type v) { _mm256_storeu_ps((float*) p, v); }
+  static type set1(lane s) { return _mm256_set1_ps(s); }
+  static type add(type a, type b) { return _mm256_add_ps(a, b); }
+  static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+  static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+  static type div(type a, type b) { return _mm256_div_ps(a, b); }
+  static type neg(type a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.f)); }
+  static type min(type a, type b) { return _mm256_min_ps(a, b); }
+  static type max(type a, type b) { return _mm256_max_ps(a, b); }
+#if defined(__FMA__)
+  static type fmadd(type a, type b, type c)
+  { return _mm256_fmadd_ps(a, b, c); }
+#endif
+  //! Lane j of operand i becomes lane i of operand j, within each quad
+  static void transpose4(type& a, type& b, type& c, type& d) {
+    type ab0 = _mm256_unpacklo_ps(a, b), ab1 = _mm256_unpackhi_ps(a, b);
+    type cd0 = _mm256_unpacklo_ps(c, d), cd1 = _mm256_unpackhi_ps(c, d);
+    a = _mm256_shuffle_ps(ab0, cd0, 0x44);
+    b = _mm256_shuffle_ps(ab0, cd0, 0xEE);
+    c = _mm256_shuffle_ps(ab1, cd1, 0x44);
+    d = _mm256_shuffle_ps(ab1, cd1, 0xEE);
+  }
+  typedef simd_reg<simd_f32,16> quad;
+  static constexpr std::size_t quads = 2;
+  static type join(const quad::type* q) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(q[0]), q[1], 1);
+  }
+  static void split(type v, quad::type* q) {
+    q[0] = _mm256_castps256_ps128(v);
+    q[1] = _mm256_extractf128_ps(v, 1);
+  }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return unsigned(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_EQ_OQ))); }
+  static unsigned lt_bits(type a, type b)
+  { return unsigned(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ))); }
+  static unsigned le_bits(type a, type b)
+  { return unsigned(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ))); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m) {
+    return _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_castsi128_ps(simd_bits_epi32(m))),
+        _mm_castsi128_ps(simd_bits_epi32(m >> 4)), 1);
+  }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm256_blendv_ps(b, a, m); }
+};
+
+template <>
+struct simd_reg<simd_f64,32> {
+  typedef __m256d type;
+  typedef double  lane;
+  static constexpr std::size_t lanes = 4;
+  static type load(const void* p) { return _mm256_loadu_pd((const double*) p); }
+  static void store(void* p, type v) { _mm256_storeu_pd((double*) p, v); }
+  static type set1(lane s) { return _mm256_set1_pd(s); }
+  static type add(type a, type b) { return _mm256_add_pd(a, b); }
+  static type sub(type a, type b) { return _mm256_sub_pd(a, b); }
+  static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+  static type div(type a, type b) { return _mm256_div_pd(a, b); }
+  static type neg(type a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.)); }
+  static type min(type a, type b) { return _mm256_min_pd(a, b); }
+  static type max(type a, type b) { return _mm256_max_pd(a, b); }
+#if defined(__FMA__)
+  static type fmadd(type a, type b, type c)
+  { return _mm256_fmadd_pd(a, b, c); }
+#endif
+  //! The first three lanes; the fourth is zero on load
+  static type load3(const lane* p) {
+    return _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadu_pd(p)),
+                                _mm_load_sd(p + 2), 1);
+  }
+  static void store3(lane* p, type v) {
+    _mm_storeu_pd(p, _mm256_castpd256_pd128(v));
+    _mm_store_sd(p + 2, _mm256_extractf128_pd(v, 1));
+  }
+  //! Lane i is the sum of the lanes of operand i
+  static type hadd4(type a, type b, type c, type d) {
+    type ab = _mm256_hadd_pd(a, b);
+    type cd = _mm256_hadd_pd(c, d);
+    return _mm256_add_pd(_mm256_permute2f128_pd(ab, cd, 0x20),
+                         _mm256_permute2f128_pd(ab, cd, 0x31));
+  }
+  //! Lane j of operand i becomes lane i of operand j
+  static void transpose4(type& a, type& b, type& c, type& d) {
+    type ab0 = _mm256_unpacklo_pd(a, b), ab1 = _mm256_unpackhi_pd(a, b);
+    type cd0 = _mm256_unpacklo_pd(c, d), cd1 = _mm256_unpackhi_pd(c, d);
+    a = _mm256_permute2f128_pd(ab0, cd0, 0x20);
+    b = _mm256_permute2f128_pd(ab1, cd1, 0x20);
+    c = _mm256_permute2f128_pd(ab0, cd0, 0x31);
+    d = _mm256_permute2f128_pd(ab1, cd1, 0x31);
+  }
+  //! The register as groups of four lanes, which transpose4 works within
+  typedef simd_reg quad;
+  static constexpr std::size_t quads = 1;
+  static type join(const type* q) { return q[0]; }
+  static void split(type v, type* q) { q[0] = v; }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return unsigned(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ))); }
+  static unsigned lt_bits(type a, type b)
+  { return unsigned(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ))); }
+  static unsigned le_bits(type a, type b)
+  { return unsigned(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LE_OQ))); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m) {
+    return _mm256_insertf128_pd(
+        _mm256_castpd128_pd256(_mm_castsi128_pd(simd_bits_epi64(m))),
+        _mm_castsi128_pd(simd_bits_epi64(m >> 2)), 1);
+  }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm256_blendv_pd(b, a, m); }
+};
+#endif
+
+#if defined(__AVX2__)
+template <>
+struct simd_reg<simd_i32,32> {
+  typedef __m256i      type;
+  typedef std::int32_t lane;
+  static constexpr std::size_t lanes = 8;
+  static type load(const void* p) { return _mm256_loadu_si256((const __m256i*) p); }
+  static void store(void* p, type v) { _mm256_storeu_si256((__m256i*) p, v); }
+  static type set1(lane s) { return _mm256_set1_epi32(s); }
+  static type add(type a, type b) { return _mm256_add_epi32(a, b); }
+  static type sub(type a, type b) { return _mm256_sub_epi32(a, b); }
+  static type mul(type a, type b) { return _mm256_mullo_epi32(a, b); }
+  static type band(type a, type b) { return _mm256_and_si256(a, b); }
+  static type bor(type a, type b) { return _mm256_or_si256(a, b); }
+  static type bxor(type a, type b) { return _mm256_xor_si256(a, b); }
+  static type neg(type a) { return _mm256_sub_epi32(_mm256_setzero_si256(), a); }
+  static type bnot(type a) { return _mm256_xor_si256(a, _mm256_set1_epi32(-1)); }
+  static type min(type a, type b) { return _mm256_min_epi32(a, b); }
+  static type max(type a, type b) { return _mm256_max_epi32(a, b); }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b) {
+    return unsigned(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))));
+  }
+  static unsigned lt_bits(type a, type b) {
+    return unsigned(_mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpgt_epi32(b, a))));
+  }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m) {
+    const type k = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(int(m)), k),
+                              k);
+  }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm256_blendv_epi8(b, a, m); }
+};
+
+template <>
+struct simd_reg<simd_i64,32> {
+  typedef __m256i      type;
+  typedef std::int64_t lane;
+  static constexpr std::size_t lanes = 4;
+  static type load(const void* p) { return _mm256_loadu_si256((const __m256i*) p); }
+  static void store(void* p, type v) { _mm256_storeu_si256((__m256i*) p, v); }
+  static type set1(lane s) { return _mm256_set1_epi64x(s); }
+  static type add(type a, type b) { return _mm256_add_epi64(a, b); }
+  static type sub(type a, type b) { return _mm256_sub_epi64(a, b); }
+#if defined(__AVX512DQ__) && defined(__AVX512VL__)
+  static type mul(type a, type b) { return _mm256_mullo_epi64(a, b); }
+#endif
+  static type band(type a, type b) { return _mm256_and_si256(a, b); }
+  static type bor(type a, type b) { return _mm256_or_si256(a, b); }
+  static type bxor(type a, type b) { return _mm256_xor_si256(a, b); }
+  static type neg(type a) { return _mm256_sub_epi64(_mm256_setzero_si256(), a); }
+  static type bnot(type a) { return _mm256_xor_si256(a, _mm256_set1_epi32(-1)); }
+#if defined(__AVX512VL__)
+  static type min(type a, type b) { return _mm256_min_epi64(a, b); }
+  static type max(type a, type b) { return _mm256_max_epi64(a, b); }
+#endif
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b) {
+    return unsigned(_mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(a, b))));
+  }
+  static unsigned lt_bits(type a, type b) {
+    return unsigned(_mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpgt_epi64(b, a))));
+  }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m) {
+    const type k = _mm256_setr_epi64x(1, 2, 4, 8);
+    return _mm256_cmpeq_epi64(
+        _mm256_and_si256(_mm256_set1_epi64x(m), k), k);
+  }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm256_blendv_epi8(b, a, m); }
+};
+#endif
+
+#if defined(__AVX512F__)
+// min, max and the shuffles go through the zero-masked forms: the unmasked
+// ones expand to an undefined register that g++ 12 reports as used
+// uninitialized.
+template <>
+struct simd_reg<simd_f32,64> {
+  typedef __m512    type;
+  typedef float     lane;
+  static constexpr std::size_t lanes = 16;
+  static type load(const void* p) { return _mm512_loadu_ps(p); }
+  static void store(void* p, type v) { _mm512_storeu_ps(p, v); }
+  static type set1(lane s) { return _mm512_set1_ps(s); }
+  static type add(type a, type b) { return _mm512_add_ps(a, b); }
+  static type sub(type a, type b) { return _mm512_sub_ps(a, b); }
+  static type mul(type a, type b) { return _mm512_mul_ps(a, b); }
+  static type div(type a, type b) { return _mm512_div_ps(a, b); }
+#if defined(__AVX512DQ__)
+  static type neg(type a) { return _mm512_xor_ps(a, _mm512_set1_ps(-0.f)); }
+#else
+  static type neg(type a) {
+    return _mm512_castsi512_ps(_mm512_xor_si512(
+        _mm512_castps_si512(a), _mm512_set1_epi32(INT32_MIN)));
+  }
+#endif
+  static type min(type a, type b) { return _mm512_maskz_min_ps(0xFFFF, a, b); }
+  static type max(type a, type b) { return _mm512_maskz_max_ps(0xFFFF, a, b); }
+  static type fmadd(type a, type b, type c)
+  { return _mm512_fmadd_ps(a, b, c); }
+  //! Lane j of operand i becomes lane i of operand j, within each quad
+  static void transpose4(type& a, type& b, type& c, type& d) {
+    type ab0 = _mm512_maskz_unpacklo_ps(0xFFFF, a, b);
+    type ab1 = _mm512_maskz_unpackhi_ps(0xFFFF, a, b);
+    type cd0 = _mm512_maskz_unpacklo_ps(0xFFFF, c, d);
+    type cd1 = _mm512_maskz_unpackhi_ps(0xFFFF, c, d);
+    a = _mm512_maskz_shuffle_ps(0xFFFF, ab0, cd0, 0x44);
+    b = _mm512_maskz_shuffle_ps(0xFFFF, ab0, cd0, 0xEE);
+    c = _mm512_maskz_shuffle_ps(0xFFFF, ab1, cd1, 0x44);
+    d = _mm512_maskz_shuffle_ps(0xFFFF, ab1, cd1, 0xEE);
+  }
+  typedef simd_reg<simd_f32,16> quad;
+  static constexpr std::size_t quads = 4;
+  static type join(const quad::type* q) {
+    type v = _mm512_castps128_ps512(q[0]);
+    v = _mm512_maskz_insertf32x4(0xFFFF, v, q[1], 1);
+    v = _mm512_maskz_insertf32x4(0xFFFF, v, q[2], 2);
+    return _mm512_maskz_insertf32x4(0xFFFF, v, q[3], 3);
+  }
+  static void split(type v, quad::type* q) {
+    q[0] = _mm512_maskz_extractf32x4_ps(0xF, v, 0);
+    q[1] = _mm512_maskz_extractf32x4_ps(0xF, v, 1);
+    q[2] = _mm512_maskz_extractf32x4_ps(0xF, v, 2);
+    q[3] = _mm512_maskz_extractf32x4_ps(0xF, v, 3);
+  }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+  static unsigned lt_bits(type a, type b)
+  { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+  static unsigned le_bits(type a, type b)
+  { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m)
+  { return _mm512_castsi512_ps(_mm512_maskz_set1_epi32(__mmask16(m), -1)); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b) {
+    return _mm512_castsi512_ps(_mm512_ternarylogic_epi32(
+        _mm512_castps_si512(m), _mm512_castps_si512(a),
+        _mm512_castps_si512(b), 0xCA));
+  }
+};
+
+template <>
+struct simd_reg<simd_f64,64> {
+  typedef __m512d  type;
+  typedef double   lane;
+  static constexpr std::size_t lanes = 8;
+  static type load(const void* p) { return _mm512_loadu_pd(p); }
+  static void store(void* p, type v) { _mm512_storeu_pd(p, v); }
+  static type set1(lane s) { return _mm512_set1_pd(s); }
+  static type add(type a, type b) { return _mm512_add_pd(a, b); }
+  static type sub(type a, type b) { return _mm512_sub_pd(a, b); }
+  static type mul(type a, type b) { return _mm512_mul_pd(a, b); }
+  static type div(type a, type b) { return _mm512_div_pd(a, b); }
+#if defined(__AVX512DQ__)
+  static type neg(type a) { return _mm512_xor_pd(a, _mm512_set1_pd(-0.)); }
+#else
+  static type neg(type a) {
+    return _mm512_castsi512_pd(_mm512_xor_si512(
+        _mm512_castpd_si512(a), _mm512_set1_epi64(INT64_MIN)));
+  }
+#endif
+  static type min(type a, type b) { return _mm512_maskz_min_pd(0xFF, a, b); }
+  static type max(type a, type b) { return _mm512_maskz_max_pd(0xFF, a, b); }
+  static type fmadd(type a, type b, type c)
+  { return _mm512_fmadd_pd(a, b, c); }
+  //! Lane j of operand i becomes lane i of operand j, within each quad
+  static void transpose4(type& a, type& b, type& c, type& d) {
+    const __m512i lo = _mm512_set_epi64(13, 12, 5, 4, 9, 8, 1, 0);
+    const __m512i hi = _mm512_set_epi64(15, 14, 7, 6, 11, 10, 3, 2);
+    type ab0 = _mm512_maskz_unpacklo_pd(0xFF, a, b);
+    type ab1 = _mm512_maskz_unpackhi_pd(0xFF, a, b);
+    type cd0 = _mm512_maskz_unpacklo_pd(0xFF, c, d);
+    type cd1 = _mm512_maskz_unpackhi_pd(0xFF, c, d);
+    a = _mm512_maskz_permutex2var_pd(0xFF, ab0, lo, cd0);
+    b = _mm512_maskz_permutex2var_pd(0xFF, ab1, lo, cd1);
+    c = _mm512_maskz_permutex2var_pd(0xFF, ab0, hi, cd0);
+    d = _mm512_maskz_permutex2var_pd(0xFF, ab1, hi, cd1);
+  }
+  typedef simd_reg<simd_f64,32> quad;
+  static constexpr std::size_t quads = 2;
+  static type join(const quad::type* q) {
+    return _mm512_maskz_insertf64x4(0xFF, _mm512_castpd256_pd512(q[0]),
+                                    q[1], 1);
+  }
+  static void split(type v, quad::type* q) {
+    q[0] = _mm512_maskz_extractf64x4_pd(0xF, v, 0);
+    q[1] = _mm512_maskz_extractf64x4_pd(0xF, v, 1);
+  }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+  static unsigned lt_bits(type a, type b)
+  { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+  static unsigned le_bits(type a, type b)
+  { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m)
+  { return _mm512_castsi512_pd(_mm512_maskz_set1_epi64(__mmask8(m), -1)); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b) {
+    return _mm512_castsi512_pd(_mm512_ternarylogic_epi64(
+        _mm512_castpd_si512(m), _mm512_castpd_si512(a),
+        _mm512_castpd_si512(b), 0xCA));
+  }
+};
+
+template <>
+struct simd_reg<simd_i32,64> {
+  typedef __m512i      type;
+  typedef std::int32_t lane;
+  static constexpr std::size_t lanes = 16;
+  static type load(const void* p) { return _mm512_loadu_si512(p); }
+  static void store(void* p, type v) { _mm512_storeu_si512(p, v); }
+  static type set1(lane s) { return _mm512_set1_epi32(s); }
+  static type add(type a, type b) { return _mm512_add_epi32(a, b); }
+  static type sub(type a, type b) { return _mm512_sub_epi32(a, b); }
+  static type mul(type a, type b) { return _mm512_mullo_epi32(a, b); }
+  static type band(type a, type b) { return _mm512_and_si512(a, b); }
+  static type bor(type a, type b) { return _mm512_or_si512(a, b); }
+  static type bxor(type a, type b) { return _mm512_xor_si512(a, b); }
+  static type neg(type a) { return _mm512_sub_epi32(_mm512_setzero_si512(), a); }
+  static type bnot(type a) { return _mm512_xor_si512(a, _mm512_set1_epi32(-1)); }
+  static type min(type a, type b)
+  { return _mm512_maskz_min_epi32(0xFFFF, a, b); }
+  static type max(type a, type b)
+  { return _mm512_maskz_max_epi32(0xFFFF, a, b); }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return _mm512_cmpeq_epi32_mask(a, b); }
+  static unsigned lt_bits(type a, type b)
+  { return _mm512_cmplt_epi32_mask(a, b); }
+  static unsigned le_bits(type a, type b)
+  { return _mm512_cmple_epi32_mask(a, b); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m)
+  { return _mm512_maskz_set1_epi32(__mmask16(m), -1); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm512_ternarylogic_epi32(m, a, b, 0xCA); }
+};
+
+template <>
+struct simd_reg<simd_i64,64> {
+  typedef __m512i      type;
+  typedef std::int64_t lane;
+  static constexpr std::size_t lanes = 8;
+  static type load(const void* p) { return _mm512_loadu_si512(p); }
+  static void store(void* p, type v) { _mm512_storeu_si512(p, v); }
+  static type set1(lane s) { return _mm512_set1_epi64(s); }
+  static type add(type a, type b) { return _mm512_add_epi64(a, b); }
+  static type sub(type a, type b) { return _mm512_sub_epi64(a, b); }
+#if defined(__AVX512DQ__)
+  static type mul(type a, type b) { return _mm512_mullo_epi64(a, b); }
+#endif
+  static type band(type a, type b) { return _mm512_and_si512(a, b); }
+  static type bor(type a, type b) { return _mm512_or_si512(a, b); }
+  static type bxor(type a, type b) { return _mm512_xor_si512(a, b); }
+  static type neg(type a) { return _mm512_sub_epi64(_mm512_setzero_si512(), a); }
+  static type bnot(type a) { return _mm512_xor_si512(a, _mm512_set1_epi32(-1)); }
+  static type min(type a, type b) { return _mm512_maskz_min_epi64(0xFF, a, b); }
+  static type max(type a, type b) { return _mm512_maskz_max_epi64(0xFF, a, b); }
+  //! Bit i set where lane i compares true
+  static unsigned eq_bits(type a, type b)
+  { return _mm512_cmpeq_epi64_mask(a, b); }
+  static unsigned lt_bits(type a, type b)
+  { return _mm512_cmplt_epi64_mask(a, b); }
+  static unsigned le_bits(type a, type b)
+  { return _mm512_cmple_epi64_mask(a, b); }
+  //! Lanes of all ones where bit i is set
+  static type bits_mask(unsigned m)
+  { return _mm512_maskz_set1_epi64(__mmask8(m), -1); }
+  //! Lanes of a where m is set, of b elsewhere
+  static type blend(type m, type a, type b)
+  { return _mm512_ternarylogic_epi64(m, a, b, 0xCA); }
+};
+#endif
+
+
+/** Register operation for a fn:: functor.
+ *
+ *  scalar is the pure functor computing the same element, used for the tail
+ *  and to check that the element result type is unchanged.
+ */
+template <typename Fn>
+struct simd_op {};
+
+#define AGG_SIMD_BIN_OP(NAME,SCALAR,REG)                                      \
+  template <>                                                                 \
+  struct simd_op<fn::NAME> {                                                  \
+    typedef fn::SCALAR scalar;                                                \
+    template <typename S>                                                     \
+    static auto apply(typename S::type a, typename S::type b)                 \
+        -> decltype(S::REG(a, b)) {                                           \
+      return S::REG(a, b);                                                    \
+    }                                                                         \
+  }
+
+AGG_SIMD_BIN_OP(plus,              plus,       add);
+AGG_SIMD_BIN_OP(minus,             minus,      sub);
+AGG_SIMD_BIN_OP(multiplies,        multiplies, mul);
+AGG_SIMD_BIN_OP(divides,           divides,    div);
+AGG_SIMD_BIN_OP(bit_and,           bit_and,    band);
+AGG_SIMD_BIN_OP(bit_or,            bit_or,     bor);
+AGG_SIMD_BIN_OP(bit_xor,           bit_xor,    bxor);
+AGG_SIMD_BIN_OP(plus_assign,       plus,       add);
+AGG_SIMD_BIN_OP(minus_assign,      minus,      sub);
+AGG_SIMD_BIN_OP(multiplies_assign, multiplies, mul);
+AGG_SIMD_BIN_OP(divides_assign,    divides,    div);
+AGG_SIMD_BIN_OP(bit_and_assign,    bit_and,    band);
+AGG_SIMD_BIN_OP(bit_or_assign,     bit_or,     bor);
+AGG_SIMD_BIN_OP(bit_xor_assign,    bit_xor,    bxor);
+#undef AGG_SIMD_BIN_OP
+
+#define AGG_SIMD_UN_OP(NAME,REG)                                              \
+  template <>                                                                 \
+  struct simd_op<fn::NAME> {                                                  \
+    typedef fn::NAME scalar;                                                  \
+    template <typename S>                                                     \
+    static auto apply(typename S::type a)                                     \
+        -> decltype(S::REG(a)) {                                              \
+      return S::REG(a);                                                       \
+    }                                                                         \
+  }
+
+AGG_SIMD_UN_OP(unary_minus, neg);
+AGG_SIMD_UN_OP(bit_not,     bnot);
+#undef AGG_SIMD_UN_OP
+
+//! a*b + c, with one rounding when the register has fmadd
+template <typename S>
+inline auto
+simd_madd(typename S::type a, typename S::type b, typename S::type c, int)
+    -> decltype(S::fmadd(a, b, c)) {
+  return S::fmadd(a, b, c);
+}
+template <typename S>
+inline auto
+simd_madd(typename S::type a, typename S::type b, typename S::type c, long)
+    -> decltype(S::add(S::mul(a, b), c)) {
+  return S::add(S::mul(a, b), c);
+}
+
+template <>
+struct simd_op<fn::fma> {
+  typedef fn::fma scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b,
+                    typename S::type c)
+      -> decltype(simd_madd<S>(a, b, c, 0)) {
+    return simd_madd<S>(a, b, c, 0);
+  }
+};
+
+template <>
+struct simd_op<fn::lerp> {
+  typedef fn::lerp scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b,
+                    typename S::type t)
+      -> decltype(simd_madd<S>(t, b, simd_madd<S>(S::neg(t), a, a, 0), 0)) {
+    return simd_madd<S>(t, b, simd_madd<S>(S::neg(t), a, a, 0), 0);
+  }
+};
+
+//! min and max return their second operand if either is NaN, so a NaN v
+//! passes through as with fn::clamp. Requires lo <= hi.
+template <>
+struct simd_op<fn::clamp> {
+  typedef fn::clamp scalar;
+  template <typename S>
+  static auto apply(typename S::type v, typename S::type lo,
+                    typename S::type hi)
+      -> decltype(S::min(hi, S::max(lo, v))) {
+    return S::min(hi, S::max(lo, v));
+  }
+};
+
+
+/** Register comparison for a fn:: comparison functor: bit i of the result
+ *  is set where lane i compares true. scalar computes one element.
+ *  Registers without le_bits negate lt_bits, which holds for integers.
+ */
+template <typename Fn>
+struct simd_compare {};
+
+template <typename S>
+inline auto
+simd_le_bits(typename S::type a, typename S::type b, int)
+    -> decltype(S::le_bits(a, b)) {
+  return S::le_bits(a, b);
+}
+template <typename S>
+inline auto
+simd_le_bits(typename S::type a, typename S::type b, long)
+    -> decltype(S::lt_bits(b, a)) {
+  return ~S::lt_bits(b, a) & ((1u << S::lanes) - 1);
+}
+
+template <>
+struct simd_compare<fn::equal_to> {
+  typedef fn::equal_to scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b)
+      -> decltype(S::eq_bits(a, b)) {
+    return S::eq_bits(a, b);
+  }
+};
+template <>
+struct simd_compare<fn::not_equal_to> {
+  typedef fn::not_equal_to scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b)
+      -> decltype(S::eq_bits(a, b)) {
+    return ~S::eq_bits(a, b) & ((1u << S::lanes) - 1);
+  }
+};
+template <>
+struct simd_compare<fn::less> {
+  typedef fn::less scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b)
+      -> decltype(S::lt_bits(a, b)) {
+    return S::lt_bits(a, b);
+  }
+};
+template <>
+struct simd_compare<fn::greater> {
+  typedef fn::greater scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b)
+      -> decltype(S::lt_bits(b, a)) {
+    return S::lt_bits(b, a);
+  }
+};
+template <>
+struct simd_compare<fn::less_equal> {
+  typedef fn::less_equal scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b)
+      -> decltype(simd_le_bits<S>(a, b, 0)) {
+    return simd_le_bits<S>(a, b, 0);
+  }
+};
+template <>
+struct simd_compare<fn::greater_equal> {
+  typedef fn::greater_equal scalar;
+  template <typename S>
+  static auto apply(typename S::type a, typename S::type b)
+      -> decltype(simd_le_bits<S>(b, a, 0)) {
+    return simd_le_bits<S>(b, a, 0);
+  }
+};
+
+//! Lanes of a where the mask lane is set, of b elsewhere
+struct simd_select {
+  typedef fn::select scalar;
+  template <typename S>
+  static auto apply(typename S::type m, typename S::type a,
+                    typename S::type b)
+      -> decltype(S::bits_mask(0u), S::blend(m, a, b)) {
+    return S::blend(m, a, b);
+  }
+};
+
+
+/** Bytes [0,L) of a register from memory, the rest zero, and back; L is 2,
+ *  4, 8 or 16.
+ */
+template <std::size_t L>
+inline __m128i
+simd_load_bytes(const void* p) {
+  std::int32_t x = 0;
+  std::memcpy(&x, p, L);
+  return _mm_cvtsi32_si128(x);
+}
+template <>
+inline __m128i
+simd_load_bytes<8>(const void* p) {
+  return _mm_loadl_epi64((const __m128i*) p);
+}
+template <>
+inline __m128i
+simd_load_bytes<16>(const void* p) {
+  return _mm_loadu_si128((const __m128i*) p);
+}
+
+template <std::size_t L>
+inline void
+simd_store_bytes(void* p, __m128i v) {
+  std::int32_t x = _mm_cvtsi128_si32(v);
+  std::memcpy(p, &x, L);
+}
+template <>
+inline void
+simd_store_bytes<8>(void* p, __m128i v) {
+  _mm_storel_epi64((__m128i*) p, v);
+}
+template <>
+inline void
+simd_store_bytes<16>(void* p, __m128i v) {
+  _mm_storeu_si128((__m128i*) p, v);
+}
+
+//! Bit i set where bool i of L is true
+template <std::size_t L>
+inline unsigned
+simd_load_bits(const bool* p) {
+  __m128i zero = _mm_cmpeq_epi8(simd_load_bytes<L>(p), _mm_setzero_si128());
+  return ~unsigned(_mm_movemask_epi8(zero)) & ((1u << L) - 1);
+}
+
+//! Bool i of L true where bit i is set
+template <std::size_t L>
+inline void
+simd_store_bits(bool* p, unsigned m) {
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+  __m128i v = _mm_maskz_set1_epi8(__mmask16(m), 1);
+#else
+  // Byte i of v holds bits [8*(i/8), 8*(i/8) + 8) of m, then bit i % 8
+  __m128i v = _mm_set1_epi16(short(m));
+  v = _mm_unpacklo_epi8(v, v);
+  v = _mm_unpacklo_epi16(v, v);
+  v = _mm_unpacklo_epi32(v, v);
+  const __m128i k = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                  1, 2, 4, 8, 16, 32, 64, -128);
+  v = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(v, k), k),
+                    _mm_set1_epi8(1));
+#endif
+  simd_store_bytes<L>(p, v);
+}
+
+//! Register results to memory: lanes, or bits as bools
+template <typename S, typename T>
+inline void simd_put(T* p, typename S::type v) { S::store(p, v); }
+template <typename S>
+inline void simd_put(bool* p, unsigned m) { simd_store_bits<S::lanes>(p, m); }
+
+
+//! Operand read from memory
+template <typename T>
+struct simd_stream {
+  const T* p;
+  template <typename S>
+  typename S::type load(std::size_t i) const { return S::load(p + i); }
+  const T& operator[](std::size_t i) const { return p[i]; }
+};
+
+//! Operand broadcast from a scalar
+template <typename T>
+struct simd_splat {
+  T s;
+  template <typename S>
+  typename S::type load(std::size_t) const { return S::set1(s); }
+  const T& operator[](std::size_t) const { return s; }
+};
+
+//! Mask operand read from bools, as lanes of all ones or zeros
+struct simd_bools {
+  const bool* p;
+  template <typename S>
+  typename S::type load(std::size_t i) const
+  { return S::bits_mask(simd_load_bits<S::lanes>(p + i)); }
+  const bool& operator[](std::size_t i) const { return p[i]; }
+};
+
+template <typename T, std::size_t N>
+inline T* simd_data(aggregate<T,N>& a) { return a.data(); }
+template <typename T>
+inline T* simd_data(aggregate<T,0>&) { return nullptr; }
+template <typename T, std::size_t N>
+inline const T* simd_data(const aggregate<T,N>& a) { return a.data(); }
+template <typename T>
+inline const T* simd_data(const aggregate<T,0>&) { return nullptr; }
+
+/** Lanes processed for aggregate<T,N>. Padding from aggregate_storage that
+ *  is aligned for registers is processed too, so no scalar tail remains.
+ */
+template <typename T, std::size_t N>
+struct simd_extent
+    : std::integral_constant<std::size_t,
+        __aggregate_traits<T,N>::_Align >= 16
+        ? __aggregate_traits<T,N>::_Lanes : N> {};
+
+
+//! Whether register S supports Op with Arity operands
+template <typename Op, typename S, std::size_t Arity>
+struct simd_supports;
+
+template <typename Op, typename S>
+struct simd_supports<Op,S,1> {
+  template <typename O = Op, typename R = S>
+  static auto test(int)
+      -> decltype(O::template apply<R>(std::declval<typename R::type>()),
+                  std::true_type());
+  static std::false_type test(...);
+
+  static constexpr bool value = decltype(test(0))::value;
+};
+
+template <typename Op, typename S>
+struct simd_supports<Op,S,2> {
+  template <typename O = Op, typename R = S>
+  static auto test(int)
+      -> decltype(O::template apply<R>(std::declval<typename R::type>(),
+                                       std::declval<typename R::type>()),
+                  std::true_type());
+  static std::false_type test(...);
+
+  static constexpr bool value = decltype(test(0))::value;
+};
+
+template <typename Op, typename S>
+struct simd_supports<Op,S,3> {
+  template <typename O = Op, typename R = S>
+  static auto test(int)
+      -> decltype(O::template apply<R>(std::declval<typename R::type>(),
+                                       std::declval<typename R::type>(),
+                                       std::declval<typename R::type>()),
+                  std::true_type());
+  static std::false_type test(...);
+
+  static constexpr bool value = decltype(test(0))::value;
+};
+
+//! Whether some register width supports Op on Kind
+template <typename Op, typename Kind, std::size_t Arity,
+          std::size_t Bytes = AGG_SIMD_BYTES>
+struct simd_available
+    : std::integral_constant<bool,
+        simd_supports<Op, simd_reg<Kind,Bytes>, Arity>::value ||
+        simd_available<Op, Kind, Arity, Bytes/2>::value> {};
+template <typename Op, typename Kind, std::size_t Arity>
+struct simd_available<Op, Kind, Arity, 8> : std::false_type {};
+
+
+/** Apply Op to the Arity operands over lanes [I,N) with registers of Bytes
+ *  bytes, falling back to narrower registers for what is left.
+ *  end is the first lane left for scalar code.
+ */
+template <typename Op, typename Kind, std::size_t Arity, std::size_t Bytes,
+          std::size_t I, std::size_t N, typename Enable = void>
+struct simd_cascade : simd_cascade<Op,Kind,Arity,Bytes/2,I,N> {};
+
+template <typename Op, typename Kind, std::size_t Arity,
+          std::size_t I, std::size_t N>
+struct simd_cascade<Op,Kind,Arity,8,I,N> {
+  static constexpr std::size_t end = I;
+
+  template <typename T, typename... A>
+  static void run(T*, const A&...) {}
+};
+
+template <typename Op, typename Kind, std::size_t Arity, std::size_t Bytes,
+          std::size_t I, std::size_t N>
+struct simd_cascade<Op,Kind,Arity,Bytes,I,N,
+    enable_if<simd_supports<Op, simd_reg<Kind,Bytes>, Arity>, void> > {
+  typedef simd_reg<Kind,Bytes> S;
+  static constexpr std::size_t full = I + (N - I) / S::lanes * S::lanes;
+  typedef simd_cascade<Op,Kind,Arity,Bytes/2,full,N> next;
+  static constexpr std::size_t end = next::end;
+
+  template <typename T, typename... A>
+  static void run(T* out, const A&... a) {
+    for (std::size_t i = I; i != full; i += S::lanes)
+      simd_put<S>(out + i, Op::template apply<S>(a.template load<S>(i)...));
+    next::run(out, a...);
+  }
+};
+
+/** out[i] = op(a[i]...) over lanes [0,L) of Kind, registers first then
+ *  scalar code
+ */
+template <typename Op, typename Kind, std::size_t L, typename Out,
+          typename... A>
+inline void simd_map_lanes(Out* out, const A&... a) {
+  typedef simd_cascade<Op, Kind, sizeof...(A), AGG_SIMD_BYTES, 0, L> C;
+  C::run(out, a...);
+  for (std::size_t i = C::end; i < L; ++i)
+    out[i] = typename Op::scalar()(a[i]...);
+}
+
+/** out[i] = fn(a[i]...) over the lanes of aggregate<T,N> storage, registers
+ *  first then scalar code
+ */
+template <typename Fn, std::size_t N, typename T, typename... A>
+inline void simd_map(T* out, const A&... a) {
+  simd_map_lanes<simd_op<Fn>, typename simd_kind<T>::type,
+                 simd_extent<T,N>::value>(out, a...);
+}
+
+
+template <typename... T>
+struct simd_void {
+  typedef void type;
+};
+
+//! Whether Fn on (T, U...) elements can run in registers of T
+template <typename Fn, typename Enable, typename T, typename... U>
+struct simd_enabled_impl : std::false_type {};
+template <typename Fn, typename T, typename... U>
+struct simd_enabled_impl<Fn,
+    typename simd_void<
+      enable_if<std::is_arithmetic<T>, void>,
+      function_result_t<typename simd_op<Fn>::scalar,
+                        const T&, const U&...> >::type,
+    T, U...>
+    : std::integral_constant<bool,
+        simd_available<simd_op<Fn>, typename simd_kind<T>::type,
+                       1 + sizeof...(U)>::value &&
+        std::is_same<decay_t<function_result_t<typename simd_op<Fn>::scalar,
+                                               const T&, const U&...> >,
+                     T>::value> {};
+
+template <typename Fn, typename T, typename... U>
+struct simd_enabled : simd_enabled_impl<Fn, void, T, U...> {};
+
+//! clamp uses signed min and max; unsigned lanes do not order
+template <typename T, typename... U>
+struct simd_enabled<fn::clamp, T, U...>
+    : std::integral_constant<bool,
+        (std::is_floating_point<T>::value || std::is_signed<T>::value) &&
+        simd_enabled_impl<fn::clamp, void, T, U...>::value> {};
+
+
+template <typename Fn, typename T>
+struct unary_kernel<Fn,T, enable_if<simd_enabled<Fn,T>, void> > {
+  template <typename R, std::size_t N>
+  static R map(const aggregate<T,N>& a) {
+    R r;
+    simd_map<Fn,N>(simd_data(r), simd_stream<T>{simd_data(a)});
+    return r;
+  }
+};
+
+template <typename Fn, typename T, typename U>
+struct map_kernel<Fn,T,U,
+    enable_if<std::integral_constant<bool, simd_enabled<Fn,T,U>::value &&
+                                           std::is_arithmetic<U>::value>,
+              void> >
+    : map_kernel<Fn,T,U,generic_kernel> {
+  typedef map_kernel<Fn,T,U,generic_kernel> generic;
+
+  template <typename R, std::size_t N>
+  static R map(const aggregate<T,N>& a, const aggregate<U,N>& b) {
+    return map<R>(a, b, std::is_same<T,U>());
+  }
+  template <typename R, std::size_t N>
+  static R map(const aggregate<T,N>& a, const aggregate<U,N>& b,
+               std::true_type) {
+    R r;
+    simd_map<Fn,N>(simd_data(r),
+                   simd_stream<T>{simd_data(a)}, simd_stream<T>{simd_data(b)});
+    return r;
+  }
+  template <typename R, std::size_t N>
+  static R map(const aggregate<T,N>& a, const aggregate<U,N>& b,
+               std::false_type) {
+    return generic::template map<R>(a, b);
+  }
+
+  template <typename R, std::size_t N>
+  static R map_right(const aggregate<T,N>& a, const U& b) {
+    R r;
+    simd_map<Fn,N>(simd_data(r),
+                   simd_stream<T>{simd_data(a)}, simd_splat<T>{T(b)});
+    return r;
+  }
+
+  template <typename R, std::size_t N>
+  static R map_left(const T& a, const aggregate<U,N>& b) {
+    return map_left<R>(a, b, std::is_same<T,U>());
+  }
+  template <typename R, std::size_t N>
+  static R map_left(const T& a, const aggregate<U,N>& b, std::true_type) {
+    R r;
+    simd_map<Fn,N>(simd_data(r),
+                   simd_splat<T>{a}, simd_stream<T>{simd_data(b)});
+    return r;
+  }
+  template <typename R, std::size_t N>
+  static R map_left(const T& a, const aggregate<U,N>& b, std::false_type) {
+    return generic::template map_left<R>(a, b);
+  }
+};
+
+template <typename Fn, typename T, typename U>
+struct map_kernel<Fn,T,U,
+    enable_if<std::integral_constant<bool, simd_enabled<Fn,U,T>::value &&
+                                           !std::is_same<T,U>::value &&
+                                           std::is_arithmetic<T>::value &&
+                                           std::is_same<decay_t<
+                                             function_result_t<Fn, T, U> >,
+                                             U>::value>,
+              void> >
+    : map_kernel<Fn,T,U,generic_kernel> {
+  template <typename R, std::size_t N>
+  static R map_left(const T& a, const aggregate<U,N>& b) {
+    R r;
+    simd_map<Fn,N>(simd_data(r),
+                   simd_splat<U>{U(a)}, simd_stream<U>{simd_data(b)});
+    return r;
+  }
+};
+
+template <typename Fn, typename T, typename U>
+struct assign_kernel<Fn,T,U,
+    enable_if<std::integral_constant<bool, simd_enabled<Fn,T,U>::value &&
+                                           std::is_arithmetic<U>::value>,
+              void> >
+    : assign_kernel<Fn,T,U,generic_kernel> {
+  typedef assign_kernel<Fn,T,U,generic_kernel> generic;
+
+  template <std::size_t N>
+  static void apply(aggregate<T,N>& a, const aggregate<U,N>& b) {
+    apply(a, b, std::is_same<T,U>());
+  }
+  template <std::size_t N>
+  static void apply(aggregate<T,N>& a, const aggregate<U,N>& b,
+                    std::true_type) {
+    simd_map<Fn,N>(simd_data(a),
+                   simd_stream<T>{simd_data(a)}, simd_stream<T>{simd_data(b)});
+  }
+  template <std::size_t N>
+  static void apply(aggregate<T,N>& a, const aggregate<U,N>& b,
+                    std::false_type) {
+    generic::apply(a, b);
+  }
+
+  template <std::size_t N>
+  static void apply_right(aggregate<T,N>& a, const U& b) {
+    simd_map<Fn,N>(simd_data(a),
+                   simd_stream<T>{simd_data(a)}, simd_splat<T>{T(b)});
+  }
+};
+
+
+
+
+//! Whether operand A of a fused operation on T elements reads as T lanes
+template <typename T, typename A>
+struct simd_fused_operand
+    : std::integral_constant<bool,
+        std::is_arithmetic<A>::value &&
+        std::is_same<typename std::common_type<T,A>::type, T>::value> {};
+template <typename T, typename U, std::size_t N>
+struct simd_fused_operand<T, aggregate<U,N> > : std::is_same<T,U> {};
+
+template <typename T, typename... A>
+struct simd_fused : std::true_type {};
+template <typename T, typename A, typename... B>
+struct simd_fused<T, A, B...>
+    : std::integral_constant<bool, simd_fused_operand<T,A>::value &&
+                                   simd_fused<T, B...>::value> {};
+
+template <typename T, std::size_t N>
+inline simd_stream<T> simd_operand(const aggregate<T,N>& a) {
+  return {simd_data(a)};
+}
+template <typename T, typename S>
+inline simd_splat<T> simd_operand(const S& s) {
+  return {T(s)};
+}
+
+template <typename Fn, typename T>
+struct fused_kernel<Fn,T, enable_if<simd_enabled<Fn,T,T,T>, void> >
+    : fused_kernel<Fn,T,generic_kernel> {
+  typedef fused_kernel<Fn,T,generic_kernel> generic;
+
+  template <typename R, typename... A>
+  static R map(const A&... a) {
+    return map_simd<R>(simd_fused<T,A...>(), a...);
+  }
+  template <typename R, typename... A>
+  static R map_simd(std::true_type, const A&... a) {
+    R r;
+    simd_map<Fn,std::tuple_size<R>::value>(simd_data(r),
+                                           simd_operand<T>(a)...);
+    return r;
+  }
+  template <typename R, typename... A>
+  static R map_simd(std::false_type, const A&... a) {
+    return generic::template map<R>(a...);
+  }
+
+  template <std::size_t N, typename... A>
+  static void apply(aggregate<T,N>& r, const A&... a) {
+    apply_simd(simd_fused<T,A...>(), r, a...);
+  }
+  template <std::size_t N, typename... A>
+  static void apply_simd(std::true_type, aggregate<T,N>& r, const A&... a) {
+    simd_map<Fn,N>(simd_data(r), simd_operand<T>(a)...);
+  }
+  template <std::size_t N, typename... A>
+  static void apply_simd(std::false_type, aggregate<T,N>& r, const A&... a) {
+    generic::apply(r, a...);
+  }
+};
+
+
+//! Whether registers compare T lanes by Fn; unsigned lanes do not order
+template <typename Fn, typename T>
+struct simd_comparable
+    : std::integral_constant<bool,
+        (std::is_floating_point<T>::value || std::is_signed<T>::value) &&
+        simd_available<simd_compare<Fn>, typename simd_kind<T>::type,
+                       2>::value> {};
+
+/** Comparisons in registers of the aggregate's lanes. Scalar operands are
+ *  converted to the lane type where that does not change the comparison.
+ */
+template <typename Fn, typename T, typename U>
+struct compare_kernel<Fn,T,U,
+    enable_if<std::integral_constant<bool,
+        simd_comparable<Fn,T>::value || simd_comparable<Fn,U>::value>,
+              void> >
+    : compare_kernel<Fn,T,U,generic_kernel> {
+  typedef compare_kernel<Fn,T,U,generic_kernel> generic;
+  typedef simd_compare<Fn> Op;
+
+  template <typename R, std::size_t N>
+  static R map(const aggregate<T,N>& a, const aggregate<U,N>& b) {
+    return map<R>(a, b, std::integral_constant<bool,
+                          simd_comparable<Fn,T>::value &&
+                          std::is_same<T,U>::value>());
+  }
+  template <typename R, std::size_t N>
+  static R map(const aggregate<T,N>& a, const aggregate<U,N>& b,
+               std::true_type) {
+    R r;
+    simd_map_lanes<Op, typename simd_kind<T>::type, N>(
+        simd_data(r), simd_stream<T>{simd_data(a)},
+        simd_stream<T>{simd_data(b)});
+    return r;
+  }
+  template <typename R, std::size_t N>
+  static R map(const aggregate<T,N>& a, const aggregate<U,N>& b,
+               std::false_type) {
+    return generic::template map<R>(a, b);
+  }
+
+  template <typename R, std::size_t N>
+  static R map_right(const aggregate<T,N>& a, const U& b) {
+    return map_right<R>(a, b, std::integral_constant<bool,
+                                simd_comparable<Fn,T>::value &&
+                                simd_fused_operand<T,U>::value>());
+  }
+  template <typename R, std::size_t N>
+  static R map_right(const aggregate<T,N>& a, const U& b, std::true_type) {
+    R r;
+    simd_map_lanes<Op, typename simd_kind<T>::type, N>(
+        simd_data(r), simd_stream<T>{simd_data(a)}, simd_splat<T>{T(b)});
+    return r;
+  }
+  template <typename R, std::size_t N>
+  static R map_right(const aggregate<T,N>& a, const U& b, std::false_type) {
+    return generic::template map_right<R>(a, b);
+  }
+
+  template <typename R, std::size_t N>
+  static R map_left(const T& a, const aggregate<U,N>& b) {
+    return map_left<R>(a, b, std::integral_constant<bool,
+                               simd_comparable<Fn,U>::value &&
+                               simd_fused_operand<U,T>::value>());
+  }
+  template <typename R, std::size_t N>
+  static R map_left(const T& a, const aggregate<U,N>& b, std::true_type) {
+    R r;
+    simd_map_lanes<Op, typename simd_kind<U>::type, N>(
+        simd_data(r), simd_splat<U>{U(a)}, simd_stream<U>{simd_data(b)});
+    return r;
+  }
+  template <typename R, std::size_t N>
+  static R map_left(const T& a, const aggregate<U,N>& b, std::false_type) {
+    return generic::template map_left<R>(a, b);
+  }
+};
+
+/** Selects between T lanes by a mask of bools; masks and operands of other
+ *  types go through the generic kernel.
+ */
+template <typename T>
+struct fused_kernel<fn::select,T,
+    enable_if<simd_available<simd_select, typename simd_kind<T>::type,
+                             3>, void> >
+    : fused_kernel<fn::select,T,generic_kernel> {
+  typedef fused_kernel<fn::select,T,generic_kernel> generic;
+
+  template <typename R, typename M, typename A, typename B>
+  static R map(const M& m, const A& a, const B& b) {
+    return map_simd<R>(std::integral_constant<bool,
+                           std::is_same<M, aggregate<bool,
+                                                     std::tuple_size<R>::value>
+                                       >::value &&
+                           simd_fused<T,A,B>::value>(), m, a, b);
+  }
+  template <typename R, typename M, typename A, typename B>
+  static R map_simd(std::true_type, const M& m, const A& a, const B& b) {
+    R r;
+    simd_map_lanes<simd_select, typename simd_kind<T>::type,
+                   std::tuple_size<R>::value>(
+        simd_data(r), simd_bools{simd_data(m)},
+        simd_operand<T>(a), simd_operand<T>(b));
+    return r;
+  }
+  template <typename R, typename M, typename A, typename B>
+  static R map_simd(std::false_type, const M& m, const A& a, const B& b) {
+    return generic::template map<R>(m, a, b);
+  }
+};
+
+//! Index of the lowest set bit of m, which is not zero
+inline unsigned
+simd_ctz(std::uint32_t m) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long i;
+  _BitScanForward(&i, m);
+  return unsigned(i);
+#else
+  return unsigned(__builtin_ctz(m));
+#endif
+}
+inline unsigned
+simd_ctz(std::uint64_t m) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long i;
+  _BitScanForward64(&i, m);
+  return unsigned(i);
+#else
+  return unsigned(__builtin_ctzll(m));
+#endif
+}
+
+/** Chunks of Bytes bytes compared at once: diff is nonzero where a and b
+ *  differ, and first(diff) the offset of the first byte that does.
+ */
+template <std::size_t Bytes>
+struct simd_chunk;
+
+template <>
+struct simd_chunk<1> {
+  static unsigned diff(const unsigned char* a, const unsigned char* b)
+  { return *a != *b; }
+  static std::size_t first(unsigned) { return 0; }
+};
+template <>
+struct simd_chunk<4> {
+  static std::uint32_t diff(const unsigned char* a, const unsigned char* b) {
+    std::uint32_t x, y;
+    std::memcpy(&x, a, 4);
+    std::memcpy(&y, b, 4);
+    return x ^ y;
+  }
+  static std::size_t first(std::uint32_t m) { return simd_ctz(m) / 8; }
+};
+template <>
+struct simd_chunk<8> {
+  static std::uint64_t diff(const unsigned char* a, const unsigned char* b) {
+    std::uint64_t x, y;
+    std::memcpy(&x, a, 8);
+    std::memcpy(&y, b, 8);
+    return x ^ y;
+  }
+  static std::size_t first(std::uint64_t m) { return simd_ctz(m) / 8; }
+};
+template <>
+struct simd_chunk<16> {
+  static std::uint32_t diff(const unsigned char* a, const unsigned char* b) {
+    __m128i e = _mm_cmpeq_epi8(simd_load_bytes<16>(a),
+                               simd_load_bytes<16>(b));
+    return std::uint32_t(_mm_movemask_epi8(e)) ^ 0xFFFFu;
+  }
+  static std::size_t first(std::uint32_t m) { return simd_ctz(m); }
+};
+#if defined(__AVX2__)
+template <>
+struct simd_chunk<32> {
+  static std::uint32_t diff(const unsigned char* a, const unsigned char* b) {
+    __m256i e = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*) a),
+                                  _mm256_loadu_si256((const __m256i*) b));
+    return ~std::uint32_t(_mm256_movemask_epi8(e));
+  }
+  static std::size_t first(std::uint32_t m) { return simd_ctz(m); }
+};
+#endif
+
+//! Widest chunk of at most B bytes
+template <std::size_t B>
+struct simd_chunk_width
+    : std::integral_constant<std::size_t,
+#if defined(__AVX2__)
+        B >= 32 ? 32 :
+#endif
+        B >= 16 ? 16 : B >= 8 ? 8 : B >= 4 ? 4 : 1> {};
+
+/** Offset of the first of B bytes that differs between a and b, B if none.
+ *  Bytes past the last whole chunk are compared in a chunk ending at B,
+ *  overlapping bytes already found equal.
+ */
+template <std::size_t B>
+inline std::size_t
+simd_mismatch(const void* pa, const void* pb) {
+  const std::size_t W = simd_chunk_width<B>::value;
+  typedef simd_chunk<W> C;
+  const unsigned char* a = static_cast<const unsigned char*>(pa);
+  const unsigned char* b = static_cast<const unsigned char*>(pb);
+  std::size_t i = 0;
+  for (; i + W <= B; i += W)
+    if (auto m = C::diff(a + i, b + i))
+      return i + C::first(m);
+  if (i != B)
+    if (auto m = C::diff(a + B - W, b + B - W))
+      return B - W + C::first(m);
+  return B;
+}
+
+//! Element types whose values are equal exactly when their bytes are
+template <typename T>
+struct simd_bytewise
+    : std::integral_constant<bool,
+        std::is_integral<T>::value || std::is_enum<T>::value> {};
+
+/** Integral aggregates are equal when their bytes are. From 256 bytes on,
+ *  the library memcmp, unrolled over wider registers, is faster.
+ */
+template <typename T>
+struct equal_kernel<T,T, enable_if<simd_bytewise<T>, void> > {
+  template <std::size_t N>
+  static bool apply(const aggregate<T,N>& a, const aggregate<T,N>& b) {
+    const std::size_t B = N * sizeof(T);
+    return B >= 256
+        ? std::memcmp(simd_data(a), simd_data(b), B) == 0
+        : simd_mismatch<B>(simd_data(a), simd_data(b)) == B;
+  }
+};
+
+//! Element types whose order registers compare directly
+template <typename T>
+struct simd_ordered
+    : std::integral_constant<bool,
+        std::is_signed<T>::value && simd_comparable<fn::less,T>::value> {};
+
+/** Other integral aggregates are ordered by the first element that differs,
+ *  that of the first byte that differs.
+ */
+template <typename T>
+struct less_kernel<T,T, enable_if<std::integral_constant<bool,
+    simd_bytewise<T>::value && !simd_ordered<T>::value>, void> > {
+  template <std::size_t N>
+  static bool apply(const aggregate<T,N>& a, const aggregate<T,N>& b) {
+    const std::size_t B = N * sizeof(T);
+    const std::size_t k = simd_mismatch<B>(simd_data(a), simd_data(b));
+    return k != B && a[k / sizeof(T)] < b[k / sizeof(T)];
+  }
+  static bool apply(const aggregate<T,0>&, const aggregate<T,0>&) {
+    return false;
+  }
+};
+
+/** a == b over N lanes of Kind, a register of Bytes bytes at a time, or
+ *  narrower registers for fewer lanes. The lanes past the last whole
+ *  register are compared in a register ending at lane N.
+ */
+template <typename Kind, std::size_t N, std::size_t Bytes = AGG_SIMD_BYTES,
+          typename Enable = void>
+struct simd_equal : simd_equal<Kind,N,Bytes/2> {};
+
+template <typename Kind, std::size_t N>
+struct simd_equal<Kind,N,8> {
+  template <typename T>
+  static bool apply(const T* a, const T* b) {
+    for (std::size_t i = 0; i < N; ++i)
+      if (!(a[i] == b[i]))
+        return false;
+    return true;
+  }
+};
+
+template <typename Kind, std::size_t N, std::size_t Bytes>
+struct simd_equal<Kind,N,Bytes,
+    enable_if<std::integral_constant<bool,
+        simd_supports<simd_compare<fn::equal_to>, simd_reg<Kind,Bytes>,
+                      2>::value &&
+        simd_reg<Kind,Bytes>::lanes <= N>, void> > {
+  typedef simd_reg<Kind,Bytes> S;
+  typedef simd_compare<fn::equal_to> Op;
+  static constexpr unsigned all = (1u << S::lanes) - 1;
+
+  template <typename T>
+  static bool apply(const T* a, const T* b) {
+    std::size_t i = 0;
+    for (; i + S::lanes <= N; i += S::lanes)
+      if (Op::apply<S>(S::load(a + i), S::load(b + i)) != all)
+        return false;
+    return i == N ||
+           Op::apply<S>(S::load(a + N - S::lanes),
+                        S::load(b + N - S::lanes)) == all;
+  }
+};
+
+/** a < b lexicographically over N lanes of Kind, a register of Bytes bytes
+ *  at a time, or narrower registers for fewer lanes. The lowest lane where
+ *  a < b or b < a decides, so lanes holding NaNs are skipped as by
+ *  std::lexicographical_compare.
+ */
+template <typename Kind, std::size_t N, std::size_t Bytes = AGG_SIMD_BYTES,
+          typename Enable = void>
+struct simd_less : simd_less<Kind,N,Bytes/2> {};
+
+template <typename Kind, std::size_t N>
+struct simd_less<Kind,N,8> {
+  template <typename T>
+  static bool apply(const T* a, const T* b) {
+    return std::lexicographical_compare(a, a + N, b, b + N);
+  }
+};
+
+template <typename Kind, std::size_t N, std::size_t Bytes>
+struct simd_less<Kind,N,Bytes,
+    enable_if<std::integral_constant<bool,
+        simd_supports<simd_compare<fn::less>, simd_reg<Kind,Bytes>,
+                      2>::value &&
+        simd_reg<Kind,Bytes>::lanes <= N>, void> > {
+  typedef simd_reg<Kind,Bytes> S;
+  typedef simd_compare<fn::less> Op;
+
+  template <typename T>
+  static bool apply(const T* a, const T* b) {
+    std::size_t i = 0;
+    for (; i + S::lanes <= N; i += S::lanes)
+      if (unsigned d = decide(a + i, b + i))
+        return d == 1;
+    return i != N && decide(a + N - S::lanes, b + N - S::lanes) == 1;
+  }
+
+  //! 0 if all lanes are unordered or equal, else 1 if a < b and 2 if not
+  template <typename T>
+  static unsigned decide(const T* a, const T* b) {
+    typename S::type x = S::load(a), y = S::load(b);
+    unsigned lt = Op::apply<S>(x, y), gt = Op::apply<S>(y, x);
+    unsigned d = lt | gt;
+    return d == 0 ? 0 : (lt & d & (0u - d)) ? 1 : 2;
+  }
+};
+
+//! Signed and floating-point aggregates ordered a register at a time
+template <typename T>
+struct less_kernel<T,T, enable_if<simd_ordered<T>, void> > {
+  template <std::size_t N>
+  static bool apply(const aggregate<T,N>& a, const aggregate<T,N>& b) {
+    return simd_less<typename simd_kind<T>::type, N>::apply(simd_data(a),
+                                                            simd_data(b));
+  }
+};
+
+//! Floating-point aggregates compared a register at a time
+template <typename T>
+struct equal_kernel<T,T, enable_if<std::is_floating_point<T>, void> > {
+  template <std::size_t N>
+  static bool apply(const aggregate<T,N>& a, const aggregate<T,N>& b) {
+    return simd_equal<typename simd_kind<T>::type, N>::apply(simd_data(a),
+                                                             simd_data(b));
+  }
+};
+
+//! Set bools counted sixteen at a time, as bytes of 0 or 1
+template <>
+struct count_kernel<bool> : count_kernel<bool,generic_kernel> {
+  using count_kernel<bool,generic_kernel>::apply;
+
+  template <std::size_t N>
+  static std::size_t apply(const aggregate<bool,N>& a) {
+    const bool* p = simd_data(a);
+    std::size_t n = 0, i = 0;
+    for (; i + 16 <= N; i += 16) {
+      __m128i s = _mm_sad_epu8(simd_load_bytes<16>(p + i),
+                               _mm_setzero_si128());
+      n += unsigned(_mm_cvtsi128_si32(s) + _mm_extract_epi16(s, 4));
+    }
+    for (; i < N; ++i)
+      n += p[i];
+    return n;
+  }
+};
+
+
+//! Register operations used by the reductions
+template <typename S>
+struct simd_add {
+  typename S::type operator()(typename S::type a, typename S::type b) const
+  { return S::add(a, b); }
+};
+
+//! Register i of an array
+template <typename S, typename T>
+struct simd_load_leaf {
+  const T* p;
+  typename S::type operator[](std::size_t i) const
+  { return S::load(p + i * S::lanes); }
+};
+
+//! Product of registers i of two arrays
+template <typename S, typename T>
+struct simd_mul_leaf {
+  const T* a;
+  const T* b;
+  typename S::type operator[](std::size_t i) const
+  { return S::mul(S::load(a + i * S::lanes), S::load(b + i * S::lanes)); }
+};
+
+//! Product of elements i of two arrays
+template <typename T>
+struct array_product_leaf {
+  const T* a;
+  const T* b;
+  T operator[](std::size_t i) const { return a[i] * b[i]; }
+};
+
+/** Reductions over N lanes of Kind with the widest register that fits and
+ *  adds, and multiplies too if Mul. Whole registers are summed as a tree,
+ *  then their lanes, then the remaining elements.
+ */
+template <typename Kind, std::size_t N, bool Mul,
+          std::size_t Bytes = AGG_SIMD_BYTES, typename Enable = void>
+struct simd_fold : simd_fold<Kind,N,Mul,Bytes/2> {};
+
+template <typename Kind, std::size_t N, bool Mul>
+struct simd_fold<Kind,N,Mul,8> : std::false_type {};
+
+template <typename Kind, std::size_t N, bool Mul, std::size_t Bytes>
+struct simd_fold<Kind,N,Mul,Bytes,
+    enable_if<std::integral_constant<bool,
+        simd_supports<simd_op<fn::plus>, simd_reg<Kind,Bytes>, 2>::value &&
+        (!Mul ||
+         simd_supports<simd_op<fn::multiplies>, simd_reg<Kind,Bytes>, 2>::value)
+        && simd_reg<Kind,Bytes>::lanes <= N>, void> >
+    : std::true_type {
+  typedef simd_reg<Kind,Bytes> S;
+  static constexpr std::size_t regs = N / S::lanes;
+  static constexpr std::size_t full = regs * S::lanes;
+
+  template <typename T>
+  static T sum(const T* a) {
+    return finish<T>(tree_reduce<0,regs>::template apply<typename S::type>(
+                         simd_add<S>(), simd_load_leaf<S,T>{a}),
+                     array_leaf<T,T>{a});
+  }
+
+  template <typename T>
+  static T dot(const T* a, const T* b) {
+    return finish<T>(tree_reduce<0,regs>::template apply<typename S::type>(
+                         simd_add<S>(), simd_mul_leaf<S,T>{a, b}),
+                     array_product_leaf<T>{a, b});
+  }
+
+ private:
+  template <typename T, typename Leaf>
+  static T finish(typename S::type r, const Leaf& rest) {
+    T lane[S::lanes];
+    S::store(lane, r);
+    T s = tree_reduce<0,S::lanes>::template apply<T>(fn::plus(),
+                                                     array_leaf<T,T>{lane});
+    return tail(s, rest, std::integral_constant<bool, (full < N)>());
+  }
+
+  //! Add the elements [full,N) that do not fill a register
+  template <typename T, typename Leaf>
+  static T tail(T s, const Leaf& rest, std::true_type) {
+    return s + tree_reduce<full, N - full>::template apply<T>(fn::plus(),
+                                                              rest);
+  }
+  template <typename T, typename Leaf>
+  static T tail(T s, const Leaf&, std::false_type) {
+    return s;
+  }
+};
+
+template <typename T>
+struct sum_kernel<T,
+    enable_if<std::integral_constant<bool,
+        !std::is_void<typename simd_kind<T>::type>::value>, void> >
+    : sum_kernel<T,generic_kernel> {
+  typedef sum_kernel<T,generic_kernel> generic;
+  typedef typename simd_kind<T>::type Kind;
+
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a) {
+    return apply<R>(a, simd_fold<Kind,N,false>());
+  }
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a, std::true_type) {
+    return static_cast<R>(simd_fold<Kind,N,false>::sum(simd_data(a)));
+  }
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a, std::false_type) {
+    return generic::template apply<R>(a);
+  }
+};
+
+template <typename T>
+struct dot_kernel<T,T,
+    enable_if<std::integral_constant<bool,
+        !std::is_void<typename simd_kind<T>::type>::value>, void> >
+    : dot_kernel<T,T,generic_kernel> {
+  typedef dot_kernel<T,T,generic_kernel> generic;
+  typedef typename simd_kind<T>::type Kind;
+
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a, const aggregate<T,N>& b) {
+    return apply<R>(a, b, simd_fold<Kind,N,true>());
+  }
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a, const aggregate<T,N>& b,
+                 std::true_type) {
+    return static_cast<R>(simd_fold<Kind,N,true>::dot(simd_data(a),
+                                                       simd_data(b)));
+  }
+  template <typename R, std::size_t N>
+  static R apply(const aggregate<T,N>& a, const aggregate<T,N>& b,
+                 std::false_type) {
+    return generic::template apply<R>(a, b);
+  }
+};
+
+} // end namespace detail
+} // end namespace agg
+
+#endif // AGG_NO_SIMD
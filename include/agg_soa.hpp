@@ -0,0 +1,669 @@
+#pragma once
+
+#include <tuple>
+#include <vector>
+
+#include "aggregate.hpp"
+
+/** Structure-of-arrays storage for aggregates.
+ *
+ *  agg::soa_vector<T,N> holds a sequence of aggregate<T,N> as N contiguous
+ *  arrays of T, one per component. Elements are accessed through
+ *  agg::soa_reference proxies, which convert to and assign from
+ *  aggregate<T,N> and forward the aggregate operators:
+ *
+ *    agg::soa_vector<float,3> pos(n), vel(n);
+ *    pos[i] = vel[i] * 2.f + pos[j];
+ *
+ *  Operators on whole soa_vectors build an agg::soa_expression instead of a
+ *  temporary container. Assigning or compound-assigning it to a soa_vector
+ *  runs one streaming loop per component, which the compiler vectorizes:
+ *
+ *    pos += vel * dt;
+ *
+ *  The operands of a container expression are soa_vectors of equal size,
+ *  scalars broadcast to every element and aggregate<U,N> (or element
+ *  proxies) broadcast component-wise. Expressions hold soa_vectors by
+ *  reference; evaluate them before those go out of scope.
+ */
+
+namespace agg {
+
+template <typename T, std::size_t N>
+class soa_vector;
+
+template <typename T, std::size_t N>
+class soa_reference;
+
+template <typename Fn, typename... Args>
+struct soa_expression;
+
+template <typename Fn, typename... Args>
+struct expression;
+
+namespace detail {
+
+template <typename X>
+struct is_soa_reference : std::false_type {};
+template <typename T, std::size_t N>
+struct is_soa_reference<soa_reference<T,N> > : std::true_type {};
+
+//! Whether X is a soa_vector or soa_expression
+template <typename X>
+struct is_soa_container : std::false_type {};
+template <typename T, std::size_t N>
+struct is_soa_container<soa_vector<T,N> > : std::true_type {};
+template <typename Fn, typename... Args>
+struct is_soa_container<soa_expression<Fn,Args...> > : std::true_type {};
+
+//! The value of an element proxy, other operands unchanged
+template <typename X>
+inline const X&
+soa_value(const X& x) {
+  return x;
+}
+template <typename T, std::size_t N>
+inline aggregate<typename std::remove_const<T>::type,N>
+soa_value(const soa_reference<T,N>& r) {
+  return r.value();
+}
+
+//! Result of an aggregate operator, with expression nodes evaluated
+template <typename X>
+struct soa_result {
+  typedef X type;
+};
+template <typename Fn, typename... Args>
+struct soa_result<expression<Fn,Args...> > {
+  typedef typename expression<Fn,Args...>::result_type type;
+};
+template <typename X>
+using soa_result_t = typename soa_result<X>::type;
+
+
+//! Column of a soa_vector component
+template <typename T>
+struct soa_column {
+  const T* p;
+  const T& operator[](std::size_t i) const { return p[i]; }
+};
+
+//! Column repeating a single value
+template <typename S>
+struct soa_splat {
+  const S& s;
+  const S& operator[](std::size_t) const { return s; }
+};
+
+//! Column computing fn(c[i]...) from the columns of the operands
+template <typename Fn, typename... C>
+struct soa_column_expr {
+  const Fn& fn;
+  std::tuple<C...> c;
+
+  template <std::size_t... J>
+  auto at(std::size_t i, index_sequence<J...>) const
+      -> decltype(fn(std::get<J>(c)[i]...)) {
+    return fn(std::get<J>(c)[i]...);
+  }
+
+  auto operator[](std::size_t i) const
+      -> decltype(this->at(i, make_index_sequence<sizeof...(C)>())) {
+    return at(i, make_index_sequence<sizeof...(C)>());
+  }
+};
+
+
+//! Leaf referring to a soa_vector operand
+template <typename T, std::size_t N>
+struct soa_leaf {
+  typedef T value_type;
+  static constexpr std::size_t static_size = N;
+
+  const soa_vector<T,N>& v;
+
+  std::size_t size() const { return v.size(); }
+  soa_column<T> column(std::size_t k) const { return {v.data(k)}; }
+};
+
+//! Leaf broadcasting a scalar operand to every element and component
+template <typename S>
+struct soa_broadcast {
+  typedef S value_type;
+  static constexpr std::size_t static_size = 0;
+
+  S s;
+
+  std::size_t size() const { return 0; }
+  soa_splat<S> column(std::size_t) const { return {s}; }
+};
+
+//! Leaf broadcasting component k of an aggregate to column k
+template <typename U, std::size_t N>
+struct soa_broadcast<aggregate<U,N> > {
+  typedef U value_type;
+  static constexpr std::size_t static_size = N;
+
+  aggregate<U,N> s;
+
+  std::size_t size() const { return 0; }
+  soa_splat<U> column(std::size_t k) const { return {s[k]}; }
+};
+
+//! The expression node of an operand
+template <typename X>
+struct soa_node {
+  typedef soa_broadcast<decay_t<decltype(soa_value(std::declval<X>()))> > type;
+  static type make(const X& x) { return {soa_value(x)}; }
+};
+template <typename T, std::size_t N>
+struct soa_node<soa_vector<T,N> > {
+  typedef soa_leaf<T,N> type;
+  static type make(const soa_vector<T,N>& v) { return {v}; }
+};
+template <typename Fn, typename... Args>
+struct soa_node<soa_expression<Fn,Args...> > {
+  typedef soa_expression<Fn,Args...> type;
+  static const type& make(const type& e) { return e; }
+};
+template <typename X>
+using soa_node_t = typename soa_node<X>::type;
+
+//! Element type of an operand
+template <typename X>
+using soa_value_t = typename soa_node_t<X>::value_type;
+
+//! Common static size of the nodes, zero if all are broadcast scalars
+template <typename... X>
+struct soa_common_size
+    : std::integral_constant<std::size_t, 0> {};
+template <typename X, typename... Xs>
+struct soa_common_size<X,Xs...>
+    : std::integral_constant<std::size_t,
+        X::static_size ? X::static_size : soa_common_size<Xs...>::value> {};
+
+//! Whether the nodes' static sizes agree
+template <typename... X>
+struct soa_size_match : std::true_type {};
+template <typename X, typename... Xs>
+struct soa_size_match<X,Xs...>
+    : std::integral_constant<bool,
+        (X::static_size == 0 ||
+         X::static_size == soa_common_size<X,Xs...>::value) &&
+        soa_size_match<Xs...>::value> {};
+
+//! Common run-time size of two operands, zero for broadcast scalars
+inline std::size_t
+soa_common(std::size_t a, std::size_t b) {
+  assert(a == 0 || b == 0 || a == b);
+  return a ? a : b;
+}
+
+template <typename Fn, typename... Args>
+soa_expression<Fn,Args...>
+make_soa_expr(const Args&... args) {
+  std::size_t n = 0;
+  auto l = { (n = soa_common(n, args.size()))... };
+  (void) l;
+  return {Fn(), std::tuple<Args...>(args...), n};
+}
+
+//! Evaluate a node into a soa_vector, a[i] op= e[i] for each component
+template <typename Fn, typename T, std::size_t N, typename E>
+void soa_assign(Fn f, soa_vector<T,N>& a, const E& e) {
+  static_assert(E::static_size == 0 || E::static_size == N,
+                "mismatched number of components");
+  assert(e.size() == 0 || e.size() == a.size());
+  const std::size_t n = a.size();
+  for (std::size_t k = 0; k < N; ++k) {
+    T* o = a.data(k);
+    auto c = e.column(k);
+    for (std::size_t i = 0; i < n; ++i)
+      f(o[i], c[i]);
+  }
+}
+
+//! Whether an operator on A and B is a proxy operator
+template <typename A, typename B>
+struct soa_reference_operands
+    : std::integral_constant<bool,
+        (is_soa_reference<A>::value || is_soa_reference<B>::value) &&
+        !is_soa_container<A>::value && !is_soa_container<B>::value> {};
+
+//! Whether an operator on A and B builds a container expression
+template <typename A, typename B>
+struct soa_container_operands
+    : std::integral_constant<bool,
+        is_soa_container<A>::value || is_soa_container<B>::value> {};
+
+} // end namespace detail
+
+
+//! Containers and proxies are not broadcast by the aggregate operators
+template <typename T, std::size_t N>
+struct is_scalar_operand<soa_vector<T,N> > : std::false_type {};
+template <typename T, std::size_t N>
+struct is_scalar_operand<soa_reference<T,N> > : std::false_type {};
+template <typename Fn, typename... Args>
+struct is_scalar_operand<soa_expression<Fn,Args...> > : std::false_type {};
+
+
+/** @brief Proxy for element i of a soa_vector, behaving like an
+ *         aggregate<T,N>&.
+ *
+ *  Copying a proxy copies the reference; assigning to it writes through.
+ *
+ *  @tparam T  Type of component, const-qualified for read-only proxies.
+ *  @tparam N  Number of components.
+ */
+template <typename T, std::size_t N>
+class soa_reference {
+ public:
+  typedef  aggregate<typename std::remove_const<T>::type,N>  value_type;
+  typedef  T&                                               reference;
+  typedef  std::size_t                                      size_type;
+
+  explicit soa_reference(const aggregate<T*,N>& p) noexcept
+      : _p(p) {}
+
+  soa_reference(const soa_reference&) = default;
+
+  //! Read-only proxies convert from writable ones
+  template <typename U,
+            typename = enable_if<std::is_same<const U,T>, void> >
+  soa_reference(const soa_reference<U,N>& r) noexcept
+      : _p(r._p) {}
+
+  const soa_reference&
+  operator=(const value_type& v) const {
+    for (size_type k = 0; k < N; ++k)
+      *_p[k] = v[k];
+    return *this;
+  }
+
+  soa_reference&
+  operator=(const soa_reference& r) {
+    *this = r.value();
+    return *this;
+  }
+
+  //! Gather the components into an aggregate
+  value_type
+  value() const {
+    value_type v;
+    for (size_type k = 0; k < N; ++k)
+      v[k] = *_p[k];
+    return v;
+  }
+
+  operator value_type() const {
+    return value();
+  }
+
+  reference
+  operator[](size_type k) const {
+    return *_p[k];
+  }
+
+  constexpr size_type
+  size() const noexcept
+  { return N; }
+
+ private:
+  template <typename U, std::size_t M>
+  friend class soa_reference;
+
+  // Pointers to component i of each array
+  aggregate<T*,N>                                           _p;
+};
+
+
+/** @brief A sequence of aggregate<T,N> stored as N arrays of T.
+ *
+ *  @tparam  T  Type of component.
+ *  @tparam  N  Number of components.
+ */
+template <typename T, std::size_t N>
+class soa_vector {
+  static_assert(N > 0, "soa_vector requires at least one component");
+
+ public:
+  typedef  aggregate<T,N>                           value_type;
+  typedef  soa_reference<T,N>                       reference;
+  typedef  soa_reference<const T,N>                 const_reference;
+  typedef  std::size_t                              size_type;
+
+  soa_vector() = default;
+
+  explicit soa_vector(size_type n, const value_type& v = value_type{}) {
+    resize(n, v);
+  }
+
+  //! Evaluate a container expression
+  template <typename Fn, typename... Args>
+  soa_vector(const soa_expression<Fn,Args...>& e) {
+    *this = e;
+  }
+
+  template <typename Fn, typename... Args>
+  soa_vector&
+  operator=(const soa_expression<Fn,Args...>& e) {
+    resize(e.size());
+    detail::soa_assign(fn::assign(), *this, e);
+    return *this;
+  }
+
+  void
+  fill(const value_type& v) {
+    for (size_type k = 0; k < N; ++k)
+      std::fill(_comp[k].begin(), _comp[k].end(), v[k]);
+  }
+
+  // Capacity.
+  size_type
+  size() const noexcept
+  { return _comp[0].size(); }
+
+  bool
+  empty() const noexcept
+  { return size() == 0; }
+
+  size_type
+  capacity() const noexcept
+  { return _comp[0].capacity(); }
+
+  void
+  reserve(size_type n) {
+    for (size_type k = 0; k < N; ++k)
+      _comp[k].reserve(n);
+  }
+
+  void
+  resize(size_type n) {
+    for (size_type k = 0; k < N; ++k)
+      _comp[k].resize(n);
+  }
+
+  void
+  resize(size_type n, const value_type& v) {
+    for (size_type k = 0; k < N; ++k)
+      _comp[k].resize(n, v[k]);
+  }
+
+  // Modifiers.
+  void
+  push_back(const value_type& v) {
+    for (size_type k = 0; k < N; ++k)
+      _comp[k].push_back(v[k]);
+  }
+
+  void
+  pop_back() {
+    for (size_type k = 0; k < N; ++k)
+      _comp[k].pop_back();
+  }
+
+  void
+  clear() noexcept {
+    for (size_type k = 0; k < N; ++k)
+      _comp[k].clear();
+  }
+
+  void
+  swap(soa_vector& other) noexcept {
+    _comp.swap(other._comp);
+  }
+
+  // Element access.
+  reference
+  operator[](size_type i) {
+    aggregate<T*,N> p;
+    for (size_type k = 0; k < N; ++k)
+      p[k] = _comp[k].data() + i;
+    return reference(p);
+  }
+
+  const_reference
+  operator[](size_type i) const {
+    aggregate<const T*,N> p;
+    for (size_type k = 0; k < N; ++k)
+      p[k] = _comp[k].data() + i;
+    return const_reference(p);
+  }
+
+  reference
+  front()
+  { return (*this)[0]; }
+
+  const_reference
+  front() const
+  { return (*this)[0]; }
+
+  reference
+  back()
+  { return (*this)[size() - 1]; }
+
+  const_reference
+  back() const
+  { return (*this)[size() - 1]; }
+
+  //! Contiguous array of component k
+  T*
+  data(size_type k) noexcept
+  { return _comp[k].data(); }
+
+  const T*
+  data(size_type k) const noexcept
+  { return _comp[k].data(); }
+
+ private:
+  aggregate<std::vector<T>,N>                      _comp;
+};
+
+
+/** @brief A lazily evaluated element-wise operation on soa_vectors.
+ *
+ *  @tparam Fn    The fn:: functor applied to each component of each element.
+ *  @tparam Args  The operand nodes: detail::soa_leaf, detail::soa_broadcast
+ *                or nested expressions.
+ */
+template <typename Fn, typename... Args>
+struct soa_expression {
+  typedef decay_t<function_result_t<const Fn&,
+                                    typename Args::value_type...> >
+                                                        value_type;
+  typedef std::size_t                                   size_type;
+
+  static constexpr size_type static_size =
+      detail::soa_common_size<Args...>::value;
+
+  Fn                                                    _fn;
+  std::tuple<Args...>                                   _args;
+  size_type                                             _size;
+
+  //! Number of elements, zero if every operand is broadcast
+  size_type
+  size() const noexcept
+  { return _size; }
+
+  //! Column of component k
+  auto
+  column(size_type k) const
+      -> detail::soa_column_expr<Fn,
+             decltype(std::declval<const Args&>().column(k))...> {
+    return _column(k, detail::make_index_sequence<sizeof...(Args)>());
+  }
+
+ private:
+  template <std::size_t... J>
+  detail::soa_column_expr<Fn,
+      decltype(std::declval<const Args&>().column(0))...>
+  _column(size_type k, detail::index_sequence<J...>) const {
+    return {_fn, std::make_tuple(std::get<J>(_args).column(k)...)};
+  }
+};
+
+
+//! Write to an output stream
+template <typename CharT, typename Traits, typename T, std::size_t N>
+inline std::basic_ostream<CharT,Traits>&
+operator<<(std::basic_ostream<CharT,Traits>& s, const soa_reference<T,N>& r) {
+  return s << r.value();
+}
+
+
+#define AGG_SOA_UN_OP(NAME,OP)                                                \
+  template <typename T, std::size_t N>                                        \
+  inline auto                                                                 \
+  operator OP(const soa_reference<T,N>& a)                                    \
+      -> detail::soa_result_t<decltype(OP a.value())> {                       \
+    return OP a.value();                                                      \
+  }                                                                           \
+  template <typename X,                                                        \
+            typename = enable_if<detail::is_soa_container<X>, void> >         \
+  inline                                                                      \
+  enable_if<                                                                  \
+    has_##NAME<const detail::soa_value_t<X>&>,                                \
+    soa_expression<fn::NAME, detail::soa_node_t<X> > >                        \
+  operator OP(const X& a) {                                                   \
+    return detail::make_soa_expr<fn::NAME>(detail::soa_node<X>::make(a));     \
+  }
+
+AGG_SOA_UN_OP(unary_plus,       +)
+AGG_SOA_UN_OP(unary_minus,      -)
+AGG_SOA_UN_OP(bit_not,          ~)
+AGG_SOA_UN_OP(logical_not,      !)
+#undef AGG_SOA_UN_OP
+
+
+#define AGG_SOA_BIN_OP_ASSIGN(NAME,OP)                                        \
+  template <typename T, std::size_t N, typename U>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    has_##NAME<aggregate<T,N>&,                                               \
+               decltype(detail::soa_value(std::declval<const U&>()))>,        \
+    soa_reference<T,N> >                                                      \
+  operator OP(const soa_reference<T,N>& a, const U& b) {                      \
+    aggregate<T,N> v = a.value();                                             \
+    v OP detail::soa_value(b);                                                \
+    a = v;                                                                    \
+    return a;                                                                 \
+  }                                                                           \
+  template <typename T, typename U, std::size_t N>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    has_##NAME<aggregate<T,N>&,const aggregate<U,N>&>,                        \
+    aggregate<T,N>&>                                                          \
+  operator OP(aggregate<T,N>& a, const soa_reference<U,N>& b) {               \
+    return a OP b.value();                                                    \
+  }                                                                           \
+  template <typename T, std::size_t N, typename U>                            \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<T&,const detail::soa_value_t<U>&>::value &&                  \
+      detail::soa_size_match<detail::soa_leaf<T,N>,                           \
+                             detail::soa_node_t<U> >::value>,                 \
+    soa_vector<T,N>&>                                                         \
+  operator OP(soa_vector<T,N>& a, const U& b) {                               \
+    detail::soa_assign(fn::NAME(), a, detail::soa_node<U>::make(b));          \
+    return a;                                                                 \
+  }
+
+AGG_SOA_BIN_OP_ASSIGN(plus_assign,         +=)
+AGG_SOA_BIN_OP_ASSIGN(minus_assign,        -=)
+AGG_SOA_BIN_OP_ASSIGN(multiplies_assign,   *=)
+AGG_SOA_BIN_OP_ASSIGN(divides_assign,      /=)
+AGG_SOA_BIN_OP_ASSIGN(modulus_assign,      %=)
+AGG_SOA_BIN_OP_ASSIGN(bit_and_assign,      &=)
+AGG_SOA_BIN_OP_ASSIGN(bit_or_assign,       |=)
+AGG_SOA_BIN_OP_ASSIGN(bit_xor_assign,      ^=)
+AGG_SOA_BIN_OP_ASSIGN(left_shift_assign,  <<=)
+AGG_SOA_BIN_OP_ASSIGN(right_shift_assign, >>=)
+#undef AGG_SOA_BIN_OP_ASSIGN
+
+
+// Proxy operators evaluate on the gathered aggregates. Container operators
+// build soa_expression nodes; the comma operator is left alone.
+#define AGG_SOA_BIN_OP(NAME,OP)                                               \
+  template <typename A, typename B,                                           \
+            typename = enable_if<detail::soa_reference_operands<A,B>, void> > \
+  inline auto                                                                 \
+  operator OP(const A& a, const B& b)                                         \
+      -> detail::soa_result_t<decltype(detail::soa_value(a) OP                \
+                                       detail::soa_value(b))> {               \
+    return detail::soa_value(a) OP detail::soa_value(b);                      \
+  }                                                                           \
+  template <typename A, typename B,                                           \
+            typename = enable_if<detail::soa_container_operands<A,B>, void> > \
+  inline                                                                      \
+  enable_if<                                                                  \
+    std::integral_constant<bool,                                              \
+      has_##NAME<const detail::soa_value_t<A>&,                               \
+                 const detail::soa_value_t<B>&>::value &&                     \
+      detail::soa_size_match<detail::soa_node_t<A>,                           \
+                             detail::soa_node_t<B> >::value>,                 \
+    soa_expression<fn::NAME, detail::soa_node_t<A>, detail::soa_node_t<B> > > \
+  operator OP(const A& a, const B& b) {                                       \
+    return detail::make_soa_expr<fn::NAME>(detail::soa_node<A>::make(a),      \
+                                           detail::soa_node<B>::make(b));     \
+  }
+
+AGG_SOA_BIN_OP(plus,                 +)
+AGG_SOA_BIN_OP(minus,                -)
+AGG_SOA_BIN_OP(multiplies,           *)
+AGG_SOA_BIN_OP(divides,              /)
+AGG_SOA_BIN_OP(modulus,              %)
+AGG_SOA_BIN_OP(bit_and,              &)
+AGG_SOA_BIN_OP(bit_or,               |)
+AGG_SOA_BIN_OP(bit_xor,              ^)
+AGG_SOA_BIN_OP(left_shift,          <<)
+AGG_SOA_BIN_OP(right_shift,         >>)
+AGG_SOA_BIN_OP(logical_and,         &&)
+AGG_SOA_BIN_OP(logical_or,          ||)
+#undef AGG_SOA_BIN_OP
+
+#define AGG_SOA_CMP_OP(OP)                                                    \
+  template <typename A, typename B,                                           \
+            typename = enable_if<detail::soa_reference_operands<A,B>, void> > \
+  inline auto                                                                 \
+  operator OP(const A& a, const B& b)                                         \
+      -> decltype(detail::soa_value(a) OP detail::soa_value(b)) {             \
+    return detail::soa_value(a) OP detail::soa_value(b);                      \
+  }
+
+AGG_SOA_CMP_OP(==)
+AGG_SOA_CMP_OP(!=)
+AGG_SOA_CMP_OP(<)
+AGG_SOA_CMP_OP(>)
+AGG_SOA_CMP_OP(<=)
+AGG_SOA_CMP_OP(>=)
+#undef AGG_SOA_CMP_OP
+
+} // end namespace agg
+
+
+//! Specialize std:: for agg::soa_reference
+namespace std {
+
+//! Specialization of std::get
+template <std::size_t I, typename T, std::size_t N>
+inline T&
+get(const agg::soa_reference<T,N>& r) noexcept {
+  static_assert(I < N, "index is out of bounds");
+  return r[I];
+}
+
+//! Specialization of std::tuple_size
+template <typename T, std::size_t N>
+struct tuple_size<agg::soa_reference<T,N> >
+    : public integral_constant<std::size_t, N> {};
+
+//! Specialization of std::tuple_element
+template <std::size_t I, typename T, std::size_t N>
+struct tuple_element<I, agg::soa_reference<T,N> > {
+  static_assert(I < N, "index is out of bounds");
+  typedef T type;
+};
+
+} // namespace std
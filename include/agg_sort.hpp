@@ -0,0 +1,399 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_parallel.hpp"
+
+/** Sorting of ranges of aggregates.
+ *
+ *  agg::sort and agg::stable_sort order a random-access range of aggregates
+ *  as std::sort and std::stable_sort do, lexicographically by operator<:
+ *
+ *    std::vector<aggregate<std::uint32_t,3> > cells = ...;
+ *    agg::sort(cells.begin(), cells.end());
+ *    cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+ *
+ *  Aggregates of integers and of IEEE float and double are radix sorted on
+ *  the bytes of their elements. Signed integers have their sign bit
+ *  flipped. Floats have every bit flipped when negative and only the sign
+ *  bit otherwise, and -0 sorts as +0, so the order is that of operator<;
+ *  NaNs, which operator< does not order, go before -inf or after +inf by
+ *  their sign. Ranges too long to fit in cache are split into 256 buckets
+ *  by the 8 most significant bits in which their aggregates differ, and
+ *  each bucket, once short enough, by stable LSD passes over the bytes: the
+ *  last element first and each element from its least significant byte,
+ *  skipping the bytes that are the same throughout, so small coordinates
+ *  cost only the bytes they use. The radix sort is stable, so agg::sort is
+ *  too for these aggregates. It needs a buffer as large as the range.
+ *
+ *  Ranges of AGG_SORT_PARALLEL_MIN aggregates or more are radix sorted by
+ *  the threads of a thread_pool, the default_pool() unless one is given:
+ *  each thread splits its own partition of the range into the buckets and
+ *  then the threads sort the buckets. Ranges shorter than
+ *  AGG_SORT_RADIX_MIN, aggregates of more than AGG_SORT_RADIX_BYTES bytes
+ *  of elements and all other aggregates are sorted by std::sort and
+ *  std::stable_sort.
+ *
+ *  Link with -pthread.
+ */
+
+#if !defined(AGG_SORT_RADIX_MIN)
+#define AGG_SORT_RADIX_MIN 2048
+#endif
+
+#if !defined(AGG_SORT_RADIX_BYTES)
+#define AGG_SORT_RADIX_BYTES 32
+#endif
+
+#if !defined(AGG_SORT_LSD_MAX)
+#define AGG_SORT_LSD_MAX (1 << 16)
+#endif
+
+#if !defined(AGG_SORT_PARALLEL_MIN)
+#define AGG_SORT_PARALLEL_MIN (std::size_t(1) << 20)
+#endif
+
+namespace agg {
+
+namespace detail {
+
+//! The unsigned integer of Size bytes
+template <std::size_t Size>
+struct sort_word;
+template <>
+struct sort_word<1> { typedef std::uint8_t type; };
+template <>
+struct sort_word<2> { typedef std::uint16_t type; };
+template <>
+struct sort_word<4> { typedef std::uint32_t type; };
+template <>
+struct sort_word<8> { typedef std::uint64_t type; };
+
+/** The radix key of T: an unsigned word whose order is the order of T, or
+ *  radix false when T has none.
+ */
+template <typename T, typename Enable = void>
+struct sort_key {
+  static constexpr bool radix = false;
+};
+
+template <typename T>
+struct sort_key<T, enable_if<
+    std::integral_constant<bool, std::is_integral<T>::value &&
+                                 (sizeof(T) == 1 || sizeof(T) == 2 ||
+                                  sizeof(T) == 4 || sizeof(T) == 8)>,
+    void> > {
+  static constexpr bool radix = true;
+  typedef typename sort_word<sizeof(T)>::type word;
+
+  static word
+  get(T x) {
+    const word sign = std::is_signed<T>::value
+        ? word(word(1) << (8 * sizeof(T) - 1)) : word(0);
+    return word(word(x) ^ sign);
+  }
+};
+
+template <typename T>
+struct sort_key<T, enable_if<
+    std::integral_constant<bool, std::is_floating_point<T>::value &&
+                                 std::numeric_limits<T>::is_iec559 &&
+                                 (sizeof(T) == 4 || sizeof(T) == 8)>,
+    void> > {
+  static constexpr bool radix = true;
+  typedef typename sort_word<sizeof(T)>::type word;
+
+  static word
+  get(T x) {
+    x = canonical_zero(x);
+    word w;
+    std::memcpy(&w, &x, sizeof(w));
+    const word sign = word(1) << (8 * sizeof(T) - 1);
+    return (w & sign) ? word(~w) : word(w | sign);
+  }
+};
+
+//! Whether ranges of V are radix sorted
+template <typename V>
+struct sort_radix : std::false_type {};
+template <typename T, std::size_t N>
+struct sort_radix<aggregate<T,N> >
+    : std::integral_constant<bool, sort_key<T>::radix && N != 0 &&
+                                   N * sizeof(T) <= AGG_SORT_RADIX_BYTES> {};
+
+
+/** The byte of the radix keys of aggregate<T,N> at bit shift of element c,
+ *  a digit of the radix sort.
+ */
+template <typename T, std::size_t N>
+struct sort_digit {
+  std::size_t c, shift;
+
+  sort_digit(std::size_t c, std::size_t shift) : c(c), shift(shift) {}
+
+  //! Byte p, counting from the least significant byte of the last element
+  explicit sort_digit(std::size_t p)
+      : c(N - 1 - p / sizeof(T)), shift(8 * (p % sizeof(T))) {}
+
+  unsigned
+  operator()(const aggregate<T,N>& a) const {
+    return unsigned(sort_key<T>::get(a[c]) >> shift) & 0xff;
+  }
+};
+
+//! Call fn(t) for every t in [0,count), on the threads of pool if not null
+template <typename Fn>
+inline void
+sort_parts(thread_pool* pool, std::size_t count, Fn fn) {
+  if (pool)
+    pool->parallel_for(count, fn);
+  else
+    for (std::size_t t = 0; t < count; ++t)
+      fn(t);
+}
+
+/** Find the element c and the bit of the most significant bit in which the
+ *  keys of [first, first+n) differ; false if they are all equal.
+ */
+template <typename T, std::size_t N, typename It>
+inline bool
+sort_top(It first, std::size_t n, std::size_t& c, std::size_t& bit) {
+  typedef typename sort_key<T>::word word;
+  if (n == 0)
+    return false;
+  word all[N], any[N];
+  for (std::size_t j = 0; j < N; ++j)
+    all[j] = any[j] = sort_key<T>::get(first[0][j]);
+  for (std::size_t i = 1; i < n; ++i) {
+    const aggregate<T,N>& a = first[i];
+    for (std::size_t j = 0; j < N; ++j) {
+      word k = sort_key<T>::get(a[j]);
+      all[j] &= k;
+      any[j] |= k;
+    }
+  }
+  for (c = 0; c < N; ++c) {
+    word d = word(all[c] ^ any[c]);
+    if (d) {
+      for (bit = 0; d >>= 1; ++bit) {}
+      return true;
+    }
+  }
+  return false;
+}
+
+//! count[p*256 + d] = the aggregates of [first, first+n) with byte p of d
+template <typename T, std::size_t N, typename It>
+inline void
+sort_count(It first, std::size_t n, std::size_t* count) {
+  typedef typename sort_key<T>::word word;
+  std::fill(count, count + (N * sizeof(T) << 8), std::size_t(0));
+  for (std::size_t i = 0; i < n; ++i) {
+    const aggregate<T,N>& a = first[i];
+    for (std::size_t c = 0; c < N; ++c) {
+      word k = sort_key<T>::get(a[N - 1 - c]);
+      for (std::size_t b = 0; b < sizeof(T); ++b, k = word(k >> 8))
+        ++count[((c * sizeof(T) + b) << 8) + (k & 0xff)];
+    }
+  }
+}
+
+//! Move [src, src+n) to dst by digit, from the next slot of each byte in off
+template <typename T, std::size_t N, typename Src, typename Dst>
+inline void
+sort_scatter(Src src, std::size_t n, Dst dst, sort_digit<T,N> digit,
+             std::size_t* off) {
+  for (std::size_t i = 0; i < n; ++i) {
+    const aggregate<T,N>& a = src[i];
+    dst[off[digit(a)]++] = a;
+  }
+}
+
+//! Turn the counts of each byte into the slot of its first aggregate
+inline void
+sort_offsets(std::size_t* count) {
+  std::size_t sum = 0;
+  for (std::size_t d = 0; d < 256; ++d) {
+    std::size_t c = count[d];
+    count[d] = sum;
+    sum += c;
+  }
+}
+
+/** LSD radix sort of the n aggregates at a by their bytes p < passes,
+ *  moving them between a and the n at b; whether they end at b.
+ *
+ *  A pass in which every aggregate has the same byte is skipped.
+ */
+template <typename T, std::size_t N, typename A, typename B>
+inline bool
+sort_lsd(A a, B b, std::size_t n, std::size_t passes) {
+  std::vector<std::size_t> count(N * sizeof(T) << 8);
+  sort_count<T,N>(a, n, count.data());
+
+  bool in_b = false;
+  for (std::size_t p = 0; p < passes; ++p) {
+    // a always holds the aggregates in some order
+    const sort_digit<T,N> digit(p);
+    std::size_t* off = count.data() + (p << 8);
+    if (off[digit(a[0])] == n)
+      continue;
+    sort_offsets(off);
+    if (in_b)
+      sort_scatter<T,N>(b, n, a, digit, off);
+    else
+      sort_scatter<T,N>(a, n, b, digit, off);
+    in_b = !in_b;
+  }
+  return in_b;
+}
+
+//! off[d] += the aggregates of [src, src+n) of digit d
+template <typename T, std::size_t N, typename Src>
+inline void
+sort_histogram(Src src, std::size_t n, sort_digit<T,N> digit,
+               std::size_t* off) {
+  for (std::size_t i = 0; i < n; ++i)
+    ++off[digit(src[i])];
+}
+
+/** Radix sort the n aggregates at buf if in_buf, and at first otherwise,
+ *  into [first, first+n), using the other as the buffer.
+ *
+ *  Up to AGG_SORT_LSD_MAX aggregates, which fit in cache, are sorted by
+ *  LSD passes over the bytes in which they differ. More are first split
+ *  into 256 buckets by the 8 most significant bits in which they differ,
+ *  and each bucket is sorted the same way. With a pool, its threads each
+ *  count and scatter a partition of the range and then sort buckets.
+ */
+template <typename T, std::size_t N, typename RandomIt>
+inline void
+radix_sort(thread_pool* pool, RandomIt first, aggregate<T,N>* buf,
+           std::size_t n, bool in_buf) {
+  std::size_t c, bit;
+  if (!(in_buf ? sort_top<T,N>(buf, n, c, bit)
+               : sort_top<T,N>(first, n, c, bit))) {
+    if (in_buf)
+      std::copy(buf, buf + n, first);
+    return;
+  }
+
+  if (n <= AGG_SORT_LSD_MAX) {
+    const std::size_t passes = (N - 1 - c) * sizeof(T) + bit / 8 + 1;
+    if (in_buf ? !sort_lsd<T,N>(buf, first, n, passes)
+               : sort_lsd<T,N>(first, buf, n, passes))
+      std::copy(buf, buf + n, first);
+    return;
+  }
+
+  const sort_digit<T,N> digit(c, bit < 8 ? 0 : bit - 7);
+  const std::size_t parts = pool ? pool->size() + 1 : 1;
+  std::vector<std::size_t> count(parts << 8);
+  sort_parts(pool, parts, [&](std::size_t t) {
+    std::size_t b = t * n / parts, e = (t + 1) * n / parts;
+    std::size_t* off = count.data() + (t << 8);
+    if (in_buf)
+      sort_histogram<T,N>(buf + b, e - b, digit, off);
+    else
+      sort_histogram<T,N>(first + b, e - b, digit, off);
+  });
+
+  // Each part scatters after the same digits of the parts before it
+  std::size_t start[257], sum = 0;
+  for (std::size_t d = 0; d < 256; ++d) {
+    start[d] = sum;
+    for (std::size_t t = 0; t < parts; ++t) {
+      std::size_t k = count[(t << 8) + d];
+      count[(t << 8) + d] = sum;
+      sum += k;
+    }
+  }
+  start[256] = n;
+  sort_parts(pool, parts, [&](std::size_t t) {
+    std::size_t b = t * n / parts, e = (t + 1) * n / parts;
+    std::size_t* off = count.data() + (t << 8);
+    if (in_buf)
+      sort_scatter<T,N>(buf + b, e - b, first, digit, off);
+    else
+      sort_scatter<T,N>(first + b, e - b, buf, digit, off);
+  });
+
+  sort_parts(pool, 256, [&](std::size_t d) {
+    radix_sort<T,N>(nullptr, first + start[d], buf + start[d],
+                    start[d + 1] - start[d], !in_buf);
+  });
+}
+
+//! Radix sort [first, last), on pool if it is long enough
+template <typename RandomIt>
+inline void
+sort_range(thread_pool* pool, RandomIt first, RandomIt last, bool stable,
+           std::true_type) {
+  typedef typename std::iterator_traits<RandomIt>::value_type V;
+  const std::size_t n = std::distance(first, last);
+  if (n < AGG_SORT_RADIX_MIN) {
+    stable ? std::stable_sort(first, last) : std::sort(first, last);
+    return;
+  }
+  std::unique_ptr<V[]> buf(new V[n]);
+  if (n < AGG_SORT_PARALLEL_MIN)
+    pool = nullptr;
+  else if (!pool)
+    pool = &default_pool();
+  radix_sort(pool, first, buf.get(), n, false);
+}
+
+//! Comparison sort [first, last)
+template <typename RandomIt>
+inline void
+sort_range(thread_pool*, RandomIt first, RandomIt last, bool stable,
+           std::false_type) {
+  stable ? std::stable_sort(first, last) : std::sort(first, last);
+}
+
+} // end namespace detail
+
+
+/** Sort [first, last) into ascending order by operator<
+ *
+ *  Aggregates of integers, float and double are radix sorted, and then
+ *  equal aggregates keep their order. Long ranges are sorted on the
+ *  threads of pool.
+ */
+template <typename RandomIt>
+inline void
+sort(thread_pool& pool, RandomIt first, RandomIt last) {
+  typedef typename std::iterator_traits<RandomIt>::value_type V;
+  detail::sort_range(&pool, first, last, false, detail::sort_radix<V>());
+}
+
+//! Sort [first, last) into ascending order, keeping equal elements in order
+template <typename RandomIt>
+inline void
+stable_sort(thread_pool& pool, RandomIt first, RandomIt last) {
+  typedef typename std::iterator_traits<RandomIt>::value_type V;
+  detail::sort_range(&pool, first, last, true, detail::sort_radix<V>());
+}
+
+template <typename RandomIt>
+inline void
+sort(RandomIt first, RandomIt last) {
+  typedef typename std::iterator_traits<RandomIt>::value_type V;
+  detail::sort_range(nullptr, first, last, false, detail::sort_radix<V>());
+}
+
+template <typename RandomIt>
+inline void
+stable_sort(RandomIt first, RandomIt last) {
+  typedef typename std::iterator_traits<RandomIt>::value_type V;
+  detail::sort_range(nullptr, first, last, true, detail::sort_radix<V>());
+}
+
+} // end namespace agg
@@ -0,0 +1,181 @@
+#pragma once
+
+/** Compile-time swizzles of aggregates.
+ *
+ *  agg::swizzle<I...>(a) is the aggregate<T,sizeof...(I)> of the elements
+ *  std::get<I>(a)..., in that order. Indices may repeat or be left out:
+ *
+ *    aggregate<float,4> p = ...;
+ *    aggregate<float,3> zyx = agg::swizzle<2,1,0>(p);     // drop w, reverse
+ *    aggregate<float,4> xxxx = agg::swizzle<0,0,0,0>(p);  // broadcast x
+ *
+ *  agg::swizzle_ref<I...>(a) is a writable view of the same elements, a
+ *  swizzle_proxy. It reads as the swizzled aggregate and assigns back
+ *  through its indices, which must then be distinct. It takes aggregates,
+ *  scalars and other proxies on the right of = and of the compound
+ *  assignment operators:
+ *
+ *    agg::swizzle_ref<0,1,2>(p) += offset;
+ *    agg::swizzle_ref<2,0>(p) = agg::swizzle_ref<0,2>(p);  // swap x and z
+ *
+ *  The right-hand side is read in full before anything is written.
+ *
+ *  Both expand over the indices at compile time, with no loop or index
+ *  array, so for arithmetic elements the compiler emits a single register
+ *  shuffle where the target has one (shufps, vpermilps, vpermpd, vpermd...).
+ */
+
+namespace agg {
+
+namespace detail {
+
+//! Whether every index is below N
+template <std::size_t N, std::size_t... I>
+struct swizzle_in_bounds : std::true_type {};
+template <std::size_t N, std::size_t I, std::size_t... Is>
+struct swizzle_in_bounds<N,I,Is...>
+    : std::integral_constant<bool,
+        (I < N) && swizzle_in_bounds<N,Is...>::value> {};
+
+//! Whether I differs from every index of Is
+template <std::size_t I, std::size_t... Is>
+struct swizzle_unique : std::true_type {};
+template <std::size_t I, std::size_t J, std::size_t... Is>
+struct swizzle_unique<I,J,Is...>
+    : std::integral_constant<bool,
+        I != J && swizzle_unique<I,Is...>::value> {};
+
+//! Whether no index occurs twice
+template <std::size_t... I>
+struct swizzle_distinct : std::true_type {};
+template <std::size_t I, std::size_t... Is>
+struct swizzle_distinct<I,Is...>
+    : std::integral_constant<bool,
+        swizzle_unique<I,Is...>::value && swizzle_distinct<Is...>::value> {};
+
+} // end namespace detail
+
+
+//! The aggregate of std::get<I>(a)..., in that order
+template <std::size_t... I, typename T, std::size_t N>
+inline constexpr aggregate<T,sizeof...(I)>
+swizzle(const aggregate<T,N>& a) {
+  static_assert(detail::swizzle_in_bounds<N,I...>::value,
+                "index is out of bounds");
+  return {std::get<I>(a)...};
+}
+
+
+template <typename T, std::size_t N, std::size_t... I>
+struct swizzle_proxy;
+
+//! Proxies are assigned as aggregates, never broadcast as scalars
+template <typename T, std::size_t N, std::size_t... I>
+struct is_scalar_operand<swizzle_proxy<T,N,I...> > : std::false_type {};
+
+/** Writable view of the elements std::get<I>(a)... of an aggregate; see
+ *  agg::swizzle_ref. Assignments write element k of the right-hand side to
+ *  std::get<I_k>(a).
+ */
+template <typename T, std::size_t N, std::size_t... I>
+struct swizzle_proxy {
+  static_assert(detail::swizzle_in_bounds<N,I...>::value,
+                "index is out of bounds");
+  static_assert(detail::swizzle_distinct<I...>::value,
+                "a writable swizzle may not repeat an index");
+
+  static constexpr std::size_t size = sizeof...(I);
+  typedef aggregate<T,size> value_type;
+
+  aggregate<T,N>& a;
+
+  //! The swizzled elements
+  value_type
+  get() const
+  { return swizzle<I...>(a); }
+
+  operator value_type() const
+  { return get(); }
+
+  swizzle_proxy&
+  operator=(const swizzle_proxy& b)
+  { return assign(b.get(), detail::make_index_sequence<size>()); }
+
+  template <typename U, std::size_t M, std::size_t... J>
+  swizzle_proxy&
+  operator=(const swizzle_proxy<U,M,J...>& b)
+  { return *this = b.get(); }
+
+  template <typename U>
+  enable_if<
+    std::is_assignable<T&,const U&>,
+    swizzle_proxy&>
+  operator=(const aggregate<U,size>& b) {
+    // b may be the viewed aggregate itself
+    const aggregate<U,size> t = b;
+    return assign(t, detail::make_index_sequence<size>());
+  }
+
+  template <typename U>
+  enable_if<
+    std::integral_constant<bool,
+      std::is_assignable<T&,const U&>::value &&
+      is_scalar_operand<U>::value>,
+    swizzle_proxy&>
+  operator=(const U& b) {
+    auto l = { (std::get<I>(a) = b, 0)... };
+    (void) l;
+    return *this;
+  }
+
+  //! The aggregate of a right-hand side: a proxy's elements or b itself
+  template <typename U, std::size_t M, std::size_t... J>
+  static aggregate<U,sizeof...(J)>
+  operand(const swizzle_proxy<U,M,J...>& b)
+  { return b.get(); }
+  template <typename U>
+  static const U&
+  operand(const U& b)
+  { return b; }
+
+#define AGG_SWIZZLE_OP_ASSIGN(OP)                                             \
+  template <typename U>                                                       \
+  auto operator OP(const U& b)                                                \
+      -> decltype(std::declval<value_type&>() OP operand(b),                  \
+                  std::declval<swizzle_proxy&>()) {                           \
+    value_type t = get();                                                     \
+    t OP operand(b);                                                          \
+    return assign(t, detail::make_index_sequence<size>());                    \
+  }
+
+  AGG_SWIZZLE_OP_ASSIGN(+=)
+  AGG_SWIZZLE_OP_ASSIGN(-=)
+  AGG_SWIZZLE_OP_ASSIGN(*=)
+  AGG_SWIZZLE_OP_ASSIGN(/=)
+  AGG_SWIZZLE_OP_ASSIGN(%=)
+  AGG_SWIZZLE_OP_ASSIGN(&=)
+  AGG_SWIZZLE_OP_ASSIGN(|=)
+  AGG_SWIZZLE_OP_ASSIGN(^=)
+  AGG_SWIZZLE_OP_ASSIGN(<<=)
+  AGG_SWIZZLE_OP_ASSIGN(>>=)
+#undef AGG_SWIZZLE_OP_ASSIGN
+
+ private:
+  //! std::get<I_k>(a) = std::get<K>(b) for every k
+  template <typename U, std::size_t... K>
+  swizzle_proxy&
+  assign(const aggregate<U,size>& b, detail::index_sequence<K...>) {
+    auto l = { (std::get<I>(a) = std::get<K>(b), 0)... };
+    (void) l;
+    return *this;
+  }
+};
+
+//! Writable view of std::get<I>(a)...; the indices must be distinct
+template <std::size_t... I, typename T, std::size_t N>
+inline swizzle_proxy<T,N,I...>
+swizzle_ref(aggregate<T,N>& a) {
+  return {a};
+}
+
+} // end namespace agg
@@ -0,0 +1,636 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <system_error>
+
+#if defined(__has_include) && __cplusplus >= 201703L
+#  if __has_include(<charconv>)
+#    include <charconv>
+#  endif
+#endif
+#if defined(__cpp_lib_to_chars) && !defined(AGG_NO_CHARCONV)
+#  define AGG_TEXT_CHARCONV 1
+#endif
+
+#include "aggregate.hpp"
+
+/** Text formatting and parsing of aggregates of arithmetic types.
+ *
+ *  agg::format writes a range of aggregates into a character buffer, one
+ *  record per aggregate, and agg::parse reads them back:
+ *
+ *    std::vector<aggregate<float,3> > pts = ...;
+ *    std::string csv = agg::format(pts.data(), pts.size(), agg::csv_format);
+ *    agg::parse(csv.data(), csv.data() + csv.size(),
+ *               pts.data(), pts.size(), agg::csv_format);
+ *
+ *  Elements are separated by the text_format's delimiter, a space by
+ *  default, and records end with its terminator, a newline. Blanks around
+ *  delimiters and blank lines are skipped, and the last record may omit its
+ *  terminator.
+ *
+ *  Numbers are converted without locales or allocation: integers by hand,
+ *  floating-point through std::to_chars and std::from_chars where the
+ *  library provides them (C++17). Otherwise floating-point numbers are
+ *  formatted with the fewest of digits10 or max_digits10 digits that read
+ *  back exactly, and parsed exactly on a fast path for up to 19 significant
+ *  digits with small exponents, falling back to strtod for the rest. Either
+ *  way, every formatted value parses back to itself.
+ *
+ *  operator>> reads the whitespace-separated elements that operator<<
+ *  writes. For arithmetic elements and char streams it converts each token
+ *  as agg::parse does, ignoring the stream's locale and basefield.
+ */
+
+namespace agg {
+
+//! Delimiters of the text of aggregates
+struct text_format {
+  char delimiter;   //!< Between the elements of an aggregate
+  char terminator;  //!< After each aggregate; not a space or tab
+
+  constexpr text_format(char delimiter = ' ', char terminator = '\n')
+      : delimiter(delimiter), terminator(terminator) {}
+};
+
+//! Comma-separated values, one aggregate per line
+constexpr text_format csv_format = text_format(',', '\n');
+
+//! The end of the formatted text and the number of aggregates formatted
+struct format_result {
+  char* ptr;
+  std::size_t count;
+};
+
+/** The end of the parsed text, the number of aggregates parsed, and an
+ *  error, if any, at the record starting at ptr
+ */
+struct parse_result {
+  const char* ptr;
+  std::size_t count;
+  std::errc ec;
+};
+
+
+namespace detail {
+
+//! The end of a converted number and an error, as std::from_chars
+struct text_result {
+  const char* ptr;
+  std::errc ec;
+};
+
+inline bool
+text_digit(char c) {
+  return unsigned(c - '0') < 10;
+}
+
+inline bool
+text_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+//! Append c, or return nullptr if there is no room
+inline char*
+text_put(char* first, char* last, char c) {
+  if (!first || first == last)
+    return nullptr;
+  *first = c;
+  return first + 1;
+}
+
+//! Append [s, s+n), or return nullptr if there is no room
+inline char*
+text_put(char* first, char* last, const char* s, std::size_t n) {
+  if (!first || std::size_t(last - first) < n)
+    return nullptr;
+  std::memcpy(first, s, n);
+  return first + n;
+}
+
+
+// Integers
+
+template <typename U>
+inline char*
+text_write_unsigned(char* first, char* last, U v) {
+  static const char pairs[] =
+      "00010203040506070809101112131415161718192021222324252627282930313233"
+      "34353637383940414243444546474849505152535455565758596061626364656667"
+      "6869707172737475767778798081828384858687888990919293949596979899";
+  char buf[std::numeric_limits<U>::digits10 + 1];
+  char* p = buf + sizeof(buf);
+  while (v >= 100) {
+    unsigned r = unsigned(v % 100);
+    v /= 100;
+    p -= 2;
+    std::memcpy(p, pairs + 2 * r, 2);
+  }
+  if (v >= 10) {
+    p -= 2;
+    std::memcpy(p, pairs + 2 * unsigned(v), 2);
+  } else {
+    *--p = char('0' + unsigned(v));
+  }
+  return text_put(first, last, p, std::size_t(buf + sizeof(buf) - p));
+}
+
+template <typename I>
+inline enable_if<std::is_integral<I>, char*>
+text_write(char* first, char* last, I v) {
+  typedef typename std::make_unsigned<I>::type U;
+  if (v < 0) {
+    first = text_put(first, last, '-');
+    return text_write_unsigned(first, last, U(U(0) - U(v)));
+  }
+  return text_write_unsigned(first, last, U(v));
+}
+
+inline char*
+text_write(char* first, char* last, bool v) {
+  return text_put(first, last, v ? '1' : '0');
+}
+
+template <typename I>
+inline enable_if<std::is_integral<I>, text_result>
+text_read(const char* first, const char* last, I& v) {
+  typedef typename std::make_unsigned<I>::type U;
+  const char* p = first;
+  bool neg = false;
+  if (p != last && (*p == '-' || *p == '+'))
+    neg = (*p++ == '-');
+  if (neg && std::is_unsigned<I>::value)
+    return {first, std::errc::invalid_argument};
+
+  const U max = neg ? U(U(0) - U(std::numeric_limits<I>::min()))
+                    : U(std::numeric_limits<I>::max());
+  const char* digits = p;
+  U u = 0;
+  bool overflow = false;
+  for ( ; p != last && text_digit(*p); ++p) {
+    unsigned d = unsigned(*p - '0');
+    if (u > (max - d) / 10)
+      overflow = true;
+    else
+      u = U(u * 10 + d);
+  }
+  if (p == digits)
+    return {first, std::errc::invalid_argument};
+  if (overflow)
+    return {p, std::errc::result_out_of_range};
+  v = neg ? I(U(0) - u) : I(u);
+  return {p, std::errc()};
+}
+
+inline text_result
+text_read(const char* first, const char* last, bool& v) {
+  unsigned char u = 0;
+  text_result r = text_read(first, last, u);
+  if (r.ec == std::errc() && u > 1)
+    return {first, std::errc::invalid_argument};
+  if (r.ec == std::errc())
+    v = u != 0;
+  return r;
+}
+
+
+// Floating-point
+
+//! Whether [p,last) starts with the lower-case word s, ignoring case
+inline const char*
+text_match(const char* p, const char* last, const char* s) {
+  for ( ; *s; ++s, ++p)
+    if (p == last || (*p | 0x20) != *s)
+      return nullptr;
+  return p;
+}
+
+//! m * 10^e if exactly representable operands make it correctly rounded
+inline bool
+text_fast_float(std::uint64_t m, int e, double& v) {
+  static const double pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  if (m > (std::uint64_t(1) << 53) || e < -22 || e > 22)
+    return false;
+  v = e < 0 ? double(m) / pow10[-e] : double(m) * pow10[e];
+  return true;
+}
+
+inline bool
+text_fast_float(std::uint64_t m, int e, float& v) {
+  static const float pow10[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+  if (m <= (std::uint64_t(1) << 24) && e >= -10 && e <= 10) {
+    v = e < 0 ? float(m) / pow10[-e] : float(m) * pow10[e];
+    return true;
+  }
+  // The nearest double rounds to the nearest float, unless it is a tie
+  double d;
+  if (!text_fast_float(m, e, d))
+    return false;
+  float f = float(d);
+  if (double(f) != d) {
+    float g = std::nextafter(f, d < f ? -HUGE_VALF : HUGE_VALF);
+    if ((double(f) + double(g)) / 2 == d)
+      return false;
+  }
+  v = f;
+  return true;
+}
+
+inline bool
+text_fast_float(std::uint64_t, int, long double&) {
+  return false;
+}
+
+inline void text_strto(const char* s, char** end, float& v)
+{ v = std::strtof(s, end); }
+inline void text_strto(const char* s, char** end, double& v)
+{ v = std::strtod(s, end); }
+inline void text_strto(const char* s, char** end, long double& v)
+{ v = std::strtold(s, end); }
+
+//! strtod on [first,last), with '.' read as the decimal point in any locale
+template <typename F>
+inline std::errc
+text_read_slow(const char* first, const char* last, F& v) {
+  char small[128];
+  std::string large;
+  std::size_t n = std::size_t(last - first);
+  char* s = small;
+  if (n >= sizeof(small)) {
+    large.resize(n + 1);
+    s = &large[0];
+  }
+  const char point = *std::localeconv()->decimal_point;
+  for (std::size_t i = 0; i < n; ++i)
+    s[i] = first[i] == '.' ? point : first[i];
+  s[n] = '\0';
+
+  int saved = errno;
+  errno = 0;
+  F x;
+  text_strto(s, nullptr, x);
+  bool range = errno == ERANGE && std::isinf(x);
+  errno = saved;
+  if (range)
+    return std::errc::result_out_of_range;
+  v = x;
+  return std::errc();
+}
+
+template <typename F>
+inline enable_if<std::is_floating_point<F>, text_result>
+text_read(const char* first, const char* last, F& v) {
+  const char* p = first;
+  bool neg = false;
+  if (p != last && (*p == '-' || *p == '+'))
+    neg = (*p++ == '-');
+
+#if defined(AGG_TEXT_CHARCONV)
+  if (p != last && *p != '-' && *p != '+') {
+    F x;
+    std::from_chars_result r = std::from_chars(p, last, x);
+    if (r.ec == std::errc())
+      v = neg ? -x : x;
+    return {r.ec == std::errc::invalid_argument ? first : r.ptr, r.ec};
+  }
+  return {first, std::errc::invalid_argument};
+#else
+  if (const char* q = text_match(p, last, "inf")) {
+    const char* r = text_match(q, last, "inity");
+    v = neg ? -std::numeric_limits<F>::infinity()
+            : std::numeric_limits<F>::infinity();
+    return {r ? r : q, std::errc()};
+  }
+  if (const char* q = text_match(p, last, "nan")) {
+    v = neg ? -std::numeric_limits<F>::quiet_NaN()
+            : std::numeric_limits<F>::quiet_NaN();
+    return {q, std::errc()};
+  }
+
+  // Up to 19 significant digits of mantissa m, and m * 10^e
+  std::uint64_t m = 0;
+  int digits = 0, e = 0;
+  bool any = false, truncated = false;
+  for ( ; p != last && text_digit(*p); ++p, any = true) {
+    if (digits < 19) {
+      m = m * 10 + unsigned(*p - '0');
+      digits += m != 0;
+    } else {
+      ++e;
+      truncated |= *p != '0';
+    }
+  }
+  if (p != last && *p == '.') {
+    for (++p; p != last && text_digit(*p); ++p, any = true) {
+      if (digits < 19) {
+        m = m * 10 + unsigned(*p - '0');
+        digits += m != 0;
+        --e;
+      } else {
+        truncated |= *p != '0';
+      }
+    }
+  }
+  if (!any)
+    return {first, std::errc::invalid_argument};
+
+  // An exponent, if digits follow the e
+  if (p != last && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool eneg = false;
+    if (q != last && (*q == '-' || *q == '+'))
+      eneg = (*q++ == '-');
+    if (q != last && text_digit(*q)) {
+      int x = 0;
+      for ( ; q != last && text_digit(*q); ++q)
+        if (x < 100000)
+          x = x * 10 + (*q - '0');
+      e += eneg ? -x : x;
+      p = q;
+    }
+  }
+
+  F x;
+  if (m == 0) {
+    x = 0;
+  } else if (truncated || !text_fast_float(m, e, x)) {
+    std::errc ec = text_read_slow(first, p, v);
+    return {p, ec};
+  }
+  v = neg ? -x : x;
+  return {p, std::errc()};
+#endif
+}
+
+inline int text_print(char* s, std::size_t n, int digits, double v)
+{ return std::snprintf(s, n, "%.*e", digits - 1, v); }
+inline int text_print(char* s, std::size_t n, int digits, long double v)
+{ return std::snprintf(s, n, "%.*Le", digits - 1, v); }
+
+//! The significant digits d[0,n) times 10^e, as printf's %.*g with p digits
+inline char*
+text_write_digits(char* first, char* last, bool neg, const char* d, int n,
+                  int e, int p) {
+  while (n > 1 && d[n-1] == '0')
+    --n;
+  char buf[64];
+  char* q = buf;
+  if (neg)
+    *q++ = '-';
+  if (e < -4 || e >= p) {
+    *q++ = d[0];
+    if (n > 1) {
+      *q++ = '.';
+      q = std::copy(d + 1, d + n, q);
+    }
+    *q++ = 'e';
+    *q++ = e < 0 ? '-' : '+';
+    unsigned x = unsigned(e < 0 ? -e : e);
+    if (x < 10)
+      *q++ = '0';
+    q = text_write_unsigned(q, buf + sizeof(buf), x);
+  } else if (e < 0) {
+    *q++ = '0';
+    *q++ = '.';
+    q = std::fill_n(q, -e - 1, '0');
+    q = std::copy(d, d + n, q);
+  } else {
+    q = std::copy(d, d + std::min(n, e + 1), q);
+    q = std::fill_n(q, std::max(0, e + 1 - n), '0');
+    if (n > e + 1) {
+      *q++ = '.';
+      q = std::copy(d + e + 1, d + n, q);
+    }
+  }
+  return text_put(first, last, buf, std::size_t(q - buf));
+}
+
+template <typename F>
+inline enable_if<std::is_floating_point<F>, char*>
+text_write(char* first, char* last, F v) {
+  if (!first)
+    return nullptr;
+#if defined(AGG_TEXT_CHARCONV)
+  std::to_chars_result r = std::to_chars(first, last, v);
+  return r.ec == std::errc() ? r.ptr : nullptr;
+#else
+  typedef typename std::conditional<std::is_same<F,long double>::value,
+                                    long double, double>::type P;
+  const bool neg = std::signbit(v);
+  if (neg && (v != v || std::isinf(v) || v == 0))
+    first = text_put(first, last, '-');
+  if (v != v)
+    return text_put(first, last, "nan", 3);
+  if (std::isinf(v))
+    return text_put(first, last, "inf", 3);
+  if (v == 0)
+    return text_put(first, last, '0');
+
+  // All max_digits10 digits of v, which always read back exactly
+  const int max = std::numeric_limits<F>::max_digits10;
+  const int few = std::numeric_limits<F>::digits10;
+  char buf[64], d[32];
+  text_print(buf, sizeof(buf), max, P(neg ? -v : v));
+  const char* s = buf;
+  int n = 0;
+  for ( ; *s != 'e'; ++s)
+    if (text_digit(*s))
+      d[n++] = *s;
+  int e = std::atoi(s + 1);
+
+  // Rounded to digits10 digits, if those read back exactly too
+  char r[32];
+  int re = e;
+  std::copy(d, d + few, r);
+  if (d[few] >= '5') {
+    int i = few - 1;
+    for ( ; i >= 0 && r[i] == '9'; --i)
+      r[i] = '0';
+    if (i >= 0) {
+      ++r[i];
+    } else {
+      r[0] = '1';
+      ++re;
+    }
+  }
+  char t[48];
+  char* q = std::copy(r, r + few, t);
+  *q++ = 'e';
+  q = text_write(q, t + sizeof(t), re - few + 1);
+  F back;
+  if (text_read(t, q, back).ec == std::errc() && back == (neg ? -v : v))
+    return text_write_digits(first, last, neg, r, few, re, few);
+  return text_write_digits(first, last, neg, d, n, e, max);
+#endif
+}
+
+
+//! s >> t, as by default
+template <typename CharT, typename Traits, typename T>
+inline void
+text_extract(std::basic_istream<CharT,Traits>& s, T& t, std::false_type) {
+  s >> t;
+}
+
+//! Read the next whitespace-separated token of s and convert it as parse
+template <typename Traits, typename T>
+inline void
+text_extract(std::basic_istream<char,Traits>& s, T& t, std::true_type) {
+  typename std::basic_istream<char,Traits>::sentry ok(s);
+  if (!ok)
+    return;
+  char buf[128];
+  std::size_t n = 0;
+  std::basic_streambuf<char,Traits>* sb = s.rdbuf();
+  typename Traits::int_type c = sb->sgetc();
+  for ( ; !Traits::eq_int_type(c, Traits::eof()); c = sb->snextc()) {
+    char ch = Traits::to_char_type(c);
+    if (std::isspace(static_cast<unsigned char>(ch)) || n == sizeof(buf))
+      break;
+    buf[n++] = ch;
+  }
+  if (Traits::eq_int_type(c, Traits::eof()))
+    s.setstate(std::ios_base::eofbit);
+  text_result r = text_read(buf, buf + n, t);
+  if (r.ec != std::errc() || r.ptr != buf + n)
+    s.setstate(std::ios_base::failbit);
+}
+
+} // end namespace detail
+
+
+/** Write the n aggregates at a into [first,last), stopping before the
+ *  first that does not fit whole.
+ */
+template <typename T, std::size_t N>
+inline format_result
+format(char* first, char* last, const aggregate<T,N>* a, std::size_t n,
+       const text_format& f = text_format()) {
+  static_assert(std::is_arithmetic<T>::value,
+                "formats aggregates of arithmetic types");
+  format_result r = {first, 0};
+  for ( ; r.count < n; ++r.count) {
+    char* p = r.ptr;
+    for (std::size_t i = 0; i < N; ++i) {
+      if (i)
+        p = detail::text_put(p, last, f.delimiter);
+      p = detail::text_write(p, last, a[r.count][i]);
+    }
+    p = detail::text_put(p, last, f.terminator);
+    if (!p)
+      break;
+    r.ptr = p;
+  }
+  return r;
+}
+
+//! The text of the n aggregates at a
+template <typename T, std::size_t N>
+inline std::string
+format(const aggregate<T,N>* a, std::size_t n,
+       const text_format& f = text_format()) {
+  std::string s(n * N * 8 + 64, '\0');
+  std::size_t used = 0;
+  for (;;) {
+    format_result r = format(&s[0] + used, &s[0] + s.size(), a, n, f);
+    used = std::size_t(r.ptr - &s[0]);
+    a += r.count;
+    n -= r.count;
+    if (!n)
+      break;
+    s.resize(2 * s.size());
+  }
+  s.resize(used);
+  return s;
+}
+
+/** Read up to n aggregates from [first,last) into a.
+ *
+ *  Stops at the end of the text, after n aggregates, or at a malformed
+ *  record, which sets ec and may be partly written to a[count].
+ */
+template <typename T, std::size_t N>
+inline parse_result
+parse(const char* first, const char* last, aggregate<T,N>* a, std::size_t n,
+      const text_format& f = text_format()) {
+  static_assert(std::is_arithmetic<T>::value,
+                "parses aggregates of arithmetic types");
+  const bool blank_delimiter = detail::text_blank(f.delimiter);
+  parse_result r = {first, 0, std::errc()};
+  const char* p = first;
+  while (r.count < n) {
+    // Blank lines
+    while (p != last && (detail::text_blank(*p) || *p == '\n' ||
+                         *p == f.terminator))
+      ++p;
+    r.ptr = p;
+    if (p == last)
+      break;
+
+    for (std::size_t i = 0; i < N; ++i) {
+      if (i) {
+        const char* q = p;
+        while (p != last && detail::text_blank(*p))
+          ++p;
+        bool separated = blank_delimiter && p != q;
+        if (!blank_delimiter && p != last && *p == f.delimiter) {
+          separated = true;
+          for (++p; p != last && detail::text_blank(*p); ++p) {}
+        }
+        if (!separated) {
+          r.ec = std::errc::invalid_argument;
+          return r;
+        }
+      }
+      detail::text_result e = detail::text_read(p, last, a[r.count][i]);
+      if (e.ec != std::errc()) {
+        r.ec = e.ec;
+        return r;
+      }
+      p = e.ptr;
+    }
+
+    while (p != last && detail::text_blank(*p))
+      ++p;
+    if (p != last) {
+      if (*p != f.terminator) {
+        r.ec = std::errc::invalid_argument;
+        return r;
+      }
+      ++p;
+    }
+    ++r.count;
+    r.ptr = p;
+  }
+  return r;
+}
+
+
+//! Read whitespace-separated elements from an input stream
+template <typename CharT, typename Traits, typename T, std::size_t N>
+inline
+enable_if<
+  has_right_shift<std::basic_istream<CharT,Traits>&,T&>,
+  std::basic_istream<CharT,Traits>&>
+operator>>(std::basic_istream<CharT,Traits>& s, aggregate<T,N>& a) {
+  typedef std::integral_constant<bool,
+      std::is_same<CharT,char>::value && std::is_arithmetic<T>::value> fast;
+  for (std::size_t i = 0; i < N && s; ++i)
+    detail::text_extract(s, a[i], fast());
+  return s;
+}
+
+} // end namespace agg
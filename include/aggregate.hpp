@@ -1,25 +1,116 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 #include <iterator>
 #include <type_traits>
 
 #include "operator_traits.hpp"
 
+/** constexpr where C++14 allows it and C++11 does not: functions that loop,
+ *  mutate their arguments or return void.
+ */
+#if defined(__cpp_constexpr) && __cpp_constexpr >= 201304L
+#  define AGG_CONSTEXPR14 constexpr
+#else
+#  define AGG_CONSTEXPR14
+#endif
+
+/** Whether the enclosing constexpr function is being evaluated in a constant
+ *  expression. The operators then take the generic kernels instead of the
+ *  intrinsics of agg_simd.hpp, which constant expressions cannot call.
+ *  Without the builtin, aggregates with SIMD kernels are not usable in
+ *  constant expressions.
+ */
+#if defined(__has_builtin) && !defined(AGG_IS_CONSTANT_EVALUATED)
+#  if __has_builtin(__builtin_is_constant_evaluated)
+#    define AGG_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#  endif
+#endif
+#if !defined(AGG_IS_CONSTANT_EVALUATED)
+#  define AGG_IS_CONSTANT_EVALUATED() false
+#endif
+
 namespace agg {
 
+/** Storage policy of aggregate<T,N>: the number of lanes allocated for the
+ *  N elements and the alignment of the array.
+ *
+ *  Specialize, e.g. by deriving from padded_storage, to pad or align chosen
+ *  aggregates. Defining AGG_STORAGE_ALIGN pads every aggregate of arithmetic
+ *  elements to that many bytes. Beyond alignof(std::max_align_t), new and
+ *  the standard allocators only honour the alignment from C++17 on, so
+ *  earlier standards reject such a value.
+ */
+template <typename T, std::size_t N, typename Enable = void>
+struct aggregate_storage {
+  static constexpr std::size_t lanes = N;
+  static constexpr std::size_t alignment = alignof(T);
+};
+
+/** Storage padded to a whole number of Align-byte blocks and aligned to Align
+ *  bytes, so an aggregate fills full registers of that width.
+ *
+ *  Element-wise kernels compute on the padding lanes as well. Like the
+ *  elements, they are value-initialized by aggregate-initialization and
+ *  indeterminate in a default-initialized aggregate. Before C++17, aggregates
+ *  aligned beyond alignof(std::max_align_t) are only aligned where they are
+ *  not allocated with new.
+ */
+template <typename T, std::size_t N, std::size_t Align>
+struct padded_storage {
+  static_assert(Align && !(Align & (Align - 1)),
+                "alignment must be a power of two");
+
+  static constexpr std::size_t block
+      = Align > sizeof(T) ? Align / sizeof(T) : 1;
+  static constexpr std::size_t lanes = (N + block - 1) / block * block;
+  static constexpr std::size_t alignment
+      = Align > alignof(T) ? Align : alignof(T);
+};
+
+#if defined(AGG_STORAGE_ALIGN)
+#if !defined(__cpp_aligned_new)
+static_assert(AGG_STORAGE_ALIGN <= alignof(std::max_align_t),
+              "AGG_STORAGE_ALIGN beyond alignof(std::max_align_t) needs "
+              "C++17 aligned new");
+#endif
+template <typename T, std::size_t N>
+struct aggregate_storage<T, N,
+    typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    : padded_storage<T, N, AGG_STORAGE_ALIGN> {};
+#endif
+
+
 template <typename T, std::size_t N>
 struct __aggregate_traits {
-  typedef T _Type[N];
+  typedef aggregate_storage<T,N> _Storage;
+  static_assert(_Storage::lanes >= N, "storage must hold N elements");
+
+  static constexpr std::size_t _Lanes = _Storage::lanes;
+  static constexpr std::size_t _Align = _Storage::alignment;
+  typedef T _Type[_Lanes];
 
   static constexpr T&
   ref(const _Type& t, std::size_t n) noexcept {
     return const_cast<T&>(t[n]);
   }
+
+  //! Swap by moves, which constant expressions can evaluate
+  static AGG_CONSTEXPR14 void
+  move_swap(_Type& a, _Type& b) {
+    for (std::size_t i = 0; i < N; ++i) {
+      T t = std::move(a[i]);
+      a[i] = std::move(b[i]);
+      b[i] = std::move(t);
+    }
+  }
 };
 
 template <typename T>
 struct __aggregate_traits<T,0> {
+  static constexpr std::size_t _Lanes = 0;
+  static constexpr std::size_t _Align = alignof(T);
   struct _Type {};
 
   static constexpr T&
@@ -27,6 +118,9 @@ struct __aggregate_traits<T,0> {
     //static_assert(false, "Dereferencing zero-sized array");
     return std::declval<T&>();
   }
+
+  static AGG_CONSTEXPR14 void
+  move_swap(_Type&, _Type&) {}
 };
 
 
@@ -59,19 +153,27 @@ struct aggregate {
   typedef  std::reverse_iterator<const_iterator>  const_reverse_iterator;
 
   // Support for zero-sized aggregates mandatory.
+  // Lanes past N are padding requested by aggregate_storage<T,N>.
   typedef __aggregate_traits<T,N>                 _AT;
-  typename _AT::_Type                             _elem;
+  alignas(_AT::_Align) typename _AT::_Type        _elem;
 
   // No explicit construct/copy/destroy for aggregate type.
 
-  void
-  fill(const value_type& u)
-  { std::fill_n(begin(), size(), u); }
+  AGG_CONSTEXPR14 void
+  fill(const value_type& u) {
+    for (size_type i = 0; i < N; ++i)
+      _AT::ref(_elem, i) = u;
+  }
 
-  void
+  AGG_CONSTEXPR14 void
   swap(aggregate& other)
-      noexcept(noexcept(swap(std::declval<T&>(), std::declval<T&>())))
-  { std::swap_ranges(begin(), end(), other.begin()); }
+      noexcept(noexcept(std::swap(std::declval<T&>(),
+                                  std::declval<T&>()))) {
+    // std::swap is not constexpr before C++20
+    AGG_IS_CONSTANT_EVALUATED()
+        ? _AT::move_swap(_elem, other._elem)
+        : void(std::swap_ranges(begin(), end(), other.begin()));
+  }
 
   // Iterators.
   iterator
@@ -136,7 +238,7 @@ struct aggregate {
   { return size() == 0; }
 
   // Element access.
-  reference
+  AGG_CONSTEXPR14 reference
   operator[](size_type n)
   { return _AT::ref(_elem, n); }
 
@@ -144,7 +246,7 @@ struct aggregate {
   operator[](size_type n) const noexcept
   { return _AT::ref(_elem, n); }
 
-  reference
+  AGG_CONSTEXPR14 reference
   at(size_type n)
   { return _AT::ref(_elem, n); }
 
@@ -152,17 +254,17 @@ struct aggregate {
   at(size_type n) const
   { return _AT::ref(_elem, n); }
 
-  reference
+  AGG_CONSTEXPR14 reference
   front()
-  { return *begin(); }
+  { return _AT::ref(_elem, 0); }
 
   constexpr const_reference
   front() const
   { return _AT::ref(_elem, 0); }
 
-  reference
+  AGG_CONSTEXPR14 reference
   back()
-  { return N ? *(end() - 1) : *end(); }
+  { return N ? _AT::ref(_elem, N - 1) : _AT::ref(_elem, 0); }
 
   constexpr const_reference
   back() const
@@ -185,7 +287,7 @@ namespace std {
 
 //! Specialization of std::swap
 template <typename T, std::size_t N>
-inline void
+inline AGG_CONSTEXPR14 void
 swap(agg::aggregate<T,N>& a, agg::aggregate<T,N>& b)
     noexcept(noexcept(a.swap(b))) {
   a.swap(b);
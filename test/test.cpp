@@ -1,8 +1,14 @@
+#include <cmath>
 #include <iostream>
 #include <typeinfo>
 #include <complex>
+#include <cstdint>
+#include <vector>
 
 #include "aggregate.hpp"
+#include "agg_batch.hpp"
+#include "agg_expression.hpp"
+#include "agg_matrix.hpp"
 
 struct my_struct {
 };
@@ -16,6 +22,12 @@ std::string operator+(float a, const my_struct&) {
 }
 
 
+namespace agg {
+// Pad and align aggregate<double,3> to a 32-byte register
+template <>
+struct aggregate_storage<double,3> : padded_storage<double,3,32> {};
+}
+
 using agg::aggregate;
 
 
@@ -67,5 +79,152 @@ int main() {
   auto vv2 = vv + vv;
   std::cout << vv2 << std::endl;
 
+  // Fused expressions
+  aggregate<float,3> fx = agg::lazy(x) * 2.f + agg::lazy(x) * x - 1;
+  std::cout << fx << std::endl;
+
+  fx += -agg::lazy(x) * 2;
+  std::cout << fx << std::endl;
+
+  aggregate<double,3> fd = agg::lazy(x) / 2;
+  std::cout << fd << std::endl;
+
+  static_assert(sizeof(fd) == 32 && alignof(aggregate<double,3>) == 32,
+                "padded storage");
+  fd = fd * fd - aggregate<double,3>{1,2,3};
+  std::cout << fd.size() << ": " << fd << std::endl;
+
+  auto fvv = agg::lazy(vv) + x;
+  std::cout << fvv << std::endl;
+
+  // Lengths that leave a remainder after the register loops
+  aggregate<float,11> f11 = {1,2,3,4,5,6,7,8,9,10,11};
+  f11 = f11 * f11 - 2.f * f11;
+  std::cout << f11 << std::endl;
+
+  aggregate<int,7> i7 = {1,-2,3,-4,5,-6,7};
+  i7 *= i7;
+  i7 = 1 - (i7 ^ 3);
+  std::cout << i7 << std::endl;
+
+  // Sizes past AGG_UNROLL_LIMIT map through loops
+  aggregate<short,100> s100;
+  aggregate<int,100> i100;
+  for (std::size_t i = 0; i < s100.size(); ++i)
+    s100[i] = short(i);
+  aggregate<int,100> r100 = (s100 << 2) % 7 - s100;
+  aggregate<int,100> e100 = agg::lazy(s100) * 3 + 1;
+  i100 = {};
+  i100 += agg::lazy(s100) * s100;
+  bool loops = true;
+  for (std::size_t i = 0; i < s100.size(); ++i) {
+    loops &= r100[i] == int(i*4 % 7) - int(i);
+    loops &= e100[i] == int(3*i + 1) && i100[i] == int(i*i);
+  }
+  std::cout << "large N: " << loops << " " << r100.back() << " "
+            << agg::sum(s100) << " " << agg::max_element(i100) << " "
+            << agg::count(s100) << std::endl;
+
+  // Negation flips the sign bit, so -0 is -0 in every register width
+  aggregate<float,16> nz16 = -aggregate<float,16>{};
+  aggregate<double,8> nz8 = -aggregate<double,8>{};
+  bool signs = true;
+  for (float z : nz16)
+    signs &= std::signbit(z) && z == 0;
+  for (double z : nz8)
+    signs &= std::signbit(z) && z == 0;
+  std::cout << "negative zero: " << signs << std::endl;
+
+  // Fused operations
+  aggregate<float,11> g11 = agg::fma(f11, 0.5f, f11);
+  agg::axpy(-1.f, f11, g11);
+  std::cout << g11 << std::endl;
+  std::cout << agg::lerp(x, aggregate<float,3>{4,5,6}, 0.25f) << " | "
+            << agg::lerp(x, 10.f, aggregate<float,3>{0,1,0.5f}) << " | "
+            << agg::clamp(i7, -20, aggregate<int,7>{0,5,0,5,0,5,0}) << " | "
+            << agg::fma(vvc, std::complex<float>{0,1}, 1.f) << std::endl;
+  aggregate<unsigned,8> u8;
+  u8.fill(0xfffffff0u);
+  std::cout << agg::clamp(u8, 0u, 10u) << " | "
+            << agg::clamp(aggregate<unsigned,4>{0x80000000u,5,20,3}, 4u, 10u)
+            << " | "
+            << agg::clamp(aggregate<std::uint64_t,4>{1ull << 63, 5, 0, 9},
+                          std::uint64_t(2), std::uint64_t(8)) << std::endl;
+
+  // Reductions
+  std::cout << agg::sum(f11) << " " << agg::dot(f11, f11) << " "
+            << agg::norm(aggregate<double,2>{3, 4}) << std::endl;
+  std::cout << agg::min_element(i7) << " " << agg::max_element(i7) << " "
+            << agg::any(i7 + 1) << " " << agg::all(i7 + 1) << " "
+            << agg::reduce(agg::fn::bit_or(), i7) << std::endl;
+
+  // Small matrices
+  auto m3 = agg::matmul(vv, agg::transpose(vv));
+  std::cout << m3 << " | " << agg::matvec(vv, x) << " | "
+            << agg::outer(aggregate<int,2>{1,2}, x) << std::endl;
+  agg::matrix<double,3,3> d3 = {{ {{2,1,0}}, {{1,3,1}}, {{0,1,4}} }};
+  agg::matrix<float,4,4> m4 = {{ {{4,7,2,3}}, {{0,5,1,2}}, {{3,1,6,1}},
+                                 {{2,2,1,8}} }};
+  aggregate<float,4> y4 = agg::matvec(m4, aggregate<float,4>{1,2,3,4});
+  std::cout << agg::determinant(d3) << " "
+            << agg::matmul(d3, agg::inverse(d3)) << " | "
+            << agg::determinant(m4) << " "
+            << agg::matvec(agg::inverse(m4), y4) << std::endl;
+
+  // Batched matrices, whole blocks and a tail
+  std::vector<agg::matrix<float,4,4> > b4(37, m4), i4(37), e4(37);
+  std::vector<aggregate<float,4> > p4(37), q4(37);
+  for (std::size_t i = 0; i < b4.size(); ++i) {
+    b4[i][i % 4][(i / 4) % 4] += float(i);
+    p4[i] = {1.f, float(i), 2.f, -1.f};
+  }
+  agg::batch_inverse(b4.begin(), b4.end(), i4.begin());
+  agg::batch_matvec(b4.begin(), b4.end(), p4.begin(), q4.begin());
+  agg::batch_matmul(b4.begin(), b4.end(), i4.begin(), e4.begin());
+  bool batched = true;
+  for (std::size_t i = 0; i < b4.size(); ++i) {
+    auto y = agg::matvec(b4[i], p4[i]);
+    for (std::size_t j = 0; j < 4; ++j) {
+      batched &= y[j] == q4[i][j];
+      for (std::size_t k = 0; k < 4; ++k)
+        batched &= std::abs(e4[i][j][k] - float(j == k)) < 1e-4f;
+    }
+  }
+  std::cout << "batched: " << batched << std::endl;
+
+  // Element-wise comparisons and select
+  auto neg = agg::cmp_lt(f11, 0.f);
+  aggregate<float,11> nan11 = f11;
+  nan11[3] = std::nanf("");
+  std::cout << neg << " " << agg::count(neg) << " | "
+            << agg::cmp_ge(i7, aggregate<int,7>{0,5,0,5,0,5,0}) << " | "
+            << agg::cmp_eq(2.f, x) << " " << agg::cmp_ne(nan11, nan11)
+            << std::endl;
+  std::cout << agg::select(neg, -f11, f11) << " | "
+            << agg::select(agg::cmp_gt(i7, 0), i7, 0) << " | "
+            << agg::count(agg::cmp_le(r100, 0)) << std::endl;
+
+  // Whole-aggregate comparisons, deciding at the first or the last element
+  aggregate<int,7> j7 = i7;
+  aggregate<float,11> h11 = f11;
+  j7.back() += 1;
+  h11.front() = -2;
+  std::cout << (i7 == j7) << (i7 < j7) << (j7 < i7) << (i7 <= i7) << " "
+            << (f11 == f11) << (nan11 == nan11) << (h11 < f11) << (f11 > h11)
+            << " " << (s100 == s100) << (r100 < r100) << (e100 >= r100)
+            << std::endl;
+
+  // Swizzles and writable swizzle views
+  aggregate<float,4> w4 = {1,2,3,4};
+  std::cout << agg::swizzle<2,1,0>(w4) << " | " << agg::swizzle<0,0,0,0>(w4)
+            << " | " << agg::swizzle<2,0>(fd) << " | ";
+  agg::swizzle_ref<0,1,2>(w4) += x;
+  agg::swizzle_ref<3,0>(w4) = agg::swizzle_ref<0,3>(w4);
+  agg::swizzle_ref<2,1,0>(i7) <<= 1;
+  agg::swizzle_ref<1,2>(vv) += 1.f;
+  aggregate<int,3> r3 = {1,2,3};
+  agg::swizzle_ref<2,1,0>(r3) = r3;
+  std::cout << w4 << " | " << i7 << " | " << vv << " | " << r3 << std::endl;
+
   return 0;
 }
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_atomic.hpp"
+#include "agg_parallel.hpp"
+
+using agg::aggregate;
+
+
+//! Whether adding updates[t][k] into buckets k % b on T threads matches
+//! adding them serially
+template <typename V>
+bool same_sums(agg::thread_pool& pool, const std::vector<std::vector<V> >& u,
+               std::size_t b) {
+  std::vector<V> serial(b, V{}), shared(b, V{});
+  for (auto& t : u)
+    for (std::size_t k = 0; k < t.size(); ++k)
+      serial[k % b] += t[k];
+  pool.parallel_for(u.size(), [&](std::size_t t) {
+    for (std::size_t k = 0; k < u[t].size(); ++k)
+      agg::atomic_ref<V>(shared[k % b])
+          .fetch_add(u[t][k], std::memory_order_relaxed);
+  });
+  return shared == serial;
+}
+
+//! Random updates for 4 threads, in multiples of 1/4 so that sums of
+//! floating-point updates are exact in any order
+template <typename V>
+std::vector<std::vector<V> > updates(std::mt19937& rng) {
+  std::vector<std::vector<V> > u(4, std::vector<V>(20000));
+  for (auto& t : u)
+    for (auto& v : t)
+      for (auto& x : v)
+        x = typename V::value_type(int(rng() % 64) - 32) /
+            typename V::value_type(4);
+  return u;
+}
+
+
+int main() {
+  std::mt19937 rng(11);
+  agg::thread_pool pool(3);
+
+  std::cout << "add: "
+            << same_sums(pool, updates<aggregate<std::int32_t,3> >(rng), 8)
+            << same_sums(pool, updates<aggregate<std::int16_t,4> >(rng), 8)
+            << same_sums(pool, updates<aggregate<float,2> >(rng), 3)
+            << same_sums(pool, updates<aggregate<double,3> >(rng), 8)
+            << same_sums(pool, updates<aggregate<double,2> >(rng), 1)
+            << std::endl;
+
+  // Aggregates in one word update together, unless misaligned
+  struct alignas(8) {
+    std::uint16_t tag;
+    aggregate<std::uint16_t,4> a;
+  } odd;
+  aggregate<float,2> f2 = {{0, 0}};
+  aggregate<double,3> d3 = {{0, 0, 0}};
+  std::cout << "whole: " << agg::atomic_ref<aggregate<float,2> >(f2).whole()
+            << agg::atomic_ref<aggregate<double,3> >(d3).whole()
+            << agg::atomic_ref<aggregate<std::uint16_t,4> >(odd.a).whole()
+            << std::endl;
+
+  // Every fetch_add of a whole word sees a state between two updates
+  aggregate<std::uint32_t,2> ticket = {{0, 0}};
+  std::vector<char> seen(40000);
+  bool snapshot = true;
+  pool.parallel_for(4, [&](std::size_t) {
+    agg::atomic_ref<aggregate<std::uint32_t,2> > r(ticket);
+    bool ok = true;
+    for (int k = 0; k < 10000; ++k) {
+      aggregate<std::uint32_t,2> x = r.fetch_add({{1, 3}});
+      ok &= x[1] == 3 * x[0] && !seen[x[0]];
+      seen[x[0]] = 1;
+    }
+    if (!ok)
+      snapshot = false;
+  });
+  std::cout << "snapshot: " << snapshot << " " << ticket << std::endl;
+
+  // Minima and maxima, element by element
+  std::vector<aggregate<std::int64_t,3> > lo(4, {{0, 0, 0}}), hi = lo;
+  std::vector<aggregate<float,2> > flo(4, {{0, 0}}), fhi = flo;
+  std::vector<aggregate<std::int64_t,3> > v(40000);
+  for (auto& x : v)
+    x = {{std::int64_t(rng() % 2001) - 1000, std::int64_t(rng() % 7) - 3,
+          std::int64_t(rng())}};
+  pool.parallel_for(v.size() / 1000, [&](std::size_t c) {
+    for (std::size_t k = c * 1000; k < (c + 1) * 1000; ++k) {
+      agg::atomic_ref<aggregate<std::int64_t,3> >(lo[k % 4]).fetch_min(v[k]);
+      agg::atomic_ref<aggregate<std::int64_t,3> >(hi[k % 4]).fetch_max(v[k]);
+      aggregate<float,2> f = {{float(v[k][0]), float(v[k][1])}};
+      agg::atomic_ref<aggregate<float,2> >(flo[k % 4]).fetch_min(f);
+      agg::atomic_ref<aggregate<float,2> >(fhi[k % 4]).fetch_max(f);
+    }
+  });
+  bool extremes = true;
+  for (std::size_t b = 0; b < 4; ++b) {
+    aggregate<std::int64_t,3> l = {{0, 0, 0}}, h = l;
+    for (std::size_t k = b; k < v.size(); k += 4)
+      for (std::size_t i = 0; i < 3; ++i) {
+        l[i] = std::min(l[i], v[k][i]);
+        h[i] = std::max(h[i], v[k][i]);
+      }
+    extremes &= lo[b] == l && hi[b] == h;
+    extremes &= flo[b][0] == float(l[0]) && flo[b][1] == float(l[1]);
+    extremes &= fhi[b][0] == float(h[0]) && fhi[b][1] == float(h[1]);
+  }
+  std::cout << "extremes: " << extremes << std::endl;
+
+  // Return values
+  aggregate<int,3> a = {{1, 2, 3}};
+  agg::atomic_ref<aggregate<int,3> > r(a);
+  std::cout << "returns: " << r.fetch_add({{1, 1, 1}}) << ", "
+            << (r += aggregate<int,3>{{10, 20, 30}}) << ", "
+            << r.fetch_sub({{2, 2, 2}}) << ", "
+            << r.fetch_min({{0, 100, 0}}) << ", "
+            << r.exchange({{7, 8, 9}}) << ", " << r.load() << std::endl;
+
+  return 0;
+}
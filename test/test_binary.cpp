@@ -0,0 +1,112 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_binary.hpp"
+
+using agg::aggregate;
+
+// Pad aggregate<short,3> to four lanes
+namespace agg {
+template <>
+struct aggregate_storage<short,3> : padded_storage<short,3,8> {};
+} // end namespace agg
+
+
+int main() {
+  const std::size_t n = 1000;
+  std::vector<aggregate<float,3> > pts(n);
+  for (std::size_t i = 0; i < n; ++i)
+    pts[i] = {float(i), 0.5f * i, -1.f};
+
+  // Stream round trip, a block and single aggregates
+  std::stringstream ss;
+  {
+    agg::binary_writer<float,3> w(ss);
+    w.write(pts.data(), n - 2);
+    w.write(pts.begin() + (n - 2), pts.end());
+    w.close();
+  }
+  std::cout << "stream: " << ss.str().size() << " bytes" << std::endl;
+
+  agg::binary_reader<float,3> r(ss);
+  std::vector<aggregate<float,3> > back(r.size() + 5);
+  std::size_t got = r.read(back.data(), 10);
+  got += r.read(back.data() + got, back.size() - got);
+  back.resize(got);
+  std::cout << "read: " << r.size_known() << " " << got << " "
+            << (back == pts) << " " << back.back() << std::endl;
+
+  // A different aggregate is refused
+  std::stringstream is(ss.str());
+  try {
+    agg::binary_reader<int,3> bad(is);
+  } catch (const agg::binary_error& e) {
+    std::cout << e.what() << std::endl;
+  }
+
+  // A file in the other byte order is converted on read
+  std::string swapped = ss.str();
+  agg::binary_header h = agg::binary_header::parse(swapped.data());
+  std::size_t offset = h.data_offset;
+  h.swap_bytes();
+  std::memcpy(&swapped[0], &h, sizeof(h));
+  agg::detail::binary_swap(&swapped[offset], swapped.size() - offset,
+                           sizeof(float));
+  std::stringstream fs(swapped);
+  agg::binary_reader<float,3> fr(fs);
+  aggregate<float,3> last;
+  while (fr.read(last)) {}
+  std::cout << "swapped: " << fr.header().swapped() << " " << last
+            << std::endl;
+
+  // Padding lanes go out as zeros, whatever they held
+  aggregate<short,3> s[2] = {{{1, 2, 3}}, {{4, 5, 6}}};
+  s[0].data()[3] = s[1].data()[3] = 0x7777;
+  std::stringstream ps;
+  {
+    agg::binary_writer<short,3> w(ps);
+    w.write(s, 2);
+  }
+  std::string padded = ps.str();
+  std::size_t at = agg::binary_header::parse(padded.data()).data_offset;
+  short lane[2];
+  std::memcpy(&lane[0], &padded[at + 6], sizeof(short));
+  std::memcpy(&lane[1], &padded[at + 14], sizeof(short));
+  agg::binary_reader<short,3> pr(ps);
+  aggregate<short,3> t[2];
+  pr.read(t, 2);
+  std::cout << "padded: " << sizeof(s[0]) << " " << padded.size() - at << " "
+            << lane[0] << " " << lane[1] << " " << t[1] << std::endl;
+
+  // Mapped in place, with alignment padding before the data
+  const char* path = "test_binary.agg";
+  std::vector<aggregate<double,4> > quads(n);
+  for (std::size_t i = 0; i < n; ++i)
+    quads[i] = {double(i), 1, 2, 3};
+  {
+    std::ofstream out(path, std::ios::binary);
+    agg::binary_writer<double,4> w(out);
+    w.write(quads.begin(), quads.end());
+  }
+  {
+    agg::mapped_array<double,4> m(path);
+    bool same = m.size() == n;
+    for (std::size_t i = 0; same && i < n; ++i)
+      same = (m[i] == quads[i]);
+    std::cout << "mapped: " << m.size() << " " << same << " " << m.back()
+              << std::endl;
+    try {
+      agg::mapped_array<float,8> bad(path);
+    } catch (const agg::binary_error& e) {
+      std::cout << e.what() << std::endl;
+    }
+  }
+  std::remove(path);
+
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+#include "aggregate.hpp"
+#include "agg_bitset.hpp"
+
+using agg::aggregate;
+using agg::bitset_aggregate;
+
+
+//! A random mask, with a chance p in 8 of each element holding
+template <std::size_t N>
+aggregate<bool,N> mask(std::mt19937& rng, unsigned p) {
+  aggregate<bool,N> m;
+  for (std::size_t i = 0; i < N; ++i)
+    m[i] = rng() % 8 < p;
+  return m;
+}
+
+//! Whether the operators and reductions of bitset_aggregate<N> match those
+//! of aggregate<bool,N>
+template <std::size_t N>
+bool same(std::mt19937& rng) {
+  bool same = true;
+  for (unsigned p = 0; p <= 8; ++p) {
+    aggregate<bool,N> a = mask<N>(rng, p), b = mask<N>(rng, 4);
+    bitset_aggregate<N> x = agg::pack(a), y = agg::pack(b);
+    same &= agg::unpack(x) == a;
+    same &= agg::unpack(x & y) == (a & b) && agg::unpack(x | y) == (a | b);
+    same &= agg::unpack(x ^ y) == (a ^ b) && agg::unpack(~x) == !a;
+    same &= agg::unpack(!x) == !a && agg::unpack(x && y) == (a && b);
+    same &= agg::unpack(x || y) == (a || b);
+    for (bool s : {false, true}) {
+      same &= agg::unpack(x & s) == (a & s) && agg::unpack(s | x) == (s | a);
+      same &= agg::unpack(x ^ s) == (a ^ s);
+    }
+    same &= agg::count(x) == agg::count(a) && agg::any(x) == agg::any(a);
+    same &= agg::all(x) == agg::all(a) && agg::none(x) == !agg::any(a);
+    same &= agg::count(~x) == N - agg::count(a);
+    bitset_aggregate<N> z = x;
+    z ^= y;
+    z |= true;
+    same &= agg::all(z) && z == ~bitset_aggregate<N>{};
+    z &= x;
+    same &= z == x && (z != y) == (a != b);
+  }
+  return same;
+}
+
+
+int main() {
+  std::mt19937 rng(9);
+
+  std::cout << "ops: " << same<1>(rng) << same<7>(rng) << same<64>(rng)
+            << same<65>(rng) << same<300>(rng) << same<1024>(rng)
+            << std::endl;
+
+  // Proxy references, and 300 flags in 5 words
+  bitset_aggregate<300> f = {};
+  f[3] = true;
+  f[299] = f[3];
+  f.set(64).flip(65).flip(3);
+  f[100].flip();
+  bool b = f[64];
+  const bitset_aggregate<300>& c = f;
+  std::cout << "bits: " << b << c[3] << c.test(65) << ~f[299] << " "
+            << agg::count(f) << " " << sizeof(f) << " " << f.words << std::endl;
+
+  f.fill(true);
+  bitset_aggregate<5> s = {};
+  s[1] = s[4] = true;
+  std::cout << "fill: " << agg::count(f) << agg::all(f) << " " << s << " "
+            << agg::count(bitset_aggregate<0>{}) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include <iostream>
+
+#include "aggregate.hpp"
+
+using agg::aggregate;
+
+// Tables built by the operators in constant expressions. The static_asserts
+// read them at compile time; main() builds them again at run time and
+// compares.
+
+typedef aggregate<int,3> offset;
+
+//! Offsets of the 27-point stencil, x fastest
+constexpr aggregate<offset,27> make_stencil() {
+  aggregate<offset,27> s{};
+  for (int i = 0; i < 27; ++i)
+    s[i] = offset{i % 3, i / 3 % 3, i / 9} - 1;
+  return s;
+}
+
+constexpr aggregate<offset,27> stencil = make_stencil();
+static_assert(stencil[0] == offset{-1,-1,-1} && stencil[26] == -stencil[0],
+              "stencil corners");
+static_assert(stencil[13] == offset{} && stencil[14] == offset{1,0,0},
+              "stencil center");
+
+//! Sum of all offsets, which cancel
+constexpr offset stencil_sum() {
+  offset s{};
+  for (std::size_t i = 0; i < stencil.size(); ++i)
+    s += stencil[i];
+  return s;
+}
+static_assert(stencil_sum() == offset{}, "stencil is symmetric");
+
+//! The face neighbours, an array initialized with the operators directly
+constexpr offset unit_x{1,0,0}, unit_y{0,1,0}, unit_z{0,0,1};
+constexpr offset faces[6] = {
+  -unit_x, unit_x, unit_y - unit_x + unit_x, -unit_y, unit_z * 1, unit_z * -1
+};
+static_assert(faces[0] == stencil[12] && faces[1] == stencil[14] &&
+              faces[5] == stencil[4] && faces[4] == -faces[5],
+              "faces of the stencil");
+
+
+// Three-point Gauss-Legendre rule on [-1,1], mapped to [0,2]
+constexpr aggregate<double,3> gauss_points
+    = {-0.7745966692414834, 0, 0.7745966692414834};
+constexpr aggregate<double,3> gauss_weights = aggregate<double,3>{5, 8, 5} / 9.;
+constexpr aggregate<double,3> points02 = gauss_points + 1.;
+
+//! The rule applied to x^k on [0,2], exactly 2^(k+1)/(k+1) up to degree 5
+constexpr double integrate(int k) {
+  aggregate<double,3> p = gauss_weights;
+  for (int i = 0; i < k; ++i)
+    p *= points02;
+  return p[0] + p[1] + p[2];
+}
+static_assert(points02[1] == 1 && gauss_weights[0] == gauss_weights[2],
+              "symmetric rule");
+static_assert(integrate(0) == 2, "weights sum to the length");
+static_assert(integrate(5) - 64. / 6 < 1e-12 && 64. / 6 - integrate(5) < 1e-12,
+              "exact to degree 5");
+
+
+// Binomial coefficients, row n+1 = row n + row n shifted by one
+typedef aggregate<long,8> row;
+
+constexpr row shifted(const row& r) {
+  return agg::swizzle<0,0,1,2,3,4,5,6>(r) * row{0,1,1,1,1,1,1,1};
+}
+
+constexpr aggregate<row,8> make_pascal() {
+  aggregate<row,8> p{};
+  p[0] = row{1};
+  for (std::size_t n = 1; n < p.size(); ++n)
+    p[n] = p[n-1] + shifted(p[n-1]);
+  return p;
+}
+
+constexpr aggregate<row,8> pascal = make_pascal();
+static_assert(pascal[7] == row{1,7,21,35,35,21,7,1}, "binomial row");
+static_assert(pascal[3] < pascal[4] && pascal[4] != pascal[3] * 2,
+              "whole-row comparisons");
+
+
+// Past AGG_UNROLL_LIMIT the operators loop
+typedef aggregate<int,64> squares_t;
+
+constexpr squares_t make_squares() {
+  squares_t r{};
+  for (int i = 0; i < 64; ++i)
+    r[i] = i;
+  squares_t s = r * r;
+  ++s;
+  s -= 1;
+  squares_t t{};
+  t.fill(-1);
+  t.swap(s);
+  return -s * t;
+}
+
+constexpr squares_t squares = make_squares();
+static_assert(squares[8] == 64 && squares[63] == 63 * 63, "squares");
+static_assert(squares == (squares < squares ? squares_t{} : squares),
+              "large comparisons");
+
+
+int main() {
+  // The same operators at run time, through the SIMD kernels
+  aggregate<offset,27> s = make_stencil();
+  volatile int one = 1;
+  offset x{one, 0, 0}, y{0, one, 0}, z{0, 0, one};
+  offset f[6] = {-x, x, y - x + x, -y, z * 1, z * -1};
+  bool same_faces = true;
+  for (int i = 0; i < 6; ++i)
+    same_faces = same_faces && f[i] == faces[i];
+  aggregate<double,3> w = aggregate<double,3>{5, 8, 5} / 9.;
+  aggregate<row,8> p = make_pascal();
+  squares_t q = make_squares();
+
+  std::cout << stencil[5] << " | " << points02 << " | " << pascal[5]
+            << " | " << squares[7] << " " << squares.back() << std::endl;
+  std::cout << "run time: " << (s == stencil) << (w == gauss_weights)
+            << (p == pascal) << (q == squares) << same_faces << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_curve.hpp"
+
+using agg::aggregate;
+
+
+//! The Z-order index of a, one bit at a time
+template <typename U, std::size_t N>
+typename agg::curve_index<U,N>::type
+interleave(const aggregate<U,N>& a) {
+  typedef typename agg::curve_index<U,N>::type W;
+  W r = 0;
+  for (std::size_t j = 0; j < agg::curve_bits<U,N>::value; ++j)
+    for (std::size_t i = 0; i < N; ++i)
+      r |= W((a[i] >> j) & 1) << (j * N + i);
+  return r;
+}
+
+//! Whether Morton and Hilbert indices of random points round trip
+template <typename U, std::size_t N>
+bool round_trip(std::mt19937_64& rng) {
+  const std::size_t B = agg::curve_bits<U,N>::value;
+  const U low = U(B < 8 * sizeof(U) ? (std::uint64_t(1) << B) - 1 : ~U(0));
+  bool same = true;
+  for (int k = 0; k < 2000; ++k) {
+    aggregate<U,N> a;
+    for (std::size_t i = 0; i < N; ++i)
+      a[i] = U(rng());
+    auto z = agg::morton_encode(a);
+    same &= z == interleave(a);
+    a &= low;
+    same &= agg::morton_decode<U,N>(z) == a;
+    same &= agg::hilbert_decode<U,N>(agg::hilbert_encode(a)) == a;
+  }
+  return same;
+}
+
+//! Whether successive Hilbert indices from 0 are neighbouring points
+template <typename U, std::size_t N>
+bool adjacent(std::size_t count) {
+  bool next = true;
+  aggregate<U,N> p = agg::hilbert_decode<U,N>(0);
+  for (std::size_t h = 1; h < count; ++h) {
+    aggregate<U,N> q = agg::hilbert_decode<U,N>(
+        typename agg::curve_index<U,N>::type(h));
+    std::size_t steps = 0;
+    for (std::size_t i = 0; i < N; ++i)
+      steps += std::size_t(p[i] > q[i] ? p[i] - q[i] : q[i] - p[i]);
+    next &= steps == 1 && agg::hilbert_encode(q) == h;
+    p = q;
+  }
+  return next;
+}
+
+
+int main() {
+  std::mt19937_64 rng(3);
+
+  // Bit j of element i is bit j*N + i
+  aggregate<std::uint32_t,2> xy = {{3, 5}};
+  std::cout << "morton: " << agg::morton_encode(xy) << " "
+            << agg::morton_decode<std::uint32_t,2>(39) << " "
+            << agg::curve_bits<std::uint32_t,3>::value << " "
+            << agg::curve_bits<std::uint16_t,4>::value << " "
+            << agg::curve_bits<std::uint8_t,3>::value << std::endl;
+
+  std::cout << "round trip: "
+            << round_trip<std::uint32_t,2>(rng)
+            << round_trip<std::uint32_t,3>(rng)
+            << round_trip<std::uint16_t,4>(rng)
+            << round_trip<std::uint8_t,3>(rng)
+            << round_trip<std::uint64_t,1>(rng)
+            << round_trip<std::uint64_t,5>(rng) << std::endl;
+
+  // The whole 256x256 grid, the first 16^3 cells of a cube and 8^4 of a
+  // tesseract
+  std::cout << "hilbert: ";
+  for (std::uint64_t i = 0; i < 4; ++i)
+    std::cout << agg::hilbert_decode<std::uint32_t,2>(i) << ", ";
+  std::cout
+            << adjacent<std::uint8_t,2>(1 << 16)
+            << adjacent<std::uint32_t,3>(1 << 12)
+            << adjacent<std::uint16_t,4>(1 << 12) << std::endl;
+
+  // Ranges, and a shuffled grid put back into curve order
+  std::vector<aggregate<std::uint32_t,2> > grid;
+  for (std::uint32_t y = 0; y < 64; ++y)
+    for (std::uint32_t x = 0; x < 64; ++x)
+      grid.push_back({{x, y}});
+  std::shuffle(grid.begin(), grid.end(), rng);
+  std::vector<std::uint64_t> z(grid.size()), h(grid.size());
+  agg::morton_encode(grid.begin(), grid.end(), z.begin());
+  agg::hilbert_encode(grid.begin(), grid.end(), h.begin());
+  std::vector<aggregate<std::uint32_t,2> > back(grid.size());
+  agg::hilbert_decode<std::uint32_t,2>(h.begin(), h.end(), back.begin());
+  bool ranges = back == grid;
+  agg::morton_decode<std::uint32_t,2>(z.begin(), z.end(), back.begin());
+  ranges &= back == grid;
+
+  std::vector<aggregate<std::uint32_t,2> > zs = grid, hs = grid;
+  agg::morton_sort(zs.begin(), zs.end());
+  agg::hilbert_sort(hs.begin(), hs.end());
+  std::sort(z.begin(), z.end());
+  std::sort(h.begin(), h.end());
+  bool sorted = true;
+  std::size_t steps = 0;
+  for (std::size_t i = 0; i < grid.size(); ++i) {
+    sorted &= agg::morton_encode(zs[i]) == z[i];
+    sorted &= agg::hilbert_encode(hs[i]) == h[i];
+    if (i)
+      steps += agg::sum(agg::select(agg::cmp_lt(hs[i], hs[i-1]),
+                                    hs[i-1] - hs[i], hs[i] - hs[i-1]));
+  }
+  std::cout << "ranges: " << ranges << " " << sorted << " "
+            << steps << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <string>
+
+#define AGG_LAZY_EXPRESSIONS
+#include "aggregate.hpp"
+
+struct my_struct {
+};
+
+std::string operator+(float a, const my_struct&) {
+  return std::string("Hello") + std::to_string(a);
+}
+
+
+using agg::aggregate;
+
+
+int main() {
+  auto x = aggregate<float,3>{1,2,3};
+  auto y = aggregate<float,3>{4,5,6};
+
+  auto e = x * y + 2.f * x - y;
+  std::cout << e << std::endl;
+
+  aggregate<float,3> z = e;
+  std::cout << z << std::endl;
+
+  z += x * y - 1;
+  std::cout << z << std::endl;
+
+  z = -(x + y) * 2;
+  std::cout << z << std::endl;
+
+  aggregate<double,3> zd = x / 2.0;
+  std::cout << zd << std::endl;
+
+  auto zi = aggregate<int,3>{1,2,3};
+  aggregate<int,3> bits = (zi << 2) | (~zi & 1);
+  std::cout << bits << std::endl;
+
+  aggregate<std::string,3> zs = x + my_struct();
+  std::cout << zs << std::endl;
+
+  auto vv = aggregate<aggregate<float,3>,3>{x,x,x};
+  aggregate<aggregate<float,3>,3> xvv = x + vv;
+  std::cout << xvv << std::endl;
+
+  aggregate<aggregate<float,3>,3> vvx = vv * 2 + x;
+  std::cout << vvx << std::endl;
+
+  return 0;
+}
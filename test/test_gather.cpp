@@ -0,0 +1,82 @@
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_gather.hpp"
+
+using agg::aggregate;
+
+
+//! Whether gather and scatter_add of aggregate<T,N> by indices of type I
+//! match the loops they replace
+template <typename T, std::size_t N, typename I>
+bool same(std::mt19937& rng, std::size_t m, std::size_t n) {
+  std::vector<aggregate<T,N> > base(m), out(n), loop(n), values(n);
+  std::vector<I> idx(n);
+  for (auto& a : base)
+    for (auto& x : a)
+      x = T(rng() % 1000);
+  for (auto& a : values)
+    for (auto& x : a)
+      x = T(rng() % 100);
+  for (auto& i : idx)
+    i = I(rng() % m);
+
+  bool same = agg::gather(base.data(), idx.begin(), idx.end(), out.begin())
+              == out.end();
+  for (std::size_t k = 0; k < n; ++k)
+    loop[k] = base[idx[k]];
+  same &= out == loop;
+
+  std::vector<aggregate<T,N> > sum = base;
+  agg::scatter_add(sum.data(), idx.begin(), idx.end(), values.begin());
+  for (std::size_t k = 0; k < n; ++k)
+    base[idx[k]] += values[k];
+  return same && sum == base;
+}
+
+
+int main() {
+  std::mt19937 rng(5);
+
+  // Masked rows, whole registers and scalar moves, with 21 indices so that
+  // the blocks of 8 leave a tail, and few records so that indices repeat
+  std::cout << "rows: "
+            << same<float,3,std::uint32_t>(rng, 10, 21)
+            << same<double,3,std::size_t>(rng, 10, 21)
+            << same<float,5,int>(rng, 1000, 300)
+            << same<float,7,std::uint16_t>(rng, 50, 300)
+            << same<float,4,std::uint32_t>(rng, 50, 300)
+            << same<double,2,std::int64_t>(rng, 50, 300)
+            << same<int,3,std::uint32_t>(rng, 50, 300) << std::endl;
+
+  // Records of one 4-byte element by signed 32-bit indices, and by others
+  std::cout << "words: "
+            << same<float,1,std::uint32_t>(rng, 1000, 301)
+            << same<float,1,std::int32_t>(rng, 7, 64)
+            << same<std::int32_t,1,int>(rng, 100000, 1003)
+            << same<std::int32_t,1,std::uint32_t>(rng, 100000, 1003)
+            << same<std::uint32_t,1,std::size_t>(rng, 100, 99)
+            << same<double,1,std::uint32_t>(rng, 100, 99) << std::endl;
+
+  // Other iterators, and unsigned indices in whole blocks of eight
+  std::deque<aggregate<float,3> > dq = {{{1, 2, 3}}, {{4, 5, 6}}};
+  std::vector<int> di = {1, 0, 1};
+  std::deque<aggregate<float,3> > dout(3);
+  agg::gather(dq.begin(), di.begin(), di.end(), dout.begin());
+  agg::scatter_add(dq.begin(), di.begin(), di.end(), dout.begin());
+
+  std::vector<aggregate<float,1> > w(16);
+  for (std::size_t i = 0; i < w.size(); ++i)
+    w[i] = {{float(i)}};
+  std::vector<std::uint32_t> wi = {15, 0, 7, 8, 1, 14, 2, 3};
+  std::vector<aggregate<float,1> > wout(8);
+  agg::gather(w.data(), wi.begin(), wi.end(), wout.begin());
+  std::cout << "other: " << dout[0] << ", " << dq[0] << ", " << dq[1]
+            << ", " << wout[7] << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_hash.hpp"
+
+using agg::aggregate;
+
+
+//! No std::hash, and not a block of bytes
+struct unhashable { int* p; };
+
+
+//! Bits that differ between hashes, on average over flips of each input bit
+template <typename T, std::size_t N>
+double avalanche(aggregate<T,N> a) {
+  std::hash<aggregate<T,N> > h;
+  const std::size_t h0 = h(a);
+  std::size_t total = 0, flips = 0;
+  for (std::size_t i = 0; i < N; ++i) {
+    for (std::size_t b = 0; b < 8 * sizeof(T); ++b, ++flips) {
+      aggregate<T,N> c = a;
+      c[i] = T(c[i] ^ (T(1) << b));
+      total += __builtin_popcountll(std::uint64_t(h(c) ^ h0));
+    }
+  }
+  return double(total) / flips;
+}
+
+
+int main() {
+  // Grid cells as keys: no two of 64^3 neighbours share a hash
+  typedef aggregate<int,3> cell;
+  std::unordered_map<cell, int> grid;
+  std::unordered_set<std::size_t> hashes;
+  std::vector<cell> cells;
+  for (int x = -32; x < 32; ++x)
+    for (int y = -32; y < 32; ++y)
+      for (int z = -32; z < 32; ++z)
+        cells.push_back(cell{{x, y, z}});
+  std::vector<std::size_t> h(cells.size());
+  agg::hash_many(cells.begin(), cells.end(), h.begin());
+  bool same = true;
+  for (std::size_t i = 0; i < cells.size(); ++i) {
+    grid[cells[i]] = int(i);
+    hashes.insert(h[i]);
+    same &= h[i] == std::hash<cell>()(cells[i]);
+  }
+  std::cout << "grid: " << grid.size() << " " << hashes.size() << " "
+            << same << " " << grid[cell{{3, -4, 5}}] << std::endl;
+
+  // Every input bit flips about half of the hash bits
+  std::cout << "avalanche: "
+            << (avalanche(cell{{1, 2, 3}}) > 28) << " "
+            << (avalanche(aggregate<std::uint8_t,5>{{9, 8, 7, 6, 5}}) > 28)
+            << " " << (avalanche(aggregate<std::int64_t,7>{}) > 28)
+            << std::endl;
+
+  // Equal floats hash equal, -0 included
+  std::hash<aggregate<float,3> > hf;
+  std::cout << "float: "
+            << (hf(aggregate<float,3>{{0.f, 1.f, 2.f}}) ==
+                hf(aggregate<float,3>{{-0.f, 1.f, 2.f}})) << " "
+            << (hf(aggregate<float,3>{{0.f, 1.f, 2.f}}) !=
+                hf(aggregate<float,3>{{0.f, 2.f, 1.f}})) << std::endl;
+
+  // Only the elements are hashed, not any padding lanes
+  aggregate<double,3> d = {{1, 2, 3}};
+  std::unordered_set<aggregate<double,3> > ds = {d, d + 1., d};
+  std::cout << "double: " << ds.size() << " " << ds.count(d) << std::endl;
+
+  // Other elements combine their own hashes; nested aggregates of bytes
+  // are one block
+  std::unordered_set<aggregate<std::string,2> > ss = {
+    {{"a", "bc"}}, {{"ab", "c"}}, {{"a", "bc"}}};
+  std::unordered_set<aggregate<aggregate<short,2>,2> > ns = {
+    {{ {{1, 2}}, {{3, 4}} }}, {{ {{1, 2}}, {{4, 3}} }}};
+  std::cout << "combined: " << ss.size() << " " << ns.size() << " "
+            << agg::hash_as_bytes<aggregate<short,2> >::value << " "
+            << agg::hash_as_bytes<aggregate<float,2> >::value << std::endl;
+
+  // Aggregates are only hashable when their elements are
+  std::cout << "disabled: "
+            << std::is_default_constructible<
+                   std::hash<aggregate<std::string,2> > >::value << " "
+            << std::is_default_constructible<
+                   std::hash<aggregate<unhashable,2> > >::value << " "
+            << std::is_default_constructible<
+                   std::hash<aggregate<aggregate<unhashable,2>,2> > >::value
+            << std::endl;
+
+  return 0;
+}
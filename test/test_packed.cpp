@@ -0,0 +1,128 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_packed.hpp"
+
+using agg::aggregate;
+
+
+//! Write v packed, read it back whole, and report the compressed size
+template <typename T, std::size_t N>
+void round_trip(const char* name, const std::vector<aggregate<T,N> >& v) {
+  std::stringstream ss;
+  agg::packed_writer<T,N> w(ss);
+  w.write(v.data(), v.size() / 3);
+  for (std::size_t i = v.size() / 3; i < v.size() / 2; ++i)
+    w.write(v[i]);
+  w.write(v.begin() + v.size() / 2, v.end());
+  w.close();
+
+  agg::packed_reader<T,N> r(ss);
+  std::vector<aggregate<T,N> > back(v.size() + 10);
+  std::size_t got = r.read(back.data(), 7);
+  got += r.read(back.data() + got, back.size() - got);
+  back.resize(got);
+  std::size_t raw = v.size() * N * sizeof(T), packed = ss.str().size();
+  std::cout << name << ": " << (back == v) << " " << r.size() << " ";
+  if (raw)
+    std::cout << (packed * 100 + raw / 2) / raw << "%" << std::endl;
+  else
+    std::cout << packed << " bytes" << std::endl;
+}
+
+
+int main() {
+  std::mt19937 rng(5);
+  std::normal_distribution<double> noise(0, 1);
+
+  // A smooth integer trajectory, a noisy float sensor, extremes
+  const std::size_t n = 10000 + 37;
+  std::vector<aggregate<std::int32_t,3> > track(n);
+  std::vector<aggregate<float,4> > sensor(n);
+  std::vector<aggregate<double,2> > orbit(n);
+  std::vector<aggregate<std::int16_t,3> > audio(n);
+  aggregate<std::int32_t,3> p = {{1000000, -5000, 0}};
+  for (std::size_t i = 0; i < n; ++i) {
+    p += aggregate<std::int32_t,3>{{std::int32_t(noise(rng) * 20),
+                                    std::int32_t(noise(rng) * 20), 3}};
+    track[i] = p;
+    sensor[i] = {{20.f + float(noise(rng)) * 0.01f, 1013.25f, float(i),
+                  float(i % 7 == 0)}};
+    orbit[i] = {{std::cos(i * 1e-3), std::sin(i * 1e-3)}};
+    audio[i] = {{std::int16_t(i % 2 ? 32767 : -32768), std::int16_t(i),
+                 std::int16_t(10000 * std::sin(i * 0.01))}};
+  }
+  round_trip("track", track);
+  round_trip("sensor", sensor);
+  round_trip("orbit", orbit);
+  round_trip("audio", audio);
+
+  std::vector<aggregate<std::uint64_t,2> > big(300);
+  std::vector<aggregate<bool,3> > flags(300);
+  for (std::size_t i = 0; i < big.size(); ++i) {
+    big[i] = {{~std::uint64_t(0) - i, std::uint64_t(rng()) << 32 | rng()}};
+    flags[i] = {{i % 2 == 0, true, i % 5 == 0}};
+  }
+  round_trip("big", big);
+  round_trip("flags", flags);
+  round_trip("empty", std::vector<aggregate<float,3> >());
+
+  // Random access through the index
+  std::stringstream ss;
+  {
+    agg::packed_writer<std::int32_t,3> w(ss);
+    w.write(track.data(), track.size());
+  }
+  agg::packed_reader<std::int32_t,3> r(ss);
+  aggregate<std::int32_t,3> a;
+  bool seeks = true;
+  for (std::size_t i : {std::size_t(5000), std::size_t(0), n - 1,
+                        std::size_t(256), std::size_t(255)}) {
+    r.seek(i);
+    seeks &= r.read(a) && a == track[i];
+  }
+  r.seek(n);
+  seeks &= !r.read(a);
+  r.seek(9999);
+  std::vector<aggregate<std::int32_t,3> > tail(100);
+  seeks &= r.read(tail.data(), tail.size()) == n - 9999;
+  seeks &= tail[37] == track[9999 + 37];
+  std::cout << "seek: " << seeks << std::endl;
+
+  // Packed files do not depend on the padding of the aggregates that were
+  // written, only on their elements
+  std::string padded = ss.str();
+  agg::binary_header h = agg::binary_header::parse(padded.data());
+  h.stride = 16;
+  h.alignment = 16;
+  std::memcpy(&padded[0], &h, sizeof(h));
+  std::stringstream ps(padded);
+  agg::packed_reader<std::int32_t,3> pr(ps);
+  pr.seek(9999);
+  std::cout << "padded: " << (pr.read(a) && a == track[9999]) << std::endl;
+
+  // Raw readers refuse packed files, and corrupt blocks are detected
+  std::stringstream raw(ss.str());
+  try {
+    agg::binary_reader<std::int32_t,3> bad(raw);
+  } catch (const agg::binary_error& e) {
+    std::cout << e.what() << std::endl;
+  }
+  std::string corrupt = ss.str();
+  corrupt[sizeof(agg::binary_header) + 8 + 4] = char(200);
+  std::stringstream cs(corrupt);
+  try {
+    agg::packed_reader<std::int32_t,3> bad(cs);
+    bad.read(a);
+  } catch (const agg::binary_error& e) {
+    std::cout << e.what() << std::endl;
+  }
+
+  return 0;
+}
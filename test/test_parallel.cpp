@@ -0,0 +1,64 @@
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_parallel.hpp"
+
+using agg::aggregate;
+
+
+int main() {
+  const std::size_t n = 10 * AGG_PARALLEL_GRAIN + 7;
+
+  std::vector<aggregate<float,3> > a(n), b(n), c(n);
+  std::vector<aggregate<long,2> > k(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    a[i] = {0.5f*i, 1.f/(i+1), float(i%7)};
+    b[i] = {1.f, 2.f, -0.25f*i};
+    k[i] = {long(i), long(i*i % 1000)};
+  }
+
+  agg::thread_pool pool(3);
+  std::cout << "workers: " << pool.size() << std::endl;
+
+  // c = a + b, then a *= b in place
+  agg::parallel_transform(pool, a.begin(), a.end(), b.begin(), c.begin(),
+                          agg::fn::plus());
+  agg::parallel_transform(pool, a.begin(), a.end(), b.begin(), a.begin(),
+                          agg::fn::multiplies_assign());
+
+  bool same = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    aggregate<float,3> ai = {0.5f*i, 1.f/(i+1), float(i%7)};
+    same &= (c[i] == ai + b[i]);
+    same &= (a[i] == ai * b[i]);
+  }
+  std::cout << "transform: " << same << std::endl;
+
+  // Integer sums are exact; floating sums repeat bit for bit across pools
+  auto ks = agg::parallel_reduce(pool, k.begin(), k.end(),
+                                 aggregate<long,2>{}, agg::fn::plus());
+  std::cout << ks << std::endl;
+
+  agg::thread_pool serial(0);
+  auto s3 = agg::parallel_reduce(pool, c.begin(), c.end(),
+                                 aggregate<float,3>{}, agg::fn::plus_assign());
+  auto s0 = agg::parallel_reduce(serial, c.begin(), c.end(),
+                                 aggregate<float,3>{}, agg::fn::plus());
+  std::cout << "deterministic: " << (s3 == s0) << std::endl;
+
+  // Kernel exceptions reach the caller
+  try {
+    agg::parallel_transform(pool, k.begin(), k.end(), k.begin(),
+                            [](const aggregate<long,2>& x) {
+                              if (x[0] == 5000)
+                                throw std::runtime_error("kernel");
+                              return x;
+                            });
+  } catch (const std::exception& e) {
+    std::cout << "caught: " << e.what() << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+
+#include "aggregate.hpp"
+
+using agg::aggregate;
+
+
+// Count every allocation made through operator new
+static std::size_t allocations = 0;
+
+void* operator new(std::size_t n) {
+  ++allocations;
+  if (void* p = std::malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+//! Allocations made by f()
+template <typename F>
+std::size_t allocated(F f) {
+  std::size_t before = allocations;
+  f();
+  return allocations - before;
+}
+
+
+typedef aggregate<std::string,4> strings;
+
+//! Strings past the small-string buffer, with room to grow in place
+strings make(const char* s) {
+  strings r;
+  for (std::size_t i = 0; i < r.size(); ++i) {
+    r[i].reserve(256);
+    r[i] += s;
+    r[i] += "-long-enough-to-allocate-";
+    r[i] += char('0' + i);
+  }
+  return r;
+}
+
+
+int main() {
+  const strings a = make("a"), b = make("b");
+  strings r;
+
+  // Both operands kept: every result string is a new allocation
+  std::size_t copied = allocated([&] { r = a + b; });
+  std::cout << "copied: " << copied << std::endl;
+  std::cout << r << std::endl;
+
+  // Expiring operands hold the result
+  strings x = make("x"), y = make("y"), z = make("z"), w = make("w");
+  std::cout << "reused: "
+            << allocated([&] { r = std::move(x) + b; }) << " "
+            << allocated([&] { r = a + std::move(r); }) << " "
+            << allocated([&] { r = std::move(y) + std::move(z); }) << " "
+            << allocated([&] { r = std::move(r) + "!"; }) << " "
+            << allocated([&] { r = "<" + std::move(r); }) << std::endl;
+  std::cout << r << std::endl;
+
+  // Expiring nested aggregates are reused element by element
+  aggregate<strings,2> n = {{make("n"), make("m")}}, m = {{b, a}};
+  std::cout << "nested: "
+            << allocated([&] { n = std::move(n) + m; }) << " "
+            << allocated([&] { n = std::move(n) + w; }) << std::endl;
+  std::cout << n << std::endl;
+
+  // Five sums, but only the first builds a new result; the others grow it
+  std::size_t chain = allocated([&] { r = a + b + a + b + a + b; });
+  std::cout << "chain: " << (chain < 5 * copied) << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include <iostream>
+
+#include "aggregate.hpp"
+#include "agg_soa.hpp"
+
+using agg::aggregate;
+using agg::soa_vector;
+
+
+int main() {
+  const std::size_t n = 37;
+
+  soa_vector<float,3> pos(n), vel(n);
+  std::vector<aggregate<float,3> > apos(n), avel(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    apos[i] = {float(i), 2.f*i, 1.f};
+    avel[i] = {1.f, -0.5f*i, float(i%4)};
+    pos[i] = apos[i];
+    vel[i] = avel[i];
+  }
+
+  // Element proxies
+  std::cout << pos[3] << std::endl;
+
+  aggregate<float,3> p = pos[3] + vel[3] * 2.f;
+  std::cout << p << std::endl;
+
+  pos[0] = vel[5];
+  pos[0] += aggregate<float,3>{1,1,1};
+  std::get<2>(pos[0]) = 7;
+  std::cout << pos[0] << " " << (pos[0] == pos[0]) << std::endl;
+  pos[0] = apos[0];
+
+  // Container expressions against the array-of-structures result
+  const float dt = 0.25f;
+  pos += vel * dt;
+  pos -= aggregate<float,3>{0, 1, 0};
+  for (std::size_t i = 0; i < n; ++i)
+    apos[i] += avel[i] * dt - aggregate<float,3>{0, 1, 0};
+
+  soa_vector<float,3> mid = (pos + -vel) / 2.f;
+
+  bool same = true;
+  for (std::size_t i = 0; i < n; ++i) {
+    same &= (pos[i] == apos[i]);
+    same &= (mid[i] == (apos[i] - avel[i]) / 2.f);
+  }
+  std::cout << "soa == aos: " << same << std::endl;
+  std::cout << pos.back() << std::endl;
+
+  soa_vector<int,2> iv(5, {3, 12});
+  iv <<= 1;
+  iv[4] = iv[4] ^ aggregate<int,2>{1, 1};
+  for (std::size_t i = 0; i < iv.size(); ++i)
+    std::cout << iv[i] << ", ";
+  std::cout << std::endl;
+
+  return 0;
+}
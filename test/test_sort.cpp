@@ -0,0 +1,112 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+// Small enough that the test splits into buckets and sorts in parallel
+#define AGG_SORT_LSD_MAX 1000
+#define AGG_SORT_PARALLEL_MIN 20000
+
+#include "aggregate.hpp"
+#include "agg_sort.hpp"
+
+using agg::aggregate;
+
+
+//! Whether agg::stable_sort of v matches std::stable_sort bit for bit, on
+//! the calling thread and on pool
+template <typename T, std::size_t N>
+bool same_order(std::vector<aggregate<T,N> > v, agg::thread_pool& pool) {
+  std::vector<aggregate<T,N> > s = v, a = v, b = v;
+  std::stable_sort(s.begin(), s.end());
+  agg::stable_sort(a.begin(), a.end());
+  agg::stable_sort(pool, b.begin(), b.end());
+  bool same = true;
+  for (std::size_t i = 0; i < v.size(); ++i) {
+    same &= std::memcmp(a[i].data(), s[i].data(), N * sizeof(T)) == 0;
+    same &= std::memcmp(b[i].data(), s[i].data(), N * sizeof(T)) == 0;
+  }
+  return same;
+}
+
+
+int main() {
+  std::mt19937 rng(7);
+  agg::thread_pool pool(3);
+
+  // Grid cells with small coordinates, many of them equal, through every
+  // path: comparison sort, serial radix and parallel radix
+  bool cells = true;
+  for (std::size_t n : {std::size_t(100), std::size_t(5000),
+                        std::size_t(50000)}) {
+    std::vector<aggregate<std::uint32_t,3> > v(n);
+    for (auto& c : v)
+      c = {{std::uint32_t(rng() % 40), std::uint32_t(rng() % 1000),
+            std::uint32_t(rng() % 3)}};
+    std::vector<aggregate<std::uint32_t,3> > s = v;
+    std::sort(s.begin(), s.end());
+    std::vector<aggregate<std::uint32_t,3> > a = v, b = v;
+    agg::sort(a.begin(), a.end());
+    agg::sort(pool, b.begin(), b.end());
+    cells &= a == s && b == s;
+  }
+  std::cout << "cells: " << cells << std::endl;
+
+  // Signed integers of every width
+  std::vector<aggregate<std::int8_t,4> > i8(30000);
+  std::vector<aggregate<std::int16_t,2> > i16(30000);
+  std::vector<aggregate<std::int64_t,2> > i64(30000);
+  std::vector<aggregate<char,3> > ch(3000);
+  for (std::size_t i = 0; i < i8.size(); ++i) {
+    i8[i] = {{std::int8_t(rng()), std::int8_t(rng() % 3 - 1),
+              std::int8_t(rng()), std::int8_t(rng())}};
+    i16[i] = {{std::int16_t(rng()), std::int16_t(rng() % 5)}};
+    i64[i] = {{std::int64_t(rng() % 7) - 3,
+               std::int64_t(std::uint64_t(rng()) << 32 | rng())}};
+  }
+  for (auto& c : ch)
+    c = {{char(rng() % 256), 'a', char(rng() % 256)}};
+  i64[0] = {{std::numeric_limits<std::int64_t>::min(), 0}};
+  i64[1] = {{std::numeric_limits<std::int64_t>::max(), 0}};
+  std::cout << "signed: " << same_order(i8, pool) << " "
+            << same_order(i16, pool) << " " << same_order(i64, pool) << " "
+            << same_order(ch, pool) << std::endl;
+
+  // Floats of both signs and zeros of both signs, which keep their order
+  std::normal_distribution<float> fnoise(0, 100);
+  std::vector<aggregate<float,3> > f(40000);
+  std::vector<aggregate<double,2> > d(3000);
+  for (std::size_t i = 0; i < f.size(); ++i)
+    f[i] = {{float(int(fnoise(rng)) / 8), i % 2 ? 0.f : -0.f, fnoise(rng)}};
+  for (std::size_t i = 0; i < d.size(); ++i)
+    d[i] = {{i % 3 ? -1. : 1.,
+             std::ldexp(i % 2 ? double(rng()) : -double(rng()),
+                        int(rng() % 600) - 300)}};
+  const float inf = std::numeric_limits<float>::infinity();
+  f[0] = {{inf, -inf, 0.f}};
+  f[1] = {{-inf, inf, std::numeric_limits<float>::denorm_min()}};
+  f[2] = {{-std::numeric_limits<float>::denorm_min(), 0.f, -0.f}};
+  std::cout << "float: " << same_order(f, pool) << " "
+            << same_order(d, pool) << std::endl;
+
+  // Other aggregates are sorted by comparison
+  std::vector<aggregate<std::string,2> > strs = {
+    {{"b", "a"}}, {{"a", "c"}}, {{"a", "b"}}};
+  agg::sort(strs.begin(), strs.end());
+  std::vector<aggregate<int,12> > wide(1000);
+  for (auto& w : wide)
+    for (int& x : w)
+      x = int(rng() % 3);
+  std::cout << "other: " << strs[0][0] << strs[0][1] << strs[2][0]
+            << strs[2][1] << " " << same_order(wide, pool) << " "
+            << agg::detail::sort_radix<aggregate<int,8> >::value
+            << agg::detail::sort_radix<aggregate<int,12> >::value
+            << agg::detail::sort_radix<aggregate<std::string,2> >::value
+            << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,154 @@
+#include <clocale>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "aggregate.hpp"
+#include "agg_text.hpp"
+
+using agg::aggregate;
+
+
+//! Whether every element of a and b has the same bits, NaNs included
+template <typename T, std::size_t N>
+bool same(const std::vector<aggregate<T,N> >& a,
+          const std::vector<aggregate<T,N> >& b) {
+  if (a.size() != b.size())
+    return false;
+  for (std::size_t i = 0; i < a.size(); ++i)
+    for (std::size_t j = 0; j < N; ++j)
+      if (std::memcmp(&a[i][j], &b[i][j], sizeof(T)))
+        return false;
+  return true;
+}
+
+//! Format v and parse it back
+template <typename T, std::size_t N>
+bool round_trip(const std::vector<aggregate<T,N> >& v,
+                const agg::text_format& f = agg::text_format()) {
+  std::string s = agg::format(v.data(), v.size(), f);
+  std::vector<aggregate<T,N> > back(v.size() + 1);
+  agg::parse_result r =
+      agg::parse(s.data(), s.data() + s.size(), back.data(), back.size(), f);
+  back.resize(r.count);
+  return r.ec == std::errc() && r.ptr == s.data() + s.size() && same(v, back);
+}
+
+
+int main() {
+  std::mt19937_64 rng(42);
+
+  // Random bit patterns, subnormals and extremes round trip exactly
+  std::vector<aggregate<double,3> > d(2000);
+  std::vector<aggregate<float,4> > f(2000);
+  for (std::size_t i = 0; i < d.size(); ++i) {
+    for (std::size_t j = 0; j < 3; ++j) {
+      std::uint64_t bits = rng();
+      std::memcpy(&d[i][j], &bits, sizeof(double));
+      if (d[i][j] != d[i][j])
+        d[i][j] = double(i) / 7;
+    }
+    for (std::size_t j = 0; j < 4; ++j) {
+      std::uint32_t bits = std::uint32_t(rng());
+      std::memcpy(&f[i][j], &bits, sizeof(float));
+      if (f[i][j] != f[i][j])
+        f[i][j] = float(j) - float(i) / 3;
+    }
+  }
+  d[0] = {0.1, -0., std::numeric_limits<double>::denorm_min()};
+  d[1] = {std::numeric_limits<double>::max(),
+          -std::numeric_limits<double>::infinity(), 1e23};
+  f[0] = {0.1f, 1e-45f, std::numeric_limits<float>::max(), 16777217.f};
+  std::cout << "double: " << round_trip(d) << " "
+            << round_trip(d, agg::csv_format) << std::endl;
+  std::cout << "float: " << round_trip(f) << " "
+            << round_trip(f, agg::text_format(';', '|')) << std::endl;
+
+  std::vector<aggregate<std::int64_t,2> > l = {
+    {{std::numeric_limits<std::int64_t>::min(),
+      std::numeric_limits<std::int64_t>::max()}},
+    {{0, -1}}, {{42, 1000000007}}};
+  std::vector<aggregate<unsigned char,3> > u = {{{0, 9, 255}}, {{10, 99, 100}}};
+  std::vector<aggregate<bool,2> > b = {{{true, false}}};
+  std::cout << "integer: " << round_trip(l) << round_trip(u)
+            << round_trip(b) << " "
+            << agg::format(l.data(), 1, agg::csv_format);
+
+  // Blanks, blank lines, CRLF and a last record without a terminator
+  const char text[] = "  1.5, -2 ,3e2\r\n\n4,5.25,  -.5\n7,8,9";
+  std::vector<aggregate<float,3> > p(8);
+  agg::parse_result r = agg::parse(text, text + sizeof(text) - 1, p.data(),
+                                   p.size(), agg::csv_format);
+  std::cout << "parsed: " << r.count << " " << (r.ec == std::errc()) << " | "
+            << p[0] << " | " << p[1] << " | " << p[2] << std::endl;
+
+  // Malformed and out-of-range records stop the parse before them
+  const char* bad[] = {"1,2,3\n4,5\n", "1,2,3\n4,x,6\n", "1 2 3\n",
+                       "1,2,3,4\n", "1,2,3\n1e99,0,0\n"};
+  for (const char* s : bad) {
+    r = agg::parse(s, s + std::strlen(s), p.data(), p.size(), agg::csv_format);
+    std::cout << r.count << ":" << (r.ptr - s) << ":"
+              << (r.ec == std::errc::invalid_argument ? "invalid" :
+                  r.ec == std::errc::result_out_of_range ? "range" : "ok")
+              << " ";
+  }
+  std::vector<aggregate<std::int8_t,2> > i8(1);
+  const char over[] = "127 -129";
+  r = agg::parse(over, over + sizeof(over) - 1, i8.data(), 1);
+  std::cout << (r.ec == std::errc::result_out_of_range) << std::endl;
+
+  // A full buffer keeps the aggregates that fit whole
+  char small[48];
+  agg::format_result w = agg::format(small, small + sizeof(small),
+                                     l.data(), l.size());
+  std::cout << "partial: " << w.count << " " << (w.ptr - small) << std::endl;
+
+  // The decimal point is '.' in any locale
+  bool localized = std::setlocale(LC_NUMERIC, "de_DE.UTF-8") ||
+                   std::setlocale(LC_NUMERIC, "fr_FR.UTF-8");
+  std::string s = agg::format(d.data(), 2);
+  std::cout << "locale: " << (s.find(',') == std::string::npos) << " "
+            << round_trip(d) << round_trip(f) << std::endl;
+  if (localized)
+    std::setlocale(LC_NUMERIC, "C");
+
+  // Streams read what they write
+  std::stringstream ss;
+  ss << d[0] << "\n" << f[1] << " " << l[0] << "\n";
+  aggregate<double,3> d0;
+  aggregate<float,4> f1;
+  aggregate<std::int64_t,2> l0;
+  ss >> d0 >> f1 >> l0;
+  std::cout << "stream: " << bool(ss) << " " << (d0 == d[0]) << " "
+            << (l0 == l[0]) << " " << f1 << std::endl;
+  std::istringstream bs("1 2 oops");
+  aggregate<int,3> i3 = {{9, 9, 9}};
+  bs >> i3;
+  std::cout << "bad stream: " << bs.fail() << " " << i3 << std::endl;
+
+  // Nested aggregates and wide streams take the elements' own operators
+  std::wistringstream ws(L"1 2 3 4");
+  aggregate<aggregate<short,2>,2> n;
+  ws >> n;
+  std::wostringstream wo;
+  wo << n;
+  std::wstring wide = wo.str();
+  std::cout << "nested: " << std::string(wide.begin(), wide.end()) << std::endl;
+
+  // File streams are not broadcast as scalars
+  {
+    std::ofstream out("test_text.tmp");
+    out << f[1] << '\n';
+  }
+  std::ifstream in("test_text.tmp");
+  in >> f1;
+  std::cout << "file: " << bool(in) << " " << f1 << std::endl;
+  std::remove("test_text.tmp");
+
+  return 0;
+}